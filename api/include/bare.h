@@ -9,6 +9,8 @@
 #define BARE_H
 
 #include<stdbool.h>
+#include<stdint.h>
+#include<stddef.h>
 /**
  * Single Precision Complex Floating Point Data Structure
  */
@@ -25,18 +27,297 @@ typedef struct {
   double y; /**< imaginary value */
 } double2;
 
+/**
+ * Half Precision Complex Floating Point Data Structure, IEEE 754 binary16 bits
+ */
+typedef struct {
+  uint16_t x; /**< real value */
+  uint16_t y; /**< imaginary value */
+} half2;
+
+/**
+ * Element types of the typed transfers
+ */
+typedef enum fpga_type {
+  FPGA_FLOAT,     /**< float */
+  FPGA_FLOAT2,    /**< float2 */
+  FPGA_DOUBLE,    /**< double */
+  FPGA_DOUBLE2,   /**< double2 */
+  FPGA_HALF2      /**< half2 */
+} fpga_type_t;
+
+#define FPGA_NUM_TYPES 5
+
 /**
  * Record time in milliseconds of different FPGA runtime stages
  */
 typedef struct fpga_timing {
   double pcie_read_t;   /**< Time to read from DDR to host using PCIe bus */ 
   double pcie_write_t; /**< Time to write from DDR to host using PCIe bus */ 
-  double exec_t;      /**< Kernel execution time */
+  double exec_t;      /**< Kernel execution time, for pipelines the wall clock
+                           time until the last command completed */
+  double conv_t;      /**< Host side data conversion time */
+  double submit_t;    /**< Time the calling thread spent submitting commands */
+  double device_t;    /**< Device time from START of the first command to END
+                           of the last, from profiling */
   int valid;          /**< Represents 1 signifying valid execution */
 } fpga_t;
 
+/**
+ * Lifecycle counters of the OpenCL events used by the transfer pipelines.
+ * Events are single use objects of the runtime, pipelines keep them in a 
+ * fixed ring of slots so that the number alive is bounded for any batch.
+ */
+typedef struct fpga_event_stats {
+  size_t created;   /**< events created by enqueued commands */
+  size_t released;  /**< events released after their consumer waited */
+  size_t peak_live; /**< largest number of events alive at the same time */
+} fpga_event_stats_t;
+
+/**
+ * Parameters of the pipelined PCIe transfers, tuned per board and BSP
+ */
+typedef struct fpga_transfer_config {
+  unsigned chunk;   /**< points per transfer, 0 transfers N points at a time */
+  unsigned depth;   /**< number of device buffers in flight */
+  unsigned banks;   /**< DDR banks the buffers are spread over, 0 interleaved */
+  unsigned queues;  /**< 1 single queue, 2 separate write and read queues */
+  bool use_svm;     /**< coarse grained SVM buffers instead of device buffers */
+  bool use_model;   /**< chunk and depth planned per payload from the fitted
+                         model of the board, see fpga_calibrate */
+} fpga_config_t;
+
+/**
+ * Transfer time of a direction fitted as latency + bytes / bandwidth
+ */
+typedef struct fpga_link {
+  double latency;   /**< fixed cost of a transfer in microseconds */
+  double bandwidth; /**< GB/s of the streaming part of a transfer */
+  double r2;        /**< coefficient of determination of the fit */
+} fpga_link_t;
+
+/**
+ * PCIe model of a board fitted by fpga_calibrate, stored in its profile
+ */
+typedef struct fpga_model {
+  fpga_link_t write;        /**< host to device, one direction at a time */
+  fpga_link_t read;         /**< device to host, one direction at a time */
+  fpga_link_t duplex_write; /**< host to device while reading */
+  fpga_link_t duplex_read;  /**< device to host while writing */
+  bool valid;               /**< write and read have been fitted */
+} fpga_model_t;
+
+/**
+ * Per direction bandwidth of a full duplex test over time. The caller sets
+ * the interval and provides the arrays of max_intervals entries.
+ */
+typedef struct fpga_duplex {
+  double interval;          /**< length of an interval in milliseconds */
+  unsigned max_intervals;   /**< number of entries of wr_gbps and rd_gbps */
+  double *wr_gbps;          /**< host to device GB/s in each interval */
+  double *rd_gbps;          /**< device to host GB/s in each interval */
+  unsigned intervals;       /**< number of intervals measured */
+  double wr_total_gbps;     /**< host to device GB/s over the whole test */
+  double rd_total_gbps;     /**< device to host GB/s over the whole test */
+} fpga_duplex_t;
+
+/**
+ * How the files of a file stream are read and written
+ */
+typedef enum fpga_file_io {
+  FPGA_FILE_MMAP,     /**< both files mapped */
+  FPGA_FILE_BLOCKING, /**< pread and pwrite of staging buffers */
+  FPGA_FILE_URING,    /**< reads and writes in flight with io_uring on 
+                           registered staging buffers */
+  FPGA_FILE_THREADS   /**< reads and writes in flight on a pread and pwrite
+                           thread pool, fallback of FPGA_FILE_URING */
+} fpga_file_io_t;
+
+/**
+ * File to file stream through the device. The caller sets chunk, io and
+ * direct, the remaining fields are set by the test.
+ */
+typedef struct fpga_file_stream {
+  size_t chunk;       /**< bytes per transfer, a multiple of 4096, reduced to
+                           the largest device buffer */
+  fpga_file_io_t io;  /**< how the files are accessed, set to the fallback
+                           used if io_uring is not available */
+  bool direct;        /**< O_DIRECT for the staging buffer modes */
+  size_t bytes;       /**< bytes streamed, the size of the input file */
+  double read_t;      /**< time reading the input in milliseconds, the host
+                           time or the time reads were in flight */
+  double write_t;     /**< time writing the output in milliseconds, the host
+                           time or the time writes were in flight */
+} fpga_file_t;
+
+// alignments of host buffers, powers of two from 64 B to a 2 MiB huge page
+#define FPGA_ALIGN_MIN 64
+#define FPGA_ALIGN_MAX (2 * 1024 * 1024)
+
+// bytes the start of a host buffer is placed past an aligned address at most
+#define FPGA_OFFSET_MAX 4096
+
+// banks a device memory pool spans at most
+#define FPGA_POOL_MAX_BANKS 4
+
+/**
+ * Usage of the buffer a device memory pool reserved in a DDR bank
+ */
+typedef struct fpga_pool_stats {
+  size_t size;      /**< bytes reserved in the bank */
+  size_t used;      /**< bytes of the regions handed out, whole blocks */
+  size_t peak;      /**< largest number of bytes used */
+  size_t largest;   /**< bytes of the largest free region */
+  size_t allocs;    /**< regions handed out */
+  size_t frees;     /**< regions returned */
+  size_t failed;    /**< requests without a free region large enough, 
+                         served by a buffer of their own */
+} fpga_pool_stats_t;
+
+// stages of a flow at most
+#define FPGA_FLOW_MAX_STAGES 8
+
+/**
+ * Stages of a flow, chunks move from a source through the stages in the
+ * order they were added
+ */
+typedef enum fpga_stage {
+  FPGA_STAGE_GENERATE,    /**< source of chunks with a known pattern */
+  FPGA_STAGE_FILE_READ,   /**< source of chunks of a float2 file */
+  FPGA_STAGE_H2D,         /**< write chunks to their device buffer */
+  FPGA_STAGE_KERNEL,      /**< run a kernel(src, dst, N) from the binary */
+  FPGA_STAGE_D2H,         /**< read chunks back from the device */
+  FPGA_STAGE_VERIFY,      /**< compare chunks with the input of the source */
+  FPGA_STAGE_FILE_WRITE   /**< write chunks to a file */
+} fpga_stage_t;
+
+/**
+ * Dataflow of chunks through stages connected by bounded queues, each stage
+ * runs on its own thread
+ */
+typedef struct fpga_flow fpga_flow_t;
+
+/**
+ * Counters of a stage of the last run of a flow
+ */
+typedef struct fpga_stage_stats {
+  const char *name;     /**< name of the stage */
+  size_t items;         /**< chunks processed */
+  size_t bytes;         /**< bytes processed */
+  double busy_t;        /**< time processing chunks in milliseconds */
+  double wait_in_t;     /**< time waiting for a chunk from the input queue */
+  double wait_out_t;    /**< time waiting for space in the output queue */
+  double occupancy;     /**< mean number of chunks in the input queue */
+  size_t peak;          /**< largest number of chunks in the input queue */
+} fpga_stage_stats_t;
+
+/**
+ * How the cache of the persistent buffers decides that host data is resident
+ * on the device already, see fpga_cache_set_mode
+ */
+typedef enum fpga_cache_mode {
+  FPGA_CACHE_OFF,       /**< every upload is done */
+  FPGA_CACHE_HASH,      /**< same host address, size and content hash */
+  FPGA_CACHE_VERSION,   /**< same host address, size and version tag */
+  FPGA_CACHE_DIRTY      /**< pages written since the last upload of the same
+                             host buffer, tracked by write protection */
+} fpga_cache_mode_t;
+
+/**
+ * Counters of the cache of the persistent buffers since its mode was set
+ */
+typedef struct fpga_cache_stats {
+  size_t hits;            /**< buffer uploads skipped */
+  size_t misses;          /**< buffer uploads done */
+  size_t bytes_saved;     /**< bytes not uploaded */
+  size_t bytes_uploaded;  /**< bytes uploaded */
+  double hash_t;          /**< time hashing host data in milliseconds */
+  size_t ranges;          /**< dirty ranges uploaded */
+  size_t faults;          /**< writes to protected pages */
+  double track_t;         /**< time protecting pages and handling faults in
+                               milliseconds */
+} fpga_cache_stats_t;
+
+/**
+ * Small transfers packed into one staging buffer and one DMA per direction,
+ * see fpga_coalesce_open. A coalescer is used by one thread at a time.
+ */
+typedef struct fpga_coalesce fpga_coalesce_t;
+
+/**
+ * Counters of a coalescer since it was opened
+ */
+typedef struct fpga_coalesce_stats {
+  size_t writes;        /**< write requests */
+  size_t reads;         /**< read requests */
+  size_t bytes;         /**< bytes requested in both directions */
+  size_t flushes;       /**< flushes that transferred pending requests */
+  size_t transfers;     /**< DMA transfers, packed or direct */
+  double flush_t;       /**< time in flushes in milliseconds */
+} fpga_coalesce_stats_t;
+
+// buffers of a staging ring at most
+#define FPGA_STAGING_MAX_DEPTH 8
+
+/**
+ * Counters of the staging ring since it was reserved, see
+ * fpga_staging_reserve
+ */
+typedef struct fpga_staging_stats {
+  size_t bytes_in;      /**< bytes staged from host to device */
+  size_t bytes_out;     /**< bytes staged from device to host */
+  size_t chunks;        /**< chunks copied through a staging buffer */
+  double copy_t;        /**< time copying between user memory and the ring
+                             in milliseconds */
+  double wait_t;        /**< time waiting for a staging buffer to be free or
+                             filled in milliseconds */
+} fpga_staging_stats_t;
+
+/**
+ * Phases of a test the host counters are attributed to
+ */
+typedef enum fpga_phase {
+  FPGA_PHASE_GENERATE,  /**< input created by the driver */
+  FPGA_PHASE_WRITE,     /**< host to device transfers, until complete */
+  FPGA_PHASE_READ,      /**< device to host transfers, until complete */
+  FPGA_PHASE_VERIFY     /**< output compared by the driver */
+} fpga_phase_t;
+
+#define FPGA_NUM_PHASES 4
+
+// cycles, instructions, LLC misses, dTLB misses, page faults, context switches
+#define FPGA_PERF_COUNTERS 6
+
+/**
+ * Host counters of a phase of the thread that opened them, see
+ * fpga_perf_open
+ */
+typedef struct fpga_perf {
+  uint64_t count[FPGA_PERF_COUNTERS]; /**< counts, scaled if multiplexed */
+  bool valid[FPGA_PERF_COUNTERS];     /**< counter could be opened */
+  unsigned calls;                     /**< times the phase was counted */
+} fpga_perf_t;
+
+/**
+ * Board and software stack the results were measured on
+ */
+typedef struct fpga_environment {
+  char board[128];    /**< board name, see FPGA_BOARD_NAME */
+  char bsp[128];      /**< BSP version, see FPGA_BSP_VERSION */
+  char device[128];   /**< OpenCL device name */
+  char platform[128]; /**< OpenCL platform version */
+} fpga_env_t;
+
+/**
+ * Handle of an initialized FPGA. Tests on the same handle run one at a time,
+ * threads with a handle each run their tests concurrently. The functions
+ * without a handle use a default handle created by fpga_initialize.
+ */
+typedef struct fpga_ctx fpga_ctx_t;
+
 /** 
- * @brief Initialize FPGA
+ * @brief Initialize FPGA, loads the transfer profile of the board if found.
+ *        Creates the default handle used by the functions without a handle.
  * @param platform_name: name of the OpenCL platform
  * @param path         : path to binary
  * @param use_svm      : 1 if true 0 otherwise
@@ -68,21 +349,95 @@ extern void* fpga_complex_malloc(size_t sz);
  */
 extern void* fpgaf_complex_malloc(size_t sz);
 
-extern fpga_t fpga_test(unsigned N, float2 *inp, float2 *out, bool interleaving);
+/** 
+ * @brief Set the alignment of the host buffers fpga_complex_malloc,
+ *        fpgaf_complex_malloc and the library allocate from now on, 64 bytes
+ *        by default. Not synchronized, set before allocating.
+ * @param alignment : power of two from FPGA_ALIGN_MIN to FPGA_ALIGN_MAX
+ * @return false if the alignment is out of range
+ */
+extern bool fpga_set_host_alignment(size_t alignment);
 
 /** 
- * @brief Non blocking PCIe test to determine if full duplex
- * @param sz  : size_t : size to allocate
+ * @brief Alignment of the host buffers allocated by the library
+ */
+extern size_t fpga_get_host_alignment();
+
+/** 
+ * @brief Allocate sz bytes starting offset bytes past an address aligned to
+ *        alignment, to measure how the placement of a host buffer affects
+ *        the transfers. Release with fpga_host_free.
+ * @param alignment : power of two from FPGA_ALIGN_MIN to FPGA_ALIGN_MAX
+ * @param offset    : bytes past the aligned address, less than
+ *                    FPGA_OFFSET_MAX. The tests reject data that is not
+ *                    aligned to fpga_type_align of its type, so for a
+ *                    buffer passed to them offset must be a multiple of it.
  * @return void ptr or NULL
  */
-extern fpga_t nb_pcie_test(unsigned N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+extern void* fpga_host_malloc(size_t sz, size_t alignment, size_t offset);
+
+/** 
+ * @brief Release a buffer of fpga_host_malloc, NULL is ignored
+ */
+extern void fpga_host_free(void *ptr);
+
+extern fpga_t fpga_test(size_t N, float2 *inp, float2 *out, bool interleaving);
+
+/**
+ * @brief Bytes of an element of type
+ * @return 0 if type is unknown
+ */
+extern size_t fpga_type_size(fpga_type_t type);
+
+/**
+ * @brief Alignment in bytes an element of type requires on the host
+ * @return 0 if type is unknown
+ */
+extern size_t fpga_type_align(fpga_type_t type);
+
+/**
+ * @brief Name of type as in C, e.g. "double2"
+ * @return "unknown" if type is unknown
+ */
+extern const char* fpga_type_name(fpga_type_t type);
+
+/**
+ * @brief Type of a name returned by fpga_type_name
+ * @return false if name is not a type
+ */
+extern bool fpga_type_parse(const char *name, fpga_type_t *type);
+
+/**
+ * @brief Blocking write and read back of N elements of type, split over
+ *        several device buffers beyond the maximum allocation.
+ *        fpga_test is the float2 case.
+ * @param N    : number of elements
+ * @param type : element type of inp and out
+ * @param inp  : N elements aligned to fpga_type_align(type)
+ * @param out  : N elements aligned to fpga_type_align(type)
+ * @return fpga_t : time taken in milliseconds for data transfers, invalid
+ *                  if the type is unknown or the data is misaligned
+ */
+extern fpga_t fpga_typed_test(size_t N, fpga_type_t type, const void *inp, void *out);
 
 /** 
  * @brief Non blocking PCIe test to determine if full duplex
  * @param sz  : size_t : size to allocate
  * @return void ptr or NULL
  */
-extern fpga_t nb_event_pcie_test(unsigned N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+extern fpga_t nb_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+
+/** 
+ * @brief Non blocking PCIe test to determine if full duplex, using wait list
+ *        events. Returns after all transfers completed.
+ * @param N         : number of points in each batch
+ * @param inp       : input of N * how_many points
+ * @param out       : output of N * how_many points
+ * @param how_many  : number of batches
+ * @return fpga_t with submit_t the time to enqueue the batch, exec_t the time
+ *         until the last read completed and device_t the device time
+ */
+extern fpga_t nb_event_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
 
 /** 
  * @brief Initialize FPGA
@@ -95,14 +450,566 @@ extern fpga_t nb_event_pcie_test(unsigned N, float2 *inp, float2 *out, bool inte
           -3 Unable to find devices for given OpenCL platform
           -4 Failed to create program, file not found in path
           -5 Device does not support required SVM
+          -7 N points do not fit in the global memory of the device
  */
-extern int fpga_initialize_withBuf(const char *platform_name, const char *path, bool use_svm, unsigned N);
+extern int fpga_initialize_withBuf(const char *platform_name, const char *path, bool use_svm, size_t N);
 
 /** 
  * @brief Release FPGA Resources
  */
 extern void fpga_final_withBuf();
 
-extern fpga_t fpga_test_bufPersist(unsigned N, float2 *inp, float2 *out, bool interleaving);
+extern fpga_t fpga_test_bufPersist(size_t N, float2 *inp, float2 *out, bool interleaving);
+
+/** 
+ * @brief Skip uploads of fpga_test_bufPersist whose data is resident in its
+ *        persistent buffer already. Each device buffer of the persistent
+ *        array remembers the host address, size and key of its last upload,
+ *        the key being a content hash or the version tag of the host
+ *        buffer. Data on the device is assumed to change only by uploads.
+ *        Setting the mode drops the entries and resets the counters.
+ *        With FPGA_CACHE_DIRTY the pages of the host buffer are made read
+ *        only after an upload, and a SIGSEGV handler marks a page dirty on
+ *        its first write. The next upload of the same buffer sends only the
+ *        dirty pages, adjacent pages coalesced into one transfer. Only pages
+ *        entirely inside the buffer are tracked, so page aligned buffers are
+ *        tracked fully, and a buffer whose pages are tracked by another
+ *        handle already is uploaded in full. The buffer must not be written
+ *        by system calls such as read(), which fail with EFAULT on protected
+ *        pages, nor freed before the mode is changed, the cache is
+ *        invalidated or the handle is released.
+ * @return false if there are no persistent buffers
+ */
+extern bool fpga_cache_set_mode(fpga_cache_mode_t mode);
+
+/** 
+ * @brief Set the version of a host buffer passed to fpga_test_bufPersist,
+ *        to be changed whenever the buffer is modified. In version mode
+ *        buffers without a version are always uploaded.
+ * @return false if too many buffers are tagged
+ */
+extern bool fpga_cache_tag(const void *host, uint64_t version);
+
+/** 
+ * @brief Forget the contents of the persistent buffers
+ */
+extern void fpga_cache_invalidate();
+
+/** 
+ * @brief Counters since the mode was set
+ */
+extern void fpga_cache_stats(fpga_cache_stats_t *stats);
+
+/** 
+ * @brief Non blocking PCIe test like nb_event_pcie_test, with writes and reads
+ *        enqueued by a dedicated submission thread per queue, fed through 
+ *        lock free single producer single consumer queues
+ * @param N         : number of points in each batch
+ * @param inp       : input of N * how_many points
+ * @param out       : output of N * how_many points
+ * @param how_many  : number of batches
+ * @return fpga_t with submit_t the time the caller spent handing over 
+ *         transfers and exec_t the time until all transfers completed
+ */
+extern fpga_t nb_thread_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+
+/** 
+ * @brief Check if SVM was requested during initialization and is supported
+ * @return true if svm_pcie_test uses SVM buffers
+ */
+extern bool fpga_svm_enabled();
+
+/** 
+ * @brief Non blocking PCIe test using coarse grained SVM buffers, falls back
+ *        to nb_event_pcie_test if SVM is not enabled
+ * @param N         : number of points in each batch
+ * @param inp       : input of N * how_many points
+ * @param out       : output of N * how_many points
+ * @param how_many  : number of batches
+ * @param use_kernel: copy on the device using svm_copy kernel from binary
+ * @return fpga_t with valid set to 1 if successful
+ */
+extern fpga_t svm_pcie_test(size_t N, float2 *inp, float2 *out, unsigned how_many, bool use_kernel);
+
+/** 
+ * @brief Pipelined PCIe test that transfers float2 data packed as half2. The
+ *        input is converted to half2 on the host, unpacked to float2 and 
+ *        packed again on the device by the fp16 kernels, and converted back
+ *        to float2 on the host.
+ * @param N         : number of points in each batch
+ * @param inp       : input of N * how_many points
+ * @param out       : output of N * how_many points, half precision accuracy
+ * @param how_many  : number of batches
+ * @return fpga_t with exec_t the transfer time and conv_t the host conversion
+ *         time, valid set to 1 if successful
+ */
+extern fpga_t fpga_fp16_test(size_t N, float2 *inp, float2 *out, unsigned how_many);
+
+/** 
+ * @brief Pipelined PCIe test with configurable chunk size, pipeline depth,
+ *        bank assignment, allocation type and number of queues
+ * @param N         : number of points in each batch
+ * @param inp       : input of N * how_many points
+ * @param out       : output of N * how_many points
+ * @param how_many  : number of batches
+ * @param config    : transfer parameters, NULL uses the active configuration.
+ *                    With use_model set the chunk and depth are planned
+ *                    for the payload if the board has a model.
+ * @return fpga_t with valid set to 1 if successful
+ */
+extern fpga_t fpga_pipeline_test(size_t N, float2 *inp, float2 *out, unsigned how_many, const fpga_config_t *config);
+
+/**
+ * @brief Pipelined transfer of how_many batches of N elements of type, see
+ *        fpga_pipeline_test which is the float2 case. Chunks of the
+ *        configuration are in elements, so the bytes per transfer scale
+ *        with the element size.
+ * @param type : element type of inp and out
+ * @return fpga_t : time taken in milliseconds for data transfers, invalid
+ *                  if the type is unknown or the data is misaligned
+ */
+extern fpga_t fpga_typed_pipeline_test(size_t N, fpga_type_t type, const void *inp, void *out, unsigned how_many, const fpga_config_t *config);
+
+/** 
+ * @brief Latency of blocking write then read round trips through a device 
+ *        buffer that persists across the rounds
+ * @param bytes     : bytes per transfer, not restricted to powers of two
+ * @param rounds    : number of timed round trips
+ * @param warmup    : untimed round trips before the first sample
+ * @param samples   : round trip time of each round in microseconds, size rounds
+ * @return fpga_t with pcie_write_t and pcie_read_t the time spent in each 
+ *         direction and exec_t the total time of the timed rounds, valid set
+ *         to 1 if the data read back matches
+ */
+extern fpga_t fpga_latency_test(size_t bytes, unsigned rounds, unsigned warmup, double *samples);
+
+/** 
+ * @brief Full duplex test, host to device writes and device to host reads are
+ *        driven independently on separate queues and DDR banks with a given
+ *        share of the bytes written
+ * @param chunk     : bytes per transfer
+ * @param total     : bytes transferred in both directions together
+ * @param write_pct : percentage of total written, 100 - write_pct is read
+ * @param duplex    : per direction bandwidth over time, NULL if not required
+ * @return fpga_t with pcie_write_t and pcie_read_t the device time of each
+ *         direction, exec_t the wall clock time, valid set to 1 if successful
+ */
+extern fpga_t fpga_duplex_test(size_t chunk, size_t total, unsigned write_pct, fpga_duplex_t *duplex);
+
+/** 
+ * @brief Stream a file of float2 points from disk to the device and back to
+ *        an output file, depth and banks of the active configuration. Disk
+ *        reads, transfers and disk writes of different chunks overlap, with
+ *        FPGA_FILE_URING or FPGA_FILE_THREADS without blocking the thread
+ *        submitting the transfers.
+ * @param inp_path  : input file, size a multiple of float2
+ * @param out_path  : output file, created or truncated to the input size
+ * @param file      : chunk and mode, filled with the host time of each file
+ *                    stage
+ * @return fpga_t with pcie_write_t and pcie_read_t the device time of each 
+ *         direction, exec_t the wall clock time from disk to disk, valid set
+ *         to 1 if every chunk was written to the output file
+ */
+extern fpga_t fpga_file_test(const char *inp_path, const char *out_path, fpga_file_t *file);
+
+/** 
+ * @brief Create an empty flow
+ * @param total : bytes produced by FPGA_STAGE_GENERATE, the file size is
+ *                used by FPGA_STAGE_FILE_READ
+ * @param chunk : bytes per chunk, a multiple of float2
+ * @param depth : chunks each queue between two stages holds
+ * @return flow or NULL if the arguments are invalid
+ */
+extern fpga_flow_t* fpga_flow_create(size_t total, size_t chunk, unsigned depth);
+
+/** 
+ * @brief Append a stage to a flow. The first stage is a source, data has to
+ *        be on the device for the kernel and D2H stages and on the host for
+ *        the others, a flow has at most one kernel.
+ * @param stage : kind of stage
+ * @param arg   : path of file stages, name of the kernel, NULL otherwise
+ * @return true if the stage can follow the stages added before
+ */
+extern bool fpga_flow_add(fpga_flow_t *flow, fpga_stage_t stage, const char *arg);
+
+/** 
+ * @brief Append the stages of a comma separated description, arguments 
+ *        follow the name after a colon, for example
+ *        "file_read:in.bin,h2d,kernel:svm_copy,d2h,file_write:out.bin"
+ * @return true if every stage was added
+ */
+extern bool fpga_flow_parse(fpga_flow_t *flow, const char *spec);
+
+/** 
+ * @brief Run a flow until the source is exhausted
+ * @return fpga_t with exec_t the wall clock time, pcie_write_t and 
+ *         pcie_read_t the busy time of the H2D and D2H stages, valid set to
+ *         1 if every stage succeeded
+ */
+extern fpga_t fpga_flow_run(fpga_flow_t *flow);
+
+/** 
+ * @brief Counters of each stage of the last run
+ * @param stats : FPGA_FLOW_MAX_STAGES entries
+ * @return number of stages
+ */
+extern unsigned fpga_flow_stats(const fpga_flow_t *flow, fpga_stage_stats_t *stats);
+
+/** 
+ * @brief Release a flow
+ */
+extern void fpga_flow_destroy(fpga_flow_t *flow);
+
+/** 
+ * @brief Open a coalescer of small transfers on its own queue. Writes are
+ *        appended to a device arena and staged in a locked host buffer,
+ *        reads of the arena are gathered into one span; both are moved by
+ *        one DMA each when flushed. Requests larger than the staging buffer
+ *        are transferred directly.
+ * @param capacity    : bytes of the device arena, at most a device buffer
+ * @param flush_bytes : bytes of each staging buffer, pending requests are
+ *                      flushed once they fill it
+ * @param flush_us    : pending requests are flushed by the next request or
+ *                      poll once the oldest is older, 0 to flush by size
+ * @return coalescer or NULL if the arguments are invalid
+ */
+extern fpga_coalesce_t* fpga_coalesce_open(size_t capacity, size_t flush_bytes, double flush_us);
+
+/** 
+ * @brief Write bytes of src to the end of the arena, src may be reused on
+ *        return
+ * @param offset : bytes from the start of the arena the data is written to
+ * @return false if the arguments are invalid or the arena is full
+ */
+extern bool fpga_coalesce_write(fpga_coalesce_t *co, const void *src, size_t bytes, size_t *offset);
+
+/** 
+ * @brief Read bytes of the arena at offset into dst, dst is filled by the
+ *        flush that includes the read
+ * @return false if the arguments are invalid or the range was not written
+ */
+extern bool fpga_coalesce_read(fpga_coalesce_t *co, size_t offset, size_t bytes, void *dst);
+
+/** 
+ * @brief Transfer all pending requests and wait for them
+ */
+extern bool fpga_coalesce_flush(fpga_coalesce_t *co);
+
+/** 
+ * @brief Flush if the oldest pending request is older than the threshold
+ * @return true if flushed
+ */
+extern bool fpga_coalesce_poll(fpga_coalesce_t *co);
+
+/** 
+ * @brief Flush and rewind the arena to offset 0
+ */
+extern void fpga_coalesce_reset(fpga_coalesce_t *co);
+
+/** 
+ * @brief Counters since the coalescer was opened
+ */
+extern void fpga_coalesce_stats(const fpga_coalesce_t *co, fpga_coalesce_stats_t *stats);
+
+/** 
+ * @brief Flush pending requests and release the coalescer
+ */
+extern void fpga_coalesce_close(fpga_coalesce_t *co);
+
+/** 
+ * @brief Reserve a buffer in each of banks DDR banks at once. Device buffers
+ *        of the tests are then handed out as regions of these buffers by a
+ *        buddy allocator instead of being created by the runtime on every
+ *        call. Replaces an earlier pool, no test may be running.
+ * @param bytes : bytes per bank, reduced to the largest device buffer, 0
+ *                releases the pool
+ * @param banks : number of banks, at most FPGA_POOL_MAX_BANKS
+ * @return true if the pool was reserved or released
+ */
+extern bool fpga_pool_reserve(size_t bytes, unsigned banks);
+
+/** 
+ * @brief Usage of each bank of the pool
+ * @param stats : FPGA_POOL_MAX_BANKS entries
+ * @return number of banks, 0 if no pool is reserved
+ */
+extern unsigned fpga_pool_stats(fpga_pool_stats_t *stats);
+
+/** 
+ * @brief Reserve a ring of locked host buffers that fpga_test and
+ *        fpga_test_bufPersist transfer pageable user memory through. Chunks
+ *        are copied into and out of the ring by several threads with
+ *        non-temporal stores, overlapping the DMA of the previous chunks.
+ *        Replaces an earlier ring, no test may be running.
+ * @param chunk   : bytes of each buffer, 0 releases the ring
+ * @param depth   : number of buffers, at most FPGA_STAGING_MAX_DEPTH
+ * @param threads : copy threads, 0 for the OpenMP default
+ * @return true if the ring was reserved or released
+ */
+extern bool fpga_staging_reserve(size_t chunk, unsigned depth, unsigned threads);
+
+/** 
+ * @brief Counters of the staging ring
+ * @return false if no ring is reserved
+ */
+extern bool fpga_staging_stats(fpga_staging_stats_t *stats);
+
+/** 
+ * @brief Get the active transfer configuration, either the default or the
+ *        one loaded from the board profile
+ */
+extern void fpga_get_config(fpga_config_t *config);
+
+/** 
+ * @brief Set the active transfer configuration used by fpga_pipeline_test
+ */
+extern void fpga_set_config(const fpga_config_t *config);
+
+/** 
+ * @brief Counters of the events created and released by the pipelines since
+ *        the last reset
+ */
+extern void fpga_get_event_stats(fpga_event_stats_t *stats);
+
+/** 
+ * @brief Reset the event counters
+ */
+extern void fpga_reset_event_stats();
+
+/**
+ * @brief Whether the library was built with host call tracing, see USE_TRACE
+ */
+extern bool fpga_trace_enabled();
+
+/**
+ * @brief Print the count and time of the host calls traced so far, over
+ *        all threads, and export the records of each thread as a trace
+ *        viewable in chrome://tracing or Perfetto. No test may be running.
+ * @param path : file for the trace, NULL for the summary only
+ * @return false if tracing is disabled or the trace could not be written
+ */
+extern bool fpga_trace_dump(const char *path);
+
+/**
+ * @brief Clear the traced records and totals
+ */
+extern void fpga_trace_reset();
+
+/**
+ * @brief Open perf_event counters of the calling thread: cycles,
+ *        instructions, LLC misses, dTLB misses, page faults and context
+ *        switches. The blocking tests count their write and read phases,
+ *        drivers count the others using fpga_perf_begin and fpga_perf_end.
+ * @return number of counters opened, 0 if perf events are not permitted
+ */
+extern unsigned fpga_perf_open();
+
+/**
+ * @brief Close the counters of the calling thread
+ */
+extern void fpga_perf_close();
+
+/**
+ * @brief Start counting a phase of the calling thread, no effect if its
+ *        counters are not open
+ */
+extern void fpga_perf_begin(fpga_phase_t phase);
+
+/**
+ * @brief Add the counts since fpga_perf_begin to the phase
+ */
+extern void fpga_perf_end(fpga_phase_t phase);
+
+/**
+ * @brief Counts of a phase since the counters were opened or reset
+ */
+extern void fpga_perf_get(fpga_phase_t phase, fpga_perf_t *perf);
+
+/**
+ * @brief Clear the counts of every phase
+ */
+extern void fpga_perf_reset();
+
+/**
+ * @brief Name of a counter of fpga_perf_t, e.g. "dtlb_misses"
+ */
+extern const char* fpga_perf_counter_name(unsigned counter);
+
+/**
+ * @brief Name of a phase, e.g. "write"
+ */
+extern const char* fpga_phase_name(fpga_phase_t phase);
+
+/** 
+ * @brief Path of the transfer profile of the current board and BSP
+ * @return path or empty string if FPGA is not initialized
+ */
+extern const char* fpga_profile_path();
+
+/** 
+ * @brief Board, BSP and OpenCL versions of the initialized FPGA
+ * @param env : environment to fill
+ * @return true if FPGA is initialized
+ */
+extern bool fpga_get_environment(fpga_env_t *env);
+
+/** 
+ * @brief Search the transfer parameters for the fastest configuration and
+ *        store it in the profile of the board. The result becomes the active
+ *        configuration.
+ * @param N         : number of points in each batch, not necessarily a
+ *                    power of two
+ * @param how_many  : number of batches
+ * @param reps      : repetitions of each candidate configuration
+ * @param best      : optional, filled with the fastest configuration
+ * @return 0 if successful
+ *        -1 Invalid arguments, N, how_many or reps is 0
+ *        -2 Unable to allocate host buffers
+ *        -3 Unable to write profile
+ *        -4 No configuration transferred the batch correctly, the profile
+ *           is not written
+ */
+extern int fpga_autotune(size_t N, unsigned how_many, unsigned reps, fpga_config_t *best);
+
+/**
+ * @brief Fit the PCIe model of the board: blocking writes and reads of 4 KiB
+ *        to 64 MiB one direction at a time, and writes and reads of the same
+ *        size at the same time on separate queues. The model is used by
+ *        configurations with use_model set and stored in the board profile
+ *        besides the active configuration.
+ * @param reps  : repetitions of each size, the median is fitted
+ * @param model : fitted model if not NULL
+ * @return 0 if successful, -1 invalid arguments, -2 if host buffers could not
+ *         be allocated, -3 if the profile could not be written, -4 if the
+ *         times did not determine a fit
+ */
+extern int fpga_calibrate(unsigned reps, fpga_model_t *model);
+
+/**
+ * @brief Model of the default handle, fitted or loaded from the profile
+ * @return false if there is no valid model
+ */
+extern bool fpga_get_model(fpga_model_t *model);
+
+/**
+ * @brief Time of a transfer of bytes over a fitted direction
+ * @return time in microseconds
+ */
+extern double fpga_model_time(const fpga_link_t *link, size_t bytes);
+
+/**
+ * @brief Predicted time of a pipelined round trip of bytes, as done by
+ *        fpga_pipeline_test
+ * @param bytes  : payload
+ * @param chunk  : bytes per transfer, 0 for a single transfer
+ * @param depth  : device buffers in flight
+ * @param queues : 1 single queue, 2 separate write and read queues
+ * @return time in milliseconds, 0.0 if the model is not valid
+ */
+extern double fpga_model_predict(const fpga_model_t *model, size_t bytes, size_t chunk, unsigned depth, unsigned queues);
+
+/**
+ * @brief Chunk and depth with the smallest predicted time for a payload of
+ *        total elements, the other parameters of config are kept
+ * @param elem      : bytes per element
+ * @param max_chunk : elements a device buffer holds, 0 for no limit
+ * @param config    : chunk in elements and depth are set
+ * @return false if the model is not valid
+ */
+extern bool fpga_model_plan(const fpga_model_t *model, size_t total, size_t elem, size_t max_chunk, fpga_config_t *config);
+
+/** 
+ * @brief Create a handle on the first device of the platform, loads the 
+ *        transfer profile of the board if found
+ * @param ctx          : set to the handle, NULL on error
+ * @param platform_name: name of the OpenCL platform
+ * @param path         : path to binary
+ * @param use_svm      : 1 if true 0 otherwise
+ * @return error codes of fpga_initialize, -6 Unable to allocate the handle
+ */
+extern int fpga_ctx_create(fpga_ctx_t **ctx, const char *platform_name, const char *path, bool use_svm);
+
+/** 
+ * @brief Create a handle with persistent device buffers of N points used by
+ *        fpga_ctx_test_bufPersist
+ * @return error codes of fpga_ctx_create, -7 if N points do not fit on the
+ *         device
+ */
+extern int fpga_ctx_create_withBuf(fpga_ctx_t **ctx, const char *platform_name, const char *path, bool use_svm, size_t N);
+
+/** 
+ * @brief Release the resources of a handle. No test may be running on it.
+ */
+extern void fpga_ctx_destroy(fpga_ctx_t *ctx);
+
+/** 
+ * @brief Tests on a handle, see the function of the same name without a 
+ *        handle. Invalid if ctx is NULL.
+ */
+extern fpga_t fpga_ctx_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving);
+
+extern fpga_t fpga_ctx_typed_test(fpga_ctx_t *ctx, size_t N, fpga_type_t type, const void *inp, void *out);
+
+extern fpga_t fpga_ctx_test_bufPersist(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving);
+
+extern bool fpga_ctx_cache_set_mode(fpga_ctx_t *ctx, fpga_cache_mode_t mode);
+
+extern bool fpga_ctx_cache_tag(fpga_ctx_t *ctx, const void *host, uint64_t version);
+
+extern void fpga_ctx_cache_invalidate(fpga_ctx_t *ctx);
+
+extern void fpga_ctx_cache_stats(fpga_ctx_t *ctx, fpga_cache_stats_t *stats);
+
+extern fpga_t fpga_ctx_nb_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+
+extern fpga_t fpga_ctx_nb_event_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+
+extern fpga_t fpga_ctx_nb_thread_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many);
+
+extern bool fpga_ctx_svm_enabled(fpga_ctx_t *ctx);
+
+extern fpga_t fpga_ctx_svm_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many, bool use_kernel);
+
+extern fpga_t fpga_ctx_fp16_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many);
+
+extern fpga_t fpga_ctx_pipeline_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many, const fpga_config_t *config);
+
+extern fpga_t fpga_ctx_typed_pipeline_test(fpga_ctx_t *ctx, size_t N, fpga_type_t type, const void *inp, void *out, unsigned how_many, const fpga_config_t *config);
+
+extern fpga_t fpga_ctx_latency_test(fpga_ctx_t *ctx, size_t bytes, unsigned rounds, unsigned warmup, double *samples);
+
+extern fpga_t fpga_ctx_duplex_test(fpga_ctx_t *ctx, size_t chunk, size_t total, unsigned write_pct, fpga_duplex_t *duplex);
+
+extern fpga_t fpga_ctx_file_test(fpga_ctx_t *ctx, const char *inp_path, const char *out_path, fpga_file_t *file);
+
+extern fpga_t fpga_ctx_flow_run(fpga_ctx_t *ctx, fpga_flow_t *flow);
+
+extern fpga_coalesce_t* fpga_ctx_coalesce_open(fpga_ctx_t *ctx, size_t capacity, size_t flush_bytes, double flush_us);
+
+extern bool fpga_ctx_pool_reserve(fpga_ctx_t *ctx, size_t bytes, unsigned banks);
+
+extern unsigned fpga_ctx_pool_stats(fpga_ctx_t *ctx, fpga_pool_stats_t *stats);
+
+extern bool fpga_ctx_staging_reserve(fpga_ctx_t *ctx, size_t chunk, unsigned depth, unsigned threads);
+
+extern bool fpga_ctx_staging_stats(fpga_ctx_t *ctx, fpga_staging_stats_t *stats);
+
+/** 
+ * @brief Configuration, profile and environment of a handle, see the
+ *        function of the same name without a handle
+ */
+extern void fpga_ctx_get_config(fpga_ctx_t *ctx, fpga_config_t *config);
+
+extern void fpga_ctx_set_config(fpga_ctx_t *ctx, const fpga_config_t *config);
+
+extern const char* fpga_ctx_profile_path(fpga_ctx_t *ctx);
+
+extern bool fpga_ctx_get_environment(fpga_ctx_t *ctx, fpga_env_t *env);
+
+extern int fpga_ctx_autotune(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, fpga_config_t *best);
+
+extern int fpga_ctx_calibrate(fpga_ctx_t *ctx, unsigned reps, fpga_model_t *model);
+
+extern bool fpga_ctx_get_model(fpga_ctx_t *ctx, fpga_model_t *model);
 
 #endif
@@ -0,0 +1,475 @@
+// Author: Arjun Ramaswami
+
+#define _GNU_SOURCE // pread, pwrite
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#include "aio.h"
+
+/**
+ * Read or write of a registered buffer, the unit of the thread pool
+ */
+typedef struct aio_job {
+  bool write;
+  int fd;
+  void *buf;
+  unsigned index;       /**< of the registered buffer */
+  size_t len;
+  size_t offset;
+  uint64_t tag;
+  ssize_t res;
+} aio_job;
+
+/**
+ * Asynchronous reads and writes of a fixed set of buffers, either through an
+ * io_uring with the buffers registered or through a pool of threads calling
+ * pread and pwrite. At most entries operations are in flight.
+ */
+struct file_aio {
+  bool uring;
+  unsigned entries;
+  unsigned inflight;    /**< submitted and not reaped */
+  void **bufs;
+  unsigned num_bufs;
+
+  // io_uring, rings shared with the kernel
+  int ring_fd;
+  void *sq_ptr, *cq_ptr;
+  size_t sq_len, cq_len;
+  struct io_uring_sqe *sqes;
+  size_t sqes_len;
+  unsigned *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_cqe *cqes;
+
+  // thread pool, jobs and completions are rings of entries
+  pthread_t threads[AIO_THREADS];
+  unsigned num_threads;
+  pthread_mutex_t lock;
+  pthread_cond_t work, done;
+  aio_job *jobs, *dones;
+  unsigned job_head, job_count, done_head, done_count;
+  bool stop;
+};
+
+// function prototypes
+static bool uring_setup(file_aio *aio);
+static void uring_cleanup(file_aio *aio);
+static bool uring_submit(file_aio *aio, const aio_job *job);
+static bool uring_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res);
+static bool pool_setup(file_aio *aio);
+static void pool_cleanup(file_aio *aio);
+static bool pool_submit(file_aio *aio, const aio_job *job);
+static bool pool_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res);
+static void* pool_worker(void *arg);
+
+/**
+ * \brief  create the asynchronous reader and writer of the given buffers.
+ *         With try_uring the buffers are registered with a new io_uring, the
+ *         thread pool is used if the kernel does not provide io_uring or the
+ *         buffers cannot be registered.
+ * \param  entries  : operations in flight at most
+ * \param  bufs     : buffers read into and written from, also used for DMA
+ * \param  num_bufs : number of buffers
+ * \param  buf_len  : bytes of each buffer
+ * \return reader and writer or NULL if neither can be created
+ */
+file_aio* aio_create(unsigned entries, bool try_uring, void **bufs, unsigned num_bufs, size_t buf_len){
+  if(entries == 0 || num_bufs == 0 || bufs == NULL){
+    return NULL;
+  }
+
+  file_aio *aio = (file_aio *)calloc(1, sizeof(file_aio));
+  if(aio == NULL){
+    return NULL;
+  }
+  aio->entries = entries;
+  aio->num_bufs = num_bufs;
+  aio->ring_fd = -1;
+  aio->bufs = (void **)malloc(num_bufs * sizeof(void *));
+  if(aio->bufs == NULL){
+    free(aio);
+    return NULL;
+  }
+  memcpy(aio->bufs, bufs, num_bufs * sizeof(void *));
+
+  if(try_uring && uring_setup(aio)){
+    struct iovec iov[num_bufs];
+    for(unsigned b = 0; b < num_bufs; b++){
+      iov[b].iov_base = bufs[b];
+      iov[b].iov_len = buf_len;
+    }
+    if(syscall(__NR_io_uring_register, aio->ring_fd, IORING_REGISTER_BUFFERS, iov, num_bufs) == 0){
+      aio->uring = true;
+      return aio;
+    }
+    // registration pins the buffers, may exceed RLIMIT_MEMLOCK
+    uring_cleanup(aio);
+  }
+
+  if(!pool_setup(aio)){
+    free(aio->bufs);
+    free(aio);
+    return NULL;
+  }
+  return aio;
+}
+
+/**
+ * \brief  true if the reads and writes use io_uring
+ */
+bool aio_is_uring(const file_aio *aio){
+  return aio->uring;
+}
+
+/**
+ * \brief  start reading len bytes at offset of fd into buffer buf
+ * \return false if entries operations are already in flight or the read
+ *         could not be submitted
+ */
+bool aio_read(file_aio *aio, int fd, unsigned buf, size_t len, size_t offset, uint64_t tag){
+  aio_job job = {false, fd, NULL, buf, len, offset, tag, 0};
+  if(aio->inflight == aio->entries || buf >= aio->num_bufs){
+    return false;
+  }
+  job.buf = aio->bufs[buf];
+
+  bool success = aio->uring ? uring_submit(aio, &job) : pool_submit(aio, &job);
+  if(success)
+    aio->inflight++;
+  return success;
+}
+
+/**
+ * \brief  start writing len bytes of buffer buf to fd at offset
+ * \return false if entries operations are already in flight or the write
+ *         could not be submitted
+ */
+bool aio_write(file_aio *aio, int fd, unsigned buf, size_t len, size_t offset, uint64_t tag){
+  aio_job job = {true, fd, NULL, buf, len, offset, tag, 0};
+  if(aio->inflight == aio->entries || buf >= aio->num_bufs){
+    return false;
+  }
+  job.buf = aio->bufs[buf];
+
+  bool success = aio->uring ? uring_submit(aio, &job) : pool_submit(aio, &job);
+  if(success)
+    aio->inflight++;
+  return success;
+}
+
+/**
+ * \brief  take a completed operation
+ * \param  wait : block until an operation completes if none has
+ * \param  tag  : tag given on submission
+ * \param  res  : bytes transferred or negative errno
+ * \return true if an operation was taken, false if none completed or none
+ *         is in flight
+ */
+bool aio_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res){
+  if(aio->inflight == 0){
+    return false;
+  }
+
+  bool success = aio->uring ? uring_reap(aio, wait, tag, res) : pool_reap(aio, wait, tag, res);
+  if(success)
+    aio->inflight--;
+  return success;
+}
+
+/**
+ * \brief  wait for the operations in flight and release the reader and
+ *         writer, the buffers are unregistered and not freed
+ */
+void aio_destroy(file_aio *aio){
+  uint64_t tag;
+  ssize_t res;
+
+  if(aio == NULL){
+    return;
+  }
+  while(aio_reap(aio, true, &tag, &res));
+
+  if(aio->uring){
+    uring_cleanup(aio);
+  }
+  else{
+    pool_cleanup(aio);
+  }
+  free(aio->bufs);
+  free(aio);
+}
+
+/**
+ * \brief  create the io_uring and map its submission and completion rings
+ * \return false if io_uring is not available
+ */
+static bool uring_setup(file_aio *aio){
+  struct io_uring_params p;
+  memset(&p, 0, sizeof(p));
+
+  aio->ring_fd = syscall(__NR_io_uring_setup, aio->entries, &p);
+  if(aio->ring_fd < 0){
+    return false;
+  }
+
+  aio->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+  aio->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+  if(p.features & IORING_FEAT_SINGLE_MMAP){
+    if(aio->cq_len > aio->sq_len)
+      aio->sq_len = aio->cq_len;
+    aio->cq_len = aio->sq_len;
+  }
+
+  aio->sq_ptr = mmap(NULL, aio->sq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQ_RING);
+  if(aio->sq_ptr == MAP_FAILED){
+    aio->sq_ptr = NULL;
+    uring_cleanup(aio);
+    return false;
+  }
+  if(p.features & IORING_FEAT_SINGLE_MMAP){
+    aio->cq_ptr = aio->sq_ptr;
+  }
+  else{
+    aio->cq_ptr = mmap(NULL, aio->cq_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_CQ_RING);
+    if(aio->cq_ptr == MAP_FAILED){
+      aio->cq_ptr = NULL;
+      uring_cleanup(aio);
+      return false;
+    }
+  }
+
+  aio->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+  aio->sqes = mmap(NULL, aio->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, aio->ring_fd, IORING_OFF_SQES);
+  if(aio->sqes == MAP_FAILED){
+    aio->sqes = NULL;
+    uring_cleanup(aio);
+    return false;
+  }
+
+  unsigned char *sq = (unsigned char *)aio->sq_ptr;
+  unsigned char *cq = (unsigned char *)aio->cq_ptr;
+  aio->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+  aio->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+  aio->sq_array = (unsigned *)(sq + p.sq_off.array);
+  aio->cq_head = (unsigned *)(cq + p.cq_off.head);
+  aio->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+  aio->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+  aio->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+  return true;
+}
+
+/**
+ * \brief  unmap the rings and close the io_uring, unregisters the buffers
+ */
+static void uring_cleanup(file_aio *aio){
+  if(aio->sqes != NULL)
+    munmap(aio->sqes, aio->sqes_len);
+  if(aio->cq_ptr != NULL && aio->cq_ptr != aio->sq_ptr)
+    munmap(aio->cq_ptr, aio->cq_len);
+  if(aio->sq_ptr != NULL)
+    munmap(aio->sq_ptr, aio->sq_len);
+  if(aio->ring_fd >= 0)
+    close(aio->ring_fd);
+
+  aio->sqes = NULL;
+  aio->sq_ptr = aio->cq_ptr = NULL;
+  aio->ring_fd = -1;
+}
+
+/**
+ * \brief  queue a fixed buffer read or write and enter the kernel to submit
+ *         it, the kernel is the only consumer of the submission ring
+ */
+static bool uring_submit(file_aio *aio, const aio_job *job){
+  unsigned tail = *aio->sq_tail;
+  unsigned idx = tail & *aio->sq_mask;
+  struct io_uring_sqe *sqe = &aio->sqes[idx];
+
+  memset(sqe, 0, sizeof(*sqe));
+  sqe->opcode = job->write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+  sqe->fd = job->fd;
+  sqe->addr = (uint64_t)(uintptr_t)job->buf;
+  sqe->len = job->len;
+  sqe->off = job->offset;
+  sqe->buf_index = job->index;
+  sqe->user_data = job->tag;
+  aio->sq_array[idx] = idx;
+
+  // the entry is visible to the kernel before the new tail
+  __atomic_store_n(aio->sq_tail, tail + 1, __ATOMIC_RELEASE);
+
+  int ret;
+  do{
+    ret = syscall(__NR_io_uring_enter, aio->ring_fd, 1, 0, 0, NULL, 0);
+  } while(ret < 0 && errno == EINTR);
+  return (ret == 1);
+}
+
+/**
+ * \brief  take the next completion, entering the kernel to wait for one if
+ *         the completion ring is empty
+ */
+static bool uring_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res){
+  unsigned head = *aio->cq_head;
+
+  while(head == __atomic_load_n(aio->cq_tail, __ATOMIC_ACQUIRE)){
+    if(!wait){
+      return false;
+    }
+    int ret = syscall(__NR_io_uring_enter, aio->ring_fd, 0, 1, IORING_ENTER_GETEVENTS, NULL, 0);
+    if(ret < 0 && errno != EINTR){
+      return false;
+    }
+  }
+
+  struct io_uring_cqe *cqe = &aio->cqes[head & *aio->cq_mask];
+  *tag = cqe->user_data;
+  *res = cqe->res;
+
+  // the entry is consumed before the kernel may reuse it
+  __atomic_store_n(aio->cq_head, head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+/**
+ * \brief  start the threads of the pread and pwrite fallback
+ */
+static bool pool_setup(file_aio *aio){
+  aio->jobs = (aio_job *)malloc(aio->entries * sizeof(aio_job));
+  aio->dones = (aio_job *)malloc(aio->entries * sizeof(aio_job));
+  if(aio->jobs == NULL || aio->dones == NULL){
+    free(aio->jobs);
+    free(aio->dones);
+    return false;
+  }
+
+  pthread_mutex_init(&aio->lock, NULL);
+  pthread_cond_init(&aio->work, NULL);
+  pthread_cond_init(&aio->done, NULL);
+
+  for(unsigned t = 0; t < AIO_THREADS; t++){
+    if(pthread_create(&aio->threads[t], NULL, pool_worker, aio) != 0){
+      break;
+    }
+    aio->num_threads++;
+  }
+  if(aio->num_threads == 0){
+    pool_cleanup(aio);
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief  stop and join the threads, no operation may be in flight
+ */
+static void pool_cleanup(file_aio *aio){
+  pthread_mutex_lock(&aio->lock);
+  aio->stop = true;
+  pthread_cond_broadcast(&aio->work);
+  pthread_mutex_unlock(&aio->lock);
+
+  for(unsigned t = 0; t < aio->num_threads; t++){
+    pthread_join(aio->threads[t], NULL);
+  }
+
+  pthread_cond_destroy(&aio->work);
+  pthread_cond_destroy(&aio->done);
+  pthread_mutex_destroy(&aio->lock);
+  free(aio->jobs);
+  free(aio->dones);
+}
+
+/**
+ * \brief  hand a read or write to the threads, fewer than entries are in
+ *         flight so the ring has space
+ */
+static bool pool_submit(file_aio *aio, const aio_job *job){
+  pthread_mutex_lock(&aio->lock);
+  aio->jobs[(aio->job_head + aio->job_count) % aio->entries] = *job;
+  aio->job_count++;
+  pthread_cond_signal(&aio->work);
+  pthread_mutex_unlock(&aio->lock);
+  return true;
+}
+
+/**
+ * \brief  take the oldest completion of the threads
+ */
+static bool pool_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res){
+  pthread_mutex_lock(&aio->lock);
+  while(wait && aio->done_count == 0){
+    pthread_cond_wait(&aio->done, &aio->lock);
+  }
+  if(aio->done_count == 0){
+    pthread_mutex_unlock(&aio->lock);
+    return false;
+  }
+
+  aio_job *job = &aio->dones[aio->done_head];
+  *tag = job->tag;
+  *res = job->res;
+  aio->done_head = (aio->done_head + 1) % aio->entries;
+  aio->done_count--;
+  pthread_mutex_unlock(&aio->lock);
+  return true;
+}
+
+/**
+ * \brief  run reads and writes until stopped, short transfers are continued
+ *         until end of file
+ */
+static void* pool_worker(void *arg){
+  file_aio *aio = (file_aio *)arg;
+
+  pthread_mutex_lock(&aio->lock);
+  while(true){
+    while(aio->job_count == 0 && !aio->stop){
+      pthread_cond_wait(&aio->work, &aio->lock);
+    }
+    if(aio->job_count == 0){
+      break;
+    }
+    aio_job job = aio->jobs[aio->job_head];
+    aio->job_head = (aio->job_head + 1) % aio->entries;
+    aio->job_count--;
+    pthread_mutex_unlock(&aio->lock);
+
+    size_t done = 0;
+    job.res = 0;
+    while(done < job.len){
+      ssize_t ret = job.write ?
+        pwrite(job.fd, (char *)job.buf + done, job.len - done, job.offset + done) :
+        pread(job.fd, (char *)job.buf + done, job.len - done, job.offset + done);
+      if(ret < 0 && errno == EINTR){
+        continue;
+      }
+      if(ret < 0){
+        job.res = -errno;
+        break;
+      }
+      if(ret == 0){
+        break;
+      }
+      done += ret;
+      job.res = done;
+    }
+
+    pthread_mutex_lock(&aio->lock);
+    aio->dones[(aio->done_head + aio->done_count) % aio->entries] = job;
+    aio->done_count++;
+    pthread_cond_signal(&aio->done);
+  }
+  pthread_mutex_unlock(&aio->lock);
+  return NULL;
+}
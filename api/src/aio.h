@@ -0,0 +1,27 @@
+// Author: Arjun Ramaswami
+
+#ifndef AIO_H
+#define AIO_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+// threads of the pread and pwrite fallback
+#define AIO_THREADS 4
+
+typedef struct file_aio file_aio;
+
+file_aio* aio_create(unsigned entries, bool try_uring, void **bufs, unsigned num_bufs, size_t buf_len);
+
+bool aio_is_uring(const file_aio *aio);
+
+bool aio_read(file_aio *aio, int fd, unsigned buf, size_t len, size_t offset, uint64_t tag);
+
+bool aio_write(file_aio *aio, int fd, unsigned buf, size_t len, size_t offset, uint64_t tag);
+
+bool aio_reap(file_aio *aio, bool wait, uint64_t *tag, ssize_t *res);
+
+void aio_destroy(file_aio *aio);
+
+#endif // AIO_H
@@ -5,31 +5,65 @@
 #include <string.h>
 #include <unistd.h>
 #include <stdbool.h>
+#include <pthread.h>
 #define CL_VERSION_2_0
 #include <CL/cl_ext_intelfpga.h> // to disable interleaving & transfer data to specific banks - CL_CHANNEL_1_INTELFPGA
 #include "CL/opencl.h"
 
 #include "bare.h"
 #include "svm.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "dirty.h"
+#include "dev_cache.h"
+#include "tune.h"
+#include "model.h"
+#include "half.h"
+#include "submit.h"
+#include "duplex.h"
+#include "file_stream.h"
+#include "flow.h"
+#include "coalesce.h"
+#include "staging.h"
+#include "event_ring.h"
+#include "trace.h"
 #include "opencl_utils.h"
 #include "misc.h"
 
-#ifndef KERNEL_VARS
-#define KERNEL_VARS
-static cl_platform_id platform = NULL;
-static cl_device_id *devices;
-static cl_device_id device = NULL;
-static cl_context context = NULL;
-//static cl_program program = NULL;
-static cl_command_queue queue1 = NULL, queue2 = NULL, queue3 = NULL;
-static cl_mem d_inData_persist = NULL;
-
-//static int svm_handle;
-static int svm_enabled = 0;
-#endif
-
-static void queue_setup();
-void queue_cleanup();
+/**
+ * State of a handle, every test creates its queues and buffers on the handle
+ * it is given. The lock serializes tests on the same handle.
+ */
+struct fpga_ctx {
+  cl_platform_id platform;
+  cl_device_id *devices;
+  cl_device_id device;
+  cl_context context;
+  cl_program program;
+  char *bin_path;
+  cl_command_queue queue1, queue2, queue3;
+  dev_array persist;
+  dev_cache cache;              /**< contents of persist, guarded by lock */
+  dev_pool *pool;               /**< device buffers of the tests, can be NULL */
+  staging *staging;             /**< ring for user memory, can be NULL */
+  int svm_enabled;
+  fpga_config_t active_config;  /**< defaults match nb_event_pcie_test */
+  fpga_model_t model;           /**< fitted or loaded from the profile */
+  char profile_file[4096];
+  pthread_mutex_t lock;         /**< held from queue_setup to queue_cleanup */
+  pthread_mutex_t config_lock;  /**< guards active_config and model */
+};
+
+// transfer sizes of fpga_ctx_calibrate, powers of 4
+#define CALIBRATE_MIN_BYTES 4096
+#define CALIBRATE_MAX_BYTES (64 * 1024 * 1024)
+#define CALIBRATE_MAX_SIZES 8
+
+static void queue_setup(fpga_ctx_t *ctx);
+static void queue_cleanup(fpga_ctx_t *ctx);
+static cl_program program_setup(fpga_ctx_t *ctx);
+static void load_board_profile(fpga_ctx_t *ctx);
+static bool typed_data(fpga_type_t type, const void *inp, const void *out);
 
 /** 
  * @brief Allocate memory of double precision complex floating points
@@ -61,19 +95,39 @@ void* fpgaf_complex_malloc(size_t sz){
 }
 
 /** 
- * @brief Initialize FPGA
- * @param platform name: string - name of the OpenCL platform
- * @param path         : string - path to binary
- * @param use_svm      : 1 if true 0 otherwise
- * @return 0 if successful 
-          -1 Path to binary missing
-          -2 Unable to find platform passed as argument
-          -3 Unable to find devices for given OpenCL platform
-          -4 Failed to create program, file not found in path
-          -5 Device does not support required SVM
+ * @brief Set the alignment of the host buffers allocated from now on
+ * @return false if the alignment is out of range
+ */
+bool fpga_set_host_alignment(size_t alignment){
+  return setHostAlignment(alignment);
+}
 
+size_t fpga_get_host_alignment(){
+  return getHostAlignment();
+}
+
+/** 
+ * @brief Allocate sz bytes starting offset bytes past an aligned address
+ * @return void ptr or NULL
  */
-int fpga_initialize(const char *platform_name, const char *path, bool use_svm){
+void* fpga_host_malloc(size_t sz, size_t alignment, size_t offset){
+  if(sz == 0){
+    return NULL;
+  }
+  return alignedMallocAt(sz, alignment, offset);
+}
+
+void fpga_host_free(void *ptr){
+  alignedFreeAt(ptr);
+}
+
+/**
+ * \brief Find the platform and device and create the context of a handle.
+ *        The program is only built when a kernel is required, see
+ *        program_setup()
+ * \return 0 if successful, error codes of fpga_ctx_create otherwise
+ */
+static int ctx_initialize(fpga_ctx_t *ctx, const char *platform_name, const char *path, bool use_svm){
   cl_int status = 0;
 
 #ifdef VERBOSE
@@ -84,77 +138,107 @@ int fpga_initialize(const char *platform_name, const char *path, bool use_svm){
   if(path == NULL || strlen(path) == 0){
     return -1;
   }
+  ctx->bin_path = strdup(path);
 
-  // Check if this has to be sent as a pointer or value
   // Get the OpenCL platform.
-  platform = findPlatform(platform_name);
+  ctx->platform = findPlatform(platform_name);
   // Unable to find given OpenCL platform
-  if(platform == NULL){
+  if(ctx->platform == NULL){
     return -2;
   }
   // Query the available OpenCL devices.
   cl_uint num_devices;
-  devices = getDevices(platform, CL_DEVICE_TYPE_ALL, &num_devices);
+  ctx->devices = getDevices(ctx->platform, CL_DEVICE_TYPE_ALL, &num_devices);
   // Unable to find device for the OpenCL platform
-  if(devices == NULL){
+  if(ctx->devices == NULL){
     return -3;
   }
 
   // use the first device.
-  device = devices[0];
+  ctx->device = ctx->devices[0];
 
   if(use_svm){
-    if(!check_valid_svm_device(device)){
+    if(!check_valid_svm_device(ctx->device)){
       return -5;
     }
     else{
       printf("Supports SVM \n");
-      svm_enabled = 1;
+      ctx->svm_enabled = 1;
     }
   }
 
   // Create the context.
-  context = clCreateContext(NULL, 1, &device, NULL, NULL, &status);
+  ctx->context = clCreateContext(NULL, 1, &ctx->device, NULL, NULL, &status);
   checkError(status, "Failed to create context");
 
-#ifdef VERBOSE
-  printf("\tGetting program binary from path %s ...\n", path);
-#endif
-  // Create the program.
-  /*
-  program = getProgramWithBinary(context, &device, 1, path);
-  if(program == NULL) {
-    fprintf(stderr, "Failed to create program\n");
-    fpga_final();
-    return -4;
+  load_board_profile(ctx);
+
+  return 0;
+}
+
+/** 
+ * @brief Create a handle on the first device of the platform
+ * @param ctx          : set to the handle, NULL on error
+ * @param platform name: string - name of the OpenCL platform
+ * @param path         : string - path to binary
+ * @param use_svm      : 1 if true 0 otherwise
+ * @return 0 if successful 
+          -1 Path to binary missing
+          -2 Unable to find platform passed as argument
+          -3 Unable to find devices for given OpenCL platform
+          -4 Failed to create program, file not found in path
+          -5 Device does not support required SVM
+          -6 Failed to allocate the handle
+ */
+int fpga_ctx_create(fpga_ctx_t **ctx, const char *platform_name, const char *path, bool use_svm){
+  if(ctx == NULL){
+    return -6;
   }
 
-#ifdef VERBOSE
-  printf("\tBuilding program ...\n");
-#endif
-  // Build the program that was just created.
-  status = clBuildProgram(program, 0, NULL, "", NULL, NULL);
-  checkError(status, "Failed to build program");
-  */
+  *ctx = (fpga_ctx_t *)calloc(1, sizeof(fpga_ctx_t));
+  if(*ctx == NULL){
+    return -6;
+  }
+  pthread_mutex_init(&(*ctx)->lock, NULL);
+  pthread_mutex_init(&(*ctx)->config_lock, NULL);
 
-  return 0;
+  fpga_config_t default_config = {0, 2, 2, 2, false, false};
+  (*ctx)->active_config = default_config;
+
+  int isInit = ctx_initialize(*ctx, platform_name, path, use_svm);
+  if(isInit != 0){
+    fpga_ctx_destroy(*ctx);
+    *ctx = NULL;
+  }
+  return isInit;
 }
 
 /** 
- * @brief Release FPGA Resources
+ * @brief Release the resources of a handle, including the persistent buffer
+ *        of fpga_ctx_create_withBuf. No test may be running on the handle.
  */
-void fpga_final(){
+void fpga_ctx_destroy(fpga_ctx_t *ctx){
+  if(ctx == NULL){
+    return;
+  }
 
 #ifdef VERBOSE
   printf("\tCleaning up FPGA resources ...\n");
 #endif
-  /*
-  if(program) 
-    clReleaseProgram(program);
-    */
-  if(context)
-    clReleaseContext(context);
-  free(devices);
+  dev_array_release(&ctx->persist);
+  dev_cache_release(&ctx->cache);
+  dev_pool_destroy(ctx->pool);
+  staging_destroy(ctx->staging);
+  if(ctx->program)
+    clReleaseProgram(ctx->program);
+  if(ctx->context)
+    clReleaseContext(ctx->context);
+  free(ctx->devices);
+  free(ctx->bin_path);
+
+  pthread_mutex_destroy(&ctx->lock);
+  pthread_mutex_destroy(&ctx->config_lock);
+  free(ctx);
 }
 
 /**
@@ -164,37 +248,51 @@ void fpga_final(){
  * \param  out  : float2 pointer to output data of size [N * N]
  * \return fpga_t : time taken in milliseconds for data transfers and execution
  */
-fpga_t fpga_test(unsigned N, float2 *inp, float2 *out, bool interleaving){
-  fpga_t test_time = {0.0, 0.0, 0.0, 0};
+fpga_t fpga_ctx_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving){
+  return fpga_ctx_typed_test(ctx, N, FPGA_FLOAT2, inp, out);
+}
+
+/**
+ * \brief  blocking write and read back of N elements of type
+ * \param  N    : number of elements
+ * \param  type : element type of inp and out
+ * \param  inp  : pointer to input data of N elements
+ * \param  out  : pointer to output data of N elements
+ * \return fpga_t : time taken in milliseconds for data transfers
+ */
+fpga_t fpga_ctx_typed_test(fpga_ctx_t *ctx, size_t N, fpga_type_t type, const void *inp, void *out){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
   //cl_kernel test_kernel = NULL;
 
   cl_int status = 0;
-  size_t num_pts = N;
+  dev_array d_inData;
 
-  // if N is not a power of 2
-  if(inp == NULL || out == NULL || ( (N & (N-1)) !=0)){
+  if(ctx == NULL || N == 0 || !typed_data(type, inp, out)){
     return test_time;
   }
 
-  queue_setup();
+  queue_setup(ctx);
 
-  cl_mem_flags flagbuf;
-  flagbuf = CL_MEM_READ_WRITE;
-   
-  // Device memory buffers
-  cl_mem d_inData;
-  d_inData = clCreateBuffer(context, flagbuf, sizeof(float2) * num_pts, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
+  // split over several buffers beyond the maximum allocation
+  if(!dev_array_create(&d_inData, ctx->context, ctx->device, ctx->pool, N, fpga_type_size(type), 0)){
+    queue_cleanup(ctx);
+    return test_time;
+  }
 
  // Copy data from host to device
+  fpga_perf_begin(FPGA_PHASE_WRITE);
   test_time.pcie_write_t = getTimeinMilliSec();
 
-  status = clEnqueueWriteBuffer(queue1, d_inData, CL_TRUE, 0, sizeof(float2) * num_pts, inp, 0, NULL, NULL);
+  if(ctx->staging != NULL)
+    staging_array_write(ctx->staging, ctx->queue1, &d_inData, inp);
+  else
+    dev_array_write(ctx->queue1, &d_inData, inp);
 
-  status = clFinish(queue1);
+  TRACE(TRACE_FINISH, status = clFinish(ctx->queue1));
   checkError(status, "failed to finish");
 
   double temp_write = getTimeinMilliSec();
+  fpga_perf_end(FPGA_PHASE_WRITE);
   //printf("Write before - %lf, Write after - %lf \n", test_time.pcie_write_t, temp_write);
   test_time.pcie_write_t = temp_write - test_time.pcie_write_t;
   checkError(status, "Failed to copy data to device");
@@ -218,21 +316,25 @@ fpga_t fpga_test(unsigned N, float2 *inp, float2 *out, bool interleaving){
   test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
   */
   // Copy results from device to host
+  fpga_perf_begin(FPGA_PHASE_READ);
   test_time.pcie_read_t = getTimeinMilliSec();
-  status = clEnqueueReadBuffer(queue1, d_inData, CL_TRUE, 0, sizeof(float2) * num_pts, out, 0, NULL, NULL);
+  if(ctx->staging != NULL)
+    staging_array_read(ctx->staging, ctx->queue1, &d_inData, out);
+  else
+    dev_array_read(ctx->queue1, &d_inData, out);
 
-  status = clFinish(queue1);
+  TRACE(TRACE_FINISH, status = clFinish(ctx->queue1));
   checkError(status, "failed to finish reading buffer using PCIe");
 
   double temp_read = getTimeinMilliSec();
+  fpga_perf_end(FPGA_PHASE_READ);
   //printf("Read before - %lf, Read after - %lf \n", test_time.pcie_read_t, temp_read);
   test_time.pcie_read_t = temp_read - test_time.pcie_read_t;
   checkError(status, "Failed to copy data from device");
 
-  queue_cleanup();
+  dev_array_release(&d_inData);
 
-  if (d_inData)
-  	clReleaseMemObject(d_inData);
+  queue_cleanup(ctx);
 
   /*
   if(test_kernel) 
@@ -243,58 +345,31 @@ fpga_t fpga_test(unsigned N, float2 *inp, float2 *out, bool interleaving){
   return test_time;
 }
 
-int fpga_initialize_withBuf(const char *platform_name, const char *path, bool use_svm, unsigned N){
-  cl_int status = 0;
-
-#ifdef VERBOSE
-  printf("\tInitializing FPGA ...\n");
-#endif
+/** 
+ * @brief Create a handle with persistent device buffers of N points used by
+ *        fpga_ctx_test_bufPersist, split beyond the maximum allocation
+ * @return error codes of fpga_ctx_create, -7 if N points do not fit on the
+ *         device
+ */
+int fpga_ctx_create_withBuf(fpga_ctx_t **ctx, const char *platform_name, const char *path, bool use_svm, size_t N){
 
-  // Path to binary missing
-  if(path == NULL || strlen(path) == 0){
-    return -1;
+  int isInit = fpga_ctx_create(ctx, platform_name, path, use_svm);
+  if(isInit != 0){
+    return isInit;
   }
 
-  // Check if this has to be sent as a pointer or value
-  // Get the OpenCL platform.
-  platform = findPlatform(platform_name);
-  // Unable to find given OpenCL platform
-  if(platform == NULL){
-    return -2;
-  }
-  // Query the available OpenCL devices.
-  cl_uint num_devices;
-  devices = getDevices(platform, CL_DEVICE_TYPE_ALL, &num_devices);
-  // Unable to find device for the OpenCL platform
-  if(devices == NULL){
-    return -3;
+  // Device memory buffers
+  if(!dev_array_create(&(*ctx)->persist, (*ctx)->context, (*ctx)->device, NULL, N, sizeof(float2), 0)){
+    fpga_ctx_destroy(*ctx);
+    *ctx = NULL;
+    return -7;
   }
-
-  // use the first device.
-  device = devices[0];
-
-  if(use_svm){
-    if(!check_valid_svm_device(device)){
-      return -5;
-    }
-    else{
-      printf("Supports SVM \n");
-      svm_enabled = 1;
-    }
+  if(!dev_cache_init(&(*ctx)->cache, (*ctx)->persist.count)){
+    fpga_ctx_destroy(*ctx);
+    *ctx = NULL;
+    return -6;
   }
 
-  // Create the context.
-  context = clCreateContext(NULL, 1, &device, NULL, NULL, &status);
-  checkError(status, "Failed to create context");
-
-  cl_mem_flags flagbuf;
-  flagbuf = CL_MEM_READ_WRITE;
-  size_t num_pts = N;
-   
-  // Device memory buffers
-  d_inData_persist = clCreateBuffer(context, flagbuf, sizeof(float2) * num_pts, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
-
   return 0;
 }
 
@@ -306,207 +381,1159 @@ int fpga_initialize_withBuf(const char *platform_name, const char *path, bool us
  * \param  out  : float2 pointer to output data of size [N * N]
  * \return fpga_t : time taken in milliseconds for data transfers and execution
  */
-fpga_t fpga_test_bufPersist(unsigned N, float2 *inp, float2 *out, bool interleaving){
-  fpga_t test_time = {0.0, 0.0, 0.0, 0};
+fpga_t fpga_ctx_test_bufPersist(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
 
   cl_int status = 0;
-  size_t num_pts = N;
 
-  // if N is not a power of 2
-  if(inp == NULL || out == NULL || ( (N & (N-1)) !=0)){
+  // the persistent buffers hold N points
+  if(ctx == NULL || ctx->persist.count == 0 || inp == NULL || out == NULL || N != ctx->persist.total){
     return test_time;
   }
 
-  queue_setup();
+  queue_setup(ctx);
 
  // Copy data from host to device
+  fpga_perf_begin(FPGA_PHASE_WRITE);
   test_time.pcie_write_t = getTimeinMilliSec();
 
-  status = clEnqueueWriteBuffer(queue1, d_inData_persist, CL_TRUE, 0, sizeof(float2) * num_pts, inp, 0, NULL, NULL);
+  // buffers holding the data of inp already are skipped if the cache is on,
+  // the ring stages whole uploads only
+  if(ctx->staging != NULL && ctx->cache.mode == FPGA_CACHE_OFF)
+    staging_array_write(ctx->staging, ctx->queue1, &ctx->persist, inp);
+  else
+    dev_cache_write(&ctx->cache, ctx->queue1, &ctx->persist, inp);
 
-  status = clFinish(queue1);
+  TRACE(TRACE_FINISH, status = clFinish(ctx->queue1));
   checkError(status, "failed to finish");
 
   double temp_write = getTimeinMilliSec();
+  fpga_perf_end(FPGA_PHASE_WRITE);
   test_time.pcie_write_t = temp_write - test_time.pcie_write_t;
   checkError(status, "Failed to copy data to device");
 
+  fpga_perf_begin(FPGA_PHASE_READ);
   test_time.pcie_read_t = getTimeinMilliSec();
-  status = clEnqueueReadBuffer(queue1, d_inData_persist, CL_TRUE, 0, sizeof(float2) * num_pts, out, 0, NULL, NULL);
+  if(ctx->staging != NULL)
+    staging_array_read(ctx->staging, ctx->queue1, &ctx->persist, out);
+  else
+    dev_array_read(ctx->queue1, &ctx->persist, out);
 
-  status = clFinish(queue1);
+  TRACE(TRACE_FINISH, status = clFinish(ctx->queue1));
   checkError(status, "failed to finish reading buffer using PCIe");
 
   double temp_read = getTimeinMilliSec();
+  fpga_perf_end(FPGA_PHASE_READ);
   test_time.pcie_read_t = temp_read - test_time.pcie_read_t;
   checkError(status, "Failed to copy data from device");
 
-  queue_cleanup();
+  queue_cleanup(ctx);
 
   test_time.valid = 1;
   return test_time;
 }
 
-void fpga_final_withBuf(){
-  if (d_inData_persist)
-  	clReleaseMemObject(d_inData_persist);
 
-  if(context)
-    clReleaseContext(context);
-  free(devices);
+/**
+ * \brief Set the mode of the cache of the persistent buffers
+ * \return false if the handle has no persistent buffers
+ */
+bool fpga_ctx_cache_set_mode(fpga_ctx_t *ctx, fpga_cache_mode_t mode){
+  if(ctx == NULL || ctx->persist.count == 0 || (unsigned)mode > FPGA_CACHE_DIRTY){
+    return false;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  dev_cache_set_mode(&ctx->cache, mode);
+  pthread_mutex_unlock(&ctx->lock);
+  return true;
+}
+
+/**
+ * \brief Set the version of a host buffer for the version mode of the cache
+ * \return false if the handle has no persistent buffers or too many host
+ *         buffers are tagged
+ */
+bool fpga_ctx_cache_tag(fpga_ctx_t *ctx, const void *host, uint64_t version){
+  if(ctx == NULL || ctx->persist.count == 0 || host == NULL){
+    return false;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  bool tagged = dev_cache_tag(&ctx->cache, host, version);
+  pthread_mutex_unlock(&ctx->lock);
+  return tagged;
+}
+
+void fpga_ctx_cache_invalidate(fpga_ctx_t *ctx){
+  if(ctx == NULL || ctx->persist.count == 0){
+    return;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  dev_cache_invalidate(&ctx->cache);
+  pthread_mutex_unlock(&ctx->lock);
+}
+
+void fpga_ctx_cache_stats(fpga_ctx_t *ctx, fpga_cache_stats_t *stats){
+  if(ctx == NULL){
+    memset(stats, 0, sizeof(fpga_cache_stats_t));
+    return;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  *stats = ctx->cache.stats;
+  pthread_mutex_unlock(&ctx->lock);
+}
+
+/**
+ * \brief Create and build the program from the binary path given during
+ *        initialization. Built once on first use by a test that requires a
+ *        kernel.
+ * \return program or NULL if the binary could not be loaded
+ */
+static cl_program program_setup(fpga_ctx_t *ctx){
+  cl_int status = 0;
+
+  pthread_mutex_lock(&ctx->lock);
+  if(ctx->program != NULL){
+    pthread_mutex_unlock(&ctx->lock);
+    return ctx->program;
+  }
+
+#ifdef VERBOSE
+  printf("\tGetting program binary from path %s ...\n", ctx->bin_path);
+#endif
+  ctx->program = getProgramWithBinary(ctx->context, &ctx->device, 1, ctx->bin_path);
+  if(ctx->program == NULL) {
+    fprintf(stderr, "Failed to create program\n");
+    pthread_mutex_unlock(&ctx->lock);
+    return NULL;
+  }
+
+#ifdef VERBOSE
+  printf("\tBuilding program ...\n");
+#endif
+  status = clBuildProgram(ctx->program, 0, NULL, "", NULL, NULL);
+  checkError(status, "Failed to build program");
+
+  pthread_mutex_unlock(&ctx->lock);
+  return ctx->program;
+}
+
+/**
+ * \brief Load the transfer profile of the board and BSP if one exists, 
+ *        otherwise keep the default configuration
+ */
+static void load_board_profile(fpga_ctx_t *ctx){
+  profile_path(ctx->profile_file, sizeof(ctx->profile_file), ctx->device);
+
+  if(load_profile(ctx->profile_file, &ctx->active_config, &ctx->model)){
+    if(ctx->active_config.use_svm && !ctx->svm_enabled){
+      ctx->active_config.use_svm = false;
+    }
+#ifdef VERBOSE
+    printf("\tLoaded transfer profile %s ...\n", ctx->profile_file);
+#endif
+  }
 }
 
+/**
+ * \brief  check that type is known and the data is aligned to it
+ * \return false otherwise
+ */
+static bool typed_data(fpga_type_t type, const void *inp, const void *out){
+  size_t align = fpga_type_align(type);
+  if(align == 0 || inp == NULL || out == NULL){
+    return false;
+  }
+  return ((uintptr_t)inp % align == 0) && ((uintptr_t)out % align == 0);
+}
 
 /**
- * \brief Create a command queue for each kernel
+ * \brief Create a command queue for each kernel. Takes the lock of the handle
+ *        until queue_cleanup, so tests on the same handle run one at a time.
  */
-void queue_setup(){
+static void queue_setup(fpga_ctx_t *ctx){
   cl_int status = 0;
+  TRACE_BEGIN(start);
+  pthread_mutex_lock(&ctx->lock);
   // Create one command queue for each kernel.
-  queue1 = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &status);
+  ctx->queue1 = clCreateCommandQueue(ctx->context, ctx->device, CL_QUEUE_PROFILING_ENABLE, &status);
   checkError(status, "Failed to create command queue1");
-  queue2 = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &status);
+  ctx->queue2 = clCreateCommandQueue(ctx->context, ctx->device, CL_QUEUE_PROFILING_ENABLE, &status);
   checkError(status, "Failed to create command queue2");
-  queue3 = clCreateCommandQueue(context, device, CL_QUEUE_PROFILING_ENABLE, &status);
+  ctx->queue3 = clCreateCommandQueue(ctx->context, ctx->device, CL_QUEUE_PROFILING_ENABLE, &status);
   checkError(status, "Failed to create command queue3");
+  TRACE_END(TRACE_QUEUE_SETUP, start);
 }
 
 /**
- * \brief Release all command queues
+ * \brief Release all command queues and the lock of the handle
  */
-void queue_cleanup() {
-  if(queue1) 
-    clReleaseCommandQueue(queue1);
-  if(queue2) 
-    clReleaseCommandQueue(queue2);
-  if(queue3) 
-    clReleaseCommandQueue(queue3);
+static void queue_cleanup(fpga_ctx_t *ctx){
+  TRACE_BEGIN(start);
+  if(ctx->queue1) 
+    clReleaseCommandQueue(ctx->queue1);
+  if(ctx->queue2) 
+    clReleaseCommandQueue(ctx->queue2);
+  if(ctx->queue3) 
+    clReleaseCommandQueue(ctx->queue3);
+  pthread_mutex_unlock(&ctx->lock);
+  TRACE_END(TRACE_QUEUE_CLEANUP, start);
 }
 
 /**
  * \brief nonblocking PCIe memory transfer test using explicit event based
- * synchronization
+ * synchronization. Batches larger than a device buffer can hold are split
+ * into chunks, which are double buffered like batches.
  * \param  N    : size of data
  * \param  inp  : float2 pointer to input data of size N * how_many
  * \param  out  : float2 pointer to output data of size N * how_many
  * \param  how_many : number of batch iterations
  * \return fpga_t : time taken in milliseconds for data transfers
  */
-fpga_t nb_pcie_test(unsigned N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
-  fpga_t test_time = {0.0, 0.0, 0.0, 0};
+fpga_t fpga_ctx_nb_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
   cl_mem d_inoutData[2];
+  dev_block d_blk[2];
   cl_int status = 0;
 
-  // if N is not a power of 2
-  if(inp == NULL || out == NULL || ( (N & (N-1)) !=0) || (how_many <= 1)){
+  if(ctx == NULL || inp == NULL || out == NULL || N == 0 || (how_many <= 1)){
     return test_time;
   }
 
-  queue_setup();
+  size_t total = N * how_many;
+  size_t chunk = split_points(N, max_points(ctx->device, sizeof(float2), 2));
+  size_t num_chunks = (total + chunk - 1) / chunk;
 
-  // Device Buffers
-  d_inoutData[0] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_CHANNEL_1_INTELFPGA, sizeof(float2) * N, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
+  queue_setup(ctx);
 
-  d_inoutData[1] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_CHANNEL_2_INTELFPGA, sizeof(float2) * N, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
-
-  cl_event writeEvent[1];
+  // Device Buffers
+  d_inoutData[0] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 0, 2, &d_blk[0]);
+  d_inoutData[1] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 1, 2, &d_blk[1]);
 
   test_time.exec_t = getTimeinMilliSec();
 
-  clEnqueueWriteBuffer(queue1, d_inoutData[0], CL_TRUE, 0, sizeof(float2) * N, inp, 0, NULL, NULL);
-  clFinish(queue1);
+  TRACE(TRACE_ENQUEUE_WRITE, clEnqueueWriteBuffer(ctx->queue1, d_inoutData[0], CL_TRUE, 0, sizeof(float2) * chunk, inp, 0, NULL, NULL));
+  TRACE(TRACE_FINISH, clFinish(ctx->queue1));
 
-  for(size_t i = 1; i < how_many; i++){
-    clEnqueueWriteBuffer(queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * N, &inp[i * N], 0, NULL, &writeEvent[0]);
+  // every step is synchronized on both queues, which needs no events
+  for(size_t i = 1; i < num_chunks; i++){
+    size_t len = (i == num_chunks - 1) ? total - i * chunk : chunk;
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * len, &inp[i * chunk], 0, NULL, NULL));
+    checkError(status, "Failed to write to DDR");
 
-    status = clEnqueueReadBuffer(queue2, d_inoutData[(i-1)%2], CL_FALSE, 0, sizeof(float2) * N, &out[(i-1) * N], 0, NULL, &writeEvent[1]);
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue2, d_inoutData[(i-1)%2], CL_FALSE, 0, sizeof(float2) * chunk, &out[(i-1) * chunk], 0, NULL, NULL));
     checkError(status, "Failed to read");
 
-    clWaitForEvents(2, writeEvent);
-    clReleaseEvent(writeEvent[0]);
-    clReleaseEvent(writeEvent[1]);
+    TRACE(TRACE_FINISH, clFinish(ctx->queue1));
+    TRACE(TRACE_FINISH, clFinish(ctx->queue2));
   }
 
-  status = clEnqueueReadBuffer(queue1, d_inoutData[(how_many-1) % 2], CL_FALSE, 0, sizeof(float2) * N, &out[(how_many - 1) * N], 0, NULL,  &writeEvent[0]);
+  size_t last_len = total - (num_chunks - 1) * chunk;
+  TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue1, d_inoutData[(num_chunks-1) % 2], CL_FALSE, 0, sizeof(float2) * last_len, &out[(num_chunks - 1) * chunk], 0, NULL, NULL));
   checkError(status, "Failed to read");
 
-  clWaitForEvents(1, &writeEvent[0]);
-  clReleaseEvent(writeEvent[0]);
+  TRACE(TRACE_FINISH, clFinish(ctx->queue1));
 
   test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
 
-  queue_cleanup();
+  queue_cleanup(ctx);
 
-  if (d_inoutData[0])
-  	clReleaseMemObject(d_inoutData[0]);
-  if (d_inoutData[1])
-  	clReleaseMemObject(d_inoutData[1]);
+  dev_pool_release(ctx->pool, &d_blk[0]);
+  dev_pool_release(ctx->pool, &d_blk[1]);
 
   test_time.valid = 1;
   return test_time;
 }
 
 /**
- * \brief nonblocking PCIe memory transfer test using wait list events 
+ * \brief nonblocking PCIe memory transfer test using wait list events. 
+ *        Batches larger than a device buffer can hold are split into chunks
+ *        that are pipelined like batches, without a gap between the pieces.
  * \param  N    : size of data
  * \param  inp  : float2 pointer to input data of size N * how_many
  * \param  out  : float2 pointer to output data of size N * how_many
  * \param  how_many : number of batch iterations
  * \return fpga_t : time taken in milliseconds for data transfers
  */
-fpga_t nb_event_pcie_test(unsigned N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
-  fpga_t test_time = {0.0, 0.0, 0.0, 0};
+fpga_t fpga_ctx_nb_event_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
   cl_mem d_inoutData[2];
+  dev_block d_blk[2];
   cl_int status = 0;
 
-  // if N is not a power of 2
-  if(inp == NULL || out == NULL || ( (N & (N-1)) !=0) || (how_many <= 1)){
+  if(ctx == NULL || inp == NULL || out == NULL || N == 0 || (how_many <= 1)){
     return test_time;
   }
 
-  queue_setup();
+  size_t total = N * how_many;
+  size_t chunk = split_points(N, max_points(ctx->device, sizeof(float2), 2));
+  size_t num_chunks = (total + chunk - 1) / chunk;
 
-  // Device Buffers
-  d_inoutData[0] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_CHANNEL_1_INTELFPGA, sizeof(float2) * N, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
+  queue_setup(ctx);
 
-  d_inoutData[1] = clCreateBuffer(context, CL_MEM_READ_WRITE | CL_CHANNEL_2_INTELFPGA, sizeof(float2) * N, NULL, &status);
-  checkError(status, "Failed to allocate input device buffer\n");
+  // Device Buffers
+  d_inoutData[0] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 0, 2, &d_blk[0]);
+  d_inoutData[1] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 1, 2, &d_blk[1]);
   
-  cl_event writeEvent[2], readEvent[2];
-
-  test_time.exec_t = getTimeinMilliSec();
-
-  for(size_t i = 0; i < how_many; i++){
-  if(i < 2){
-      status = clEnqueueWriteBuffer(queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * N, &inp[i * N], 0, NULL, &writeEvent[i]);
+  // a buffer is reused every 2 chunks, so 2 slots of each keep the pipeline 
+  // full while bounding the events alive for any batch
+  event_ring writeEvents, readEvents;
+  event_ring_init(&writeEvents, 2);
+  event_ring_init(&readEvents, 2);
+
+  // first write and last read bound the device time of the batch
+  cl_event first = NULL, last = NULL;
+  double start = getTimeinMilliSec();
+
+  for(size_t i = 0; i < num_chunks; i++){
+    size_t len = (i == num_chunks - 1) ? total - i * chunk : chunk;
+    if(i < 2){
+      TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * len, &inp[i * chunk], 0, NULL, event_ring_acquire(&writeEvents, i)));
       checkError(status, "Failed to write to DDR");
-      clFlush(queue1);
+      TRACE(TRACE_FLUSH, clFlush(ctx->queue1));
+      if(i == 0){
+        first = event_ring_keep(&writeEvents, i);
+      }
     }
     else{
-      status = clEnqueueWriteBuffer(queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * N, &inp[i * N], 1, &readEvent[i-2], &writeEvent[i]);
+      TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * len, &inp[i * chunk], 1, event_ring_get(&readEvents, i-2), event_ring_acquire(&writeEvents, i)));
       checkError(status, "Failed to write to DDR");
-      clFlush(queue1);
+      TRACE(TRACE_FLUSH, clFlush(ctx->queue1));
+      event_ring_release(&readEvents, i-2);
     }
 
-    status = clEnqueueReadBuffer(queue2, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * N, &out[i * N], 1, &writeEvent[i], &readEvent[i]);
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue2, d_inoutData[i%2], CL_FALSE, 0, sizeof(float2) * len, &out[i * chunk], 1, event_ring_get(&writeEvents, i), event_ring_acquire(&readEvents, i)));
     checkError(status, "Failed to read");
-    clFlush(queue2);
+    TRACE(TRACE_FLUSH, clFlush(ctx->queue2));
+    if(i == num_chunks - 1){
+      last = event_ring_keep(&readEvents, i);
+    }
+    event_ring_release(&writeEvents, i);
+  }
+  test_time.submit_t = getTimeinMilliSec() - start;
+
+  // reads are in order on queue2, the batch completes with its last read
+  TRACE(TRACE_WAIT, status = clWaitForEvents(1, &last));
+  checkError(status, "Failed to wait for last read");
+  test_time.exec_t = getTimeinMilliSec() - start;
+  test_time.device_t = event_elapsed(first, last);
+
+  clReleaseEvent(first);
+  clReleaseEvent(last);
+
+  // the last reads have no consumer in the pipeline
+  event_ring_drain(&readEvents);
+
+  queue_cleanup(ctx);
+
+  dev_pool_release(ctx->pool, &d_blk[0]);
+  dev_pool_release(ctx->pool, &d_blk[1]);
+
+  test_time.valid = 1;
+  return test_time;
+}
+
+/**
+ * \brief nonblocking PCIe memory transfer test with a submission thread per
+ *        queue. The calling thread only hands over transfer descriptors, the
+ *        write thread enqueues on queue1 and the read thread on queue2.
+ * \param  N    : size of data
+ * \param  inp  : float2 pointer to input data of size N * how_many
+ * \param  out  : float2 pointer to output data of size N * how_many
+ * \param  how_many : number of batch iterations
+ * \return fpga_t : submit_t time the caller spent submitting, exec_t time
+ *                  until all transfers completed, device_t device time, 
+ *                  in milliseconds
+ */
+fpga_t fpga_ctx_nb_thread_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  cl_mem d_inoutData[2];
+  dev_block d_blk[2];
+  event_table writeEvents, readEvents;
+  submitter writer, reader;
+  cl_int status = 0;
+
+  if(ctx == NULL || inp == NULL || out == NULL || N == 0 || (how_many <= 1)){
+    return test_time;
+  }
+
+  // batches beyond a device buffer are split into chunks
+  size_t total = N * how_many;
+  size_t chunk = split_points(N, max_points(ctx->device, sizeof(float2), 2));
+  size_t num_chunks = (total + chunk - 1) / chunk;
+
+  if(!event_table_init(&writeEvents, num_chunks)){
+    return test_time;
+  }
+  if(!event_table_init(&readEvents, num_chunks)){
+    event_table_release(&writeEvents);
+    return test_time;
+  }
+
+  queue_setup(ctx);
+
+  // Device Buffers
+  d_inoutData[0] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 0, 2, &d_blk[0]);
+  d_inoutData[1] = dev_pool_buffer(ctx->pool, ctx->context, sizeof(float2) * chunk, 1, 2, &d_blk[1]);
+
+  // without both threads nothing is submitted, stop a thread that started
+  bool started = submitter_start(&writer, ctx->queue1);
+  if(!started || !submitter_start(&reader, ctx->queue2)){
+    if(started)
+      submitter_stop(&writer);
+    event_table_release(&writeEvents);
+    event_table_release(&readEvents);
+    dev_pool_release(ctx->pool, &d_blk[0]);
+    dev_pool_release(ctx->pool, &d_blk[1]);
+    queue_cleanup(ctx);
+    return test_time;
+  }
+
+  test_time.exec_t = getTimeinMilliSec();
+
+  for(size_t i = 0; i < num_chunks; i++){
+    size_t len = (i == num_chunks - 1) ? total - i * chunk : chunk;
+
+    // write waits on the read of the chunk that last used the buffer
+    transfer_desc wr = {SUBMIT_WRITE, d_inoutData[i%2], sizeof(float2) * len, &inp[i * chunk], (i < 2) ? NULL : &readEvents, (i < 2) ? 0 : i - 2, &writeEvents, i};
+    submitter_push(&writer, &wr);
+
+    transfer_desc rd = {SUBMIT_READ, d_inoutData[i%2], sizeof(float2) * len, &out[i * chunk], &writeEvents, i, &readEvents, i};
+    submitter_push(&reader, &rd);
   }
 
+  test_time.submit_t = getTimeinMilliSec() - test_time.exec_t;
+
+  submitter_stop(&writer);
+  submitter_stop(&reader);
+
+  // reads complete in order on queue2
+  TRACE(TRACE_WAIT, status = clWaitForEvents(1, &readEvents.events[num_chunks - 1]));
+  checkError(status, "Failed to wait for reads");
+
   test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+  test_time.device_t = event_elapsed(writer.first, readEvents.events[num_chunks - 1]);
+  clReleaseEvent(writer.first);
+  clReleaseEvent(reader.first);
 
-  queue_cleanup();
+#ifdef VERBOSE
+  printf("\tWrite thread: %lu transfers, %lfms enqueue\n", writer.count, writer.busy_t);
+  printf("\tRead thread : %lu transfers, %lfms enqueue\n", reader.count, reader.busy_t);
+#endif
 
-  /*
-  if (d_inoutData[0])
-  	clReleaseMemObject(d_inoutData[0]);
-  if (d_inoutData[1])
-  	clReleaseMemObject(d_inoutData[1]);
-  */
+  event_table_release(&writeEvents);
+  event_table_release(&readEvents);
+
+  queue_cleanup(ctx);
+
+  dev_pool_release(ctx->pool, &d_blk[0]);
+  dev_pool_release(ctx->pool, &d_blk[1]);
 
   test_time.valid = 1;
   return test_time;
 }
+
+
+/**
+ * \brief  Check if SVM was requested and is supported by the device
+ * \return true if SVM transfers are used by svm_pcie_test
+ */
+bool fpga_ctx_svm_enabled(fpga_ctx_t *ctx){
+  return (ctx != NULL && ctx->svm_enabled == 1);
+}
+
+/**
+ * \brief nonblocking PCIe memory transfer test using coarse grained SVM 
+ *        buffers that are mapped and unmapped. Falls back to 
+ *        nb_event_pcie_test if SVM is not enabled.
+ * \param  N    : size of data
+ * \param  inp  : float2 pointer to input data of size N * how_many
+ * \param  out  : float2 pointer to output data of size N * how_many
+ * \param  how_many   : number of batch iterations
+ * \param  use_kernel : copy each chunk on the device using the svm_copy kernel
+ * \return fpga_t : time taken in milliseconds for data transfers
+ */
+fpga_t fpga_ctx_svm_pcie_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many, bool use_kernel){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  cl_kernel svm_kernel = NULL;
+  cl_int status = 0;
+
+  if(ctx != NULL && !ctx->svm_enabled){
+    return fpga_ctx_nb_event_pcie_test(ctx, N, inp, out, false, how_many);
+  }
+
+  if(ctx == NULL || inp == NULL || out == NULL || N == 0 || (how_many < 1)){
+    return test_time;
+  }
+
+  if(use_kernel){
+    if(program_setup(ctx) == NULL){
+      return test_time;
+    }
+    svm_kernel = clCreateKernel(ctx->program, "svm_copy", &status);
+    checkError(status, "Failed to create svm_copy kernel");
+  }
+
+  queue_setup(ctx);
+
+  test_time.exec_t = getTimeinMilliSec();
+
+  // batches beyond the maximum allocation are streamed in chunks
+  size_t chunk = split_points(N, max_points(ctx->device, sizeof(float2), 0));
+  bool success = svm_stream(ctx->context, ctx->queue1, ctx->queue2, svm_kernel, chunk, N * how_many, sizeof(float2), inp, out);
+
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  queue_cleanup(ctx);
+
+  if(svm_kernel)
+    clReleaseKernel(svm_kernel);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief nonblocking PCIe memory transfer test that ships float2 data packed
+ *        as half2, halving the bytes over PCIe. Uses the unpack_half2 and 
+ *        pack_half2 kernels of the fp16 binary.
+ * \param  N    : size of data
+ * \param  inp  : float2 pointer to input data of size N * how_many
+ * \param  out  : float2 pointer to output data of size N * how_many
+ * \param  how_many : number of batch iterations
+ * \return fpga_t : exec_t time taken in milliseconds for data transfers,
+ *                  conv_t for host side conversions
+ */
+fpga_t fpga_ctx_fp16_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  cl_kernel unpack_kernel = NULL, pack_kernel = NULL;
+  cl_int status = 0;
+
+  if(ctx == NULL || inp == NULL || out == NULL || N == 0 || (how_many < 1)){
+    return test_time;
+  }
+
+  if(program_setup(ctx) == NULL){
+    return test_time;
+  }
+
+  size_t total = N * how_many;
+  half2 *h_inp = (half2 *)alignedMalloc(sizeof(half2) * total);
+  half2 *h_out = (half2 *)alignedMalloc(sizeof(half2) * total);
+  if(h_inp == NULL || h_out == NULL){
+    free(h_inp);
+    free(h_out);
+    return test_time;
+  }
+
+  unpack_kernel = clCreateKernel(ctx->program, "unpack_half2", &status);
+  checkError(status, "Failed to create unpack_half2 kernel");
+  pack_kernel = clCreateKernel(ctx->program, "pack_half2", &status);
+  checkError(status, "Failed to create pack_half2 kernel");
+
+  queue_setup(ctx);
+
+  test_time.conv_t = getTimeinMilliSec();
+  float2_to_half2(inp, h_inp, total);
+  test_time.conv_t = getTimeinMilliSec() - test_time.conv_t;
+
+  test_time.exec_t = getTimeinMilliSec();
+  // the float2 buffers bound the chunk
+  size_t chunk = split_points(N, max_points(ctx->device, sizeof(float2), 2));
+  bool success = fp16_stream(ctx->context, ctx->queue1, ctx->queue2, ctx->queue3, unpack_kernel, pack_kernel, chunk, total, h_inp, h_out, &test_time);
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  double temp_conv = getTimeinMilliSec();
+  half2_to_float2(h_out, out, total);
+  test_time.conv_t += getTimeinMilliSec() - temp_conv;
+
+  queue_cleanup(ctx);
+
+  clReleaseKernel(unpack_kernel);
+  clReleaseKernel(pack_kernel);
+  free(h_inp);
+  free(h_out);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief nonblocking PCIe memory transfer test with configurable chunk size,
+ *        pipeline depth, bank assignment, allocation type and queues
+ * \param  N    : size of data
+ * \param  inp  : float2 pointer to input data of size N * how_many
+ * \param  out  : float2 pointer to output data of size N * how_many
+ * \param  how_many : number of batch iterations
+ * \param  config   : transfer parameters, NULL for the active configuration
+ * \return fpga_t : time taken in milliseconds for data transfers
+ */
+fpga_t fpga_ctx_pipeline_test(fpga_ctx_t *ctx, size_t N, float2 *inp, float2 *out, unsigned how_many, const fpga_config_t *config){
+  return fpga_ctx_typed_pipeline_test(ctx, N, FPGA_FLOAT2, inp, out, how_many, config);
+}
+
+/**
+ * \brief pipelined transfer of how_many batches of N elements of type. 
+ *        Chunks are in elements and limited by the largest device buffer
+ *        of the element size.
+ * \param  type : element type of inp and out
+ * \return fpga_t : time taken in milliseconds for data transfers
+ */
+fpga_t fpga_ctx_typed_pipeline_test(fpga_ctx_t *ctx, size_t N, fpga_type_t type, const void *inp, void *out, unsigned how_many, const fpga_config_t *config){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  bool success = false;
+  fpga_config_t active;
+
+  if(ctx == NULL || N == 0 || (how_many < 1) || !typed_data(type, inp, out)){
+    return test_time;
+  }
+
+  // a copy, the active configuration may be set while the test runs
+  if(config == NULL){
+    fpga_ctx_get_config(ctx, &active);
+    config = &active;
+  }
+  if(config->depth == 0 || (config->use_svm && !ctx->svm_enabled)){
+    return test_time;
+  }
+
+  size_t elem = fpga_type_size(type);
+  size_t total = N * how_many;
+
+  // chunk and depth of the payload from the model of the board, SVM
+  // transfers are not modelled
+  fpga_model_t model;
+  if(config->use_model && !config->use_svm && fpga_ctx_get_model(ctx, &model)){
+    active = *config;
+    fpga_model_plan(&model, total, elem, max_points(ctx->device, elem, config->banks), &active);
+    config = &active;
+  }
+
+  // chunks beyond a device buffer are split, keeping depth transfers in 
+  // flight across the pieces
+  size_t chunk = (config->chunk == 0) ? N : config->chunk;
+  chunk = split_points(chunk, max_points(ctx->device, elem, config->use_svm ? 0 : config->banks));
+
+  queue_setup(ctx);
+  cl_command_queue queue_rd = (config->queues == 1) ? ctx->queue1 : ctx->queue2;
+
+  test_time.exec_t = getTimeinMilliSec();
+
+  if(config->use_svm){
+    success = svm_stream(ctx->context, ctx->queue1, queue_rd, NULL, chunk, total, elem, inp, out);
+  }
+  else{
+    fpga_config_t cfg = *config;
+    cfg.chunk = chunk;
+    success = pipeline_transfer(ctx->context, ctx->pool, ctx->queue1, queue_rd, &cfg, total, elem, inp, out, &test_time);
+  }
+
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  queue_cleanup(ctx);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief Latency of blocking write then read round trips of bytes on queue1.
+ *        The device buffer is created once and reused by every round, the
+ *        input changes every round so each read returns fresh data.
+ * \param  bytes   : bytes per transfer
+ * \param  rounds  : number of timed round trips
+ * \param  warmup  : untimed round trips
+ * \param  samples : round trip time of each round in microseconds
+ * \return fpga_t : time taken in milliseconds summed over the timed rounds
+ */
+fpga_t fpga_ctx_latency_test(fpga_ctx_t *ctx, size_t bytes, unsigned rounds, unsigned warmup, double *samples){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  cl_int status = 0;
+
+  // a single buffer, bytes is not split
+  if(ctx == NULL || bytes == 0 || rounds == 0 || samples == NULL || bytes > max_points(ctx->device, 1, 1)){
+    return test_time;
+  }
+
+  unsigned char *h_inp = (unsigned char *)alignedMalloc(bytes);
+  unsigned char *h_out = (unsigned char *)alignedMalloc(bytes);
+  if(h_inp == NULL || h_out == NULL){
+    free(h_inp);
+    free(h_out);
+    return test_time;
+  }
+  for(size_t i = 0; i < bytes; i++){
+    h_inp[i] = (unsigned char)i;
+  }
+
+  queue_setup(ctx);
+
+  dev_block d_blk;
+  cl_mem d_buf = dev_pool_buffer(ctx->pool, ctx->context, bytes, 0, 1, &d_blk);
+
+  bool match = true;
+  for(size_t r = 0; r < (size_t)warmup + rounds; r++){
+    h_inp[0] = (unsigned char)r;
+
+    double start = getTimeinMilliSec();
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_buf, CL_TRUE, 0, bytes, h_inp, 0, NULL, NULL));
+    checkError(status, "Failed to write to DDR");
+    double mid = getTimeinMilliSec();
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue1, d_buf, CL_TRUE, 0, bytes, h_out, 0, NULL, NULL));
+    checkError(status, "Failed to read");
+    double end = getTimeinMilliSec();
+
+    if(h_out[0] != h_inp[0]){
+      match = false;
+    }
+    if(r < warmup){
+      continue;
+    }
+
+    samples[r - warmup] = (end - start) * 1.0e3;
+    test_time.pcie_write_t += mid - start;
+    test_time.pcie_read_t += end - mid;
+    test_time.exec_t += end - start;
+  }
+
+  if(memcmp(h_inp, h_out, bytes) != 0){
+    match = false;
+  }
+
+  dev_pool_release(ctx->pool, &d_blk);
+  queue_cleanup(ctx);
+
+  free(h_inp);
+  free(h_out);
+
+  test_time.valid = match ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief Full duplex test with writes on queue1 and reads on queue2, each 
+ *        direction using its own DDR bank
+ * \param  chunk     : bytes per transfer
+ * \param  total     : bytes of both directions, rounded up to whole chunks
+ * \param  write_pct : percentage of total written
+ * \param  duplex    : per direction bandwidth over time, can be NULL
+ * \return fpga_t : device time of each direction and wall clock time in 
+ *                  milliseconds
+ */
+fpga_t fpga_ctx_duplex_test(fpga_ctx_t *ctx, size_t chunk, size_t total, unsigned write_pct, fpga_duplex_t *duplex){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+
+  if(ctx == NULL || chunk == 0 || total == 0 || write_pct > 100){
+    return test_time;
+  }
+
+  // each direction uses a bank, larger chunks are split
+  chunk = split_points(chunk, max_points(ctx->device, 1, 2));
+  size_t wr_bytes = total / 100 * write_pct + total % 100 * write_pct / 100;
+  size_t wr_count = (wr_bytes + chunk - 1) / chunk;
+  size_t rd_count = (total - wr_bytes + chunk - 1) / chunk;
+
+  queue_setup(ctx);
+
+  test_time.exec_t = getTimeinMilliSec();
+  bool success = duplex_stream(ctx->context, ctx->queue1, ctx->queue2, chunk, wr_count, rd_count, duplex, &test_time);
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  queue_cleanup(ctx);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief  Stream a file from disk through the device to an output file
+ * \param  inp_path : input file of float2 points
+ * \param  out_path : output file of the same size
+ * \param  file     : chunk and mode, host time of the file stages
+ * \return fpga_t : device time of each direction and wall clock time in
+ *                  milliseconds, valid set to 1 if successful
+ */
+fpga_t fpga_ctx_file_test(fpga_ctx_t *ctx, const char *inp_path, const char *out_path, fpga_file_t *file){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  fpga_config_t config;
+
+  if(ctx == NULL || inp_path == NULL || out_path == NULL || file == NULL){
+    return test_time;
+  }
+  fpga_ctx_get_config(ctx, &config);
+
+  // chunks beyond a device buffer are reduced to whole blocks, the chunk used
+  // is returned
+  size_t max_chunk = max_points(ctx->device, 4096, config.banks) * 4096;
+  if(file->chunk > max_chunk){
+    file->chunk = max_chunk;
+  }
+
+  queue_setup(ctx);
+  cl_command_queue queue_rd = (config.queues == 1) ? ctx->queue1 : ctx->queue2;
+
+  test_time.exec_t = getTimeinMilliSec();
+  bool success = file_stream(ctx->context, ctx->queue1, queue_rd, &config, inp_path, out_path, file, &test_time);
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  queue_cleanup(ctx);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief  Run a flow with the queues of the handle, the program is built if
+ *         the flow has a kernel stage
+ * \param  flow : flow with at least a source
+ * \return fpga_t : exec_t wall clock time of the run, pcie_write_t and
+ *                  pcie_read_t busy time of the H2D and D2H stages
+ */
+fpga_t fpga_ctx_flow_run(fpga_ctx_t *ctx, fpga_flow_t *flow){
+  fpga_t test_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  cl_program program = NULL;
+
+  if(ctx == NULL || flow == NULL){
+    return test_time;
+  }
+
+  if(flow_kernel(flow) != NULL){
+    program = program_setup(ctx);
+    if(program == NULL){
+      return test_time;
+    }
+  }
+
+  queue_setup(ctx);
+
+  test_time.exec_t = getTimeinMilliSec();
+  size_t max_chunk = max_points(ctx->device, sizeof(float2), 2) * sizeof(float2);
+  bool success = flow_run(flow, ctx->context, program, ctx->queue1, ctx->queue2, ctx->queue3, max_chunk, &test_time);
+  test_time.exec_t = getTimeinMilliSec() - test_time.exec_t;
+
+  queue_cleanup(ctx);
+
+  test_time.valid = success ? 1 : 0;
+  return test_time;
+}
+
+/**
+ * \brief  Open a coalescer of small transfers on the context of the handle,
+ *         it does not hold the handle
+ * \return coalescer or NULL if the arguments are invalid
+ */
+fpga_coalesce_t* fpga_ctx_coalesce_open(fpga_ctx_t *ctx, size_t capacity, size_t flush_bytes, double flush_us){
+  if(ctx == NULL || capacity == 0 || flush_bytes == 0 || flush_bytes > capacity || flush_us < 0.0 || capacity > max_points(ctx->device, 1, 1)){
+    return NULL;
+  }
+  return coalesce_create(ctx->context, ctx->device, capacity, flush_bytes, flush_us);
+}
+
+/**
+ * \brief  Reserve a buffer in each of banks DDR banks for the device buffers
+ *         of the tests, or release the pool if bytes is 0
+ * \return true if the pool was reserved or released
+ */
+bool fpga_ctx_pool_reserve(fpga_ctx_t *ctx, size_t bytes, unsigned banks){
+  if(ctx == NULL || (bytes > 0 && (banks == 0 || banks > FPGA_POOL_MAX_BANKS))){
+    return false;
+  }
+
+  // the lock of the handle, no test uses the old pool
+  queue_setup(ctx);
+  dev_pool_destroy(ctx->pool);
+  ctx->pool = (bytes > 0) ? dev_pool_create(ctx->context, ctx->device, ctx->queue1, bytes, banks) : NULL;
+  bool success = (bytes == 0 || ctx->pool != NULL);
+  queue_cleanup(ctx);
+
+  return success;
+}
+
+/**
+ * \brief  Usage of each bank of the pool of the handle
+ * \param  stats : FPGA_POOL_MAX_BANKS entries
+ * \return number of banks, 0 if no pool is reserved
+ */
+unsigned fpga_ctx_pool_stats(fpga_ctx_t *ctx, fpga_pool_stats_t *stats){
+  if(ctx == NULL || stats == NULL){
+    return 0;
+  }
+  return dev_pool_stats(ctx->pool, stats);
+}
+
+/**
+ * \brief  Reserve a ring of depth locked host buffers of chunk bytes that the
+ *         blocking tests stage user memory through, or release the ring if
+ *         chunk is 0
+ * \return true if the ring was reserved or released
+ */
+bool fpga_ctx_staging_reserve(fpga_ctx_t *ctx, size_t chunk, unsigned depth, unsigned threads){
+  if(ctx == NULL || (chunk > 0 && (depth == 0 || depth > FPGA_STAGING_MAX_DEPTH))){
+    return false;
+  }
+
+  // the lock of the handle, no test uses the old ring
+  queue_setup(ctx);
+  staging_destroy(ctx->staging);
+  ctx->staging = (chunk > 0) ? staging_create(chunk, depth, threads) : NULL;
+  bool success = (chunk == 0 || ctx->staging != NULL);
+  queue_cleanup(ctx);
+
+  return success;
+}
+
+/**
+ * \brief  Counters of the staging ring of the handle
+ * \return false if no ring is reserved
+ */
+bool fpga_ctx_staging_stats(fpga_ctx_t *ctx, fpga_staging_stats_t *stats){
+  if(ctx == NULL || stats == NULL){
+    return false;
+  }
+  pthread_mutex_lock(&ctx->lock);
+  bool reserved = (ctx->staging != NULL);
+  if(reserved)
+    staging_stats(ctx->staging, stats);
+  pthread_mutex_unlock(&ctx->lock);
+  return reserved;
+}
+
+/**
+ * \brief Get the active transfer configuration
+ */
+void fpga_ctx_get_config(fpga_ctx_t *ctx, fpga_config_t *config){
+  if(ctx == NULL){
+    fpga_config_t default_config = {0, 2, 2, 2, false, false};
+    *config = default_config;
+    return;
+  }
+  pthread_mutex_lock(&ctx->config_lock);
+  *config = ctx->active_config;
+  pthread_mutex_unlock(&ctx->config_lock);
+}
+
+/**
+ * \brief Set the active transfer configuration
+ */
+void fpga_ctx_set_config(fpga_ctx_t *ctx, const fpga_config_t *config){
+  if(ctx == NULL){
+    return;
+  }
+  pthread_mutex_lock(&ctx->config_lock);
+  ctx->active_config = *config;
+  pthread_mutex_unlock(&ctx->config_lock);
+}
+
+/**
+ * \brief Path of the transfer profile of the current board and BSP
+ */
+const char* fpga_ctx_profile_path(fpga_ctx_t *ctx){
+  return (ctx != NULL) ? ctx->profile_file : "";
+}
+
+/**
+ * \brief Board, BSP and OpenCL versions of the initialized FPGA
+ * \return true if FPGA is initialized
+ */
+bool fpga_ctx_get_environment(fpga_ctx_t *ctx, fpga_env_t *env){
+  if(ctx == NULL || ctx->device == NULL){
+    return false;
+  }
+
+  board_name(env->board, sizeof(env->board));
+  bsp_version(env->bsp, sizeof(env->bsp), ctx->device);
+  if(clGetDeviceInfo(ctx->device, CL_DEVICE_NAME, sizeof(env->device), env->device, NULL) != CL_SUCCESS){
+    snprintf(env->device, sizeof(env->device), "unknown");
+  }
+  if(clGetPlatformInfo(ctx->platform, CL_PLATFORM_VERSION, sizeof(env->platform), env->platform, NULL) != CL_SUCCESS){
+    snprintf(env->platform, sizeof(env->platform), "unknown");
+  }
+  return true;
+}
+
+/**
+ * \brief Search the transfer parameters for the fastest configuration and 
+ *        store it in the profile of the board
+ * \param  N        : number of points in each batch, any size the pipeline
+ *                    test accepts
+ * \param  how_many : number of batches
+ * \param  reps     : repetitions of each candidate configuration
+ * \param  best     : optional, filled with the fastest configuration
+ * \return 0 if successful, -1 if ctx is NULL or N, how_many or reps is 0,
+ *         -2 host allocation failed, -3 unable to write profile, -4 no
+ *         valid configuration, nothing is stored
+ */
+int fpga_ctx_autotune(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, fpga_config_t *best){
+  fpga_config_t tuned;
+  double bandwidth = 0.0;
+
+  if(ctx == NULL || N == 0 || how_many < 1 || reps < 1){
+    return -1;
+  }
+
+  int status = autotune_search(ctx, N, how_many, reps, (ctx->svm_enabled == 1), &tuned, &bandwidth);
+  if(status != 0){
+    return status;
+  }
+
+  fpga_ctx_set_config(ctx, &tuned);
+  if(best != NULL){
+    *best = tuned;
+  }
+
+  fpga_model_t model;
+  fpga_ctx_get_model(ctx, &model);
+  if(!save_profile(ctx->profile_file, &tuned, bandwidth, &model)){
+    return -3;
+  }
+  return 0;
+}
+
+/**
+ * \brief Model of the handle, fitted or loaded from the profile
+ * \return false if there is no valid model
+ */
+bool fpga_ctx_get_model(fpga_ctx_t *ctx, fpga_model_t *model){
+  if(ctx == NULL || model == NULL){
+    return false;
+  }
+  pthread_mutex_lock(&ctx->config_lock);
+  *model = ctx->model;
+  pthread_mutex_unlock(&ctx->config_lock);
+  return model->valid;
+}
+
+/**
+ * \brief  time each transfer size reps times after an untimed round and
+ *         store the median in microseconds. Single directions are blocking
+ *         transfers on queue1 timed by the wall clock. Duplex transfers write
+ *         the first and read the second buffer at the same time on queue1
+ *         and queue2 and are timed from their profiling events.
+ * \param  us : medians of write, read, duplex write and duplex read of each
+ *              size, in that order
+ */
+static void calibrate_sizes(fpga_ctx_t *ctx, const size_t *sizes, size_t num_sizes, unsigned reps, unsigned char *h_inp, unsigned char *h_out, double us[][4]){
+  cl_int status = 0;
+  dev_block blk[2];
+
+  cl_mem d_buf[2];
+  d_buf[0] = dev_pool_buffer(ctx->pool, ctx->context, sizes[num_sizes - 1], 0, 2, &blk[0]);
+  d_buf[1] = dev_pool_buffer(ctx->pool, ctx->context, sizes[num_sizes - 1], 1, 2, &blk[1]);
+
+  for(size_t s = 0; s < num_sizes; s++){
+    size_t bytes = sizes[s];
+    double wr[reps], rd[reps], dup_wr[reps], dup_rd[reps];
+
+    for(unsigned r = 0; r <= reps; r++){
+      double start = getTimeinMilliSec();
+      TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_buf[0], CL_TRUE, 0, bytes, h_inp, 0, NULL, NULL));
+      checkError(status, "Failed to write to DDR");
+      double mid = getTimeinMilliSec();
+      TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue1, d_buf[0], CL_TRUE, 0, bytes, h_out, 0, NULL, NULL));
+      checkError(status, "Failed to read");
+      double end = getTimeinMilliSec();
+
+      cl_event ev[2];
+      TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(ctx->queue1, d_buf[0], CL_FALSE, 0, bytes, h_inp, 0, NULL, &ev[0]));
+      checkError(status, "Failed to write to DDR");
+      TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(ctx->queue2, d_buf[1], CL_FALSE, 0, bytes, h_out, 0, NULL, &ev[1]));
+      checkError(status, "Failed to read");
+      TRACE(TRACE_FLUSH, clFlush(ctx->queue1));
+      TRACE(TRACE_FLUSH, clFlush(ctx->queue2));
+      TRACE(TRACE_WAIT, status = clWaitForEvents(2, ev));
+      checkError(status, "Failed to wait for duplex transfers");
+
+      // the first round is not timed
+      if(r > 0){
+        wr[r - 1] = (mid - start) * 1.0e3;
+        rd[r - 1] = (end - mid) * 1.0e3;
+        dup_wr[r - 1] = event_elapsed(ev[0], ev[0]) * 1.0e3;
+        dup_rd[r - 1] = event_elapsed(ev[1], ev[1]) * 1.0e3;
+      }
+      clReleaseEvent(ev[0]);
+      clReleaseEvent(ev[1]);
+    }
+
+    us[s][0] = model_median(wr, reps);
+    us[s][1] = model_median(rd, reps);
+    us[s][2] = model_median(dup_wr, reps);
+    us[s][3] = model_median(dup_rd, reps);
+  }
+
+  dev_pool_release(ctx->pool, &blk[0]);
+  dev_pool_release(ctx->pool, &blk[1]);
+}
+
+/**
+ * \brief Fit the PCIe model of the board to transfers of 4 KiB to 64 MiB, or
+ *        the largest buffer of a bank, and store it in the profile of the
+ *        board with the active configuration
+ * \param  reps  : repetitions of each size
+ * \param  model : optional, filled with the fitted model
+ * \return 0 if successful, -1 invalid arguments, -2 host allocation failed,
+ *         -3 unable to write profile, -4 no fit
+ */
+int fpga_ctx_calibrate(fpga_ctx_t *ctx, unsigned reps, fpga_model_t *model){
+  size_t sizes[CALIBRATE_MAX_SIZES], num_sizes = 0;
+  double us[CALIBRATE_MAX_SIZES][4], x[CALIBRATE_MAX_SIZES], y[CALIBRATE_MAX_SIZES];
+
+  if(ctx == NULL || reps < 1 || reps > 1000){
+    return -1;
+  }
+
+  size_t max_bytes = max_points(ctx->device, 1, 2);
+  for(size_t b = CALIBRATE_MIN_BYTES; b <= CALIBRATE_MAX_BYTES && b <= max_bytes; b *= 4){
+    sizes[num_sizes++] = b;
+  }
+  if(num_sizes < 2){
+    return -1;
+  }
+
+  size_t max_size = sizes[num_sizes - 1];
+  unsigned char *h_inp = (unsigned char *)alignedMalloc(max_size);
+  unsigned char *h_out = (unsigned char *)alignedMalloc(max_size);
+  if(h_inp == NULL || h_out == NULL){
+    free(h_inp);
+    free(h_out);
+    return -2;
+  }
+  for(size_t i = 0; i < max_size; i++){
+    h_inp[i] = (unsigned char)i;
+  }
+
+  queue_setup(ctx);
+  calibrate_sizes(ctx, sizes, num_sizes, reps, h_inp, h_out, us);
+  queue_cleanup(ctx);
+
+  free(h_inp);
+  free(h_out);
+
+  fpga_model_t fitted;
+  fpga_link_t *links[4] = {&fitted.write, &fitted.read, &fitted.duplex_write, &fitted.duplex_read};
+  for(unsigned l = 0; l < 4; l++){
+    for(size_t s = 0; s < num_sizes; s++){
+      x[s] = (double)sizes[s];
+      y[s] = us[s][l];
+    }
+    // duplex directions without profiling information stay unfitted
+    model_fit(x, y, num_sizes, links[l]);
+  }
+  fitted.valid = (fitted.write.bandwidth > 0.0 && fitted.read.bandwidth > 0.0);
+  if(!fitted.valid){
+    return -4;
+  }
+
+  fpga_config_t active;
+  pthread_mutex_lock(&ctx->config_lock);
+  ctx->model = fitted;
+  active = ctx->active_config;
+  pthread_mutex_unlock(&ctx->config_lock);
+
+  if(model != NULL){
+    *model = fitted;
+  }
+
+  if(!save_profile(ctx->profile_file, &active, 0.0, &fitted)){
+    return -3;
+  }
+  return 0;
+}
\ No newline at end of file
@@ -0,0 +1,319 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "coalesce.h"
+#include "trace.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+/**
+ * Read waiting for the next flush
+ */
+typedef struct coalesce_read {
+  size_t offset;        /**< bytes from the start of the arena */
+  size_t bytes;
+  void *dst;
+} coalesce_read;
+
+/**
+ * Small transfers packed into one staging buffer per direction. Writes are
+ * appended to a device arena, the writes staged since the last flush cover
+ * the end of the arena [end - staged, end). Reads are gathered as one span of
+ * the arena and scattered to their destinations after the flush.
+ */
+struct fpga_coalesce {
+  cl_command_queue queue;
+  cl_mem d_arena;
+  size_t capacity;          /**< bytes of the arena */
+  size_t flush_bytes;       /**< bytes of each staging buffer */
+  double flush_us;          /**< age of a pending request that flushes, 0 for none */
+  unsigned char *stage_wr;
+  unsigned char *stage_rd;
+  bool pinned;              /**< staging buffers locked in memory */
+  size_t end;               /**< bytes of the arena written or staged */
+  size_t staged;            /**< bytes of pending writes */
+  coalesce_read *reads;
+  size_t num_reads, max_reads;
+  size_t rd_lo, rd_hi;      /**< span of the pending reads */
+  double oldest;            /**< time of the oldest pending request in ms */
+  fpga_coalesce_stats_t stats;
+};
+
+// function prototypes
+static bool coalesce_check(fpga_coalesce_t *co);
+static void direct_write(fpga_coalesce_t *co, size_t offset, const void *src, size_t bytes);
+static void direct_read(fpga_coalesce_t *co, size_t offset, void *dst, size_t bytes);
+
+/**
+ * \brief  Create a coalescer with its own queue, so that it can be used
+ *         while tests run on the handle
+ * \param  capacity    : bytes of the device arena
+ * \param  flush_bytes : bytes of each staging buffer, pending requests are
+ *                       flushed once they fill it
+ * \param  flush_us    : pending requests are flushed once the oldest is
+ *                       older, 0 to flush by size only
+ * \return coalescer or NULL if allocation failed
+ */
+fpga_coalesce_t* coalesce_create(cl_context context, cl_device_id device, size_t capacity, size_t flush_bytes, double flush_us){
+  cl_int status = 0;
+
+  fpga_coalesce_t *co = (fpga_coalesce_t *)calloc(1, sizeof(fpga_coalesce_t));
+  if(co == NULL){
+    return NULL;
+  }
+  co->capacity = capacity;
+  co->flush_bytes = flush_bytes;
+  co->flush_us = flush_us;
+  co->max_reads = 64;
+  co->reads = (coalesce_read *)malloc(co->max_reads * sizeof(coalesce_read));
+  co->stage_wr = (unsigned char *)alignedMalloc(flush_bytes);
+  co->stage_rd = (unsigned char *)alignedMalloc(flush_bytes);
+  if(co->reads == NULL || co->stage_wr == NULL || co->stage_rd == NULL){
+    fpga_coalesce_close(co);
+    return NULL;
+  }
+
+  // locked pages are not swapped or migrated under a DMA, best effort as
+  // the limit of locked memory may be small
+  co->pinned = (mlock(co->stage_wr, flush_bytes) == 0);
+  if(co->pinned && mlock(co->stage_rd, flush_bytes) != 0){
+    munlock(co->stage_wr, flush_bytes);
+    co->pinned = false;
+  }
+
+  co->queue = clCreateCommandQueue(context, device, 0, &status);
+  checkError(status, "Failed to create coalescing queue");
+
+  TRACE(TRACE_CREATE_BUFFER, co->d_arena = clCreateBuffer(context, CL_MEM_READ_WRITE, capacity, NULL, &status));
+  checkError(status, "Failed to allocate coalescing arena");
+
+  return co;
+}
+
+/**
+ * \brief  Stage a write of bytes to the end of the arena. Writes larger than
+ *         the staging buffer are transferred directly after a flush.
+ * \param  offset : bytes from the start of the arena the data is written to
+ * \return false if the arguments are invalid or the arena is full
+ */
+bool fpga_coalesce_write(fpga_coalesce_t *co, const void *src, size_t bytes, size_t *offset){
+  if(co == NULL || src == NULL || bytes == 0 || bytes > co->capacity - co->end){
+    return false;
+  }
+
+  if(bytes > co->flush_bytes){
+    fpga_coalesce_flush(co);
+    direct_write(co, co->end, src, bytes);
+  }
+  else{
+    if(co->staged + bytes > co->flush_bytes){
+      fpga_coalesce_flush(co);
+    }
+    if(co->oldest == 0.0){
+      co->oldest = getTimeinMilliSec();
+    }
+    memcpy(co->stage_wr + co->staged, src, bytes);
+    co->staged += bytes;
+  }
+
+  if(offset != NULL){
+    *offset = co->end;
+  }
+  co->end += bytes;
+  co->stats.writes++;
+  co->stats.bytes += bytes;
+
+  coalesce_check(co);
+  return true;
+}
+
+/**
+ * \brief  Queue a read of bytes of the arena into dst, dst is filled by the
+ *         flush that includes the read. Reads whose span with the pending
+ *         reads exceeds the staging buffer flush the pending reads first.
+ * \return false if the arguments are invalid or the range was not written
+ */
+bool fpga_coalesce_read(fpga_coalesce_t *co, size_t offset, size_t bytes, void *dst){
+  if(co == NULL || dst == NULL || bytes == 0 || offset > co->end || bytes > co->end - offset){
+    return false;
+  }
+  co->stats.reads++;
+  co->stats.bytes += bytes;
+
+  if(bytes > co->flush_bytes){
+    fpga_coalesce_flush(co);
+    direct_read(co, offset, dst, bytes);
+    return true;
+  }
+
+  size_t lo = offset, hi = offset + bytes;
+  if(co->num_reads > 0){
+    lo = (co->rd_lo < lo) ? co->rd_lo : lo;
+    hi = (co->rd_hi > hi) ? co->rd_hi : hi;
+    if(hi - lo > co->flush_bytes){
+      fpga_coalesce_flush(co);
+      lo = offset;
+      hi = offset + bytes;
+    }
+  }
+
+  if(co->num_reads == co->max_reads){
+    coalesce_read *grown = (coalesce_read *)realloc(co->reads, 2 * co->max_reads * sizeof(coalesce_read));
+    if(grown == NULL){
+      fpga_coalesce_flush(co);
+      direct_read(co, offset, dst, bytes);
+      return true;
+    }
+    co->reads = grown;
+    co->max_reads *= 2;
+  }
+
+  if(co->oldest == 0.0){
+    co->oldest = getTimeinMilliSec();
+  }
+  coalesce_read *r = &co->reads[co->num_reads++];
+  r->offset = offset;
+  r->bytes = bytes;
+  r->dst = dst;
+  co->rd_lo = lo;
+  co->rd_hi = hi;
+
+  coalesce_check(co);
+  return true;
+}
+
+/**
+ * \brief  Transfer the staged writes in one write and the span of the
+ *         pending reads in one read, then scatter the reads. Writes are
+ *         enqueued first, so reads of staged data see it.
+ * \return true, errors of the runtime exit
+ */
+bool fpga_coalesce_flush(fpga_coalesce_t *co){
+  cl_int status = 0;
+
+  if(co == NULL){
+    return false;
+  }
+  if(co->staged == 0 && co->num_reads == 0){
+    return true;
+  }
+
+  double start = getTimeinMilliSec();
+
+  if(co->staged > 0){
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(co->queue, co->d_arena, CL_FALSE, co->end - co->staged, co->staged, co->stage_wr, 0, NULL, NULL));
+    checkError(status, "Failed to write coalesced requests");
+    co->stats.transfers++;
+  }
+
+  if(co->num_reads > 0){
+    // the queue is in order, the read completes after the write
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(co->queue, co->d_arena, CL_TRUE, co->rd_lo, co->rd_hi - co->rd_lo, co->stage_rd, 0, NULL, NULL));
+    checkError(status, "Failed to read coalesced requests");
+    co->stats.transfers++;
+
+    for(size_t i = 0; i < co->num_reads; i++){
+      const coalesce_read *r = &co->reads[i];
+      memcpy(r->dst, co->stage_rd + (r->offset - co->rd_lo), r->bytes);
+    }
+  }
+  else{
+    TRACE(TRACE_FINISH, status = clFinish(co->queue));
+    checkError(status, "Failed to finish coalesced writes");
+  }
+
+  co->staged = 0;
+  co->num_reads = 0;
+  co->oldest = 0.0;
+  co->stats.flushes++;
+  co->stats.flush_t += getTimeinMilliSec() - start;
+  return true;
+}
+
+/**
+ * \brief  Flush if the oldest pending request is older than the time
+ *         threshold, for callers that stop issuing requests for a while
+ * \return true if flushed
+ */
+bool fpga_coalesce_poll(fpga_coalesce_t *co){
+  return (co != NULL) && coalesce_check(co);
+}
+
+/**
+ * \brief  Flush and rewind the arena, offsets handed out before are reused
+ */
+void fpga_coalesce_reset(fpga_coalesce_t *co){
+  if(co == NULL){
+    return;
+  }
+  fpga_coalesce_flush(co);
+  co->end = 0;
+}
+
+void fpga_coalesce_stats(const fpga_coalesce_t *co, fpga_coalesce_stats_t *stats){
+  if(co == NULL){
+    memset(stats, 0, sizeof(fpga_coalesce_stats_t));
+    return;
+  }
+  *stats = co->stats;
+}
+
+/**
+ * \brief  Flush pending requests and release the coalescer
+ */
+void fpga_coalesce_close(fpga_coalesce_t *co){
+  if(co == NULL){
+    return;
+  }
+  if(co->queue){
+    fpga_coalesce_flush(co);
+    clReleaseCommandQueue(co->queue);
+  }
+  if(co->d_arena){
+    TRACE(TRACE_RELEASE_BUFFER, clReleaseMemObject(co->d_arena));
+  }
+  if(co->pinned){
+    munlock(co->stage_wr, co->flush_bytes);
+    munlock(co->stage_rd, co->flush_bytes);
+  }
+  free(co->stage_wr);
+  free(co->stage_rd);
+  free(co->reads);
+  free(co);
+}
+
+/**
+ * \brief  flush once a staging buffer is full or the oldest pending request
+ *         is older than the time threshold
+ * \return true if flushed
+ */
+static bool coalesce_check(fpga_coalesce_t *co){
+  bool full = (co->staged == co->flush_bytes) || (co->num_reads > 0 && co->rd_hi - co->rd_lo == co->flush_bytes);
+  bool aged = (co->flush_us > 0.0 && co->oldest > 0.0 && (getTimeinMilliSec() - co->oldest) * 1.0e3 >= co->flush_us);
+
+  if(full || aged){
+    return fpga_coalesce_flush(co);
+  }
+  return false;
+}
+
+static void direct_write(fpga_coalesce_t *co, size_t offset, const void *src, size_t bytes){
+  cl_int status = 0;
+  TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(co->queue, co->d_arena, CL_TRUE, offset, bytes, src, 0, NULL, NULL));
+  checkError(status, "Failed to write request");
+  co->stats.transfers++;
+}
+
+static void direct_read(fpga_coalesce_t *co, size_t offset, void *dst, size_t bytes){
+  cl_int status = 0;
+  TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(co->queue, co->d_arena, CL_TRUE, offset, bytes, dst, 0, NULL, NULL));
+  checkError(status, "Failed to read request");
+  co->stats.transfers++;
+}
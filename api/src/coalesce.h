@@ -0,0 +1,10 @@
+// Author: Arjun Ramaswami
+
+#ifndef COALESCE_H
+#define COALESCE_H
+
+#include <stdbool.h>
+
+fpga_coalesce_t* coalesce_create(cl_context context, cl_device_id device, size_t capacity, size_t flush_bytes, double flush_us);
+
+#endif // COALESCE_H
@@ -0,0 +1,167 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+
+#include "bare.h"
+
+// handle of the functions without a handle, see fpga_initialize()
+static fpga_ctx_t *default_ctx = NULL;
+
+/**
+ * @brief Initialize FPGA, creates the default handle
+ * @return error codes of fpga_ctx_create
+ */
+int fpga_initialize(const char *platform_name, const char *path, bool use_svm){
+  fpga_ctx_destroy(default_ctx);
+  return fpga_ctx_create(&default_ctx, platform_name, path, use_svm);
+}
+
+/**
+ * @brief Initialize FPGA with a persistent device buffer of N points
+ * @return error codes of fpga_ctx_create
+ */
+int fpga_initialize_withBuf(const char *platform_name, const char *path, bool use_svm, size_t N){
+  fpga_ctx_destroy(default_ctx);
+  return fpga_ctx_create_withBuf(&default_ctx, platform_name, path, use_svm, N);
+}
+
+/**
+ * @brief Release FPGA Resources of the default handle
+ */
+void fpga_final(){
+  fpga_ctx_destroy(default_ctx);
+  default_ctx = NULL;
+}
+
+/**
+ * @brief Release FPGA Resources including the persistent buffer
+ */
+void fpga_final_withBuf(){
+  fpga_final();
+}
+
+fpga_t fpga_test(size_t N, float2 *inp, float2 *out, bool interleaving){
+  return fpga_ctx_test(default_ctx, N, inp, out, interleaving);
+}
+
+fpga_t fpga_typed_test(size_t N, fpga_type_t type, const void *inp, void *out){
+  return fpga_ctx_typed_test(default_ctx, N, type, inp, out);
+}
+
+fpga_t fpga_test_bufPersist(size_t N, float2 *inp, float2 *out, bool interleaving){
+  return fpga_ctx_test_bufPersist(default_ctx, N, inp, out, interleaving);
+}
+
+bool fpga_cache_set_mode(fpga_cache_mode_t mode){
+  return fpga_ctx_cache_set_mode(default_ctx, mode);
+}
+
+bool fpga_cache_tag(const void *host, uint64_t version){
+  return fpga_ctx_cache_tag(default_ctx, host, version);
+}
+
+void fpga_cache_invalidate(){
+  fpga_ctx_cache_invalidate(default_ctx);
+}
+
+void fpga_cache_stats(fpga_cache_stats_t *stats){
+  fpga_ctx_cache_stats(default_ctx, stats);
+}
+
+fpga_t nb_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  return fpga_ctx_nb_pcie_test(default_ctx, N, inp, out, interleaving, how_many);
+}
+
+fpga_t nb_event_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  return fpga_ctx_nb_event_pcie_test(default_ctx, N, inp, out, interleaving, how_many);
+}
+
+fpga_t nb_thread_pcie_test(size_t N, float2 *inp, float2 *out, bool interleaving, unsigned how_many){
+  return fpga_ctx_nb_thread_pcie_test(default_ctx, N, inp, out, interleaving, how_many);
+}
+
+bool fpga_svm_enabled(){
+  return fpga_ctx_svm_enabled(default_ctx);
+}
+
+fpga_t svm_pcie_test(size_t N, float2 *inp, float2 *out, unsigned how_many, bool use_kernel){
+  return fpga_ctx_svm_pcie_test(default_ctx, N, inp, out, how_many, use_kernel);
+}
+
+fpga_t fpga_fp16_test(size_t N, float2 *inp, float2 *out, unsigned how_many){
+  return fpga_ctx_fp16_test(default_ctx, N, inp, out, how_many);
+}
+
+fpga_t fpga_pipeline_test(size_t N, float2 *inp, float2 *out, unsigned how_many, const fpga_config_t *config){
+  return fpga_ctx_pipeline_test(default_ctx, N, inp, out, how_many, config);
+}
+
+fpga_t fpga_typed_pipeline_test(size_t N, fpga_type_t type, const void *inp, void *out, unsigned how_many, const fpga_config_t *config){
+  return fpga_ctx_typed_pipeline_test(default_ctx, N, type, inp, out, how_many, config);
+}
+
+fpga_t fpga_latency_test(size_t bytes, unsigned rounds, unsigned warmup, double *samples){
+  return fpga_ctx_latency_test(default_ctx, bytes, rounds, warmup, samples);
+}
+
+fpga_t fpga_duplex_test(size_t chunk, size_t total, unsigned write_pct, fpga_duplex_t *duplex){
+  return fpga_ctx_duplex_test(default_ctx, chunk, total, write_pct, duplex);
+}
+
+fpga_t fpga_file_test(const char *inp_path, const char *out_path, fpga_file_t *file){
+  return fpga_ctx_file_test(default_ctx, inp_path, out_path, file);
+}
+
+fpga_t fpga_flow_run(fpga_flow_t *flow){
+  return fpga_ctx_flow_run(default_ctx, flow);
+}
+
+fpga_coalesce_t* fpga_coalesce_open(size_t capacity, size_t flush_bytes, double flush_us){
+  return fpga_ctx_coalesce_open(default_ctx, capacity, flush_bytes, flush_us);
+}
+
+bool fpga_pool_reserve(size_t bytes, unsigned banks){
+  return fpga_ctx_pool_reserve(default_ctx, bytes, banks);
+}
+
+unsigned fpga_pool_stats(fpga_pool_stats_t *stats){
+  return fpga_ctx_pool_stats(default_ctx, stats);
+}
+
+bool fpga_staging_reserve(size_t chunk, unsigned depth, unsigned threads){
+  return fpga_ctx_staging_reserve(default_ctx, chunk, depth, threads);
+}
+
+bool fpga_staging_stats(fpga_staging_stats_t *stats){
+  return fpga_ctx_staging_stats(default_ctx, stats);
+}
+
+void fpga_get_config(fpga_config_t *config){
+  fpga_ctx_get_config(default_ctx, config);
+}
+
+void fpga_set_config(const fpga_config_t *config){
+  fpga_ctx_set_config(default_ctx, config);
+}
+
+const char* fpga_profile_path(){
+  return fpga_ctx_profile_path(default_ctx);
+}
+
+bool fpga_get_environment(fpga_env_t *env){
+  return fpga_ctx_get_environment(default_ctx, env);
+}
+
+int fpga_autotune(size_t N, unsigned how_many, unsigned reps, fpga_config_t *best){
+  return fpga_ctx_autotune(default_ctx, N, how_many, reps, best);
+}
+
+int fpga_calibrate(unsigned reps, fpga_model_t *model){
+  return fpga_ctx_calibrate(default_ctx, reps, model);
+}
+
+bool fpga_get_model(fpga_model_t *model){
+  return fpga_ctx_get_model(default_ctx, model);
+}
@@ -0,0 +1,250 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "dirty.h"
+#include "dev_cache.h"
+#include "trace.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+// multipliers of the hash rounds
+#define PRIME1 0x9E3779B185EBCA87ull
+#define PRIME2 0xC2B2AE3D27D4EB4Full
+#define PRIME3 0x165667B19E3779F9ull
+
+static inline uint64_t rotl(uint64_t x, unsigned r){
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t hash_round(uint64_t acc, uint64_t word){
+  acc += word * PRIME2;
+  return rotl(acc, 31) * PRIME1;
+}
+
+/**
+ * \brief  64 bit hash of bytes in four independent lanes of 8 bytes, so
+ *         that the multiplies of the lanes overlap and hashing runs well
+ *         above the PCIe bandwidth
+ */
+static uint64_t content_hash(const void *data, size_t bytes){
+  const unsigned char *p = (const unsigned char *)data;
+  uint64_t lane[4] = {PRIME1 + PRIME2, PRIME2, 0, PRIME3};
+  size_t i = 0;
+
+  for(; i + 32 <= bytes; i += 32){
+    uint64_t w[4];
+    memcpy(w, p + i, sizeof(w));
+    lane[0] = hash_round(lane[0], w[0]);
+    lane[1] = hash_round(lane[1], w[1]);
+    lane[2] = hash_round(lane[2], w[2]);
+    lane[3] = hash_round(lane[3], w[3]);
+  }
+
+  uint64_t h = rotl(lane[0], 1) + rotl(lane[1], 7) + rotl(lane[2], 12) + rotl(lane[3], 18) + bytes;
+  for(; i < bytes; i++){
+    h = rotl(h ^ (p[i] * PRIME3), 11) * PRIME1;
+  }
+
+  h ^= h >> 33;
+  h *= PRIME2;
+  h ^= h >> 29;
+  h *= PRIME3;
+  return h ^ (h >> 32);
+}
+
+/**
+ * \brief  Cache of the count buffers of a device array, off until a mode is
+ *         set
+ * \return false if the entries could not be allocated
+ */
+bool dev_cache_init(dev_cache *cache, size_t count){
+  memset(cache, 0, sizeof(dev_cache));
+  cache->entries = (cache_entry *)calloc(count, sizeof(cache_entry));
+  if(cache->entries == NULL){
+    return false;
+  }
+  cache->count = count;
+  return true;
+}
+
+void dev_cache_release(dev_cache *cache){
+  dirty_release(cache->dirty);
+  free(cache->entries);
+  memset(cache, 0, sizeof(dev_cache));
+}
+
+/**
+ * \brief  Change the mode, entries of the previous mode are dropped and
+ *         counters reset
+ */
+void dev_cache_set_mode(dev_cache *cache, fpga_cache_mode_t mode){
+  dev_cache_invalidate(cache);
+  cache->mode = mode;
+  memset(&cache->stats, 0, sizeof(fpga_cache_stats_t));
+}
+
+/**
+ * \brief  Set the version of a host buffer, uploads from the buffer with the
+ *         version they were made with are skipped
+ * \return false if CACHE_MAX_TAGS buffers are tagged already
+ */
+bool dev_cache_tag(dev_cache *cache, const void *host, uint64_t version){
+  for(unsigned t = 0; t < cache->num_tags; t++){
+    if(cache->tags[t].host == host){
+      cache->tags[t].version = version;
+      return true;
+    }
+  }
+  if(cache->num_tags == CACHE_MAX_TAGS){
+    return false;
+  }
+  cache->tags[cache->num_tags].host = host;
+  cache->tags[cache->num_tags].version = version;
+  cache->num_tags++;
+  return true;
+}
+
+/**
+ * \brief  Forget the contents of every buffer, the next uploads are misses
+ */
+void dev_cache_invalidate(dev_cache *cache){
+  for(size_t e = 0; e < cache->count; e++){
+    cache->entries[e].host = NULL;
+  }
+  dirty_release(cache->dirty);
+  cache->dirty = NULL;
+}
+
+/**
+ * \brief  key of the data of a buffer: the content hash, or the version of
+ *         the host buffer src the data is part of
+ * \return false if src has no version in version mode
+ */
+static bool cache_key(dev_cache *cache, const void *src, const void *host, size_t bytes, uint64_t *key){
+  if(cache->mode == FPGA_CACHE_HASH){
+    double start = getTimeinMilliSec();
+    *key = content_hash(host, bytes);
+    cache->stats.hash_t += getTimeinMilliSec() - start;
+    return true;
+  }
+  for(unsigned t = 0; t < cache->num_tags; t++){
+    if(cache->tags[t].host == src){
+      *key = cache->tags[t].version;
+      return true;
+    }
+  }
+  return false;
+}
+
+/**
+ * \brief  Enqueue writes of the pages of src written since its last upload,
+ *         each range of adjacent dirty pages in one write. Another host
+ *         buffer is tracked from its first upload, which is complete.
+ */
+static void dirty_write(dev_cache *cache, cl_command_queue queue, const dev_array *arr, const void *src){
+  size_t total = arr->elem * arr->total;
+  double start = getTimeinMilliSec();
+
+  if(cache->dirty != NULL && (dirty_host(cache->dirty) != src || dirty_bytes(cache->dirty) != total)){
+    dirty_release(cache->dirty);
+    cache->dirty = NULL;
+  }
+
+  if(cache->dirty == NULL){
+    cache->dirty = dirty_track(src, total);
+    cache->stats.track_t += getTimeinMilliSec() - start;
+
+    dev_array_write(queue, arr, src);
+    cache->stats.misses += arr->count;
+    cache->stats.bytes_uploaded += total;
+    cache->stats.ranges += arr->count;
+  }
+  else{
+    const char *bytes = (const char *)src;
+    for(size_t b = 0; b < arr->count; b++){
+      size_t seg_lo = arr->elem * b * arr->seg;
+      size_t seg_hi = seg_lo + arr->elem * ((b == arr->count - 1) ? arr->total - b * arr->seg : arr->seg);
+      size_t lo = seg_lo, hi = seg_lo, sent = 0;
+
+      while(hi < seg_hi && dirty_next(cache->dirty, hi, seg_hi, &lo, &hi)){
+        cl_int status = 0;
+        TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(queue, arr->bufs[b].buf, CL_FALSE, lo - seg_lo, hi - lo, &bytes[lo], 0, NULL, NULL));
+        checkError(status, "Failed to write to DDR");
+        sent += hi - lo;
+        cache->stats.ranges++;
+      }
+
+      if(sent == 0)
+        cache->stats.hits++;
+      else
+        cache->stats.misses++;
+      cache->stats.bytes_uploaded += sent;
+      cache->stats.bytes_saved += (seg_hi - seg_lo) - sent;
+    }
+  }
+
+  if(cache->dirty != NULL){
+    double protect = getTimeinMilliSec();
+    dirty_protect(cache->dirty);
+    cache->stats.track_t += getTimeinMilliSec() - protect;
+
+    size_t faults;
+    double fault_ms;
+    dirty_take(cache->dirty, &faults, &fault_ms);
+    cache->stats.faults += faults;
+    cache->stats.track_t += fault_ms;
+  }
+}
+
+/**
+ * \brief  Enqueue the writes of the buffers of the array whose data is not
+ *         resident already, like dev_array_write. Data is resident if the
+ *         buffer was last written from the same host address and size with
+ *         the same key.
+ * \param  cache : can be NULL or off, every buffer is written
+ */
+void dev_cache_write(dev_cache *cache, cl_command_queue queue, const dev_array *arr, const void *src){
+  if(cache == NULL || cache->mode == FPGA_CACHE_OFF || cache->count != arr->count){
+    dev_array_write(queue, arr, src);
+    return;
+  }
+  if(cache->mode == FPGA_CACHE_DIRTY){
+    dirty_write(cache, queue, arr, src);
+    return;
+  }
+
+  const char *bytes = (const char *)src;
+  for(size_t b = 0; b < arr->count; b++){
+    size_t len = arr->elem * ((b == arr->count - 1) ? arr->total - b * arr->seg : arr->seg);
+    const char *host = &bytes[arr->elem * b * arr->seg];
+    cache_entry *e = &cache->entries[b];
+
+    uint64_t key = 0;
+    bool keyed = cache_key(cache, src, host, len, &key);
+    if(keyed && e->host == host && e->bytes == len && e->key == key){
+      cache->stats.hits++;
+      cache->stats.bytes_saved += len;
+      continue;
+    }
+
+    cl_int status = 0;
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(queue, arr->bufs[b].buf, CL_FALSE, 0, len, host, 0, NULL, NULL));
+    checkError(status, "Failed to write to DDR");
+
+    // untagged data is uploaded every time
+    e->host = keyed ? host : NULL;
+    e->bytes = len;
+    e->key = key;
+    cache->stats.misses++;
+    cache->stats.bytes_uploaded += len;
+  }
+}
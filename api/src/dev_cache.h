@@ -0,0 +1,55 @@
+// Author: Arjun Ramaswami
+
+#ifndef DEV_CACHE_H
+#define DEV_CACHE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// host buffers that can be tagged with a version at once
+#define CACHE_MAX_TAGS 64
+
+/**
+ * Host data last uploaded to a buffer of a device array
+ */
+typedef struct cache_entry {
+  const void *host;     /**< NULL if the buffer holds nothing known */
+  size_t bytes;
+  uint64_t key;         /**< content hash or version of the upload */
+} cache_entry;
+
+/**
+ * Version of a host buffer, set by the application
+ */
+typedef struct cache_tag {
+  const void *host;
+  uint64_t version;
+} cache_tag;
+
+/**
+ * Contents of the buffers of a device array, so that uploads of unchanged
+ * host data can be skipped
+ */
+typedef struct dev_cache {
+  fpga_cache_mode_t mode;
+  cache_entry *entries;   /**< one per buffer of the array */
+  size_t count;
+  cache_tag tags[CACHE_MAX_TAGS];
+  unsigned num_tags;
+  dirty_region *dirty;    /**< host buffer tracked in dirty mode, or NULL */
+  fpga_cache_stats_t stats;
+} dev_cache;
+
+bool dev_cache_init(dev_cache *cache, size_t count);
+
+void dev_cache_release(dev_cache *cache);
+
+void dev_cache_set_mode(dev_cache *cache, fpga_cache_mode_t mode);
+
+bool dev_cache_tag(dev_cache *cache, const void *host, uint64_t version);
+
+void dev_cache_invalidate(dev_cache *cache);
+
+void dev_cache_write(dev_cache *cache, cl_command_queue queue, const dev_array *arr, const void *src);
+
+#endif // DEV_CACHE_H
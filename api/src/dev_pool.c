@@ -0,0 +1,384 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "trace.h"
+#include "opencl_utils.h"
+
+// end of a free list
+#define NIL UINT32_MAX
+
+// regions of up to 2^POOL_MAX_ORDER blocks
+#define POOL_MAX_ORDER 32
+
+/**
+ * Buddy allocator over the buffer reserved in a bank. Regions are 2^order
+ * blocks aligned to their size, indexed by their first block. Sub-buffers of
+ * freed regions are kept, so a region of the same order handed out again
+ * needs no runtime call.
+ */
+typedef struct pool_bank {
+  cl_mem buf;
+  uint32_t blocks;        /**< blocks of POOL_MIN_BLOCK bytes */
+  unsigned max_order;
+  uint32_t head[POOL_MAX_ORDER + 1];  /**< first free region of each order */
+  uint32_t *next, *prev;  /**< links of the free lists */
+  int8_t *free_order;     /**< order of a free region starting here, or -1 */
+  int8_t *used_order;     /**< order of an allocated region, or -1 */
+  cl_mem *cache;          /**< sub-buffer of the last region starting here */
+  int8_t *cache_order;    /**< order of the cached sub-buffer */
+  fpga_pool_stats_t stats;
+} pool_bank;
+
+struct dev_pool {
+  unsigned banks;
+  pool_bank bank[FPGA_POOL_MAX_BANKS];
+  pthread_mutex_t lock;
+};
+
+// function prototypes
+static bool bank_init(pool_bank *pb, cl_context context, size_t bytes, unsigned b, unsigned banks);
+static void bank_release(pool_bank *pb);
+static void list_push(pool_bank *pb, uint32_t idx, unsigned order);
+static void list_remove(pool_bank *pb, uint32_t idx, unsigned order);
+static bool bank_alloc(pool_bank *pb, unsigned order, uint32_t *idx);
+static void bank_free(pool_bank *pb, uint32_t idx);
+static size_t bank_largest(const pool_bank *pb);
+
+/**
+ * \brief  Reserve a buffer of bytes in each of the banks and write to it,
+ *         so that the device memory is allocated now and not on the first
+ *         transfer of a test
+ * \param  bytes : per bank, reduced to the largest device buffer and rounded
+ *                 down to whole blocks
+ * \param  banks : number of banks, at most FPGA_POOL_MAX_BANKS
+ * \param  queue : queue for the writes
+ * \return pool or NULL if bytes is less than a block or allocation failed
+ */
+dev_pool* dev_pool_create(cl_context context, cl_device_id device, cl_command_queue queue, size_t bytes, unsigned banks){
+  if(banks == 0 || banks > FPGA_POOL_MAX_BANKS){
+    return NULL;
+  }
+
+  size_t max_bytes = max_points(device, POOL_MIN_BLOCK, banks) * POOL_MIN_BLOCK;
+  if(bytes > max_bytes){
+    bytes = max_bytes;
+  }
+  if((uint64_t)bytes / POOL_MIN_BLOCK > UINT32_MAX - 1){
+    bytes = (size_t)(UINT32_MAX - 1) * POOL_MIN_BLOCK;
+  }
+  bytes -= bytes % POOL_MIN_BLOCK;
+  if(bytes == 0){
+    return NULL;
+  }
+
+  dev_pool *pool = (dev_pool *)calloc(1, sizeof(dev_pool));
+  if(pool == NULL){
+    return NULL;
+  }
+  pthread_mutex_init(&pool->lock, NULL);
+
+  for(unsigned b = 0; b < banks; b++){
+    if(!bank_init(&pool->bank[b], context, bytes, b, banks)){
+      dev_pool_destroy(pool);
+      return NULL;
+    }
+    pool->banks++;
+
+    const cl_uint zero = 0;
+    cl_int status = clEnqueueWriteBuffer(queue, pool->bank[b].buf, CL_TRUE, 0, sizeof(zero), &zero, 0, NULL, NULL);
+    checkError(status, "Failed to write to the buffer of bank %u", b);
+  }
+  return pool;
+}
+
+/**
+ * \brief  Release the sub-buffers and the buffers of the banks. Every region
+ *         has to be released before.
+ */
+void dev_pool_destroy(dev_pool *pool){
+  if(pool == NULL){
+    return;
+  }
+  for(unsigned b = 0; b < pool->banks; b++){
+    bank_release(&pool->bank[b]);
+  }
+  pthread_mutex_destroy(&pool->lock);
+  free(pool);
+}
+
+/**
+ * \brief  bytes of the largest region a bank can hand out
+ */
+size_t dev_pool_max_block(const dev_pool *pool){
+  size_t max = 0;
+  for(unsigned b = 0; b < pool->banks; b++){
+    size_t sz = (size_t)POOL_MIN_BLOCK << pool->bank[b].max_order;
+    if(sz > max)
+      max = sz;
+  }
+  return max;
+}
+
+/**
+ * \brief  Device buffer of bytes for buffer buf spread over banks. Taken from
+ *         the pool if there is one with a free region large enough,
+ *         otherwise created on its own. Regions of the pool are handed out
+ *         round robin over its banks.
+ * \param  pool  : pool or NULL
+ * \param  buf   : index of the buffer, selects the bank
+ * \param  banks : number of banks the buffers are spread over, 0 for
+ *                 interleaved placement without a pool
+ * \param  blk   : set to the region, passed to dev_pool_release
+ * \return buffer
+ */
+cl_mem dev_pool_buffer(dev_pool *pool, cl_context context, size_t bytes, unsigned buf, unsigned banks, dev_block *blk){
+  cl_int status = 0;
+  TRACE_BEGIN(start);
+
+  blk->buf = NULL;
+  blk->pooled = false;
+  blk->bank = 0;
+  blk->offset = 0;
+
+  if(pool != NULL && bytes > 0){
+    unsigned b = ((banks > 0) ? buf % banks : buf) % pool->banks;
+    pool_bank *pb = &pool->bank[b];
+
+    size_t need = (bytes + POOL_MIN_BLOCK - 1) / POOL_MIN_BLOCK;
+    unsigned order = 0;
+    while(((size_t)1 << order) < need){
+      order++;
+    }
+
+    uint32_t idx;
+    pthread_mutex_lock(&pool->lock);
+    bool found = (order <= pb->max_order) && bank_alloc(pb, order, &idx);
+    if(found){
+      if(pb->cache[idx] == NULL || pb->cache_order[idx] != (int8_t)order){
+        if(pb->cache[idx] != NULL)
+          clReleaseMemObject(pb->cache[idx]);
+
+        cl_buffer_region region = {(size_t)idx * POOL_MIN_BLOCK, (size_t)POOL_MIN_BLOCK << order};
+        pb->cache[idx] = clCreateSubBuffer(pb->buf, CL_MEM_READ_WRITE, CL_BUFFER_CREATE_TYPE_REGION, &region, &status);
+        checkError(status, "Failed to create sub-buffer of bank %u", b);
+        pb->cache_order[idx] = order;
+      }
+      blk->buf = pb->cache[idx];
+      blk->pooled = true;
+      blk->bank = b;
+      blk->offset = (size_t)idx * POOL_MIN_BLOCK;
+    }
+    else{
+      pb->stats.failed++;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if(found){
+      TRACE_END(TRACE_CREATE_BUFFER, start);
+      return blk->buf;
+    }
+  }
+
+  blk->buf = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(buf, banks), bytes, NULL, &status);
+  checkError(status, "Failed to allocate device buffer %u\n", buf);
+  TRACE_END(TRACE_CREATE_BUFFER, start);
+  return blk->buf;
+}
+
+/**
+ * \brief  Return a region to its bank or release a buffer created on its own
+ */
+void dev_pool_release(dev_pool *pool, dev_block *blk){
+  if(blk->buf == NULL){
+    return;
+  }
+
+  TRACE_BEGIN(start);
+  if(blk->pooled){
+    pthread_mutex_lock(&pool->lock);
+    bank_free(&pool->bank[blk->bank], blk->offset / POOL_MIN_BLOCK);
+    pthread_mutex_unlock(&pool->lock);
+  }
+  else{
+    clReleaseMemObject(blk->buf);
+  }
+  TRACE_END(TRACE_RELEASE_BUFFER, start);
+  blk->buf = NULL;
+  blk->pooled = false;
+}
+
+/**
+ * \brief  usage of each bank
+ * \param  stats : FPGA_POOL_MAX_BANKS entries
+ * \return number of banks, 0 without a pool
+ */
+unsigned dev_pool_stats(dev_pool *pool, fpga_pool_stats_t *stats){
+  if(pool == NULL){
+    return 0;
+  }
+
+  pthread_mutex_lock(&pool->lock);
+  for(unsigned b = 0; b < pool->banks; b++){
+    stats[b] = pool->bank[b].stats;
+    stats[b].largest = bank_largest(&pool->bank[b]);
+  }
+  pthread_mutex_unlock(&pool->lock);
+  return pool->banks;
+}
+
+/**
+ * \brief  Create the buffer of a bank and add it to the free lists as the
+ *         largest aligned regions that fit
+ */
+static bool bank_init(pool_bank *pb, cl_context context, size_t bytes, unsigned b, unsigned banks){
+  cl_int status = 0;
+  uint32_t blocks = bytes / POOL_MIN_BLOCK;
+
+  pb->next = (uint32_t *)malloc(sizeof(uint32_t) * blocks);
+  pb->prev = (uint32_t *)malloc(sizeof(uint32_t) * blocks);
+  pb->free_order = (int8_t *)malloc(blocks);
+  pb->used_order = (int8_t *)malloc(blocks);
+  pb->cache = (cl_mem *)calloc(blocks, sizeof(cl_mem));
+  pb->cache_order = (int8_t *)malloc(blocks);
+  if(pb->next == NULL || pb->prev == NULL || pb->free_order == NULL || pb->used_order == NULL || pb->cache == NULL || pb->cache_order == NULL){
+    bank_release(pb);
+    return false;
+  }
+
+  pb->buf = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(b, banks), bytes, NULL, &status);
+  checkError(status, "Failed to allocate the buffer of bank %u", b);
+
+  pb->blocks = blocks;
+  pb->max_order = 0;
+  while(pb->max_order < POOL_MAX_ORDER && ((uint64_t)1 << (pb->max_order + 1)) <= blocks){
+    pb->max_order++;
+  }
+  for(unsigned o = 0; o <= POOL_MAX_ORDER; o++){
+    pb->head[o] = NIL;
+  }
+  for(uint32_t i = 0; i < blocks; i++){
+    pb->free_order[i] = -1;
+    pb->used_order[i] = -1;
+    pb->cache_order[i] = -1;
+  }
+
+  uint32_t idx = 0;
+  while(idx < blocks){
+    unsigned o = pb->max_order;
+    while((idx & (((uint32_t)1 << o) - 1)) != 0 || (uint64_t)idx + ((uint64_t)1 << o) > blocks){
+      o--;
+    }
+    list_push(pb, idx, o);
+    idx += (uint32_t)1 << o;
+  }
+
+  pb->stats.size = bytes;
+  return true;
+}
+
+static void bank_release(pool_bank *pb){
+  if(pb->cache != NULL){
+    for(uint32_t i = 0; i < pb->blocks; i++){
+      if(pb->cache[i] != NULL)
+        clReleaseMemObject(pb->cache[i]);
+    }
+  }
+  if(pb->buf != NULL)
+    clReleaseMemObject(pb->buf);
+  free(pb->next);
+  free(pb->prev);
+  free(pb->free_order);
+  free(pb->used_order);
+  free(pb->cache);
+  free(pb->cache_order);
+}
+
+static void list_push(pool_bank *pb, uint32_t idx, unsigned order){
+  pb->next[idx] = pb->head[order];
+  pb->prev[idx] = NIL;
+  if(pb->head[order] != NIL)
+    pb->prev[pb->head[order]] = idx;
+  pb->head[order] = idx;
+  pb->free_order[idx] = order;
+}
+
+static void list_remove(pool_bank *pb, uint32_t idx, unsigned order){
+  if(pb->prev[idx] != NIL)
+    pb->next[pb->prev[idx]] = pb->next[idx];
+  else
+    pb->head[order] = pb->next[idx];
+  if(pb->next[idx] != NIL)
+    pb->prev[pb->next[idx]] = pb->prev[idx];
+  pb->free_order[idx] = -1;
+}
+
+/**
+ * \brief  take the first free region of the smallest order that fits and
+ *         split it down to order, the upper halves go back to the free lists
+ * \return false if no region is large enough
+ */
+static bool bank_alloc(pool_bank *pb, unsigned order, uint32_t *idx){
+  unsigned o = order;
+  while(o <= pb->max_order && pb->head[o] == NIL){
+    o++;
+  }
+  if(o > pb->max_order){
+    return false;
+  }
+
+  uint32_t i = pb->head[o];
+  list_remove(pb, i, o);
+  while(o > order){
+    o--;
+    list_push(pb, i + ((uint32_t)1 << o), o);
+  }
+  pb->used_order[i] = order;
+
+  pb->stats.used += (size_t)POOL_MIN_BLOCK << order;
+  if(pb->stats.used > pb->stats.peak)
+    pb->stats.peak = pb->stats.used;
+  pb->stats.allocs++;
+
+  *idx = i;
+  return true;
+}
+
+/**
+ * \brief  return a region and merge it with its buddy while the buddy is free
+ */
+static void bank_free(pool_bank *pb, uint32_t idx){
+  unsigned order = pb->used_order[idx];
+  pb->used_order[idx] = -1;
+  pb->stats.used -= (size_t)POOL_MIN_BLOCK << order;
+  pb->stats.frees++;
+
+  while(order < pb->max_order){
+    uint32_t buddy = idx ^ ((uint32_t)1 << order);
+    if((uint64_t)buddy + ((uint64_t)1 << order) > pb->blocks || pb->free_order[buddy] != (int8_t)order){
+      break;
+    }
+    list_remove(pb, buddy, order);
+    if(buddy < idx)
+      idx = buddy;
+    order++;
+  }
+  list_push(pb, idx, order);
+}
+
+static size_t bank_largest(const pool_bank *pb){
+  for(int o = pb->max_order; o >= 0; o--){
+    if(pb->head[o] != NIL)
+      return (size_t)POOL_MIN_BLOCK << o;
+  }
+  return 0;
+}
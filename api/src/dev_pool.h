@@ -0,0 +1,36 @@
+// Author: Arjun Ramaswami
+
+#ifndef DEV_POOL_H
+#define DEV_POOL_H
+
+#include <stdbool.h>
+
+// smallest region handed out, larger than any base address alignment
+#define POOL_MIN_BLOCK (64 * 1024)
+
+typedef struct dev_pool dev_pool;
+
+/**
+ * Device buffer either taken from a pool or created on its own if there is
+ * no pool or no free region large enough
+ */
+typedef struct dev_block {
+  cl_mem buf;       /**< sub-buffer of the bank or buffer of its own */
+  bool pooled;      /**< buf is a region of the pool */
+  unsigned bank;    /**< bank of the region */
+  size_t offset;    /**< bytes from the start of the bank */
+} dev_block;
+
+dev_pool* dev_pool_create(cl_context context, cl_device_id device, cl_command_queue queue, size_t bytes, unsigned banks);
+
+void dev_pool_destroy(dev_pool *pool);
+
+size_t dev_pool_max_block(const dev_pool *pool);
+
+cl_mem dev_pool_buffer(dev_pool *pool, cl_context context, size_t bytes, unsigned buf, unsigned banks, dev_block *blk);
+
+void dev_pool_release(dev_pool *pool, dev_block *blk);
+
+unsigned dev_pool_stats(dev_pool *pool, fpga_pool_stats_t *stats);
+
+#endif // DEV_POOL_H
@@ -0,0 +1,258 @@
+// Author: Arjun Ramaswami
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "dirty.h"
+
+/**
+ * Host buffer whose pages are read only after an upload. The first write to
+ * a page faults, the handler marks the page dirty and makes it writable.
+ * Only the pages entirely inside the buffer are protected, the partial
+ * pages at either end are shared with other data and always dirty.
+ */
+struct dirty_region {
+  const unsigned char *host;
+  size_t bytes;
+  uintptr_t start;            /**< first protected page */
+  size_t pages;               /**< protected pages */
+  size_t page_sz;
+  atomic_uchar *dirty;        /**< written since the last protect, per page */
+  atomic_size_t faults;
+  atomic_uint_fast64_t fault_ns;
+};
+
+// regions searched by the fault handler
+static _Atomic(dirty_region *) regions[DIRTY_MAX_REGIONS];
+static pthread_mutex_t regions_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static struct sigaction old_action;
+static pthread_once_t handler_once = PTHREAD_ONCE_INIT;
+static bool handler_installed = false;
+
+/**
+ * \brief  SIGSEGV handler, a write to a protected page is recorded and
+ *         retried. Other faults go to the previous disposition.
+ */
+static void dirty_fault(int sig, siginfo_t *info, void *uctx){
+  uintptr_t addr = (uintptr_t)info->si_addr;
+
+  for(unsigned i = 0; i < DIRTY_MAX_REGIONS; i++){
+    dirty_region *r = atomic_load(&regions[i]);
+    if(r == NULL || addr < r->start || addr >= r->start + r->pages * r->page_sz){
+      continue;
+    }
+
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    size_t page = (addr - r->start) / r->page_sz;
+    atomic_store_explicit(&r->dirty[page], 1, memory_order_relaxed);
+    mprotect((void *)(r->start + page * r->page_sz), r->page_sz, PROT_READ | PROT_WRITE);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+
+    atomic_fetch_add_explicit(&r->faults, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&r->fault_ns, (uint64_t)(t1.tv_sec - t0.tv_sec) * 1000000000ull + (uint64_t)t1.tv_nsec - (uint64_t)t0.tv_nsec, memory_order_relaxed);
+    return;
+  }
+
+  if(old_action.sa_flags & SA_SIGINFO){
+    old_action.sa_sigaction(sig, info, uctx);
+  }
+  else if(old_action.sa_handler == SIG_DFL || old_action.sa_handler == SIG_IGN){
+    // the fault repeats on return and terminates as without the handler
+    signal(SIGSEGV, SIG_DFL);
+  }
+  else{
+    old_action.sa_handler(sig);
+  }
+}
+
+static void handler_install(){
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = dirty_fault;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigemptyset(&sa.sa_mask);
+  handler_installed = (sigaction(SIGSEGV, &sa, &old_action) == 0);
+}
+
+/**
+ * \brief  Track the pages of a host buffer, every page starts dirty so that
+ *         the first dirty_protect protects them all
+ * \return region or NULL if DIRTY_MAX_REGIONS buffers are tracked, the
+ *         pages overlap those of a tracked buffer or the handler could not be
+ *         installed
+ */
+dirty_region* dirty_track(const void *host, size_t bytes){
+  pthread_once(&handler_once, handler_install);
+  if(!handler_installed || host == NULL || bytes == 0){
+    return NULL;
+  }
+
+  dirty_region *r = (dirty_region *)calloc(1, sizeof(dirty_region));
+  if(r == NULL){
+    return NULL;
+  }
+  r->host = (const unsigned char *)host;
+  r->bytes = bytes;
+  r->page_sz = (size_t)sysconf(_SC_PAGESIZE);
+
+  uintptr_t first = ((uintptr_t)host + r->page_sz - 1) & ~(uintptr_t)(r->page_sz - 1);
+  uintptr_t last = ((uintptr_t)host + bytes) & ~(uintptr_t)(r->page_sz - 1);
+  r->start = first;
+  r->pages = (last > first) ? (last - first) / r->page_sz : 0;
+
+  r->dirty = (atomic_uchar *)malloc(r->pages + 1);
+  if(r->dirty == NULL){
+    free(r);
+    return NULL;
+  }
+  for(size_t p = 0; p < r->pages; p++){
+    atomic_init(&r->dirty[p], 1);
+  }
+
+  // a page protected by two regions would be unprotected by the fault or
+  // release of one while the other still relies on it, an overlapping
+  // buffer is not tracked and uploaded in full
+  pthread_mutex_lock(&regions_lock);
+  int slot = -1;
+  for(unsigned i = 0; i < DIRTY_MAX_REGIONS; i++){
+    dirty_region *o = atomic_load(&regions[i]);
+    if(o == NULL){
+      slot = (slot < 0) ? (int)i : slot;
+    }
+    else if(r->pages > 0 && o->pages > 0 && r->start < o->start + o->pages * o->page_sz && o->start < r->start + r->pages * r->page_sz){
+      slot = -1;
+      break;
+    }
+  }
+  if(slot >= 0){
+    atomic_store(&regions[slot], r);
+    pthread_mutex_unlock(&regions_lock);
+    return r;
+  }
+  pthread_mutex_unlock(&regions_lock);
+
+  free(r->dirty);
+  free(r);
+  return NULL;
+}
+
+/**
+ * \brief  Make the pages writable again and stop tracking, the buffer must
+ *         still be mapped
+ */
+void dirty_release(dirty_region *r){
+  if(r == NULL){
+    return;
+  }
+  if(r->pages > 0){
+    mprotect((void *)r->start, r->pages * r->page_sz, PROT_READ | PROT_WRITE);
+  }
+
+  pthread_mutex_lock(&regions_lock);
+  for(unsigned i = 0; i < DIRTY_MAX_REGIONS; i++){
+    if(atomic_load(&regions[i]) == r){
+      atomic_store(&regions[i], NULL);
+    }
+  }
+  pthread_mutex_unlock(&regions_lock);
+
+  free(r->dirty);
+  free(r);
+}
+
+const void* dirty_host(const dirty_region *r){
+  return r->host;
+}
+
+size_t dirty_bytes(const dirty_region *r){
+  return r->bytes;
+}
+
+/**
+ * \brief  whether the byte at offset off of the buffer is dirty, and the
+ *         end of its page or partial page
+ */
+static bool unit_dirty(const dirty_region *r, size_t off, size_t *end){
+  size_t head = r->start - (uintptr_t)r->host;
+
+  if(r->pages == 0){
+    *end = r->bytes;
+    return true;
+  }
+  if(off < head){
+    *end = head;
+    return true;
+  }
+  size_t p = (off - head) / r->page_sz;
+  if(p >= r->pages){
+    *end = r->bytes;
+    return true;
+  }
+  *end = head + (p + 1) * r->page_sz;
+  return atomic_load_explicit(&r->dirty[p], memory_order_relaxed) != 0;
+}
+
+/**
+ * \brief  First range of dirty bytes in [from, to) of the buffer, adjacent
+ *         dirty pages are coalesced into one range
+ * \param  lo, hi : bytes from the start of the buffer
+ * \return false if [from, to) is clean
+ */
+bool dirty_next(const dirty_region *r, size_t from, size_t to, size_t *lo, size_t *hi){
+  size_t off = from, end = from;
+
+  while(off < to && !unit_dirty(r, off, &end)){
+    off = end;
+  }
+  if(off >= to){
+    return false;
+  }
+  *lo = off;
+  while(off < to && unit_dirty(r, off, &end)){
+    off = end;
+  }
+  *hi = (off < to) ? off : to;
+  return true;
+}
+
+/**
+ * \brief  Protect the dirty pages and mark them clean, once their data was
+ *         uploaded. The buffer must not be written meanwhile.
+ */
+void dirty_protect(dirty_region *r){
+  size_t p = 0;
+
+  while(p < r->pages){
+    if(atomic_load_explicit(&r->dirty[p], memory_order_relaxed) == 0){
+      p++;
+      continue;
+    }
+    size_t first = p;
+    while(p < r->pages && atomic_load_explicit(&r->dirty[p], memory_order_relaxed) != 0){
+      atomic_store_explicit(&r->dirty[p], 0, memory_order_relaxed);
+      p++;
+    }
+    mprotect((void *)(r->start + first * r->page_sz), (p - first) * r->page_sz, PROT_READ);
+  }
+}
+
+/**
+ * \brief  Faults handled and the time spent handling them since the last
+ *         call
+ */
+void dirty_take(dirty_region *r, size_t *faults, double *fault_ms){
+  *faults = atomic_exchange(&r->faults, 0);
+  *fault_ms = (double)atomic_exchange(&r->fault_ns, 0) * 1.0e-6;
+}
@@ -0,0 +1,28 @@
+// Author: Arjun Ramaswami
+
+#ifndef DIRTY_H
+#define DIRTY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// host buffers tracked at once over all handles
+#define DIRTY_MAX_REGIONS 16
+
+typedef struct dirty_region dirty_region;
+
+dirty_region* dirty_track(const void *host, size_t bytes);
+
+void dirty_release(dirty_region *r);
+
+const void* dirty_host(const dirty_region *r);
+
+size_t dirty_bytes(const dirty_region *r);
+
+bool dirty_next(const dirty_region *r, size_t from, size_t to, size_t *lo, size_t *hi);
+
+void dirty_protect(dirty_region *r);
+
+void dirty_take(dirty_region *r, size_t *faults, double *fault_ms);
+
+#endif // DIRTY_H
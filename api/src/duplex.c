@@ -0,0 +1,248 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "duplex.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "event_ring.h"
+#include "opencl_utils.h"
+
+// transfers in flight in each direction
+#define DUPLEX_DEPTH 4
+
+typedef struct span {
+  cl_ulong start, end;
+} span;
+
+/**
+ * One direction of the duplex test, transfers cycle over DUPLEX_DEPTH host
+ * chunks and a single device buffer
+ */
+typedef struct direction {
+  bool write;
+  cl_command_queue queue;
+  cl_mem buf;
+  unsigned char *host;
+  size_t count;           /**< transfers to issue */
+  size_t issued;          /**< transfers issued */
+  event_ring events;
+  span *spans;            /**< profiled start and end of each transfer */
+} direction;
+
+// function prototypes
+static void retire(direction *d, size_t seq);
+static void issue(direction *d, size_t chunk);
+static void bandwidth_over_time(const direction *wr, const direction *rd, size_t chunk, fpga_duplex_t *duplex);
+
+/**
+ * \brief  Writes and reads of chunk bytes driven independently on their own
+ *         queue and DDR bank. The next transfer is issued in the direction
+ *         that is behind its share of the transfers, so both directions are
+ *         active over the whole test whatever the mix.
+ * \param  context  : context to create the device buffers
+ * \param  queue_wr : queue for host to device writes
+ * \param  queue_rd : queue for device to host reads
+ * \param  chunk    : bytes per transfer
+ * \param  wr_count : number of writes
+ * \param  rd_count : number of reads
+ * \param  duplex   : bandwidth per interval, NULL if not required
+ * \param  timing   : pcie_write_t and pcie_read_t set to the device time of
+ *                    each direction
+ * \return true if successful and the data of both directions is verified
+ */
+bool duplex_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, size_t chunk, size_t wr_count, size_t rd_count, fpga_duplex_t *duplex, fpga_t *timing){
+  cl_int status = 0;
+  direction wr = {true, queue_wr, NULL, NULL, wr_count, 0};
+  direction rd = {false, queue_rd, NULL, NULL, rd_count, 0};
+  direction *dirs[2] = {&wr, &rd};
+  bool success = true;
+
+  for(unsigned d = 0; d < 2; d++){
+    event_ring_init(&dirs[d]->events, DUPLEX_DEPTH);
+    dirs[d]->host = (unsigned char *)alignedMalloc(chunk * DUPLEX_DEPTH);
+    dirs[d]->spans = (span *)calloc(dirs[d]->count + 1, sizeof(span));
+  }
+  if(wr.host == NULL || wr.spans == NULL || rd.host == NULL || rd.spans == NULL){
+    free(wr.host);
+    free(wr.spans);
+    free(rd.host);
+    free(rd.spans);
+    return false;
+  }
+
+  // separate banks so the directions only share the PCIe link
+  for(unsigned d = 0; d < 2; d++){
+    dirs[d]->buf = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(d, 2), chunk, NULL, &status);
+    checkError(status, "Failed to allocate device buffer\n");
+  }
+
+  // distinct data per written chunk, known data to read back
+  for(size_t i = 0; i < chunk * DUPLEX_DEPTH; i++){
+    wr.host[i] = (unsigned char)(i / chunk + 1);
+    rd.host[i] = 0;
+  }
+  memset(rd.host, 0xA5, chunk);
+  status = clEnqueueWriteBuffer(queue_rd, rd.buf, CL_TRUE, 0, chunk, rd.host, 0, NULL, NULL);
+  checkError(status, "Failed to initialize read buffer");
+  memset(rd.host, 0, chunk);
+
+  while(wr.issued < wr.count || rd.issued < rd.count){
+    // compare the fraction of each direction already issued
+    bool write_next = (rd.issued == rd.count) ||
+      (wr.issued < wr.count && wr.issued * rd.count <= rd.issued * wr.count);
+    issue(write_next ? &wr : &rd, chunk);
+  }
+
+  for(unsigned d = 0; d < 2; d++){
+    direction *dir = dirs[d];
+    size_t first = (dir->count > DUPLEX_DEPTH) ? dir->count - DUPLEX_DEPTH : 0;
+    for(size_t i = first; i < dir->count; i++){
+      retire(dir, i);
+    }
+  }
+
+  // every read returns the initial data, the buffer holds the last write
+  for(size_t i = 0; i < chunk * ((rd.count < DUPLEX_DEPTH) ? rd.count : DUPLEX_DEPTH); i++){
+    if(rd.host[i] != 0xA5){
+      success = false;
+      break;
+    }
+  }
+  if(wr.count > 0){
+    unsigned char *check = (unsigned char *)malloc(chunk);
+    if(check == NULL){
+      success = false;
+    }
+    else{
+      status = clEnqueueReadBuffer(queue_wr, wr.buf, CL_TRUE, 0, chunk, check, 0, NULL, NULL);
+      checkError(status, "Failed to read back write buffer");
+      if(memcmp(check, wr.host + ((wr.count - 1) % DUPLEX_DEPTH) * chunk, chunk) != 0){
+        success = false;
+      }
+      free(check);
+    }
+  }
+
+  timing->pcie_write_t = (wr.count > 0) ? (wr.spans[wr.count - 1].end - wr.spans[0].start) * 1.0e-6 : 0.0;
+  timing->pcie_read_t = (rd.count > 0) ? (rd.spans[rd.count - 1].end - rd.spans[0].start) * 1.0e-6 : 0.0;
+
+  if(duplex != NULL){
+    duplex->wr_total_gbps = (timing->pcie_write_t > 0.0) ? wr.count * chunk * 1.0e-6 / timing->pcie_write_t : 0.0;
+    duplex->rd_total_gbps = (timing->pcie_read_t > 0.0) ? rd.count * chunk * 1.0e-6 / timing->pcie_read_t : 0.0;
+    bandwidth_over_time(&wr, &rd, chunk, duplex);
+  }
+
+  for(unsigned d = 0; d < 2; d++){
+    clReleaseMemObject(dirs[d]->buf);
+    free(dirs[d]->host);
+    free(dirs[d]->spans);
+  }
+  return success;
+}
+
+/**
+ * \brief  wait for the transfer seq, keep its profiled start and end and
+ *         release its event
+ */
+static void retire(direction *d, size_t seq){
+  cl_event *event = event_ring_get(&d->events, seq);
+  cl_int status = clWaitForEvents(1, event);
+  checkError(status, "Failed to wait for transfer");
+
+  clGetEventProfilingInfo(*event, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &d->spans[seq].start, NULL);
+  clGetEventProfilingInfo(*event, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &d->spans[seq].end, NULL);
+  event_ring_release(&d->events, seq);
+}
+
+/**
+ * \brief  issue the next transfer of the direction, retiring the transfer
+ *         DUPLEX_DEPTH before it to keep the host chunk and slot free
+ */
+static void issue(direction *d, size_t chunk){
+  cl_int status = 0;
+  size_t i = d->issued;
+  void *host = d->host + (i % DUPLEX_DEPTH) * chunk;
+
+  if(i >= DUPLEX_DEPTH){
+    retire(d, i - DUPLEX_DEPTH);
+  }
+
+  if(d->write){
+    status = clEnqueueWriteBuffer(d->queue, d->buf, CL_FALSE, 0, chunk, host, 0, NULL, event_ring_acquire(&d->events, i));
+    checkError(status, "Failed to write to DDR");
+  }
+  else{
+    status = clEnqueueReadBuffer(d->queue, d->buf, CL_FALSE, 0, chunk, host, 0, NULL, event_ring_acquire(&d->events, i));
+    checkError(status, "Failed to read");
+  }
+  clFlush(d->queue);
+  d->issued++;
+}
+
+/**
+ * \brief  bytes of each transfer are spread over the intervals its profiled
+ *         span overlaps, intervals start at the first transfer of either
+ *         direction. Bytes per nanosecond are GB/s.
+ */
+static void bandwidth_over_time(const direction *wr, const direction *rd, size_t chunk, fpga_duplex_t *duplex){
+  const direction *dirs[2] = {wr, rd};
+  double *series[2] = {duplex->wr_gbps, duplex->rd_gbps};
+  cl_ulong t0 = 0, t1 = 0;
+  bool first = true;
+
+  duplex->intervals = 0;
+  if(duplex->interval <= 0.0 || duplex->max_intervals == 0 || duplex->wr_gbps == NULL || duplex->rd_gbps == NULL){
+    return;
+  }
+
+  for(unsigned d = 0; d < 2; d++){
+    for(size_t i = 0; i < dirs[d]->count; i++){
+      if(first || dirs[d]->spans[i].start < t0)
+        t0 = dirs[d]->spans[i].start;
+      if(first || dirs[d]->spans[i].end > t1)
+        t1 = dirs[d]->spans[i].end;
+      first = false;
+    }
+  }
+  if(first || t1 <= t0){
+    return;
+  }
+
+  double width = duplex->interval * 1.0e6;
+  double length = (double)(t1 - t0);
+  unsigned intervals = (unsigned)(length / width) + 1;
+  if(intervals > duplex->max_intervals)
+    intervals = duplex->max_intervals;
+
+  for(unsigned d = 0; d < 2; d++){
+    memset(series[d], 0, intervals * sizeof(double));
+    for(size_t i = 0; i < dirs[d]->count; i++){
+      double start = (double)(dirs[d]->spans[i].start - t0);
+      double end = (double)(dirs[d]->spans[i].end - t0);
+      double per_ns = (end > start) ? chunk / (end - start) : 0.0;
+
+      for(unsigned b = (unsigned)(start / width); b < intervals && b * width < end; b++){
+        double lo = (start > b * width) ? start : b * width;
+        double hi = (end < (b + 1) * width) ? end : (b + 1) * width;
+        if(hi > lo)
+          series[d][b] += per_ns * (hi - lo);
+      }
+    }
+  }
+
+  // bytes to GB/s, the last interval may be shorter
+  for(unsigned b = 0; b < intervals; b++){
+    double len = (length - b * width < width) ? length - b * width : width;
+    for(unsigned d = 0; d < 2; d++){
+      series[d][b] = (len > 0.0) ? series[d][b] / len : 0.0;
+    }
+  }
+  duplex->intervals = intervals;
+}
@@ -0,0 +1,10 @@
+// Author: Arjun Ramaswami
+
+#ifndef DUPLEX_H
+#define DUPLEX_H
+
+#include <stdbool.h>
+
+bool duplex_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, size_t chunk, size_t wr_count, size_t rd_count, fpga_duplex_t *duplex, fpga_t *timing);
+
+#endif // DUPLEX_H
@@ -0,0 +1,159 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdatomic.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "event_ring.h"
+#include "trace.h"
+#include "opencl_utils.h"
+
+// counters shared by all pipelines, updated by submission threads as well
+static atomic_size_t events_created = 0;
+static atomic_size_t events_released = 0;
+static atomic_size_t events_peak_live = 0;
+
+/**
+ * \brief  count an event created by an enqueued command
+ */
+void event_count_created(){
+  size_t created = atomic_fetch_add(&events_created, 1) + 1;
+  size_t live = created - atomic_load(&events_released);
+  size_t peak = atomic_load(&events_peak_live);
+
+  while(live > peak && !atomic_compare_exchange_weak(&events_peak_live, &peak, live));
+}
+
+/**
+ * \brief  count an event released
+ */
+void event_count_released(){
+  atomic_fetch_add(&events_released, 1);
+}
+
+/**
+ * \brief  prepare a ring with all slots free
+ * \param  capacity : number of slots, at most EVENT_RING_MAX
+ */
+void event_ring_init(event_ring *r, size_t capacity){
+  r->capacity = (capacity == 0) ? 1 : (capacity > EVENT_RING_MAX) ? EVENT_RING_MAX : capacity;
+  for(size_t i = 0; i < EVENT_RING_MAX; i++){
+    r->slots[i] = NULL;
+  }
+}
+
+/**
+ * \brief  slot to be passed as the event of the command with sequence number
+ *         seq. If the previous event of the slot is still alive, the ring is 
+ *         too small for the pipeline, so it is waited on and released.
+ * \return pointer to the free slot
+ */
+cl_event* event_ring_acquire(event_ring *r, size_t seq){
+  size_t idx = seq % r->capacity;
+
+  if(r->slots[idx] != NULL){
+    event_ring_wait(r, seq);
+  }
+
+  event_count_created();
+  return &r->slots[idx];
+}
+
+/**
+ * \brief  slot of the event of the command with sequence number seq, to be
+ *         used in a wait list
+ */
+cl_event* event_ring_get(event_ring *r, size_t seq){
+  return &r->slots[seq % r->capacity];
+}
+
+/**
+ * \brief  release the event of seq once its consumer has been enqueued with
+ *         it in the wait list or has waited on it
+ */
+void event_ring_release(event_ring *r, size_t seq){
+  size_t idx = seq % r->capacity;
+
+  if(r->slots[idx] != NULL){
+    clReleaseEvent(r->slots[idx]);
+    r->slots[idx] = NULL;
+    event_count_released();
+  }
+}
+
+/**
+ * \brief  wait for the command of seq to complete and release its event
+ */
+void event_ring_wait(event_ring *r, size_t seq){
+  size_t idx = seq % r->capacity;
+
+  if(r->slots[idx] != NULL){
+    cl_int status = 0;
+    TRACE(TRACE_WAIT, status = clWaitForEvents(1, &r->slots[idx]));
+    checkError(status, "Failed to wait for event");
+    event_ring_release(r, seq);
+  }
+}
+
+/**
+ * \brief  wait for and release every event still alive in the ring
+ */
+void event_ring_drain(event_ring *r){
+  for(size_t i = 0; i < r->capacity; i++){
+    event_ring_wait(r, i);
+  }
+}
+
+/**
+ * \brief  keep a reference to the event of seq after it is released from the
+ *         ring, to be profiled. Release it using clReleaseEvent.
+ * \return event or NULL if the slot is free
+ */
+cl_event event_ring_keep(event_ring *r, size_t seq){
+  cl_event event = r->slots[seq % r->capacity];
+  if(event != NULL){
+    clRetainEvent(event);
+  }
+  return event;
+}
+
+/**
+ * \brief  device time from the START of the first command to the END of the
+ *         last command, requires queues with profiling enabled
+ * \param  first : event of the first command
+ * \param  last  : event of the last command, must have completed
+ * \return time in milliseconds or 0.0 if profiling is not available
+ */
+double event_elapsed(cl_event first, cl_event last){
+  cl_ulong start = 0, end = 0;
+
+  if(first == NULL || last == NULL){
+    return 0.0;
+  }
+  if(clGetEventProfilingInfo(first, CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL) != CL_SUCCESS){
+    return 0.0;
+  }
+  if(clGetEventProfilingInfo(last, CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL) != CL_SUCCESS){
+    return 0.0;
+  }
+  return (end > start) ? (double)(end - start) * 1.0e-6 : 0.0;
+}
+
+/**
+ * \brief  counters of the events created and released by the pipelines
+ */
+void fpga_get_event_stats(fpga_event_stats_t *stats){
+  stats->created = atomic_load(&events_created);
+  stats->released = atomic_load(&events_released);
+  stats->peak_live = atomic_load(&events_peak_live);
+}
+
+/**
+ * \brief  reset the event counters, only valid while no events are alive
+ */
+void fpga_reset_event_stats(){
+  atomic_store(&events_created, 0);
+  atomic_store(&events_released, 0);
+  atomic_store(&events_peak_live, 0);
+}
@@ -0,0 +1,40 @@
+// Author: Arjun Ramaswami
+
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <stddef.h>
+
+// largest number of events a ring keeps alive
+#define EVENT_RING_MAX 16
+
+/**
+ * Fixed ring of event slots indexed by the sequence number of the command 
+ * that creates the event. Slots are reused every capacity commands.
+ */
+typedef struct event_ring {
+  cl_event slots[EVENT_RING_MAX];
+  size_t capacity;
+} event_ring;
+
+void event_ring_init(event_ring *r, size_t capacity);
+
+cl_event* event_ring_acquire(event_ring *r, size_t seq);
+
+cl_event* event_ring_get(event_ring *r, size_t seq);
+
+void event_ring_release(event_ring *r, size_t seq);
+
+void event_ring_wait(event_ring *r, size_t seq);
+
+void event_ring_drain(event_ring *r);
+
+cl_event event_ring_keep(event_ring *r, size_t seq);
+
+double event_elapsed(cl_event first, cl_event last);
+
+void event_count_created();
+
+void event_count_released();
+
+#endif // EVENT_RING_H
@@ -0,0 +1,547 @@
+// Author: Arjun Ramaswami
+
+#define _GNU_SOURCE // O_DIRECT
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "file_stream.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "event_ring.h"
+#include "aio.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+// O_DIRECT offsets, lengths and buffers are aligned to the logical block size
+#define FILE_ALIGNMENT 4096
+
+/**
+ * Input and output of a stream, either mapped or read and written with
+ * O_DIRECT through staging buffers of depth chunks
+ */
+typedef struct file_io {
+  bool staging;
+  bool async;             /**< one staging buffer per chunk, in and out */
+  bool direct;
+  int in_fd, out_fd;
+  size_t bytes;
+  unsigned char *in_map, *out_map;
+  unsigned char *in_stage, *out_stage;
+} file_io;
+
+// function prototypes
+static bool file_open(file_io *io, const char *inp_path, const char *out_path, size_t chunk, size_t depth);
+static void file_close(file_io *io);
+static bool source_chunk(file_io *io, size_t offset, size_t len, void *stage, double *read_t);
+static bool sink_chunk(file_io *io, size_t offset, size_t len, void *stage, double *write_t);
+static void direct_tail(file_io *io, size_t len);
+static bool file_stream_async(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, file_io *io, size_t chunk, size_t depth, fpga_file_t *file, fpga_t *timing);
+
+/**
+ * \brief  Stream a file of float2 points to the device and back to an output
+ *         file of the same size. Chunk i is read from disk while earlier
+ *         chunks are in flight, and written to the output file once its read
+ *         from the device completed, depth chunks are in flight. The
+ *         asynchronous modes keep the file reads and writes in flight too,
+ *         see file_stream_async().
+ * \param  context  : context to create the device buffers
+ * \param  queue_wr : queue for writes
+ * \param  queue_rd : queue for reads, can be the same as queue_wr
+ * \param  config   : depth and banks of the device buffers
+ * \param  inp_path : input file, size a multiple of float2
+ * \param  out_path : output file, created or truncated
+ * \param  file     : chunk and mode, bytes and host time of each file stage
+ *                    are set
+ * \param  timing   : pcie_write_t and pcie_read_t the summed device time of
+ *                    each direction, submit_t and device_t
+ * \return true if successful, all chunks are written to the output file
+ */
+bool file_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, const char *inp_path, const char *out_path, fpga_file_t *file, fpga_t *timing){
+  cl_int status = 0;
+  cl_event first = NULL, last = NULL;
+  bool success = true;
+  file_io io;
+
+  size_t chunk = file->chunk;
+  size_t depth = (config->depth > EVENT_RING_MAX) ? EVENT_RING_MAX : config->depth;
+  if(chunk == 0 || chunk % FILE_ALIGNMENT != 0 || depth == 0){
+    return false;
+  }
+
+  io.staging = (file->io != FPGA_FILE_MMAP);
+  io.async = (file->io == FPGA_FILE_URING || file->io == FPGA_FILE_THREADS);
+  io.direct = io.staging && file->direct;
+  if(!file_open(&io, inp_path, out_path, chunk, depth)){
+    return false;
+  }
+
+  size_t num_chunks = (io.bytes + chunk - 1) / chunk;
+  if(depth > num_chunks){
+    depth = num_chunks;
+  }
+
+  file->bytes = io.bytes;
+  file->read_t = 0.0;
+  file->write_t = 0.0;
+  timing->pcie_write_t = 0.0;
+  timing->pcie_read_t = 0.0;
+  timing->submit_t = 0.0;
+
+  if(io.async){
+    success = file_stream_async(context, queue_wr, queue_rd, config, &io, chunk, depth, file, timing);
+    file_close(&io);
+    return success;
+  }
+
+  cl_mem d_buf[EVENT_RING_MAX];
+  event_ring writeEvents, readEvents;
+  event_ring_init(&writeEvents, depth);
+  event_ring_init(&readEvents, depth);
+
+  for(size_t b = 0; b < depth; b++){
+    d_buf[b] = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(b, config->banks), chunk, NULL, &status);
+    checkError(status, "Failed to allocate device buffer %lu\n", b);
+  }
+
+
+  for(size_t i = 0; i < num_chunks + depth; i++){
+    // retire the chunk depth steps before, frees its buffer and staging slot
+    if(i >= depth){
+      size_t r = i - depth;
+      size_t offset = r * chunk;
+      size_t len = (offset + chunk > io.bytes) ? (io.bytes - offset) : chunk;
+      cl_ulong start, end;
+
+      status = clWaitForEvents(1, event_ring_get(&readEvents, r));
+      checkError(status, "Failed to wait for read");
+      clGetEventProfilingInfo(*event_ring_get(&writeEvents, r), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+      clGetEventProfilingInfo(*event_ring_get(&writeEvents, r), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+      timing->pcie_write_t += (end - start) * 1.0e-6;
+      clGetEventProfilingInfo(*event_ring_get(&readEvents, r), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+      clGetEventProfilingInfo(*event_ring_get(&readEvents, r), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+      timing->pcie_read_t += (end - start) * 1.0e-6;
+      if(r == num_chunks - 1)
+        last = event_ring_keep(&readEvents, r);
+      event_ring_release(&writeEvents, r);
+      event_ring_release(&readEvents, r);
+
+      void *stage = io.staging ? io.out_stage + (r % depth) * chunk : NULL;
+      if(success && !sink_chunk(&io, offset, len, stage, &file->write_t)){
+        success = false;
+      }
+    }
+    if(i >= num_chunks){
+      continue;
+    }
+
+    size_t b = i % depth;
+    size_t offset = i * chunk;
+    size_t len = (offset + chunk > io.bytes) ? (io.bytes - offset) : chunk;
+    void *src = io.staging ? io.in_stage + b * chunk : io.in_map + offset;
+    void *dst = io.staging ? io.out_stage + b * chunk : io.out_map + offset;
+
+    // the remaining chunks are retired without issuing on failure
+    if(!success || !source_chunk(&io, offset, len, src, &file->read_t)){
+      success = false;
+      num_chunks = i;
+      continue;
+    }
+
+    double start = getTimeinMilliSec();
+    status = clEnqueueWriteBuffer(queue_wr, d_buf[b], CL_FALSE, 0, len, src, 0, NULL, event_ring_acquire(&writeEvents, i));
+    checkError(status, "Failed to write to DDR");
+    clFlush(queue_wr);
+    if(i == 0)
+      first = event_ring_keep(&writeEvents, i);
+
+    status = clEnqueueReadBuffer(queue_rd, d_buf[b], CL_FALSE, 0, len, dst, 1, event_ring_get(&writeEvents, i), event_ring_acquire(&readEvents, i));
+    checkError(status, "Failed to read");
+    clFlush(queue_rd);
+    timing->submit_t += getTimeinMilliSec() - start;
+  }
+
+  timing->device_t = (first != NULL && last != NULL) ? event_elapsed(first, last) : 0.0;
+  if(first != NULL)
+    clReleaseEvent(first);
+  if(last != NULL)
+    clReleaseEvent(last);
+
+  for(size_t b = 0; b < depth; b++){
+    clReleaseMemObject(d_buf[b]);
+  }
+  file_close(&io);
+  return success;
+}
+
+/**
+ * \brief  open the input and create the output of the same size, map both or
+ *         allocate the staging buffers for O_DIRECT
+ * \return true if successful, io is released otherwise
+ */
+static bool file_open(file_io *io, const char *inp_path, const char *out_path, size_t chunk, size_t depth){
+  struct stat st;
+  int flags = io->direct ? O_DIRECT : 0;
+
+  io->in_map = io->out_map = NULL;
+  io->in_stage = io->out_stage = NULL;
+  io->bytes = 0;
+
+  io->in_fd = open(inp_path, O_RDONLY | flags);
+  io->out_fd = open(out_path, O_RDWR | O_CREAT | O_TRUNC | flags, 0644);
+  if(io->in_fd < 0 || io->out_fd < 0){
+    fprintf(stderr, "Unable to open %s\n", (io->in_fd < 0) ? inp_path : out_path);
+    file_close(io);
+    return false;
+  }
+
+  if(fstat(io->in_fd, &st) != 0 || st.st_size == 0 || st.st_size % sizeof(float2) != 0){
+    fprintf(stderr, "Size of %s is not a multiple of float2\n", inp_path);
+    file_close(io);
+    return false;
+  }
+  io->bytes = st.st_size;
+
+  if(ftruncate(io->out_fd, io->bytes) != 0){
+    fprintf(stderr, "Unable to resize %s\n", out_path);
+    file_close(io);
+    return false;
+  }
+
+  if(io->staging){
+    if(posix_memalign((void **)&io->in_stage, FILE_ALIGNMENT, chunk * depth) != 0)
+      io->in_stage = NULL;
+    if(!io->async && posix_memalign((void **)&io->out_stage, FILE_ALIGNMENT, chunk * depth) != 0)
+      io->out_stage = NULL;
+    if(io->in_stage == NULL || (!io->async && io->out_stage == NULL)){
+      file_close(io);
+      return false;
+    }
+    return true;
+  }
+
+  io->in_map = mmap(NULL, io->bytes, PROT_READ, MAP_SHARED, io->in_fd, 0);
+  io->out_map = mmap(NULL, io->bytes, PROT_READ | PROT_WRITE, MAP_SHARED, io->out_fd, 0);
+  if(io->in_map == MAP_FAILED || io->out_map == MAP_FAILED){
+    fprintf(stderr, "Unable to map %s\n", (io->in_map == MAP_FAILED) ? inp_path : out_path);
+    if(io->in_map == MAP_FAILED)
+      io->in_map = NULL;
+    if(io->out_map == MAP_FAILED)
+      io->out_map = NULL;
+    file_close(io);
+    return false;
+  }
+  madvise(io->in_map, io->bytes, MADV_SEQUENTIAL);
+  return true;
+}
+
+/**
+ * \brief  unmap, free and close whatever of io is open
+ */
+static void file_close(file_io *io){
+  if(io->in_map != NULL)
+    munmap(io->in_map, io->bytes);
+  if(io->out_map != NULL)
+    munmap(io->out_map, io->bytes);
+  free(io->in_stage);
+  free(io->out_stage);
+  if(io->in_fd >= 0)
+    close(io->in_fd);
+  if(io->out_fd >= 0)
+    close(io->out_fd);
+}
+
+/**
+ * \brief  bring a chunk of the input into host memory. The staging buffer
+ *         is read into, mapped chunks are faulted in by touching every
+ *         page so the disk time is not hidden in the DMA, and read ahead of
+ *         the next chunk is started.
+ * \param  stage  : staging buffer or the mapped chunk
+ * \return true if the chunk was read
+ */
+static bool source_chunk(file_io *io, size_t offset, size_t len, void *stage, double *read_t){
+  double start = getTimeinMilliSec();
+
+  if(io->staging){
+    // the tail is read with an aligned length, the read ends at end of file
+    size_t aligned = (len + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+    ssize_t ret = pread(io->in_fd, stage, aligned, offset);
+    *read_t += getTimeinMilliSec() - start;
+    return (ret >= 0 && (size_t)ret >= len);
+  }
+
+  volatile unsigned char *page = (volatile unsigned char *)stage;
+  unsigned char sum = 0;
+  for(size_t p = 0; p < len; p += FILE_ALIGNMENT){
+    sum += page[p];
+  }
+  (void)sum;
+  if(offset + len < io->bytes){
+    size_t next = (offset + 2 * len > io->bytes) ? io->bytes - offset - len : len;
+    madvise(io->in_map + offset + len, next, MADV_WILLNEED);
+  }
+  *read_t += getTimeinMilliSec() - start;
+  return true;
+}
+
+/**
+ * \brief  persist a chunk of the output. The staging buffer is written,
+ *         mapped chunks are synchronized to disk.
+ * \return true if the chunk was written
+ */
+static bool sink_chunk(file_io *io, size_t offset, size_t len, void *stage, double *write_t){
+  double start = getTimeinMilliSec();
+  bool success = true;
+
+  if(io->staging){
+    direct_tail(io, len);
+    ssize_t ret = pwrite(io->out_fd, stage, len, offset);
+    success = (ret >= 0 && (size_t)ret == len);
+  }
+  else{
+    success = (msync(io->out_map + offset, len, MS_SYNC) == 0);
+  }
+
+  *write_t += getTimeinMilliSec() - start;
+  return success;
+}
+
+/**
+ * \brief  clear O_DIRECT of the output before writing the tail, its length
+ *         is not aligned
+ */
+static void direct_tail(file_io *io, size_t len){
+  if(io->direct && len % FILE_ALIGNMENT != 0){
+    int flags = fcntl(io->out_fd, F_GETFL);
+    fcntl(io->out_fd, F_SETFL, flags & ~O_DIRECT);
+  }
+}
+
+/**
+ * States of a slot of the asynchronous stream, the staging buffer of a slot
+ * is read from disk, written to and read back from the device in place and
+ * written to disk, before the slot takes the next chunk not yet read. Events
+ * of the slot are kept in the rings at the index of the slot.
+ */
+typedef enum { SLOT_FREE, SLOT_READ, SLOT_DEVICE, SLOT_WRITE } slot_state;
+
+typedef struct slot {
+  slot_state state;
+  size_t chunk;     /**< index of the chunk of the slot */
+  cl_mem buf;       /**< device buffer of the slot */
+} slot;
+
+/**
+ * Reads or writes in flight, the stage is busy while at least one is
+ */
+typedef struct busy {
+  unsigned inflight;
+  double since;
+  double *total;
+} busy;
+
+static void busy_start(busy *b){
+  if(b->inflight++ == 0)
+    b->since = getTimeinMilliSec();
+}
+
+static void busy_end(busy *b){
+  if(--b->inflight == 0)
+    *b->total += getTimeinMilliSec() - b->since;
+}
+
+/**
+ * \brief  Stream with depth disk reads and writes in flight on io_uring or
+ *         the thread pool, one slot per chunk in flight. The calling thread
+ *         only submits: completed reads are handed to the device queues,
+ *         completed device reads to the disk writer and completed writes
+ *         free the slot for its next chunk. When nothing completed it waits
+ *         on the oldest chunk in flight.
+ * \return true if every chunk was written
+ */
+static bool file_stream_async(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, file_io *io, size_t chunk, size_t depth, fpga_file_t *file, fpga_t *timing){
+  cl_int status = 0;
+  cl_event first = NULL, last = NULL;
+  bool success = true;
+  size_t num_chunks = (io->bytes + chunk - 1) / chunk;
+  size_t next = 0;
+  unsigned active = 0;
+
+  slot slots[EVENT_RING_MAX];
+  void *bufs[EVENT_RING_MAX];
+  event_ring writeEvents, readEvents;
+  event_ring_init(&writeEvents, depth);
+  event_ring_init(&readEvents, depth);
+
+  for(size_t b = 0; b < depth; b++){
+    slots[b].state = SLOT_FREE;
+    slots[b].buf = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(b, config->banks), chunk, NULL, &status);
+    checkError(status, "Failed to allocate device buffer %lu\n", b);
+    bufs[b] = io->in_stage + b * chunk;
+  }
+
+  // staging buffers are registered with io_uring, DMA uses the same buffers
+  file_aio *aio = aio_create(depth, (file->io == FPGA_FILE_URING), bufs, depth, chunk);
+  if(aio == NULL){
+    for(size_t b = 0; b < depth; b++){
+      clReleaseMemObject(slots[b].buf);
+    }
+    return false;
+  }
+  file->io = aio_is_uring(aio) ? FPGA_FILE_URING : FPGA_FILE_THREADS;
+
+  busy reading = {0, 0.0, &file->read_t};
+  busy writing = {0, 0.0, &file->write_t};
+
+  // a read of every slot
+  for(size_t b = 0; b < depth; b++){
+    size_t len = (next * chunk + chunk > io->bytes) ? io->bytes - next * chunk : chunk;
+    size_t aligned = (len + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT;
+    slots[b].chunk = next;
+    slots[b].state = SLOT_READ;
+    busy_start(&reading);
+    if(!aio_read(aio, io->in_fd, b, aligned, next * chunk, b)){
+      busy_end(&reading);
+      slots[b].state = SLOT_FREE;
+      success = false;
+      break;
+    }
+    next++;
+    active++;
+  }
+
+  while(active > 0){
+    bool progress = false;
+    uint64_t tag;
+    ssize_t res;
+
+    // device reads completed, in the order of the chunks
+    for(size_t b = 0; b < depth; b++){
+      slot *s = &slots[b];
+      cl_int exec = CL_COMPLETE;
+      if(s->state != SLOT_DEVICE){
+        continue;
+      }
+      clGetEventInfo(*event_ring_get(&readEvents, b), CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(cl_int), &exec, NULL);
+      if(exec != CL_COMPLETE){
+        continue;
+      }
+
+      cl_ulong start, end;
+      clGetEventProfilingInfo(*event_ring_get(&writeEvents, b), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+      clGetEventProfilingInfo(*event_ring_get(&writeEvents, b), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+      timing->pcie_write_t += (end - start) * 1.0e-6;
+      clGetEventProfilingInfo(*event_ring_get(&readEvents, b), CL_PROFILING_COMMAND_START, sizeof(cl_ulong), &start, NULL);
+      clGetEventProfilingInfo(*event_ring_get(&readEvents, b), CL_PROFILING_COMMAND_END, sizeof(cl_ulong), &end, NULL);
+      timing->pcie_read_t += (end - start) * 1.0e-6;
+      if(s->chunk == num_chunks - 1)
+        last = event_ring_keep(&readEvents, b);
+      event_ring_release(&writeEvents, b);
+      event_ring_release(&readEvents, b);
+      progress = true;
+
+      size_t len = (s->chunk * chunk + chunk > io->bytes) ? io->bytes - s->chunk * chunk : chunk;
+      direct_tail(io, len);
+      s->state = SLOT_WRITE;
+      busy_start(&writing);
+      if(!success || !aio_write(aio, io->out_fd, b, len, s->chunk * chunk, b)){
+        busy_end(&writing);
+        s->state = SLOT_FREE;
+        active--;
+        success = false;
+      }
+    }
+
+    // disk reads and writes completed, wait for the oldest chunk if none
+    bool reaped = aio_reap(aio, false, &tag, &res);
+    if(!reaped && !progress){
+      slot *oldest = NULL;
+      for(size_t b = 0; b < depth; b++){
+        if(slots[b].state != SLOT_FREE && (oldest == NULL || slots[b].chunk < oldest->chunk))
+          oldest = &slots[b];
+      }
+      if(oldest->state == SLOT_DEVICE){
+        status = clWaitForEvents(1, event_ring_get(&readEvents, oldest - slots));
+        checkError(status, "Failed to wait for read");
+        continue;
+      }
+      reaped = aio_reap(aio, true, &tag, &res);
+    }
+    if(!reaped){
+      continue;
+    }
+
+    slot *s = &slots[tag];
+    size_t offset = s->chunk * chunk;
+    size_t len = (offset + chunk > io->bytes) ? io->bytes - offset : chunk;
+    void *stage = bufs[tag];
+
+    if(s->state == SLOT_READ){
+      busy_end(&reading);
+      if(!success || res < 0 || (size_t)res < len){
+        s->state = SLOT_FREE;
+        active--;
+        success = false;
+        continue;
+      }
+
+      double start = getTimeinMilliSec();
+      status = clEnqueueWriteBuffer(queue_wr, s->buf, CL_FALSE, 0, len, stage, 0, NULL, event_ring_acquire(&writeEvents, tag));
+      checkError(status, "Failed to write to DDR");
+      clFlush(queue_wr);
+      if(s->chunk == 0)
+        first = event_ring_keep(&writeEvents, tag);
+
+      // read back in place once the write has left the staging buffer
+      status = clEnqueueReadBuffer(queue_rd, s->buf, CL_FALSE, 0, len, stage, 1, event_ring_get(&writeEvents, tag), event_ring_acquire(&readEvents, tag));
+      checkError(status, "Failed to read");
+      clFlush(queue_rd);
+      timing->submit_t += getTimeinMilliSec() - start;
+      s->state = SLOT_DEVICE;
+    }
+    else{
+      busy_end(&writing);
+      if(res < 0 || (size_t)res != len){
+        success = false;
+      }
+
+      // the slot takes its next chunk
+      if(!success || next == num_chunks){
+        s->state = SLOT_FREE;
+        active--;
+        continue;
+      }
+      len = (next * chunk + chunk > io->bytes) ? io->bytes - next * chunk : chunk;
+      s->chunk = next++;
+      s->state = SLOT_READ;
+      busy_start(&reading);
+      if(!aio_read(aio, io->in_fd, tag, (len + FILE_ALIGNMENT - 1) / FILE_ALIGNMENT * FILE_ALIGNMENT, s->chunk * chunk, tag)){
+        busy_end(&reading);
+        s->state = SLOT_FREE;
+        active--;
+        success = false;
+      }
+    }
+  }
+
+  aio_destroy(aio);
+
+  timing->device_t = (first != NULL && last != NULL) ? event_elapsed(first, last) : 0.0;
+  if(first != NULL)
+    clReleaseEvent(first);
+  if(last != NULL)
+    clReleaseEvent(last);
+
+  for(size_t b = 0; b < depth; b++){
+    clReleaseMemObject(slots[b].buf);
+  }
+  return success;
+}
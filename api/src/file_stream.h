@@ -0,0 +1,10 @@
+// Author: Arjun Ramaswami
+
+#ifndef FILE_STREAM_H
+#define FILE_STREAM_H
+
+#include <stdbool.h>
+
+bool file_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, const char *inp_path, const char *out_path, fpga_file_t *file, fpga_t *timing);
+
+#endif // FILE_STREAM_H
@@ -0,0 +1,639 @@
+// Author: Arjun Ramaswami
+
+#define _GNU_SOURCE // pread, pwrite
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "flow.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+static const char *const stage_names[] = {
+  "generate", "file_read", "h2d", "kernel", "d2h", "verify", "file_write"
+};
+#define NUM_STAGE_KINDS (sizeof(stage_names) / sizeof(stage_names[0]))
+
+/**
+ * Chunk moving through the flow with its host and device buffers
+ */
+typedef struct flow_item {
+  size_t offset;        /**< bytes from the start of the stream */
+  size_t len;           /**< bytes of the chunk */
+  float2 *host;
+  cl_mem d_in, d_out;   /**< d_out is written by the kernel */
+} flow_item;
+
+/**
+ * Bounded blocking queue of chunks between two stages. Occupancy is the
+ * number of chunks integrated over time.
+ */
+typedef struct flow_queue {
+  flow_item **items;
+  unsigned capacity, head, count;
+  bool closed;
+  pthread_mutex_t lock;
+  pthread_cond_t not_empty, not_full;
+  double area, last;
+  size_t peak;
+} flow_queue;
+
+typedef struct flow_stage {
+  fpga_stage_t kind;
+  char *arg;
+  fpga_flow_t *flow;
+  flow_queue *in, *out;
+  int fd;               /**< file of file stages */
+  cl_kernel kernel;
+  float2 *check;        /**< input read back by verify */
+  fpga_stage_stats_t stats;
+  pthread_t thread;
+} flow_stage;
+
+struct fpga_flow {
+  size_t total, chunk;
+  unsigned depth;
+  flow_stage stages[FPGA_FLOW_MAX_STAGES];
+  unsigned num_stages;
+  bool on_device;       /**< data is on the device after the last stage */
+  bool has_kernel;
+
+  // state of a run
+  cl_command_queue queue_h2d, queue_kernel, queue_d2h;
+  size_t step;          /**< chunk of the run, at most a device buffer */
+  size_t next;          /**< offset of the next chunk of the source */
+  int src_fd;           /**< input of a file source, read back by verify */
+  atomic_bool failed;
+};
+
+// function prototypes
+static bool queue_init(flow_queue *q, unsigned capacity, double now);
+static void queue_free(flow_queue *q);
+static void queue_track(flow_queue *q, double now);
+static bool queue_push(flow_queue *q, flow_item *item, double *wait_t);
+static flow_item* queue_pop(flow_queue *q, double *wait_t);
+static void queue_close(flow_queue *q);
+static void* stage_thread(void *arg);
+static bool stage_work(flow_stage *st, flow_item *item);
+static bool stage_open(flow_stage *st, cl_program program);
+static void stage_close(flow_stage *st);
+static void pattern(float2 *host, size_t offset, size_t len);
+
+/**
+ * \brief  create an empty flow
+ * \return flow or NULL if chunk is not a multiple of float2 or depth is 0
+ */
+fpga_flow_t* fpga_flow_create(size_t total, size_t chunk, unsigned depth){
+  if(chunk == 0 || chunk % sizeof(float2) != 0 || depth == 0){
+    return NULL;
+  }
+
+  fpga_flow_t *flow = (fpga_flow_t *)calloc(1, sizeof(fpga_flow_t));
+  if(flow == NULL){
+    return NULL;
+  }
+  flow->total = total;
+  flow->chunk = chunk;
+  flow->depth = depth;
+  flow->src_fd = -1;
+  return flow;
+}
+
+/**
+ * \brief  append a stage if it can follow the stages before: sources only
+ *         first, kernel and D2H on data on the device, the others on data
+ *         on the host
+ */
+bool fpga_flow_add(fpga_flow_t *flow, fpga_stage_t stage, const char *arg){
+  if(flow == NULL || (unsigned)stage >= NUM_STAGE_KINDS || flow->num_stages == FPGA_FLOW_MAX_STAGES){
+    return false;
+  }
+
+  bool source = (stage == FPGA_STAGE_GENERATE || stage == FPGA_STAGE_FILE_READ);
+  bool needs_arg = (stage == FPGA_STAGE_FILE_READ || stage == FPGA_STAGE_KERNEL || stage == FPGA_STAGE_FILE_WRITE);
+  if(source != (flow->num_stages == 0) || (needs_arg && (arg == NULL || strlen(arg) == 0))){
+    return false;
+  }
+  if((stage == FPGA_STAGE_KERNEL || stage == FPGA_STAGE_D2H) != flow->on_device && !source){
+    return false;
+  }
+  if(stage == FPGA_STAGE_KERNEL && flow->has_kernel){
+    return false;
+  }
+
+  flow_stage *st = &flow->stages[flow->num_stages];
+  memset(st, 0, sizeof(flow_stage));
+  st->kind = stage;
+  st->arg = needs_arg ? strdup(arg) : NULL;
+  st->flow = flow;
+  st->fd = -1;
+  flow->num_stages++;
+
+  if(stage == FPGA_STAGE_H2D)
+    flow->on_device = true;
+  if(stage == FPGA_STAGE_D2H)
+    flow->on_device = false;
+  if(stage == FPGA_STAGE_KERNEL)
+    flow->has_kernel = true;
+  return true;
+}
+
+/**
+ * \brief  append the stages of a comma separated description, name:arg
+ * \return true if every stage was added
+ */
+bool fpga_flow_parse(fpga_flow_t *flow, const char *spec){
+  if(flow == NULL || spec == NULL){
+    return false;
+  }
+
+  char *copy = strdup(spec);
+  char *save = NULL;
+  bool success = (copy != NULL);
+
+  for(char *tok = strtok_r(copy, ",", &save); success && tok != NULL; tok = strtok_r(NULL, ",", &save)){
+    char *arg = strchr(tok, ':');
+    if(arg != NULL){
+      *arg++ = '\0';
+    }
+
+    unsigned kind = 0;
+    while(kind < NUM_STAGE_KINDS && strcmp(tok, stage_names[kind]) != 0){
+      kind++;
+    }
+    success = (kind < NUM_STAGE_KINDS) && fpga_flow_add(flow, (fpga_stage_t)kind, arg);
+  }
+
+  free(copy);
+  return success;
+}
+
+/**
+ * \brief  counters of each stage of the last run
+ * \return number of stages
+ */
+unsigned fpga_flow_stats(const fpga_flow_t *flow, fpga_stage_stats_t *stats){
+  if(flow == NULL || stats == NULL){
+    return 0;
+  }
+  for(unsigned s = 0; s < flow->num_stages; s++){
+    stats[s] = flow->stages[s].stats;
+  }
+  return flow->num_stages;
+}
+
+/**
+ * \brief  release a flow, not while it runs
+ */
+void fpga_flow_destroy(fpga_flow_t *flow){
+  if(flow == NULL){
+    return;
+  }
+  for(unsigned s = 0; s < flow->num_stages; s++){
+    free(flow->stages[s].arg);
+  }
+  free(flow);
+}
+
+/**
+ * \brief  name of the kernel of the flow
+ * \return name or NULL if the flow has no kernel stage
+ */
+const char* flow_kernel(const fpga_flow_t *flow){
+  for(unsigned s = 0; s < flow->num_stages; s++){
+    if(flow->stages[s].kind == FPGA_STAGE_KERNEL)
+      return flow->stages[s].arg;
+  }
+  return NULL;
+}
+
+/**
+ * \brief  Run the flow, a thread per stage. depth + stages chunks circulate:
+ *         the source takes a free chunk, every stage passes it on through
+ *         its output queue and the last stage returns it to the free queue.
+ *         Stages on the device enqueue on their own queue and wait for
+ *         completion before passing the chunk on.
+ * \param  program     : built program, required if the flow has a kernel
+ * \param  queue_h2d   : queue of the H2D stage
+ * \param  queue_kernel: queue of the kernel stage
+ * \param  queue_d2h   : queue of the D2H stage
+ * \param  max_chunk   : bytes a device buffer can hold, larger chunks are
+ *                       split
+ * \param  timing      : pcie_write_t and pcie_read_t set to the busy time of
+ *                       the H2D and D2H stages
+ * \return true if the source was exhausted and every stage succeeded
+ */
+bool flow_run(fpga_flow_t *flow, cl_context context, cl_program program, cl_command_queue queue_h2d, cl_command_queue queue_kernel, cl_command_queue queue_d2h, size_t max_chunk, fpga_t *timing){
+  cl_int status = 0;
+  bool success = true;
+  unsigned num = flow->num_stages;
+
+  if(num == 0 || (flow->has_kernel && program == NULL)){
+    return false;
+  }
+
+  flow->queue_h2d = queue_h2d;
+  flow->queue_kernel = queue_kernel;
+  flow->queue_d2h = queue_d2h;
+  flow->step = (flow->chunk > max_chunk) ? max_chunk - max_chunk % sizeof(float2) : flow->chunk;
+  flow->next = 0;
+  flow->src_fd = -1;
+  atomic_init(&flow->failed, false);
+
+  for(unsigned s = 0; s < num; s++){
+    memset(&flow->stages[s].stats, 0, sizeof(fpga_stage_stats_t));
+    flow->stages[s].stats.name = stage_names[flow->stages[s].kind];
+    if(success && !stage_open(&flow->stages[s], program)){
+      success = false;
+    }
+  }
+
+  bool device = false;
+  for(unsigned s = 0; s < num; s++){
+    device |= (flow->stages[s].kind == FPGA_STAGE_H2D);
+  }
+
+  // chunks in the queues and one in each stage
+  unsigned num_items = flow->depth + num;
+  flow_item *items = (flow_item *)calloc(num_items, sizeof(flow_item));
+  flow_queue *queues = (flow_queue *)calloc(num, sizeof(flow_queue));
+  unsigned num_queues = 0;
+  double start = getTimeinMilliSec();
+
+  if(items == NULL || queues == NULL){
+    success = false;
+  }
+  for(unsigned i = 0; success && i < num_items; i++){
+    items[i].host = (float2 *)alignedMalloc(flow->step);
+    if(items[i].host == NULL){
+      success = false;
+      break;
+    }
+    if(device){
+      items[i].d_in = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(i, 2), flow->step, NULL, &status);
+      checkError(status, "Failed to allocate device buffer %u\n", i);
+    }
+    if(flow->has_kernel){
+      items[i].d_out = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(i + 1, 2), flow->step, NULL, &status);
+      checkError(status, "Failed to allocate device buffer %u\n", i);
+    }
+  }
+
+  // queue 0 holds the free chunks, queue s is the input of stage s
+  for(unsigned q = 0; success && q < num; q++){
+    if(!queue_init(&queues[q], (q == 0) ? num_items : flow->depth, start)){
+      success = false;
+      break;
+    }
+    num_queues++;
+  }
+
+  if(success){
+    for(unsigned i = 0; i < num_items; i++){
+      queue_push(&queues[0], &items[i], NULL);
+    }
+    for(unsigned s = 0; s < num; s++){
+      flow->stages[s].in = &queues[s];
+      flow->stages[s].out = &queues[(s + 1) % num];
+    }
+
+    start = getTimeinMilliSec();
+    unsigned started = 0;
+    for(unsigned s = 0; s < num; s++){
+      if(pthread_create(&flow->stages[s].thread, NULL, stage_thread, &flow->stages[s]) != 0){
+        // the stages started drain once the source stops, chunks pushed to
+        // the stage that did not start are dropped. The free queue is closed
+        // as the chunks no longer return to the source.
+        atomic_store(&flow->failed, true);
+        if(s > 0){
+          queue_close(&queues[s]);
+          queue_close(&queues[0]);
+        }
+        break;
+      }
+      started++;
+    }
+    for(unsigned s = 0; s < started; s++){
+      pthread_join(flow->stages[s].thread, NULL);
+    }
+    success = (started == num) && !atomic_load(&flow->failed);
+  }
+  double end = getTimeinMilliSec();
+
+  for(unsigned q = 0; q < num_queues; q++){
+    queue_track(&queues[q], end);
+    flow->stages[q].stats.occupancy = (end > start) ? queues[q].area / (end - start) : 0.0;
+    flow->stages[q].stats.peak = queues[q].peak;
+    queue_free(&queues[q]);
+  }
+  for(unsigned i = 0; items != NULL && i < num_items; i++){
+    free(items[i].host);
+    if(items[i].d_in)
+      clReleaseMemObject(items[i].d_in);
+    if(items[i].d_out)
+      clReleaseMemObject(items[i].d_out);
+  }
+  free(items);
+  free(queues);
+  for(unsigned s = 0; s < num; s++){
+    stage_close(&flow->stages[s]);
+  }
+
+  for(unsigned s = 0; s < num; s++){
+    if(flow->stages[s].kind == FPGA_STAGE_H2D)
+      timing->pcie_write_t = flow->stages[s].stats.busy_t;
+    if(flow->stages[s].kind == FPGA_STAGE_D2H)
+      timing->pcie_read_t = flow->stages[s].stats.busy_t;
+  }
+  return success;
+}
+
+/**
+ * \brief  open the file, create the kernel or allocate the buffer a stage
+ *         needs, a file source sets the total of the flow
+ */
+static bool stage_open(flow_stage *st, cl_program program){
+  fpga_flow_t *flow = st->flow;
+  cl_int status = 0;
+  struct stat sb;
+
+  switch(st->kind){
+    case FPGA_STAGE_FILE_READ:
+      st->fd = open(st->arg, O_RDONLY);
+      if(st->fd < 0 || fstat(st->fd, &sb) != 0){
+        fprintf(stderr, "Unable to open %s\n", st->arg);
+        return false;
+      }
+      if(sb.st_size == 0 || sb.st_size % sizeof(float2) != 0){
+        fprintf(stderr, "Size of %s is not a multiple of float2\n", st->arg);
+        return false;
+      }
+      flow->total = sb.st_size;
+      flow->src_fd = st->fd;
+      return true;
+    case FPGA_STAGE_FILE_WRITE:
+      st->fd = open(st->arg, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      if(st->fd < 0){
+        fprintf(stderr, "Unable to open %s\n", st->arg);
+        return false;
+      }
+      return true;
+    case FPGA_STAGE_KERNEL:
+      st->kernel = clCreateKernel(program, st->arg, &status);
+      checkError(status, "Failed to create kernel %s", st->arg);
+      return true;
+    case FPGA_STAGE_VERIFY:
+      st->check = (float2 *)alignedMalloc(flow->step);
+      return (st->check != NULL);
+    default:
+      return true;
+  }
+}
+
+/**
+ * \brief  release what stage_open acquired
+ */
+static void stage_close(flow_stage *st){
+  if(st->fd >= 0){
+    close(st->fd);
+    st->fd = -1;
+  }
+  if(st->kernel != NULL){
+    clReleaseKernel(st->kernel);
+    st->kernel = NULL;
+  }
+  free(st->check);
+  st->check = NULL;
+}
+
+/**
+ * \brief  take chunks from the input queue, process them and pass them on.
+ *         The source stops when the stream is exhausted or a stage failed,
+ *         the other stages when their input is closed and empty.
+ */
+static void* stage_thread(void *arg){
+  flow_stage *st = (flow_stage *)arg;
+  fpga_flow_t *flow = st->flow;
+  bool source = (st->kind == FPGA_STAGE_GENERATE || st->kind == FPGA_STAGE_FILE_READ);
+
+  while(true){
+    if(source && (flow->next >= flow->total || atomic_load(&flow->failed))){
+      break;
+    }
+    flow_item *item = queue_pop(st->in, &st->stats.wait_in_t);
+    if(item == NULL){
+      break;
+    }
+
+    if(source){
+      item->offset = flow->next;
+      item->len = (flow->total - flow->next < flow->step) ? flow->total - flow->next : flow->step;
+      flow->next += item->len;
+    }
+
+    double start = getTimeinMilliSec();
+    if(!stage_work(st, item)){
+      atomic_store(&flow->failed, true);
+    }
+    st->stats.busy_t += getTimeinMilliSec() - start;
+    st->stats.items++;
+    st->stats.bytes += item->len;
+
+    if(!queue_push(st->out, item, &st->stats.wait_out_t)){
+      atomic_store(&flow->failed, true);
+    }
+  }
+
+  // the free queue stays open for the source
+  if(st != &flow->stages[flow->num_stages - 1]){
+    queue_close(st->out);
+  }
+  return NULL;
+}
+
+/**
+ * \brief  work of a stage on a chunk
+ * \return false if the chunk could not be read, written or verified
+ */
+static bool stage_work(flow_stage *st, flow_item *item){
+  fpga_flow_t *flow = st->flow;
+  cl_int status = 0;
+  ssize_t ret;
+
+  switch(st->kind){
+    case FPGA_STAGE_GENERATE:
+      pattern(item->host, item->offset, item->len);
+      return true;
+
+    case FPGA_STAGE_FILE_READ:
+      ret = pread(st->fd, item->host, item->len, item->offset);
+      return (ret >= 0 && (size_t)ret == item->len);
+
+    case FPGA_STAGE_H2D:
+      status = clEnqueueWriteBuffer(flow->queue_h2d, item->d_in, CL_TRUE, 0, item->len, item->host, 0, NULL, NULL);
+      checkError(status, "Failed to write to DDR");
+      return true;
+
+    case FPGA_STAGE_KERNEL:{
+      cl_uint N = item->len / sizeof(float2);
+      status = clSetKernelArg(st->kernel, 0, sizeof(cl_mem), (void *)&item->d_in);
+      checkError(status, "Failed to set kernel arg 0");
+      status = clSetKernelArg(st->kernel, 1, sizeof(cl_mem), (void *)&item->d_out);
+      checkError(status, "Failed to set kernel arg 1");
+      status = clSetKernelArg(st->kernel, 2, sizeof(cl_uint), (void *)&N);
+      checkError(status, "Failed to set kernel arg 2");
+      status = clEnqueueTask(flow->queue_kernel, st->kernel, 0, NULL, NULL);
+      checkError(status, "Failed to launch kernel");
+      status = clFinish(flow->queue_kernel);
+      checkError(status, "Failed to finish kernel");
+      return true;
+    }
+
+    case FPGA_STAGE_D2H:
+      status = clEnqueueReadBuffer(flow->queue_d2h, flow->has_kernel ? item->d_out : item->d_in, CL_TRUE, 0, item->len, item->host, 0, NULL, NULL);
+      checkError(status, "Failed to read");
+      return true;
+
+    case FPGA_STAGE_VERIFY:
+      if(flow->src_fd >= 0){
+        ret = pread(flow->src_fd, st->check, item->len, item->offset);
+        if(ret < 0 || (size_t)ret != item->len)
+          return false;
+      }
+      else{
+        pattern(st->check, item->offset, item->len);
+      }
+      return (memcmp(st->check, item->host, item->len) == 0);
+
+    case FPGA_STAGE_FILE_WRITE:
+      ret = pwrite(st->fd, item->host, item->len, item->offset);
+      return (ret >= 0 && (size_t)ret == item->len);
+
+    default:
+      return false;
+  }
+}
+
+/**
+ * \brief  known data of the generate source, the index of every point split
+ *         over both components, exact in single precision
+ */
+static void pattern(float2 *host, size_t offset, size_t len){
+  size_t first = offset / sizeof(float2);
+  for(size_t i = 0; i < len / sizeof(float2); i++){
+    size_t p = first + i;
+    host[i].x = (float)(p & 0xFFFFFF);
+    host[i].y = (float)((p >> 24) & 0xFFFFFF);
+  }
+}
+
+static bool queue_init(flow_queue *q, unsigned capacity, double now){
+  q->items = (flow_item **)malloc(capacity * sizeof(flow_item *));
+  if(q->items == NULL){
+    return false;
+  }
+  q->capacity = capacity;
+  q->head = q->count = 0;
+  q->closed = false;
+  q->area = 0.0;
+  q->last = now;
+  q->peak = 0;
+  pthread_mutex_init(&q->lock, NULL);
+  pthread_cond_init(&q->not_empty, NULL);
+  pthread_cond_init(&q->not_full, NULL);
+  return true;
+}
+
+static void queue_free(flow_queue *q){
+  pthread_cond_destroy(&q->not_empty);
+  pthread_cond_destroy(&q->not_full);
+  pthread_mutex_destroy(&q->lock);
+  free(q->items);
+}
+
+/**
+ * \brief  integrate the occupancy up to now, called with the lock held
+ *         before the count changes
+ */
+static void queue_track(flow_queue *q, double now){
+  q->area += q->count * (now - q->last);
+  q->last = now;
+}
+
+/**
+ * \brief  append a chunk, blocks while the queue is full and open
+ * \param  wait_t : time blocked is added if not NULL
+ * \return false if the queue is closed, the chunk is dropped
+ */
+static bool queue_push(flow_queue *q, flow_item *item, double *wait_t){
+  pthread_mutex_lock(&q->lock);
+  if(q->count == q->capacity && !q->closed){
+    double start = getTimeinMilliSec();
+    while(q->count == q->capacity && !q->closed){
+      pthread_cond_wait(&q->not_full, &q->lock);
+    }
+    if(wait_t != NULL)
+      *wait_t += getTimeinMilliSec() - start;
+  }
+  if(q->closed){
+    pthread_mutex_unlock(&q->lock);
+    return false;
+  }
+  queue_track(q, getTimeinMilliSec());
+  q->items[(q->head + q->count) % q->capacity] = item;
+  q->count++;
+  if(q->count > q->peak)
+    q->peak = q->count;
+  pthread_cond_signal(&q->not_empty);
+  pthread_mutex_unlock(&q->lock);
+  return true;
+}
+
+/**
+ * \brief  take the oldest chunk, blocks while the queue is empty and open
+ * \return chunk or NULL if the queue is closed and empty
+ */
+static flow_item* queue_pop(flow_queue *q, double *wait_t){
+  flow_item *item = NULL;
+
+  pthread_mutex_lock(&q->lock);
+  if(q->count == 0 && !q->closed){
+    double start = getTimeinMilliSec();
+    while(q->count == 0 && !q->closed){
+      pthread_cond_wait(&q->not_empty, &q->lock);
+    }
+    *wait_t += getTimeinMilliSec() - start;
+  }
+  if(q->count > 0){
+    queue_track(q, getTimeinMilliSec());
+    item = q->items[q->head];
+    q->head = (q->head + 1) % q->capacity;
+    q->count--;
+    pthread_cond_signal(&q->not_full);
+  }
+  pthread_mutex_unlock(&q->lock);
+  return item;
+}
+
+/**
+ * \brief  no more chunks are pushed, wakes the consumer and a producer
+ *         blocked on a full queue
+ */
+static void queue_close(flow_queue *q){
+  pthread_mutex_lock(&q->lock);
+  q->closed = true;
+  pthread_cond_broadcast(&q->not_empty);
+  pthread_cond_broadcast(&q->not_full);
+  pthread_mutex_unlock(&q->lock);
+}
@@ -0,0 +1,12 @@
+// Author: Arjun Ramaswami
+
+#ifndef FLOW_H
+#define FLOW_H
+
+#include <stdbool.h>
+
+const char* flow_kernel(const fpga_flow_t *flow);
+
+bool flow_run(fpga_flow_t *flow, cl_context context, cl_program program, cl_command_queue queue_h2d, cl_command_queue queue_kernel, cl_command_queue queue_d2h, size_t max_chunk, fpga_t *timing);
+
+#endif // FLOW_H
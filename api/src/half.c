@@ -0,0 +1,344 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <pthread.h>
+#include <immintrin.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "half.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "event_ring.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+// number of floats converted by a thread at a time
+#define CONV_BLOCK 65536
+
+typedef void (*conv_fn)(const void *src, void *dst, size_t n);
+
+// function prototype
+static conv_fn select_pack();
+static conv_fn select_unpack();
+static void convert(conv_fn fn, const void *src, void *dst, size_t n, size_t src_sz, size_t dst_sz);
+
+/**
+ * \brief  convert single precision float to half precision, rounding to
+ *         nearest even
+ */
+static uint16_t float_to_half(float f){
+  uint32_t x;
+  memcpy(&x, &f, sizeof(x));
+
+  uint16_t sign = (x >> 16) & 0x8000;
+  int32_t exp = (int32_t)((x >> 23) & 0xff) - 127 + 15;
+  uint32_t mant = x & 0x7fffff;
+
+  // Inf and NaN
+  if(((x >> 23) & 0xff) == 0xff){
+    return sign | 0x7c00 | (mant ? 0x200 : 0);
+  }
+  // Overflow
+  if(exp >= 31){
+    return sign | 0x7c00;
+  }
+  // Subnormal or zero
+  if(exp <= 0){
+    if(exp < -10){
+      return sign;
+    }
+    mant |= 0x800000;
+    uint32_t shift = 14 - exp;
+    uint32_t h = mant >> shift;
+    uint32_t rem = mant & ((1u << shift) - 1);
+    uint32_t mid = 1u << (shift - 1);
+    if(rem > mid || (rem == mid && (h & 1)))
+      h++;
+    return sign | h;
+  }
+
+  // rounding may carry into the exponent, which is the correct result
+  uint32_t h = ((uint32_t)exp << 10) | (mant >> 13);
+  uint32_t rem = mant & 0x1fff;
+  if(rem > 0x1000 || (rem == 0x1000 && (h & 1)))
+    h++;
+  return sign | h;
+}
+
+/**
+ * \brief  convert half precision float to single precision
+ */
+static float half_to_float(uint16_t h){
+  uint32_t sign = (uint32_t)(h & 0x8000) << 16;
+  uint32_t exp = (h >> 10) & 0x1f;
+  uint32_t mant = h & 0x3ff;
+  uint32_t x;
+
+  if(exp == 0){
+    if(mant == 0){
+      x = sign;
+    }
+    else{
+      // normalize subnormal
+      exp = 127 - 15 + 1;
+      while((mant & 0x400) == 0){
+        mant <<= 1;
+        exp--;
+      }
+      x = sign | (exp << 23) | ((mant & 0x3ff) << 13);
+    }
+  }
+  else if(exp == 31){
+    x = sign | 0x7f800000 | (mant << 13);
+  }
+  else{
+    x = sign | ((exp - 15 + 127) << 23) | (mant << 13);
+  }
+
+  float f;
+  memcpy(&f, &x, sizeof(f));
+  return f;
+}
+
+static void pack_scalar(const void *src, void *dst, size_t n){
+  const float *s = (const float *)src;
+  uint16_t *d = (uint16_t *)dst;
+  for(size_t i = 0; i < n; i++)
+    d[i] = float_to_half(s[i]);
+}
+
+static void unpack_scalar(const void *src, void *dst, size_t n){
+  const uint16_t *s = (const uint16_t *)src;
+  float *d = (float *)dst;
+  for(size_t i = 0; i < n; i++)
+    d[i] = half_to_float(s[i]);
+}
+
+__attribute__((target("avx,f16c")))
+static void pack_f16c(const void *src, void *dst, size_t n){
+  const float *s = (const float *)src;
+  uint16_t *d = (uint16_t *)dst;
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(&s[i]), _MM_FROUND_TO_NEAREST_INT);
+    _mm_storeu_si128((__m128i *)&d[i], h);
+  }
+  pack_scalar(&s[i], &d[i], n - i);
+}
+
+__attribute__((target("avx,f16c")))
+static void unpack_f16c(const void *src, void *dst, size_t n){
+  const uint16_t *s = (const uint16_t *)src;
+  float *d = (float *)dst;
+  size_t i = 0;
+  for(; i + 8 <= n; i += 8){
+    __m256 f = _mm256_cvtph_ps(_mm_loadu_si128((const __m128i *)&s[i]));
+    _mm256_storeu_ps(&d[i], f);
+  }
+  unpack_scalar(&s[i], &d[i], n - i);
+}
+
+__attribute__((target("avx512f")))
+static void pack_avx512(const void *src, void *dst, size_t n){
+  const float *s = (const float *)src;
+  uint16_t *d = (uint16_t *)dst;
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16){
+    __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(&s[i]), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    _mm256_storeu_si256((__m256i *)&d[i], h);
+  }
+  pack_scalar(&s[i], &d[i], n - i);
+}
+
+__attribute__((target("avx512f")))
+static void unpack_avx512(const void *src, void *dst, size_t n){
+  const uint16_t *s = (const uint16_t *)src;
+  float *d = (float *)dst;
+  size_t i = 0;
+  for(; i + 16 <= n; i += 16){
+    __m512 f = _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i *)&s[i]));
+    _mm512_storeu_ps(&d[i], f);
+  }
+  unpack_scalar(&s[i], &d[i], n - i);
+}
+
+/**
+ * \brief  widest conversion supported by the host cpu
+ */
+static conv_fn select_pack(){
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return pack_avx512;
+  if(__builtin_cpu_supports("f16c"))
+    return pack_f16c;
+  return pack_scalar;
+}
+
+static conv_fn select_unpack(){
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx512f"))
+    return unpack_avx512;
+  if(__builtin_cpu_supports("f16c"))
+    return unpack_f16c;
+  return unpack_scalar;
+}
+
+/**
+ * \brief  convert n floats in blocks distributed over the OpenMP threads
+ * \param  src_sz, dst_sz : size in bytes of a float in src and dst
+ */
+static void convert(conv_fn fn, const void *src, void *dst, size_t n, size_t src_sz, size_t dst_sz){
+  size_t num_blocks = (n + CONV_BLOCK - 1) / CONV_BLOCK;
+
+#pragma omp parallel for schedule(static)
+  for(size_t b = 0; b < num_blocks; b++){
+    size_t first = b * CONV_BLOCK;
+    size_t len = (first + CONV_BLOCK > n) ? (n - first) : CONV_BLOCK;
+    fn((const char *)src + first * src_sz, (char *)dst + first * dst_sz, len);
+  }
+}
+
+// conversions of the CPU, selected once for all handles
+static pthread_once_t conv_once = PTHREAD_ONCE_INIT;
+static conv_fn pack_fn = NULL;
+static conv_fn unpack_fn = NULL;
+
+static void conv_init(){
+  pack_fn = select_pack();
+  unpack_fn = select_unpack();
+}
+
+/**
+ * \brief  convert N single precision complex points to half precision
+ * \param  src : float2 input of size N
+ * \param  dst : half2 output of size N
+ * \param  N   : number of points
+ */
+void float2_to_half2(const float2 *src, half2 *dst, size_t N){
+  pthread_once(&conv_once, conv_init);
+  convert(pack_fn, src, dst, 2 * N, sizeof(float), sizeof(uint16_t));
+}
+
+/**
+ * \brief  convert N half precision complex points to single precision
+ * \param  src : half2 input of size N
+ * \param  dst : float2 output of size N
+ * \param  N   : number of points
+ */
+void half2_to_float2(const half2 *src, float2 *dst, size_t N){
+  pthread_once(&conv_once, conv_init);
+  convert(unpack_fn, src, dst, 2 * N, sizeof(uint16_t), sizeof(float));
+}
+
+/**
+ * \brief  Pipelined transfer of packed half2 chunks using two pairs of device
+ *         buffers. Each chunk is written as half2, unpacked to float2 by the
+ *         unpack kernel, packed again by the pack kernel and read back. 
+ * \param  context      : context to create the device buffers
+ * \param  queue_wr     : queue for writes
+ * \param  queue_rd     : queue for reads
+ * \param  queue_kernel : queue for the unpack and pack kernels
+ * \param  unpack       : unpack_half2 kernel
+ * \param  pack         : pack_half2 kernel
+ * \param  chunk        : number of points in a chunk, the last chunk handles
+ *                        the tail if chunk does not divide total
+ * \param  total        : total number of points
+ * \param  inp          : half2 input of size total
+ * \param  out          : half2 output of size total
+ * \param  timing       : submit_t and device_t are set if not NULL
+ * \return true if successful, all transfers have completed
+ */
+bool fp16_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, cl_command_queue queue_kernel, cl_kernel unpack, cl_kernel pack, size_t chunk, size_t total, half2 *inp, half2 *out, fpga_t *timing){
+  cl_int status = 0;
+  cl_event first = NULL, last = NULL;
+  cl_mem d_half[2], d_float[2];
+
+  if(chunk == 0 || total == 0){
+    return false;
+  }
+  if(chunk > total){
+    chunk = total;
+  }
+  size_t how_many = (total + chunk - 1) / chunk;
+
+  for(size_t b = 0; b < 2; b++){
+    d_half[b] = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(b, 2), sizeof(half2) * chunk, NULL, &status);
+    checkError(status, "Failed to allocate half2 device buffer\n");
+    d_float[b] = clCreateBuffer(context, CL_MEM_READ_WRITE | bank_flag(b, 2), sizeof(float2) * chunk, NULL, &status);
+    checkError(status, "Failed to allocate float2 device buffer\n");
+  }
+
+  event_ring writeEvents, kernelEvents, readEvents;
+  event_ring_init(&writeEvents, 1);
+  event_ring_init(&kernelEvents, 1);
+  event_ring_init(&readEvents, 2);
+
+  double start = getTimeinMilliSec();
+
+  for(size_t i = 0; i < how_many; i++){
+    size_t b = i % 2;
+    size_t len = (i == how_many - 1) ? total - i * chunk : chunk;
+    cl_uint N = len;
+
+    status = clEnqueueWriteBuffer(queue_wr, d_half[b], CL_FALSE, 0, sizeof(half2) * len, &inp[i * chunk], (i < 2) ? 0 : 1, (i < 2) ? NULL : event_ring_get(&readEvents, i - 2), event_ring_acquire(&writeEvents, i));
+    checkError(status, "Failed to write to DDR");
+    clFlush(queue_wr);
+    if(i == 0)
+      first = event_ring_keep(&writeEvents, i);
+    if(i >= 2)
+      event_ring_release(&readEvents, i - 2);
+
+    // kernel arguments are captured at enqueue
+    status = clSetKernelArg(unpack, 0, sizeof(cl_mem), (void *)&d_half[b]);
+    checkError(status, "Failed to set unpack kernel arg 0");
+    status = clSetKernelArg(unpack, 1, sizeof(cl_mem), (void *)&d_float[b]);
+    checkError(status, "Failed to set unpack kernel arg 1");
+    status = clSetKernelArg(unpack, 2, sizeof(cl_uint), (void *)&N);
+    checkError(status, "Failed to set unpack kernel arg 2");
+
+    status = clEnqueueTask(queue_kernel, unpack, 1, event_ring_get(&writeEvents, i), NULL);
+    checkError(status, "Failed to launch unpack kernel");
+    event_ring_release(&writeEvents, i);
+
+    status = clSetKernelArg(pack, 0, sizeof(cl_mem), (void *)&d_float[b]);
+    checkError(status, "Failed to set pack kernel arg 0");
+    status = clSetKernelArg(pack, 1, sizeof(cl_mem), (void *)&d_half[b]);
+    checkError(status, "Failed to set pack kernel arg 1");
+    status = clSetKernelArg(pack, 2, sizeof(cl_uint), (void *)&N);
+    checkError(status, "Failed to set pack kernel arg 2");
+
+    status = clEnqueueTask(queue_kernel, pack, 0, NULL, event_ring_acquire(&kernelEvents, i));
+    checkError(status, "Failed to launch pack kernel");
+    clFlush(queue_kernel);
+
+    status = clEnqueueReadBuffer(queue_rd, d_half[b], CL_FALSE, 0, sizeof(half2) * len, &out[i * chunk], 1, event_ring_get(&kernelEvents, i), event_ring_acquire(&readEvents, i));
+    checkError(status, "Failed to read");
+    clFlush(queue_rd);
+    if(i == how_many - 1)
+      last = event_ring_keep(&readEvents, i);
+    event_ring_release(&kernelEvents, i);
+  }
+  double submit_t = getTimeinMilliSec() - start;
+
+  // last two reads are pending
+  event_ring_drain(&readEvents);
+
+  if(timing != NULL){
+    timing->submit_t = submit_t;
+    timing->device_t = event_elapsed(first, last);
+  }
+  clReleaseEvent(first);
+  clReleaseEvent(last);
+
+  for(size_t b = 0; b < 2; b++){
+    clReleaseMemObject(d_half[b]);
+    clReleaseMemObject(d_float[b]);
+  }
+  return true;
+}
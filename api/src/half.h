@@ -0,0 +1,14 @@
+// Author: Arjun Ramaswami
+
+#ifndef HALF_H
+#define HALF_H
+
+#include <stdbool.h>
+
+void float2_to_half2(const float2 *src, half2 *dst, size_t N);
+
+void half2_to_float2(const half2 *src, float2 *dst, size_t N);
+
+bool fp16_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, cl_command_queue queue_kernel, cl_kernel unpack, cl_kernel pack, size_t chunk, size_t total, half2 *inp, half2 *out, fpga_t *timing);
+
+#endif // HALF_H
@@ -0,0 +1,191 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <limits.h>
+
+#include "bare.h"
+#include "model.h"
+
+// smallest chunk the planner considers
+#define PLAN_MIN_CHUNK (64 * 1024)
+
+// depths the planner considers, at most EVENT_RING_MAX
+static const unsigned plan_depths[] = {1, 2, 3, 4, 6, 8, 12, 16};
+
+/**
+ * \brief  fit time = latency + bytes / bandwidth by least squares of the
+ *         relative error, so that small transfers dominated by latency
+ *         weigh as much as large ones dominated by bandwidth
+ * \param  bytes : size of each sample
+ * \param  us    : time of each sample in microseconds
+ * \param  n     : number of samples, at least 2 distinct sizes
+ * \param  link  : fitted latency, bandwidth and r2 of the times
+ * \return false if the samples do not determine a line
+ */
+bool model_fit(const double *bytes, const double *us, size_t n, fpga_link_t *link){
+  double sw = 0.0, sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+
+  link->latency = link->bandwidth = link->r2 = 0.0;
+
+  // weights 1/t^2 minimize the relative residuals
+  for(size_t i = 0; i < n; i++){
+    if(us[i] <= 0.0)
+      continue;
+    double w = 1.0 / (us[i] * us[i]);
+    sw += w;
+    sx += w * bytes[i];
+    sy += w * us[i];
+    sxx += w * bytes[i] * bytes[i];
+    sxy += w * bytes[i] * us[i];
+  }
+  double det = sw * sxx - sx * sx;
+  if(det <= 0.0){
+    return false;
+  }
+  double slope = (sw * sxy - sx * sy) / det;       // us per byte
+  double intercept = (sy * sxx - sx * sxy) / det;  // us
+  if(slope <= 0.0){
+    return false;
+  }
+
+  // coefficient of determination of the times
+  double mean = 0.0, ss_tot = 0.0, ss_res = 0.0;
+  for(size_t i = 0; i < n; i++)
+    mean += us[i];
+  mean /= n;
+  for(size_t i = 0; i < n; i++){
+    double r = us[i] - (intercept + slope * bytes[i]);
+    ss_res += r * r;
+    ss_tot += (us[i] - mean) * (us[i] - mean);
+  }
+
+  link->latency = (intercept > 0.0) ? intercept : 0.0;
+  link->bandwidth = 1.0e-3 / slope;
+  link->r2 = (ss_tot > 0.0) ? 1.0 - ss_res / ss_tot : 1.0;
+  return true;
+}
+
+static int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * \brief  median of n values, the values are sorted
+ */
+double model_median(double *v, size_t n){
+  if(n == 0){
+    return 0.0;
+  }
+  qsort(v, n, sizeof(double), cmp_double);
+  return (n % 2 == 1) ? v[n / 2] : 0.5 * (v[n / 2 - 1] + v[n / 2]);
+}
+
+/**
+ * \brief  time of a transfer of bytes in microseconds
+ */
+double fpga_model_time(const fpga_link_t *link, size_t bytes){
+  if(link->bandwidth <= 0.0){
+    return 0.0;
+  }
+  return link->latency + (double)bytes * 1.0e-3 / link->bandwidth;
+}
+
+/**
+ * \brief  time of a pipelined round trip of bytes in chunks, as done by
+ *         fpga_pipeline_test. A single queue or a depth of 1 serializes the
+ *         writes and reads. Otherwise writes and reads overlap at the duplex
+ *         rates: the first write and last read are exposed, every other
+ *         chunk costs the slower direction. The latency of a command is
+ *         hidden behind the depth - 1 transfers still in flight, but a
+ *         chunk never costs less than the latency, commands are issued one
+ *         at a time.
+ * \param  bytes  : payload
+ * \param  chunk  : bytes per transfer, 0 for a single transfer
+ * \param  depth  : device buffers in flight
+ * \param  queues : 1 single queue, 2 separate write and read queues
+ * \return time in milliseconds, 0.0 if the model is not valid
+ */
+double fpga_model_predict(const fpga_model_t *model, size_t bytes, size_t chunk, unsigned depth, unsigned queues){
+  if(model == NULL || !model->valid || bytes == 0 || depth == 0){
+    return 0.0;
+  }
+  if(chunk == 0 || chunk > bytes){
+    chunk = bytes;
+  }
+  size_t n = (bytes + chunk - 1) / chunk;
+  size_t last = bytes - (n - 1) * chunk;
+
+  const fpga_link_t *wr = &model->write, *rd = &model->read;
+  double us = 0.0;
+
+  if(n == 1 || depth == 1 || queues == 1){
+    us = (n - 1) * (fpga_model_time(wr, chunk) + fpga_model_time(rd, chunk)) + fpga_model_time(wr, last) + fpga_model_time(rd, last);
+  }
+  else{
+    if(model->duplex_write.bandwidth > 0.0 && model->duplex_read.bandwidth > 0.0){
+      wr = &model->duplex_write;
+      rd = &model->duplex_read;
+    }
+    double hidden = (depth > 1) ? (double)(depth - 1) : 1.0;
+    double step_wr = fmax(fpga_model_time(wr, chunk) - wr->latency + wr->latency / hidden, wr->latency);
+    double step_rd = fmax(fpga_model_time(rd, chunk) - rd->latency + rd->latency / hidden, rd->latency);
+    double step = (step_wr > step_rd) ? step_wr : step_rd;
+    us = fpga_model_time(wr, chunk) + (n - 1) * step + fpga_model_time(rd, last);
+  }
+  return us * 1.0e-3;
+}
+
+/**
+ * \brief  chunk and depth with the smallest predicted time for a payload,
+ *         other parameters of config are kept. Chunks are powers of two of
+ *         at least 64 KiB or the whole payload.
+ * \param  total     : elements of the payload
+ * \param  elem      : bytes per element
+ * \param  max_chunk : elements a device buffer holds, 0 for no limit
+ * \param  config    : chunk in elements and depth are set
+ * \return false if the model is not valid
+ */
+bool fpga_model_plan(const fpga_model_t *model, size_t total, size_t elem, size_t max_chunk, fpga_config_t *config){
+  if(model == NULL || !model->valid || total == 0 || elem == 0 || config == NULL){
+    return false;
+  }
+  if(max_chunk == 0 || max_chunk > total){
+    max_chunk = total;
+  }
+  // config chunks are unsigned
+  if(max_chunk > UINT_MAX){
+    max_chunk = UINT_MAX;
+  }
+
+  size_t bytes = total * elem;
+  size_t best_chunk = max_chunk;
+  unsigned best_depth = 1;
+  double best_t = fpga_model_predict(model, bytes, best_chunk * elem, 1, config->queues);
+
+  size_t first = (PLAN_MIN_CHUNK + elem - 1) / elem;
+  for(size_t c = first; ; c *= 2){
+    size_t chunk = (c < max_chunk) ? c : max_chunk;
+    size_t n = (total + chunk - 1) / chunk;
+
+    for(unsigned d = 0; d < sizeof(plan_depths) / sizeof(plan_depths[0]); d++){
+      if(plan_depths[d] > n && d > 0)
+        break;
+      double t = fpga_model_predict(model, bytes, chunk * elem, plan_depths[d], config->queues);
+      if(t < best_t){
+        best_t = t;
+        best_chunk = chunk;
+        best_depth = plan_depths[d];
+      }
+    }
+    if(chunk == max_chunk)
+      break;
+  }
+
+  config->chunk = (unsigned)best_chunk;
+  config->depth = best_depth;
+  return true;
+}
@@ -0,0 +1,12 @@
+// Author: Arjun Ramaswami
+
+#ifndef MODEL_H
+#define MODEL_H
+
+#include <stdbool.h>
+
+bool model_fit(const double *bytes, const double *us, size_t n, fpga_link_t *link);
+
+double model_median(double *v, size_t n);
+
+#endif // MODEL_H
@@ -200,22 +200,80 @@ static size_t loadBinary(const char *binary_path, char **buf){
   return bin_size;
 }
 
+// alignment of alignedMalloc, see setHostAlignment
+static size_t host_alignment = FPGA_ALIGN_MIN;
+
+/**
+ * \brief  Set the alignment of the host buffers allocated from now on by
+ *         alignedMalloc. Not synchronized, set before allocating.
+ * \param  alignment : power of two from FPGA_ALIGN_MIN to FPGA_ALIGN_MAX
+ * \return false if the alignment is out of range
+ */
+bool setHostAlignment(size_t alignment){
+  if(alignment < FPGA_ALIGN_MIN || alignment > FPGA_ALIGN_MAX || (alignment & (alignment - 1)) != 0){
+    return false;
+  }
+  host_alignment = alignment;
+  return true;
+}
+
+size_t getHostAlignment(){
+  return host_alignment;
+}
+
 /**
- * \brief  Allocate host side buffers to be 64-byte aligned to make use of DMA 
- *         transfer between host and global memory
+ * \brief  Allocate host side buffers aligned to the host alignment, 64 bytes
+ *         unless set otherwise, to make use of DMA transfer between host and
+ *         global memory
  * \param  size in bytes : allocate size bytes multiples of 64
  * \return pointer to allocated memory on successful allocation otherwise NULL
  */
 void* alignedMalloc(size_t size){
-  size_t OPENCL_ALIGNMENT = 64;
   void *memptr = NULL;
-  int ret = posix_memalign(&memptr, OPENCL_ALIGNMENT, size);
+  int ret = posix_memalign(&memptr, host_alignment, size);
   if (ret != 0){
     return NULL;
   }
   return memptr;
 }
 
+/**
+ * \brief  Allocate size bytes starting offset bytes past an address aligned
+ *         to alignment. The bytes before the data hold the address of the
+ *         allocation, which starts one alignment earlier, release with
+ *         alignedFreeAt.
+ * \param  alignment : power of two from FPGA_ALIGN_MIN to FPGA_ALIGN_MAX
+ * \param  offset    : bytes past the aligned address, less than
+ *                     FPGA_OFFSET_MAX
+ * \return pointer to the data or NULL if the arguments are invalid or
+ *         allocation failed
+ */
+void* alignedMallocAt(size_t size, size_t alignment, size_t offset){
+  if(alignment < FPGA_ALIGN_MIN || alignment > FPGA_ALIGN_MAX || (alignment & (alignment - 1)) != 0 || offset >= FPGA_OFFSET_MAX){
+    return NULL;
+  }
+
+  void *base = NULL;
+  if(posix_memalign(&base, alignment, alignment + offset + size) != 0){
+    return NULL;
+  }
+  char *data = (char *)base + alignment + offset;
+  memcpy(data - sizeof(void *), &base, sizeof(void *));
+  return data;
+}
+
+/**
+ * \brief  Release memory of alignedMallocAt, NULL is ignored
+ */
+void alignedFreeAt(void *ptr){
+  if(ptr == NULL){
+    return;
+  }
+  void *base = NULL;
+  memcpy(&base, (char *)ptr - sizeof(void *), sizeof(void *));
+  free(base);
+}
+
 static void printError(cl_int error) {
 
   switch(error){
@@ -437,8 +495,8 @@ void _checkError(const char *file, int line, const char *func, cl_int err, const
     printf("\n");
     va_end(vl);
 
-    queue_cleanup();
-    fpga_final();
+    // the failing test may run on any handle or thread while others use
+    // their handles, resources are reclaimed by the process exit
     exit(err);
   }
 }
@@ -0,0 +1,194 @@
+// Author: Arjun Ramaswami
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "bare.h"
+
+/**
+ * Counter opened by fpga_perf_open, in the order of fpga_perf_t.count
+ */
+typedef struct perf_counter {
+  const char *name;
+  uint32_t type;
+  uint64_t config;
+} perf_counter;
+
+static const perf_counter counters[FPGA_PERF_COUNTERS] = {
+  {"cycles",           PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+  {"instructions",     PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+  {"llc_misses",       PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+  {"dtlb_misses",      PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+  {"page_faults",      PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+  {"context_switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES}
+};
+
+static const char *phase_names[FPGA_NUM_PHASES] = {
+  "generate", "write", "read", "verify"
+};
+
+/**
+ * Counters of a thread and the counts of each phase since the last reset
+ */
+typedef struct perf_state {
+  int fd[FPGA_PERF_COUNTERS];                              /**< -1 if unavailable */
+  uint64_t start[FPGA_NUM_PHASES][FPGA_PERF_COUNTERS];     /**< at fpga_perf_begin */
+  fpga_perf_t phase[FPGA_NUM_PHASES];
+} perf_state;
+
+// counters count the thread that opened them
+static __thread perf_state *state = NULL;
+
+/**
+ * \brief  open a counter of the calling thread on any CPU. Counting the
+ *         kernel needs perf_event_paranoid <= 1, fall back to user space.
+ * \return file descriptor or -1
+ */
+static int counter_open(const perf_counter *c){
+  struct perf_event_attr attr;
+  memset(&attr, 0, sizeof(attr));
+  attr.size = sizeof(attr);
+  attr.type = c->type;
+  attr.config = c->config;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  attr.exclude_hv = 1;
+
+  int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  if(fd < 0 && (errno == EACCES || errno == EPERM)){
+    attr.exclude_kernel = 1;
+    fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+  }
+  return fd;
+}
+
+/**
+ * \brief  value of a counter, scaled if the counter was multiplexed with
+ *         others and did not run all the time it was enabled
+ */
+static uint64_t counter_read(int fd){
+  uint64_t buf[3] = {0, 0, 0};
+
+  if(read(fd, buf, sizeof(buf)) != sizeof(buf) || buf[2] == 0){
+    return 0;
+  }
+  if(buf[2] < buf[1]){
+    return (uint64_t)((double)buf[0] * buf[1] / buf[2]);
+  }
+  return buf[0];
+}
+
+/**
+ * \brief  open the counters of the calling thread, counters the kernel or
+ *         hardware does not provide are left out
+ * \return number of counters opened
+ */
+unsigned fpga_perf_open(){
+  fpga_perf_close();
+
+  perf_state *s = (perf_state *)calloc(1, sizeof(perf_state));
+  if(s == NULL){
+    return 0;
+  }
+
+  unsigned opened = 0;
+  for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+    s->fd[c] = counter_open(&counters[c]);
+    if(s->fd[c] >= 0)
+      opened++;
+  }
+  if(opened == 0){
+    free(s);
+    return 0;
+  }
+
+  state = s;
+  fpga_perf_reset();
+  return opened;
+}
+
+/**
+ * \brief  close the counters of the calling thread
+ */
+void fpga_perf_close(){
+  if(state == NULL){
+    return;
+  }
+  for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+    if(state->fd[c] >= 0)
+      close(state->fd[c]);
+  }
+  free(state);
+  state = NULL;
+}
+
+/**
+ * \brief  start counting a phase, nothing if the counters are not open
+ */
+void fpga_perf_begin(fpga_phase_t phase){
+  if(state == NULL || (unsigned)phase >= FPGA_NUM_PHASES){
+    return;
+  }
+  for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+    if(state->fd[c] >= 0)
+      state->start[phase][c] = counter_read(state->fd[c]);
+  }
+}
+
+/**
+ * \brief  add the counts since fpga_perf_begin to the phase
+ */
+void fpga_perf_end(fpga_phase_t phase){
+  if(state == NULL || (unsigned)phase >= FPGA_NUM_PHASES){
+    return;
+  }
+  fpga_perf_t *p = &state->phase[phase];
+  for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+    if(state->fd[c] >= 0){
+      uint64_t now = counter_read(state->fd[c]);
+      p->count[c] += (now > state->start[phase][c]) ? now - state->start[phase][c] : 0;
+    }
+  }
+  p->calls++;
+}
+
+/**
+ * \brief  counts of a phase since the last reset, all counters invalid if
+ *         the counters of the calling thread are not open
+ */
+void fpga_perf_get(fpga_phase_t phase, fpga_perf_t *perf){
+  memset(perf, 0, sizeof(fpga_perf_t));
+  if(state == NULL || (unsigned)phase >= FPGA_NUM_PHASES){
+    return;
+  }
+  *perf = state->phase[phase];
+}
+
+/**
+ * \brief  clear the counts of every phase
+ */
+void fpga_perf_reset(){
+  if(state == NULL){
+    return;
+  }
+  for(unsigned p = 0; p < FPGA_NUM_PHASES; p++){
+    memset(&state->phase[p], 0, sizeof(fpga_perf_t));
+    for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+      state->phase[p].valid[c] = (state->fd[c] >= 0);
+    }
+  }
+}
+
+const char* fpga_perf_counter_name(unsigned counter){
+  return (counter < FPGA_PERF_COUNTERS) ? counters[counter].name : "unknown";
+}
+
+const char* fpga_phase_name(fpga_phase_t phase){
+  return ((unsigned)phase < FPGA_NUM_PHASES) ? phase_names[phase] : "unknown";
+}
@@ -0,0 +1,265 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <immintrin.h>
+#include <sys/mman.h>
+#include <omp.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "staging.h"
+#include "trace.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+// bytes copied by a thread at a time
+#define STAGE_BLOCK (256 * 1024)
+
+typedef void (*copy_fn)(void *dst, const void *src, size_t n);
+
+/**
+ * Ring of locked host buffers the transfers of user memory go through. A
+ * buffer is refilled once the transfer that used it last has completed, so
+ * the copy of a chunk overlaps the DMA of the chunks before it.
+ */
+struct staging {
+  unsigned char *slots[FPGA_STAGING_MAX_DEPTH];
+  cl_event events[FPGA_STAGING_MAX_DEPTH];  /**< last transfer of a slot */
+  size_t chunk;                             /**< bytes of a slot */
+  unsigned depth;
+  unsigned threads;
+  bool pinned;                              /**< slots locked in memory */
+  copy_fn copy;
+  fpga_staging_stats_t stats;
+};
+
+/**
+ * \brief  copy with non-temporal stores of 16 bytes, the destination is not
+ *         read into the cache before it is written
+ */
+static void copy_sse2(void *dst, const void *src, size_t n){
+  unsigned char *d = (unsigned char *)dst;
+  const unsigned char *s = (const unsigned char *)src;
+
+  size_t head = (16 - ((uintptr_t)d & 15)) & 15;
+  head = (head > n) ? n : head;
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  n -= head;
+
+  for(; n >= 64; n -= 64, d += 64, s += 64){
+    __m128i a = _mm_loadu_si128((const __m128i *)s);
+    __m128i b = _mm_loadu_si128((const __m128i *)(s + 16));
+    __m128i c = _mm_loadu_si128((const __m128i *)(s + 32));
+    __m128i e = _mm_loadu_si128((const __m128i *)(s + 48));
+    _mm_stream_si128((__m128i *)d, a);
+    _mm_stream_si128((__m128i *)(d + 16), b);
+    _mm_stream_si128((__m128i *)(d + 32), c);
+    _mm_stream_si128((__m128i *)(d + 48), e);
+  }
+  memcpy(d, s, n);
+  _mm_sfence();
+}
+
+__attribute__((target("avx")))
+static void copy_avx(void *dst, const void *src, size_t n){
+  unsigned char *d = (unsigned char *)dst;
+  const unsigned char *s = (const unsigned char *)src;
+
+  size_t head = (32 - ((uintptr_t)d & 31)) & 31;
+  head = (head > n) ? n : head;
+  memcpy(d, s, head);
+  d += head;
+  s += head;
+  n -= head;
+
+  for(; n >= 128; n -= 128, d += 128, s += 128){
+    __m256i a = _mm256_loadu_si256((const __m256i *)s);
+    __m256i b = _mm256_loadu_si256((const __m256i *)(s + 32));
+    __m256i c = _mm256_loadu_si256((const __m256i *)(s + 64));
+    __m256i e = _mm256_loadu_si256((const __m256i *)(s + 96));
+    _mm256_stream_si256((__m256i *)d, a);
+    _mm256_stream_si256((__m256i *)(d + 32), b);
+    _mm256_stream_si256((__m256i *)(d + 64), c);
+    _mm256_stream_si256((__m256i *)(d + 96), e);
+  }
+  memcpy(d, s, n);
+  _mm_sfence();
+}
+
+static copy_fn select_copy(){
+  __builtin_cpu_init();
+  if(__builtin_cpu_supports("avx"))
+    return copy_avx;
+  return copy_sse2;
+}
+
+/**
+ * \brief  copy n bytes in blocks distributed over the threads of the ring,
+ *         each thread fences its own stores
+ */
+static void parallel_copy(staging *s, void *dst, const void *src, size_t n){
+  size_t num_blocks = (n + STAGE_BLOCK - 1) / STAGE_BLOCK;
+  copy_fn copy = s->copy;
+  double start = getTimeinMilliSec();
+
+#pragma omp parallel for schedule(static) num_threads(s->threads) if(num_blocks > 1)
+  for(size_t b = 0; b < num_blocks; b++){
+    size_t first = b * STAGE_BLOCK;
+    size_t len = (first + STAGE_BLOCK > n) ? (n - first) : STAGE_BLOCK;
+    copy((char *)dst + first, (const char *)src + first, len);
+  }
+
+  s->stats.copy_t += getTimeinMilliSec() - start;
+}
+
+/**
+ * \brief  wait for the last transfer of a slot
+ */
+static void slot_wait(staging *s, unsigned slot){
+  if(s->events[slot] == NULL){
+    return;
+  }
+  double start = getTimeinMilliSec();
+  cl_int status = 0;
+  TRACE(TRACE_WAIT, status = clWaitForEvents(1, &s->events[slot]));
+  checkError(status, "Failed to wait for staging buffer");
+  clReleaseEvent(s->events[slot]);
+  s->events[slot] = NULL;
+  s->stats.wait_t += getTimeinMilliSec() - start;
+}
+
+/**
+ * \brief  buffer, offset and length of chunk i of an array
+ * \return false if the array has fewer chunks
+ */
+static bool chunk_at(const staging *s, const dev_array *arr, size_t i, size_t *b, size_t *off, size_t *len){
+  for(*b = 0; *b < arr->count; (*b)++){
+    size_t bytes = arr->elem * ((*b == arr->count - 1) ? arr->total - *b * arr->seg : arr->seg);
+    size_t chunks = (bytes + s->chunk - 1) / s->chunk;
+    if(i < chunks){
+      *off = i * s->chunk;
+      *len = (*off + s->chunk > bytes) ? bytes - *off : s->chunk;
+      return true;
+    }
+    i -= chunks;
+  }
+  return false;
+}
+
+/**
+ * \brief  Ring of depth locked host buffers of chunk bytes
+ * \param  threads : copy threads, 0 for the OpenMP default
+ * \return ring or NULL if allocation failed
+ */
+staging* staging_create(size_t chunk, unsigned depth, unsigned threads){
+  staging *s = (staging *)calloc(1, sizeof(staging));
+  if(s == NULL){
+    return NULL;
+  }
+  s->chunk = chunk;
+  s->depth = depth;
+  s->threads = (threads > 0) ? threads : (unsigned)omp_get_max_threads();
+  s->copy = select_copy();
+  s->pinned = true;
+
+  for(unsigned d = 0; d < depth; d++){
+    s->slots[d] = (unsigned char *)alignedMalloc(chunk);
+    if(s->slots[d] == NULL){
+      staging_destroy(s);
+      return NULL;
+    }
+    // best effort, the limit of locked memory may be small
+    if(s->pinned && mlock(s->slots[d], chunk) != 0){
+      for(unsigned l = 0; l < d; l++)
+        munlock(s->slots[l], chunk);
+      s->pinned = false;
+    }
+  }
+  return s;
+}
+
+void staging_destroy(staging *s){
+  if(s == NULL){
+    return;
+  }
+  for(unsigned d = 0; d < s->depth; d++){
+    slot_wait(s, d);
+    if(s->pinned && s->slots[d] != NULL)
+      munlock(s->slots[d], s->chunk);
+    free(s->slots[d]);
+  }
+  free(s);
+}
+
+/**
+ * \brief  Write the array from user memory through the ring, like
+ *         dev_array_write. Complete on return.
+ */
+void staging_array_write(staging *s, cl_command_queue queue, const dev_array *arr, const void *src){
+  const char *bytes = (const char *)src;
+  size_t b, off, len;
+
+  for(size_t i = 0; chunk_at(s, arr, i, &b, &off, &len); i++){
+    unsigned slot = i % s->depth;
+    slot_wait(s, slot);
+
+    parallel_copy(s, s->slots[slot], &bytes[arr->elem * b * arr->seg + off], len);
+
+    cl_int status = 0;
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(queue, arr->bufs[b].buf, CL_FALSE, off, len, s->slots[slot], 0, NULL, &s->events[slot]));
+    checkError(status, "Failed to write to DDR");
+    TRACE(TRACE_FLUSH, clFlush(queue));
+
+    s->stats.bytes_in += len;
+    s->stats.chunks++;
+  }
+
+  for(unsigned d = 0; d < s->depth; d++){
+    slot_wait(s, d);
+  }
+}
+
+/**
+ * \brief  Read the array into user memory through the ring, like
+ *         dev_array_read, keeping depth reads in flight. Complete on return.
+ */
+void staging_array_read(staging *s, cl_command_queue queue, const dev_array *arr, void *dst){
+  char *bytes = (char *)dst;
+  size_t b, off, len;
+  cl_int status = 0;
+
+  for(size_t i = 0; i < s->depth && chunk_at(s, arr, i, &b, &off, &len); i++){
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(queue, arr->bufs[b].buf, CL_FALSE, off, len, s->slots[i], 0, NULL, &s->events[i]));
+    checkError(status, "Failed to read");
+  }
+  TRACE(TRACE_FLUSH, clFlush(queue));
+
+  for(size_t i = 0; chunk_at(s, arr, i, &b, &off, &len); i++){
+    unsigned slot = i % s->depth;
+    slot_wait(s, slot);
+
+    parallel_copy(s, &bytes[arr->elem * b * arr->seg + off], s->slots[slot], len);
+    s->stats.bytes_out += len;
+    s->stats.chunks++;
+
+    // the slot is free, read the chunk depth ahead into it
+    size_t nb, noff, nlen;
+    if(chunk_at(s, arr, i + s->depth, &nb, &noff, &nlen)){
+      TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(queue, arr->bufs[nb].buf, CL_FALSE, noff, nlen, s->slots[slot], 0, NULL, &s->events[slot]));
+      checkError(status, "Failed to read");
+      TRACE(TRACE_FLUSH, clFlush(queue));
+    }
+  }
+}
+
+void staging_stats(const staging *s, fpga_staging_stats_t *stats){
+  *stats = s->stats;
+}
@@ -0,0 +1,20 @@
+// Author: Arjun Ramaswami
+
+#ifndef STAGING_H
+#define STAGING_H
+
+#include <stdbool.h>
+
+typedef struct staging staging;
+
+staging* staging_create(size_t chunk, unsigned depth, unsigned threads);
+
+void staging_destroy(staging *s);
+
+void staging_array_write(staging *s, cl_command_queue queue, const dev_array *arr, const void *src);
+
+void staging_array_read(staging *s, cl_command_queue queue, const dev_array *arr, void *dst);
+
+void staging_stats(const staging *s, fpga_staging_stats_t *stats);
+
+#endif // STAGING_H
@@ -0,0 +1,177 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <sched.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "submit.h"
+#include "event_ring.h"
+#include "trace.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+// function prototype
+static void ring_pop(spsc_ring *r, transfer_desc *desc);
+static void* submit_loop(void *arg);
+
+/**
+ * \brief  allocate a table of len events, none published
+ * \return true if successful
+ */
+bool event_table_init(event_table *tab, size_t len){
+  tab->events = (cl_event *)calloc(len, sizeof(cl_event));
+  tab->ready = (atomic_bool *)malloc(len * sizeof(atomic_bool));
+  tab->len = len;
+  if(tab->events == NULL || tab->ready == NULL){
+    free(tab->events);
+    free(tab->ready);
+    return false;
+  }
+  for(size_t i = 0; i < len; i++){
+    atomic_init(&tab->ready[i], false);
+  }
+  return true;
+}
+
+/**
+ * \brief  release the published events that were not consumed by a 
+ *         submission thread and the table
+ */
+void event_table_release(event_table *tab){
+  for(size_t i = 0; i < tab->len; i++){
+    if(atomic_load(&tab->ready[i]) && tab->events[i] != NULL){
+      clReleaseEvent(tab->events[i]);
+      event_count_released();
+    }
+  }
+  free(tab->events);
+  free(tab->ready);
+  tab->events = NULL;
+  tab->ready = NULL;
+  tab->len = 0;
+}
+
+/**
+ * \brief  start a thread that enqueues transfers pushed to it on queue
+ * \return true if successful
+ */
+bool submitter_start(submitter *s, cl_command_queue queue){
+  s->queue = queue;
+  s->busy_t = 0.0;
+  s->count = 0;
+  s->first = NULL;
+  atomic_init(&s->ring.head, 0);
+  atomic_init(&s->ring.tail, 0);
+
+  if(pthread_create(&s->thread, NULL, submit_loop, s) != 0){
+    fprintf(stderr, "Failed to create submission thread\n");
+    return false;
+  }
+  return true;
+}
+
+/**
+ * \brief  hand over a transfer to the submission thread, yields while the 
+ *         queue is full. Must only be called from a single producer thread.
+ */
+void submitter_push(submitter *s, const transfer_desc *desc){
+  spsc_ring *r = &s->ring;
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+
+  while(tail - atomic_load_explicit(&r->head, memory_order_acquire) == SUBMIT_RING){
+    sched_yield();
+  }
+
+  r->slots[tail & (SUBMIT_RING - 1)] = *desc;
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+}
+
+/**
+ * \brief  stop the submission thread after the pending transfers have been
+ *         enqueued and wait for it to finish
+ */
+void submitter_stop(submitter *s){
+  transfer_desc stop = {SUBMIT_STOP, NULL, 0, NULL, NULL, 0, NULL, 0};
+  submitter_push(s, &stop);
+  pthread_join(s->thread, NULL);
+}
+
+/**
+ * \brief  take the next transfer, yields while the queue is empty
+ */
+static void ring_pop(spsc_ring *r, transfer_desc *desc){
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+
+  while(atomic_load_explicit(&r->tail, memory_order_acquire) == head){
+    sched_yield();
+  }
+
+  *desc = r->slots[head & (SUBMIT_RING - 1)];
+  atomic_store_explicit(&r->head, head + 1, memory_order_release);
+}
+
+/**
+ * \brief  submission thread, enqueues transfers in the order they are pushed.
+ *         A transfer that depends on an event of another thread waits until
+ *         that event has been published, not until it completes, and releases
+ *         it once enqueued.
+ */
+static void* submit_loop(void *arg){
+  submitter *s = (submitter *)arg;
+  transfer_desc d;
+  cl_int status = 0;
+
+  for(;;){
+    ring_pop(&s->ring, &d);
+    if(d.op == SUBMIT_STOP){
+      break;
+    }
+
+    cl_uint num_wait = 0;
+    cl_event wait_event = NULL;
+    if(d.wait != NULL){
+      while(!atomic_load_explicit(&d.wait->ready[d.wait_idx], memory_order_acquire)){
+        sched_yield();
+      }
+      wait_event = d.wait->events[d.wait_idx];
+      num_wait = 1;
+    }
+
+    double start = getTimeinMilliSec();
+
+    if(d.op == SUBMIT_WRITE){
+      TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(s->queue, d.buf, CL_FALSE, 0, d.size, d.host, num_wait, (num_wait > 0) ? &wait_event : NULL, &d.done->events[d.done_idx]));
+      checkError(status, "Failed to write to DDR");
+    }
+    else{
+      TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(s->queue, d.buf, CL_FALSE, 0, d.size, d.host, num_wait, (num_wait > 0) ? &wait_event : NULL, &d.done->events[d.done_idx]));
+      checkError(status, "Failed to read");
+    }
+    TRACE(TRACE_FLUSH, clFlush(s->queue));
+    event_count_created();
+
+    // kept for profiling after the other thread released it
+    if(s->count == 0){
+      s->first = d.done->events[d.done_idx];
+      clRetainEvent(s->first);
+    }
+
+    // the consumer of the event has been enqueued, the other thread does not
+    // access it anymore
+    if(d.wait != NULL){
+      clReleaseEvent(wait_event);
+      d.wait->events[d.wait_idx] = NULL;
+      event_count_released();
+    }
+
+    s->busy_t += getTimeinMilliSec() - start;
+    s->count++;
+
+    atomic_store_explicit(&d.done->ready[d.done_idx], true, memory_order_release);
+  }
+
+  return NULL;
+}
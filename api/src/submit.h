@@ -0,0 +1,70 @@
+// Author: Arjun Ramaswami
+
+#ifndef SUBMIT_H
+#define SUBMIT_H
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+// number of transfer descriptors in a submission queue, power of 2
+#define SUBMIT_RING 64
+
+typedef enum { SUBMIT_WRITE, SUBMIT_READ, SUBMIT_STOP } submit_op;
+
+/**
+ * Events of enqueued transfers, published by the submitting thread
+ */
+typedef struct event_table {
+  cl_event *events;     /**< event of each transfer */
+  atomic_bool *ready;   /**< true once the event has been published */
+  size_t len;           /**< number of events */
+} event_table;
+
+/**
+ * Transfer handed over to a submission thread
+ */
+typedef struct transfer_desc {
+  submit_op op;         /**< direction or stop */
+  cl_mem buf;           /**< device buffer */
+  size_t size;          /**< bytes to transfer */
+  void *host;           /**< host pointer */
+  event_table *wait;    /**< table of event to wait on, NULL for none */
+  size_t wait_idx;      /**< index of event to wait on */
+  event_table *done;    /**< table to publish the event of the transfer */
+  size_t done_idx;      /**< index to publish the event */
+} transfer_desc;
+
+/**
+ * Lock free single producer single consumer queue of transfers
+ */
+typedef struct spsc_ring {
+  transfer_desc slots[SUBMIT_RING];
+  atomic_size_t head;   /**< next slot to pop, written by consumer */
+  atomic_size_t tail;   /**< next slot to push, written by producer */
+} spsc_ring;
+
+/**
+ * Thread that enqueues transfers to one command queue
+ */
+typedef struct submitter {
+  cl_command_queue queue;
+  spsc_ring ring;
+  pthread_t thread;
+  double busy_t;        /**< time in milliseconds spent in enqueue and flush */
+  size_t count;         /**< number of transfers enqueued */
+  cl_event first;       /**< retained event of the first transfer, released
+                             by the owner of the submitter */
+} submitter;
+
+bool event_table_init(event_table *tab, size_t len);
+
+void event_table_release(event_table *tab);
+
+bool submitter_start(submitter *s, cl_command_queue queue);
+
+void submitter_push(submitter *s, const transfer_desc *desc);
+
+void submitter_stop(submitter *s);
+
+#endif // SUBMIT_H
@@ -1,9 +1,14 @@
+// Author: Arjun Ramaswami
+
 #define CL_VERSION_2_0
 #include <stdio.h>
+#include <string.h>
 #include <stdbool.h>
 #include "CL/opencl.h"
 //#include "aocl_mmd.h"
+#include "bare.h"
 #include "svm.h"
+#include "event_ring.h"
 #include "opencl_utils.h"
 
 /*
@@ -35,141 +40,174 @@ bool check_valid_svm_device(cl_device_id device){
   );
   checkError(status, "Failed to get device info");
  
-  if (caps && CL_DEVICE_SVM_COARSE_GRAIN_BUFFER){
-    return true;
+  // Capabilities are a bitfield, fine grained support is only reported for
+  // information as the transfers use coarse grained buffers
+  if(caps & CL_DEVICE_SVM_FINE_GRAIN_SYSTEM){
+    if(caps & CL_DEVICE_SVM_ATOMICS)
+      fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_SYSTEM with support for CL_DEVICE_SVM_ATOMICS. API support in progress\n");
+    else
+      fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_SYSTEM. API support in progress\n");
   }
-  else if(caps && CL_DEVICE_SVM_FINE_GRAIN_BUFFER){
-    fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_BUFFER. API support in progress\n");
-    return true;
+  else if(caps & CL_DEVICE_SVM_FINE_GRAIN_BUFFER){
+    if(caps & CL_DEVICE_SVM_ATOMICS)
+      fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_BUFFER with support for CL_DEVICE_SVM_ATOMICS. API support in progress\n");
+    else
+      fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_BUFFER. API support in progress\n");
   }
-  else if((caps && CL_DEVICE_SVM_FINE_GRAIN_BUFFER) && (caps &&CL_DEVICE_SVM_ATOMICS)){
-    fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_BUFFER with support for CL_DEVICE_SVM_ATOMICS. API support in progress\n");
+
+  if(caps & CL_DEVICE_SVM_COARSE_GRAIN_BUFFER){
     return true;
   }
-  else if(caps && CL_DEVICE_SVM_FINE_GRAIN_SYSTEM){
-    fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_SYSTEM. API support in progress\n");
-    return false;
-  }
-  else if((caps && CL_DEVICE_SVM_FINE_GRAIN_SYSTEM) && (caps &&CL_DEVICE_SVM_ATOMICS)){
-    fprintf(stderr, "Found CL_DEVICE_SVM_FINE_GRAIN_SYSTEM with support for CL_DEVICE_SVM_ATOMICS. API support in progress\n");
-    return false;
-  }
-  else{
-    fprintf(stderr, "No SVM Support found!");
-    return false;
-  }
+
+  fprintf(stderr, "No SVM Support found!\n");
   return false;
 }
 
-    // Transfer Data to Global Memory or allocate SVM buffer
-    /*
-    size_t buf_size = sizeof(double2) * N * iter;
-    (double2 *)aocl_mmd_shared_mem_alloc(, buf_size, )
-    h_inData = (double2 *)clSVMAlloc(context, CL_MEM_READ_WRITE, sizeof(double2) * N * iter, 0);
+/**
+ * \brief  Allocate a coarse grained SVM buffer shared by host and device
+ * \param  context: context created using device
+ * \param  sz     : size in bytes
+ * \return pointer to SVM buffer or NULL if unsuccessful
+ */
+void* svm_alloc(cl_context context, size_t sz){
+  if(sz == 0){
+    return NULL;
+  }
+  return clSVMAlloc(context, CL_MEM_READ_WRITE, sz, 0);
+}
+
+/**
+ * \brief  Release SVM buffer allocated using svm_alloc
+ */
+void svm_free(cl_context context, void *ptr){
+  if(ptr)
+    clSVMFree(context, ptr);
+}
 
-    h_outData = (float2 *)clSVMAlloc(context, CL_MEM_READ_WRITE, sizeof(double2) * N * iter, 0);
+/**
+ * \brief  Set kernel argument to a SVM pointer
+ * \param  kernel : kernel whose argument is set
+ * \param  idx    : argument index
+ * \param  ptr    : SVM pointer allocated using svm_alloc
+ */
+void svm_set_kernel_arg(cl_kernel kernel, cl_uint idx, void *ptr){
+  cl_int status = clSetKernelArgSVMPointer(kernel, idx, ptr);
+  checkError(status, "Failed to set SVM kernel arg %u", idx);
+}
 
-    status = clEnqueueSVMMap(queue1, CL_TRUE, CL_MAP_WRITE,
-        (void *)h_inData, sizeof(double2) * N * iter, 0, NULL, NULL);
-    checkError(status, "Failed to map input data");
+/**
+ * \brief  Pipelined host to device to host transfer of a batch using two
+ *         coarse grained SVM buffers. Mapping a buffer for writing and
+ *         unmapping it copies the chunk to the device, mapping for reading
+ *         copies it back. The host copy of chunk i overlaps with the read back
+ *         of chunk i-1 on the second queue.
+ * \param  context   : context the SVM buffers are allocated in
+ * \param  queue_wr  : queue for write maps and kernel launches
+ * \param  queue_rd  : queue for read maps
+ * \param  kernel    : svm_copy kernel that copies input to output buffer, 
+ *                     NULL to read back the input buffers. The kernel copies
+ *                     float2 points, elem must be sizeof(float2)
+ * \param  chunk     : number of points in a chunk, the last chunk handles the
+ *                     tail if chunk does not divide total
+ * \param  total     : total number of points
+ * \param  elem      : bytes per point
+ * \param  inp       : input data of size total
+ * \param  out       : output data of size total
+ * \return true if successful
+ */
+bool svm_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, cl_kernel kernel, size_t chunk, size_t total, size_t elem, const void *inp, void *out){
+  cl_int status = 0;
 
-    // Copy data from input file to SVM allocated memory.
-    for (int i = 0; i < N * iter; i++) {
-      h_inData[i].x = inp[i].x;
-      h_inData[i].y = inp[i].y;
+  if(chunk == 0 || total == 0 || elem == 0 || (kernel != NULL && elem != sizeof(float2))){
+    return false;
+  }
+  if(chunk > total){
+    chunk = total;
+  }
+  size_t how_many = (total + chunk - 1) / chunk;
+  size_t sz = elem * chunk;
+  const char *src = (const char *)inp;
+  char *dst = (char *)out;
+  char *svm_in[2] = {NULL, NULL}, *svm_out[2] = {NULL, NULL};
+  char **svm_rd = (kernel != NULL) ? svm_out : svm_in;
+
+  for(size_t b = 0; b < 2; b++){
+    svm_in[b] = (char *)svm_alloc(context, sz);
+    if(kernel != NULL)
+      svm_out[b] = (char *)svm_alloc(context, sz);
+    if(svm_in[b] == NULL || (kernel != NULL && svm_out[b] == NULL)){
+      fprintf(stderr, "Failed to allocate SVM buffers\n");
+      for(size_t j = 0; j < 2; j++){
+        svm_free(context, svm_in[j]);
+        svm_free(context, svm_out[j]);
+      }
+      return false;
     }
+  }
 
-    status = clEnqueueSVMUnmap(queue1, (void *)h_inData, 0, NULL, NULL);
-    checkError(status, "Failed to unmap input data");
-
-    // Can't pass bool to device, so convert it to int
-    int inverse_int = inv;
-
-    // Create Kernels - names must match the kernel name in the original CL file
-    kernel1 = clCreateKernel(program, "fetch", &status);
-    checkError(status, "Failed to create fetch kernel");
-
-    kernel2 = clCreateKernel(program, "fft1d", &status);
-    checkError(status, "Failed to create fft1d kernel");
-    // Set the kernel arguments
-
-    status = clSetKernelArgSVMPointer(kernel1, 0, (void *)h_inData);
-    checkError(status, "Failed to set kernel1 arg 0");
-
-    status = clSetKernelArgSVMPointer(kernel2, 0, (void *)h_outData);
-    checkError(status, "Failed to set kernel1 arg 0");
-    status = clSetKernelArgSVMPointer(kernel1, 0, (void *)h_inData);
-    checkError(status, "Failed to set kernel1 arg 0");
-
-    status = clSetKernelArgSVMPointer(kernel2, 0, (void *)h_outData);
-
-    checkError(status, "Failed to set kernel arg 0");
-    status = clSetKernelArg(kernel2, 1, sizeof(cl_int), (void*)&iter);
-    checkError(status, "Failed to set kernel arg 1");
-    status = clSetKernelArg(kernel2, 2, sizeof(cl_int), (void*)&inverse_int);
-    checkError(status, "Failed to set kernel arg 2");
-
-    printf(inverse_int ? "\tInverse FFT" : "\tFFT");
-    printf(" kernel initialization is complete.\n");
-
-    // Get the itertamp to evaluate performance
-    fft_time.exec_t = getTimeinMilliSec();
-
-    // Launch the kernel - we launch a single work item hence enqueue a task
-    status = clEnqueueTask(queue1, kernel1, 0, NULL, NULL);
-    checkError(status, "Failed to launch kernel");
-
-    size_t ls = N/8;
-    size_t gs = iter * ls;
-    status = clEnqueueNDRangeKernel(queue1, kernel2, 1, NULL, &gs, &ls, 0, NULL, NULL);
-    checkError(status, "Failed to launch fetch kernel");
-    
-    // Wait for command queue to complete pending events
-    status = clFinish(queue1);
-    checkError(status, "Failed to finish");
-    status = clFinish(queue2);
-    checkError(status, "Failed to finish queue1");
-    
-    // Record execution time
-    fft_time.exec_t = getTimeinMilliSec() - fft_time.exec_t;
-    status = clEnqueueSVMMap(queue1, CL_TRUE, CL_MAP_READ,
-        (void *)h_outData, sizeof(float2) * N * iter, 0, NULL, NULL);
-    checkError(status, "Failed to map out data");
-
-      // Copy data from input file to SVM allocated memory.
-    for (int i = 0; i < N * iter; i++) {
-      out[i].x = h_outData[i].x;
-      out[i].y = h_outData[i].y;
+  // unmapEvents: chunk resident on device, mapEvents: chunk mapped for 
+  // reading, readEvents: read buffer released, buffer can be refilled
+  event_ring unmapEvents, mapEvents, readEvents;
+  event_ring_init(&unmapEvents, 1);
+  event_ring_init(&mapEvents, 2);
+  event_ring_init(&readEvents, 2);
+
+  for(size_t i = 0; i <= how_many; i++){
+    size_t b = i % 2;
+
+    if(i < how_many){
+      size_t len = (i == how_many - 1) ? total - i * chunk : chunk;
+      cl_uint N = len;
+
+      // buffer is free once the chunk before last has been read back
+      status = clEnqueueSVMMap(queue_wr, CL_TRUE, CL_MAP_WRITE_INVALIDATE_REGION, svm_in[b], sz, (i < 2) ? 0 : 1, (i < 2) ? NULL : event_ring_get(&readEvents, i - 2), NULL);
+      checkError(status, "Failed to map SVM input buffer");
+      if(i >= 2)
+        event_ring_release(&readEvents, i - 2);
+
+      memcpy(svm_in[b], &src[elem * i * chunk], elem * len);
+
+      status = clEnqueueSVMUnmap(queue_wr, svm_in[b], 0, NULL, (kernel != NULL) ? NULL : event_ring_acquire(&unmapEvents, i));
+      checkError(status, "Failed to unmap SVM input buffer");
+
+      if(kernel != NULL){
+        svm_set_kernel_arg(kernel, 0, svm_in[b]);
+        svm_set_kernel_arg(kernel, 1, svm_out[b]);
+        status = clSetKernelArg(kernel, 2, sizeof(cl_uint), (void *)&N);
+        checkError(status, "Failed to set kernel arg 2");
+
+        // in order queue, kernel follows the unmap
+        status = clEnqueueTask(queue_wr, kernel, 0, NULL, event_ring_acquire(&unmapEvents, i));
+        checkError(status, "Failed to launch svm kernel");
+      }
+      clFlush(queue_wr);
+
+      status = clEnqueueSVMMap(queue_rd, CL_FALSE, CL_MAP_READ, svm_rd[b], sz, 1, event_ring_get(&unmapEvents, i), event_ring_acquire(&mapEvents, i));
+      checkError(status, "Failed to map SVM output buffer");
+      clFlush(queue_rd);
+      event_ring_release(&unmapEvents, i);
     }
 
-    status = clEnqueueSVMUnmap(queue1, (void *)h_outData, 0, NULL, NULL);
-    checkError(status, "Failed to unmap input data");
-
-    // Cleanup
-    if(kernel1)
-      clReleaseKernel(kernel1);
-    if(kernel2)
-      clReleaseKernel(kernel2);
-    queue_cleanup();
-    if (h_inData)
-      clSVMFree(context, h_inData);
-    if (h_outData)
-      clSVMFree(context, h_outData);
-    }
-    */
+    // copy out the previous chunk while the current one is in flight
+    if(i > 0){
+      size_t p = (i - 1) % 2;
+      event_ring_wait(&mapEvents, i - 1);
 
+      size_t len = (i == how_many) ? total - (i - 1) * chunk : chunk;
+      memcpy(&dst[elem * (i - 1) * chunk], svm_rd[p], elem * len);
 
-  // return if SVM enabled but no device supported
-  /*
-  if(use_svm){
-    // TODO: emulation and svm
-    if (check_valid_svm_device(device)){
-      svm_enabled = 1;
+      status = clEnqueueSVMUnmap(queue_rd, svm_rd[p], 0, NULL, event_ring_acquire(&readEvents, i - 1));
+      checkError(status, "Failed to unmap SVM output buffer");
+      clFlush(queue_rd);
     }
-    else{
-      fpga_final();
-      return 1;
-    }
-    return 1;
   }
-  */
+
+  // last two read buffers are still pending
+  event_ring_drain(&readEvents);
+
+  for(size_t b = 0; b < 2; b++){
+    svm_free(context, svm_in[b]);
+    svm_free(context, svm_out[b]);
+  }
+  return true;
+}
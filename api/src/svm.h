@@ -7,4 +7,12 @@
 
 bool check_valid_svm_device(cl_device_id device);
 
-#endif 
\ No newline at end of file
+void* svm_alloc(cl_context context, size_t sz);
+
+void svm_free(cl_context context, void *ptr);
+
+void svm_set_kernel_arg(cl_kernel kernel, cl_uint idx, void *ptr);
+
+bool svm_stream(cl_context context, cl_command_queue queue_wr, cl_command_queue queue_rd, cl_kernel kernel, size_t chunk, size_t total, size_t elem, const void *inp, void *out);
+
+#endif
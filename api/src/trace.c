@@ -0,0 +1,232 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+#include "bare.h"
+#include "trace.h"
+#include "misc.h"
+
+#ifdef FPGA_TRACE
+
+// records kept per thread, older records are overwritten
+#define TRACE_RING_SIZE (1 << 16)
+
+static const char *trace_names[TRACE_NUM_IDS] = {
+  "queue_setup", "queue_cleanup", "create_buffer", "release_buffer",
+  "enqueue_write", "enqueue_read", "flush", "finish", "wait"
+};
+
+typedef struct trace_rec {
+  uint64_t start;
+  uint64_t end;
+  uint32_t id;
+} trace_rec;
+
+/**
+ * Records of a thread, written only by the thread. Totals cover every call,
+ * including the ones whose record was overwritten.
+ */
+typedef struct trace_ring {
+  trace_rec recs[TRACE_RING_SIZE];
+  atomic_size_t head;               /**< records written */
+  uint64_t calls[TRACE_NUM_IDS];
+  uint64_t ticks[TRACE_NUM_IDS];
+  uint64_t max[TRACE_NUM_IDS];
+  unsigned tid;
+  atomic_bool idle;                 /**< thread exited, the ring can be reused */
+  struct trace_ring *next;
+} trace_ring;
+
+// rings of the threads that recorded, kept until the process exits. The ring
+// of an exited thread is taken over by the next thread that records, so the
+// number of rings is bounded by the threads alive at once.
+static _Atomic(trace_ring *) rings = NULL;
+static atomic_uint num_threads = 0;
+static __thread trace_ring *local = NULL;
+static pthread_key_t ring_key;
+
+// ticks and time of the first record, to convert ticks to time
+static pthread_once_t base_once = PTHREAD_ONCE_INIT;
+static uint64_t base_ticks = 0;
+static double base_ms = 0.0;
+
+/**
+ * \brief  destructor of the key, runs when a thread that recorded exits
+ */
+static void ring_exit(void *ring){
+  atomic_store_explicit(&((trace_ring *)ring)->idle, true, memory_order_release);
+}
+
+static void base_init(){
+  base_ms = getTimeinMilliSec();
+  base_ticks = trace_ticks();
+  pthread_key_create(&ring_key, ring_exit);
+}
+
+/**
+ * \brief  ring of the calling thread on first use, the ring of an exited
+ *         thread if there is one, its records continue under its tid
+ */
+static trace_ring* ring_register(){
+  pthread_once(&base_once, base_init);
+
+  trace_ring *r = NULL;
+  for(trace_ring *it = atomic_load(&rings); it != NULL && r == NULL; it = it->next){
+    bool idle = true;
+    if(atomic_compare_exchange_strong(&it->idle, &idle, false))
+      r = it;
+  }
+
+  if(r == NULL){
+    r = (trace_ring *)calloc(1, sizeof(trace_ring));
+    if(r == NULL){
+      return NULL;
+    }
+    r->tid = atomic_fetch_add(&num_threads, 1);
+    r->next = atomic_load(&rings);
+    while(!atomic_compare_exchange_weak(&rings, &r->next, r));
+  }
+
+  pthread_setspecific(ring_key, r);
+  local = r;
+  return r;
+}
+
+/**
+ * \brief  record a call of the calling thread, without locks or system calls
+ * \param  start, end : ticks before and after the call
+ */
+void trace_record(trace_id id, uint64_t start, uint64_t end){
+  trace_ring *r = local;
+  if(r == NULL && (r = ring_register()) == NULL){
+    return;
+  }
+
+  uint64_t ticks = end - start;
+  r->calls[id]++;
+  r->ticks[id] += ticks;
+  if(ticks > r->max[id])
+    r->max[id] = ticks;
+
+  size_t h = atomic_load_explicit(&r->head, memory_order_relaxed);
+  trace_rec *rec = &r->recs[h & (TRACE_RING_SIZE - 1)];
+  rec->start = start;
+  rec->end = end;
+  rec->id = id;
+  atomic_store_explicit(&r->head, h + 1, memory_order_release);
+}
+
+/**
+ * \brief  write the records as trace events in the JSON format of
+ *         chrome://tracing and Perfetto, timestamps in microseconds
+ */
+static bool trace_export(const char *path, double us_per_tick){
+  FILE *fp = fopen(path, "w");
+  if(fp == NULL){
+    fprintf(stderr, "Unable to open trace file %s\n", path);
+    return false;
+  }
+
+  fprintf(fp, "{\"traceEvents\":[");
+  bool first = true;
+  for(trace_ring *r = atomic_load(&rings); r != NULL; r = r->next){
+    size_t head = atomic_load_explicit(&r->head, memory_order_acquire);
+    size_t begin = (head > TRACE_RING_SIZE) ? head - TRACE_RING_SIZE : 0;
+    for(size_t i = begin; i < head; i++){
+      const trace_rec *rec = &r->recs[i & (TRACE_RING_SIZE - 1)];
+      fprintf(fp, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3lf,\"dur\":%.3lf}", first ? "" : ",", trace_names[rec->id], r->tid, (double)(int64_t)(rec->start - base_ticks) * us_per_tick, (double)(rec->end - rec->start) * us_per_tick);
+      first = false;
+    }
+  }
+  fprintf(fp, "\n],\"displayTimeUnit\":\"ms\"}\n");
+
+  return fclose(fp) == 0;
+}
+
+bool fpga_trace_enabled(){
+  return true;
+}
+
+/**
+ * \brief  print the time spent in each traced call over all threads and
+ *         write the records of the rings to path. Ticks are converted using
+ *         the ticks and wall clock time since the first record.
+ * \return false if the trace could not be written
+ */
+bool fpga_trace_dump(const char *path){
+  uint64_t calls[TRACE_NUM_IDS] = {0}, ticks[TRACE_NUM_IDS] = {0}, max[TRACE_NUM_IDS] = {0};
+  size_t dropped = 0;
+  unsigned threads = 0;
+
+  trace_ring *head = atomic_load(&rings);
+  if(head == NULL){
+    printf("No host calls traced\n");
+    return true;
+  }
+
+  double elapsed_ms = getTimeinMilliSec() - base_ms;
+  uint64_t elapsed_ticks = trace_ticks() - base_ticks;
+  double us_per_tick = (elapsed_ticks > 0) ? elapsed_ms * 1.0e3 / (double)elapsed_ticks : 0.0;
+
+  for(trace_ring *r = head; r != NULL; r = r->next){
+    size_t written = atomic_load_explicit(&r->head, memory_order_acquire);
+    dropped += (written > TRACE_RING_SIZE) ? written - TRACE_RING_SIZE : 0;
+    threads++;
+    for(unsigned id = 0; id < TRACE_NUM_IDS; id++){
+      calls[id] += r->calls[id];
+      ticks[id] += r->ticks[id];
+      if(r->max[id] > max[id])
+        max[id] = r->max[id];
+    }
+  }
+
+  printf("\n------------------------------------------\n");
+  printf("Host Trace, rings of %u threads \n", threads);
+  printf("--------------------------------------------\n");
+  printf("%16s %10s %12s %12s %12s\n", "Call", "Count", "Total (ms)", "Mean (us)", "Max (us)");
+  for(unsigned id = 0; id < TRACE_NUM_IDS; id++){
+    if(calls[id] == 0)
+      continue;
+    double total_us = (double)ticks[id] * us_per_tick;
+    printf("%16s %10lu %12.3lf %12.3lf %12.3lf\n", trace_names[id], calls[id], total_us * 1.0e-3, total_us / calls[id], (double)max[id] * us_per_tick);
+  }
+  if(dropped > 0){
+    printf("%zu records overwritten, the export holds the last %d per thread\n", dropped, TRACE_RING_SIZE);
+  }
+
+  if(path != NULL){
+    return trace_export(path, us_per_tick);
+  }
+  return true;
+}
+
+/**
+ * \brief  clear the records and totals, no traced call may be running
+ */
+void fpga_trace_reset(){
+  for(trace_ring *r = atomic_load(&rings); r != NULL; r = r->next){
+    atomic_store(&r->head, 0);
+    for(unsigned id = 0; id < TRACE_NUM_IDS; id++){
+      r->calls[id] = r->ticks[id] = r->max[id] = 0;
+    }
+  }
+}
+
+#else
+
+bool fpga_trace_enabled(){
+  return false;
+}
+
+bool fpga_trace_dump(const char *path){
+  return false;
+}
+
+void fpga_trace_reset(){
+}
+
+#endif // FPGA_TRACE
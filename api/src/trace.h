@@ -0,0 +1,63 @@
+// Author: Arjun Ramaswami
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+/**
+ * Host calls recorded by the tracing layer, see TRACE()
+ */
+typedef enum trace_id {
+  TRACE_QUEUE_SETUP,      /**< queue_setup, including waiting for the handle */
+  TRACE_QUEUE_CLEANUP,    /**< queue_cleanup */
+  TRACE_CREATE_BUFFER,    /**< device buffer from the pool or the runtime */
+  TRACE_RELEASE_BUFFER,   /**< device buffer returned or released */
+  TRACE_ENQUEUE_WRITE,    /**< clEnqueueWriteBuffer */
+  TRACE_ENQUEUE_READ,     /**< clEnqueueReadBuffer */
+  TRACE_FLUSH,            /**< clFlush */
+  TRACE_FINISH,           /**< clFinish */
+  TRACE_WAIT,             /**< clWaitForEvents */
+  TRACE_NUM_IDS
+} trace_id;
+
+#ifdef FPGA_TRACE
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#else
+#include <time.h>
+#endif
+
+/**
+ * \brief  timestamp of the time stamp counter, nanoseconds of the monotonic
+ *         clock where there is none
+ */
+static inline uint64_t trace_ticks(){
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return (uint64_t)t.tv_sec * 1000000000ull + (uint64_t)t.tv_nsec;
+#endif
+}
+
+void trace_record(trace_id id, uint64_t start, uint64_t end);
+
+// record the time spent in a statement, e.g. TRACE(TRACE_FLUSH, clFlush(q))
+#define TRACE(id, call) do { uint64_t trace_start_ = trace_ticks(); call; trace_record((id), trace_start_, trace_ticks()); } while(0)
+
+// record the time between the two points of a function
+#define TRACE_BEGIN(var) uint64_t var = trace_ticks()
+#define TRACE_END(id, var) trace_record((id), (var), trace_ticks())
+
+#else
+
+#define TRACE(id, call) do { call; } while(0)
+#define TRACE_BEGIN(var)
+#define TRACE_END(id, var)
+
+#endif // FPGA_TRACE
+
+#endif // TRACE_H
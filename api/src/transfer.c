@@ -0,0 +1,257 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <CL/cl_ext_intelfpga.h> // CL_CHANNEL_1_INTELFPGA
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "dev_pool.h"
+#include "transfer.h"
+#include "event_ring.h"
+#include "trace.h"
+#include "opencl_utils.h"
+#include "misc.h"
+
+#define MAX_BANKS 4
+
+static const cl_mem_flags bank_flags[MAX_BANKS] = {
+  CL_CHANNEL_1_INTELFPGA, CL_CHANNEL_2_INTELFPGA, 
+  CL_CHANNEL_3_INTELFPGA, CL_CHANNEL_4_INTELFPGA
+};
+
+/**
+ * \brief  memory flag to place a buffer in a DDR bank, buffers are assigned
+ *         round robin over the given number of banks
+ * \param  buf   : index of the buffer
+ * \param  banks : number of banks to use, 0 for interleaved placement
+ * \return flag to be combined with CL_MEM_READ_WRITE
+ */
+cl_mem_flags bank_flag(unsigned buf, unsigned banks){
+  if(banks == 0){
+    return 0;
+  }
+  if(banks > MAX_BANKS){
+    banks = MAX_BANKS;
+  }
+  return bank_flags[buf % banks];
+}
+
+/**
+ * \brief  largest number of points a single device buffer can hold: the
+ *         maximum allocation of the device and, for buffers placed in a bank,
+ *         the capacity of a bank. Kernels take the points of a buffer as 
+ *         unsigned, so it is at most UINT_MAX.
+ * \param  point_sz : bytes per point
+ * \param  banks    : number of banks the buffers are spread over, 0 for 
+ *                    interleaved placement
+ * \return points, at least 1
+ */
+size_t max_points(cl_device_id device, size_t point_sz, unsigned banks){
+  cl_ulong max_alloc = 0, global_mem = 0;
+
+  cl_int status = clGetDeviceInfo(device, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(cl_ulong), &max_alloc, NULL);
+  checkError(status, "Failed to query the maximum allocation size");
+  status = clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &global_mem, NULL);
+  checkError(status, "Failed to query the global memory size");
+
+  cl_ulong limit = max_alloc;
+  if(banks > 0 && global_mem / MAX_BANKS < limit){
+    limit = global_mem / MAX_BANKS;
+  }
+
+  cl_ulong points = limit / point_sz;
+  if(points > UINT_MAX){
+    points = UINT_MAX;
+  }
+  return (points == 0) ? 1 : (size_t)points;
+}
+
+/**
+ * \brief  points per transfer when N points are split into the fewest 
+ *         transfers of at most max points each. The split is balanced, so 
+ *         the last transfer is not a small remainder.
+ */
+size_t split_points(size_t N, size_t max){
+  if(N <= max){
+    return N;
+  }
+  size_t parts = (N + max - 1) / max;
+  return (N + parts - 1) / parts;
+}
+
+/**
+ * \brief  Allocate total points on the device as buffers of at most 
+ *         max_points each, placed round robin over the banks
+ * \param  arr   : buffers, released using dev_array_release
+ * \param  pool  : pool the buffers are taken from, NULL to create them
+ * \param  elem  : bytes per point
+ * \param  banks : number of banks, 0 for interleaved placement
+ * \return false if total exceeds the global memory of the device
+ */
+bool dev_array_create(dev_array *arr, cl_context context, cl_device_id device, dev_pool *pool, size_t total, size_t elem, unsigned banks){
+  cl_int status = 0;
+  cl_ulong global_mem = 0;
+
+  arr->bufs = NULL;
+  arr->pool = pool;
+  arr->count = arr->seg = arr->total = arr->elem = 0;
+
+  status = clGetDeviceInfo(device, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(cl_ulong), &global_mem, NULL);
+  checkError(status, "Failed to query the global memory size");
+  if(total == 0 || elem == 0 || total > global_mem / elem){
+    return false;
+  }
+
+  // regions of the pool are at most its largest block
+  size_t max = max_points(device, elem, banks);
+  if(pool != NULL && dev_pool_max_block(pool) / elem < max){
+    max = dev_pool_max_block(pool) / elem;
+  }
+  size_t seg = split_points(total, max);
+  size_t count = (total + seg - 1) / seg;
+  arr->bufs = (dev_block *)calloc(count, sizeof(dev_block));
+  if(arr->bufs == NULL){
+    return false;
+  }
+
+  for(size_t b = 0; b < count; b++){
+    size_t len = (b == count - 1) ? total - b * seg : seg;
+    dev_pool_buffer(pool, context, elem * len, b, banks, &arr->bufs[b]);
+  }
+  arr->count = count;
+  arr->seg = seg;
+  arr->total = total;
+  arr->elem = elem;
+  return true;
+}
+
+/**
+ * \brief  Enqueue the writes of every buffer of the array, complete once 
+ *         the in order queue is finished
+ * \param  src : total points
+ */
+void dev_array_write(cl_command_queue queue, const dev_array *arr, const void *src){
+  const char *bytes = (const char *)src;
+  for(size_t b = 0; b < arr->count; b++){
+    size_t len = (b == arr->count - 1) ? arr->total - b * arr->seg : arr->seg;
+    cl_int status = 0;
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(queue, arr->bufs[b].buf, CL_FALSE, 0, arr->elem * len, &bytes[arr->elem * b * arr->seg], 0, NULL, NULL));
+    checkError(status, "Failed to write to DDR");
+  }
+}
+
+/**
+ * \brief  Enqueue the reads of every buffer of the array, complete once 
+ *         the in order queue is finished
+ * \param  dst : total points
+ */
+void dev_array_read(cl_command_queue queue, const dev_array *arr, void *dst){
+  char *bytes = (char *)dst;
+  for(size_t b = 0; b < arr->count; b++){
+    size_t len = (b == arr->count - 1) ? arr->total - b * arr->seg : arr->seg;
+    cl_int status = 0;
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(queue, arr->bufs[b].buf, CL_FALSE, 0, arr->elem * len, &bytes[arr->elem * b * arr->seg], 0, NULL, NULL));
+    checkError(status, "Failed to read");
+  }
+}
+
+/**
+ * \brief  Release the buffers of an array, which can be empty
+ */
+void dev_array_release(dev_array *arr){
+  for(size_t b = 0; b < arr->count; b++){
+    dev_pool_release(arr->pool, &arr->bufs[b]);
+  }
+  free(arr->bufs);
+  arr->bufs = NULL;
+  arr->pool = NULL;
+  arr->count = arr->seg = arr->total = arr->elem = 0;
+}
+
+/**
+ * \brief  Pipelined host to device to host transfer of total points in
+ *         chunks. Write of chunk i waits on the read of the chunk that last
+ *         used the same device buffer, read of chunk i waits on its write.
+ *         The last chunk handles the tail if chunk does not divide total.
+ * \param  context  : context to create the device buffers
+ * \param  pool     : pool the device buffers are taken from, can be NULL
+ * \param  queue_wr : queue for writes
+ * \param  queue_rd : queue for reads, can be the same as queue_wr
+ * \param  config   : chunk, depth and banks of the device buffers
+ * \param  total    : total number of points
+ * \param  elem     : bytes per point
+ * \param  inp      : input data of size total
+ * \param  out      : output data of size total
+ * \param  timing   : submit_t and device_t are set if not NULL
+ * \return true if successful, all transfers have completed
+ */
+bool pipeline_transfer(cl_context context, dev_pool *pool, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, size_t total, size_t elem, const void *inp, void *out, fpga_t *timing){
+  cl_int status = 0;
+  cl_event first = NULL, last = NULL;
+
+  if(total == 0 || elem == 0 || config->depth == 0){
+    return false;
+  }
+  const char *src = (const char *)inp;
+  char *dst = (char *)out;
+
+  size_t chunk = (config->chunk == 0 || config->chunk > total) ? total : config->chunk;
+  size_t num_chunks = (total + chunk - 1) / chunk;
+  size_t depth = (config->depth > num_chunks) ? num_chunks : config->depth;
+  if(depth > EVENT_RING_MAX){
+    depth = EVENT_RING_MAX;
+  }
+
+  cl_mem d_buf[EVENT_RING_MAX];
+  dev_block d_blk[EVENT_RING_MAX];
+  event_ring writeEvents, readEvents;
+  event_ring_init(&writeEvents, 1);
+  event_ring_init(&readEvents, depth);
+
+  for(size_t b = 0; b < depth; b++){
+    d_buf[b] = dev_pool_buffer(pool, context, elem * chunk, b, config->banks, &d_blk[b]);
+  }
+
+  double start = getTimeinMilliSec();
+
+  for(size_t i = 0; i < num_chunks; i++){
+    size_t b = i % depth;
+    size_t offset = i * chunk;
+    size_t len = (offset + chunk > total) ? (total - offset) : chunk;
+
+    // buffer is reused once the read of the chunk depth steps before is done
+    TRACE(TRACE_ENQUEUE_WRITE, status = clEnqueueWriteBuffer(queue_wr, d_buf[b], CL_FALSE, 0, elem * len, &src[elem * offset], (i < depth) ? 0 : 1, (i < depth) ? NULL : event_ring_get(&readEvents, i - depth), event_ring_acquire(&writeEvents, i)));
+    checkError(status, "Failed to write to DDR");
+    TRACE(TRACE_FLUSH, clFlush(queue_wr));
+    if(i == 0)
+      first = event_ring_keep(&writeEvents, i);
+    if(i >= depth)
+      event_ring_release(&readEvents, i - depth);
+
+    TRACE(TRACE_ENQUEUE_READ, status = clEnqueueReadBuffer(queue_rd, d_buf[b], CL_FALSE, 0, elem * len, &dst[elem * offset], 1, event_ring_get(&writeEvents, i), event_ring_acquire(&readEvents, i)));
+    checkError(status, "Failed to read");
+    TRACE(TRACE_FLUSH, clFlush(queue_rd));
+    if(i == num_chunks - 1)
+      last = event_ring_keep(&readEvents, i);
+    event_ring_release(&writeEvents, i);
+  }
+  double submit_t = getTimeinMilliSec() - start;
+
+  // the last depth reads are pending
+  event_ring_drain(&readEvents);
+
+  if(timing != NULL){
+    timing->submit_t = submit_t;
+    timing->device_t = event_elapsed(first, last);
+  }
+  clReleaseEvent(first);
+  clReleaseEvent(last);
+
+  for(size_t b = 0; b < depth; b++){
+    dev_pool_release(pool, &d_blk[b]);
+  }
+  return true;
+}
@@ -0,0 +1,37 @@
+// Author: Arjun Ramaswami
+
+#ifndef TRANSFER_H
+#define TRANSFER_H
+
+#include <stdbool.h>
+
+/**
+ * Points on the device split over buffers of at most max_points each, 
+ * buffer b holds the points from b * seg
+ */
+typedef struct dev_array {
+  dev_block *bufs;
+  dev_pool *pool;   /**< pool the buffers are taken from, can be NULL */
+  size_t count;   /**< number of buffers */
+  size_t seg;     /**< points per buffer, the last holds the remainder */
+  size_t total;   /**< points of the array */
+  size_t elem;    /**< bytes per point */
+} dev_array;
+
+cl_mem_flags bank_flag(unsigned buf, unsigned banks);
+
+size_t max_points(cl_device_id device, size_t point_sz, unsigned banks);
+
+size_t split_points(size_t N, size_t max);
+
+bool dev_array_create(dev_array *arr, cl_context context, cl_device_id device, dev_pool *pool, size_t total, size_t elem, unsigned banks);
+
+void dev_array_write(cl_command_queue queue, const dev_array *arr, const void *src);
+
+void dev_array_read(cl_command_queue queue, const dev_array *arr, void *dst);
+
+void dev_array_release(dev_array *arr);
+
+bool pipeline_transfer(cl_context context, dev_pool *pool, cl_command_queue queue_wr, cl_command_queue queue_rd, const fpga_config_t *config, size_t total, size_t elem, const void *inp, void *out, fpga_t *timing);
+
+#endif // TRANSFER_H
@@ -0,0 +1,338 @@
+// Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <ctype.h>
+#include <limits.h>
+#include "CL/opencl.h"
+
+#include "bare.h"
+#include "tune.h"
+
+#ifndef FPGA_BOARD_NAME
+#define FPGA_BOARD_NAME "p520_hpc_sg280l"
+#endif
+
+#define MAX_CANDIDATES 16
+
+#define NUM_LINKS 4
+
+// profile keys of the directions of a model, in the order of model_link
+static const char *link_names[NUM_LINKS] = {"write", "read", "duplex_write", "duplex_read"};
+
+// function prototype
+static fpga_link_t* model_link(fpga_model_t *model, unsigned l);
+static void load_link(const char *key, double value, fpga_model_t *model);
+static void sanitize(char *str);
+static bool same_config(const fpga_config_t *a, const fpga_config_t *b);
+static double measure(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, const fpga_config_t *config, float2 *inp, float2 *out);
+
+/**
+ * \brief  name of the board, taken from the FPGA_BOARD_NAME environment 
+ *         variable, defaults to the board the project was configured for
+ */
+void board_name(char *board, size_t len){
+  const char *env = getenv("FPGA_BOARD_NAME");
+  snprintf(board, len, "%s", (env != NULL && strlen(env) > 0) ? env : FPGA_BOARD_NAME);
+}
+
+/**
+ * \brief  version of the BSP, taken from the FPGA_BSP_VERSION environment 
+ *         variable, defaults to the driver version reported by the device
+ */
+void bsp_version(char *bsp, size_t len, cl_device_id device){
+  const char *env = getenv("FPGA_BSP_VERSION");
+  if(env != NULL && strlen(env) > 0){
+    snprintf(bsp, len, "%s", env);
+  }
+  else if(clGetDeviceInfo(device, CL_DRIVER_VERSION, len, bsp, NULL) != CL_SUCCESS){
+    snprintf(bsp, len, "unknown");
+  }
+}
+
+/**
+ * \brief  path of the transfer profile for the board and BSP, see board_name
+ *         and bsp_version. Profiles are stored in FPGA_PROFILE_DIR, defaults
+ *         to the working directory.
+ * \param  path   : string to store the path
+ * \param  len    : length of path
+ * \param  device : device to query the driver version
+ */
+void profile_path(char *path, size_t len, cl_device_id device){
+  char board[128], bsp[128];
+  const char *env;
+
+  board_name(board, sizeof(board));
+  bsp_version(bsp, sizeof(bsp), device);
+
+  sanitize(board);
+  sanitize(bsp);
+
+  env = getenv("FPGA_PROFILE_DIR");
+  snprintf(path, len, "%s/%s_%s.profile", (env != NULL && strlen(env) > 0) ? env : ".", board, bsp);
+}
+
+/**
+ * \brief  load transfer parameters and the PCIe model from profile, keys
+ *         not found in the profile keep their values
+ * \param  path   : path to profile
+ * \param  config : configuration to fill
+ * \param  model  : model to fill, valid if both directions were found
+ * \return true if profile found
+ */
+bool load_profile(const char *path, fpga_config_t *config, fpga_model_t *model){
+  char line[256], key[64];
+  double value;
+
+  FILE *fp = fopen(path, "r");
+  if(fp == NULL){
+    return false;
+  }
+
+  while(fgets(line, sizeof(line), fp) != NULL){
+    if(line[0] == '#' || sscanf(line, "%63s = %lf", key, &value) != 2 || value < 0.0){
+      continue;
+    }
+
+    if(strcmp(key, "chunk") == 0)
+      config->chunk = (unsigned)value;
+    else if(strcmp(key, "depth") == 0 && value > 0)
+      config->depth = (unsigned)value;
+    else if(strcmp(key, "banks") == 0)
+      config->banks = (unsigned)value;
+    else if(strcmp(key, "queues") == 0 && (value == 1 || value == 2))
+      config->queues = (unsigned)value;
+    else if(strcmp(key, "svm") == 0)
+      config->use_svm = (value != 0);
+    else if(strcmp(key, "model") == 0)
+      config->use_model = (value != 0);
+    else
+      load_link(key, value, model);
+  }
+  model->valid = (model->write.bandwidth > 0.0 && model->read.bandwidth > 0.0);
+
+  fclose(fp);
+  return true;
+}
+
+/**
+ * \brief  store transfer parameters and the PCIe model to profile
+ * \param  path      : path to profile
+ * \param  config    : configuration to store
+ * \param  bandwidth : bandwidth in GB/s measured with the configuration, 0
+ *                     if not measured
+ * \param  model     : model to store if valid
+ * \return true if successful
+ */
+bool save_profile(const char *path, const fpga_config_t *config, double bandwidth, const fpga_model_t *model){
+  FILE *fp = fopen(path, "w");
+  if(fp == NULL){
+    fprintf(stderr, "Unable to write profile %s\n", path);
+    return false;
+  }
+
+  fprintf(fp, "# Transfer profile generated by fpga_autotune and fpga_calibrate\n");
+  if(bandwidth > 0.0)
+    fprintf(fp, "# bandwidth %.5lf GB/s\n", bandwidth);
+  fprintf(fp, "chunk = %u\n", config->chunk);
+  fprintf(fp, "depth = %u\n", config->depth);
+  fprintf(fp, "banks = %u\n", config->banks);
+  fprintf(fp, "queues = %u\n", config->queues);
+  fprintf(fp, "svm = %u\n", config->use_svm ? 1 : 0);
+  fprintf(fp, "model = %u\n", config->use_model ? 1 : 0);
+
+  if(model != NULL && model->valid){
+    fprintf(fp, "# time = latency us + bytes / bandwidth GB/s\n");
+    for(unsigned l = 0; l < NUM_LINKS; l++){
+      const fpga_link_t *link = model_link((fpga_model_t *)model, l);
+      fprintf(fp, "%s_latency = %.4lf\n", link_names[l], link->latency);
+      fprintf(fp, "%s_bandwidth = %.5lf\n", link_names[l], link->bandwidth);
+      fprintf(fp, "%s_r2 = %.5lf\n", link_names[l], link->r2);
+    }
+  }
+
+  fclose(fp);
+  return true;
+}
+
+/**
+ * \brief  coordinate descent over the transfer parameters. Starting from the
+ *         default configuration, every parameter is varied in turn keeping
+ *         the others fixed, until a pass does not improve the time.
+ * \param  ctx      : handle the transfers are measured on
+ * \param  N        : number of points in each batch
+ * \param  how_many : number of batches
+ * \param  reps     : repetitions of each configuration, median is compared
+ * \param  try_svm  : include SVM buffers as allocation type
+ * \param  best     : fastest configuration found
+ * \param  bandwidth: bandwidth in GB/s of the fastest configuration
+ * \return 0 if successful, -2 if host buffers could not be allocated, -4 if
+ *         no configuration is valid
+ */
+int autotune_search(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, bool try_svm, fpga_config_t *best, double *bandwidth){
+  size_t total = N * how_many;
+  unsigned cand[MAX_CANDIDATES];
+
+  float2 *inp = (float2 *)fpgaf_complex_malloc(sizeof(float2) * total);
+  float2 *out = (float2 *)fpgaf_complex_malloc(sizeof(float2) * total);
+  if(inp == NULL || out == NULL){
+    free(inp);
+    free(out);
+    return -2;
+  }
+  for(size_t i = 0; i < total; i++){
+    inp[i].x = (float)i;
+    inp[i].y = (float)(total - i);
+  }
+
+  // chunk 0 transfers N points at a time, for N beyond an unsigned chunk
+  fpga_config_t cur = {(N > UINT_MAX) ? 0 : (unsigned)N, 2, 2, 2, false, false};
+  double best_t = measure(ctx, N, how_many, reps, &cur, inp, out);
+
+  for(unsigned pass = 0; pass < 3; pass++){
+    bool improved = false;
+
+    // 0: chunk, 1: depth, 2: banks, 3: queues, 4: allocation type
+    for(unsigned param = 0; param < 5; param++){
+      unsigned num = 0;
+
+      switch(param){
+        case 0:
+          for(size_t c = (N >= 16) ? N / 16 : 1; c <= total && c <= UINT_MAX && num < MAX_CANDIDATES; c *= 2)
+            cand[num++] = c;
+          break;
+        case 1:
+          cand[num++] = 1; cand[num++] = 2; cand[num++] = 3; 
+          cand[num++] = 4; cand[num++] = 8;
+          break;
+        case 2:
+          cand[num++] = 0; cand[num++] = 1; cand[num++] = 2; cand[num++] = 4;
+          break;
+        case 3:
+          cand[num++] = 1; cand[num++] = 2;
+          break;
+        case 4:
+          cand[num++] = 0;
+          if(try_svm)
+            cand[num++] = 1;
+          break;
+      }
+
+      for(unsigned c = 0; c < num; c++){
+        fpga_config_t trial = cur;
+        switch(param){
+          case 0: trial.chunk = cand[c]; break;
+          case 1: trial.depth = cand[c]; break;
+          case 2: trial.banks = cand[c]; break;
+          case 3: trial.queues = cand[c]; break;
+          case 4: trial.use_svm = (cand[c] == 1); break;
+        }
+        if(same_config(&trial, &cur))
+          continue;
+
+        double t = measure(ctx, N, how_many, reps, &trial, inp, out);
+        if(t > 0.0 && (best_t <= 0.0 || t < best_t)){
+          best_t = t;
+          cur = trial;
+          improved = true;
+        }
+      }
+    }
+
+#ifdef VERBOSE
+    printf("\tAutotune pass %u: chunk %u depth %u banks %u queues %u svm %d - %lfms\n", pass, cur.chunk, cur.depth, cur.banks, cur.queues, cur.use_svm, best_t);
+#endif
+    if(!improved)
+      break;
+  }
+
+  free(inp);
+  free(out);
+
+  // no configuration transferred the batch correctly
+  if(best_t <= 0.0){
+    return -4;
+  }
+
+  *best = cur;
+  *bandwidth = (best_t > 0.0) ? (sizeof(float2) * total * 1e-9) / (best_t * 1e-3) : 0.0;
+  return 0;
+}
+
+static bool same_config(const fpga_config_t *a, const fpga_config_t *b){
+  return (a->chunk == b->chunk) && (a->depth == b->depth) && 
+         (a->banks == b->banks) && (a->queues == b->queues) && 
+         (a->use_svm == b->use_svm);
+}
+
+static int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * \brief  median time of reps pipelined transfers with the configuration
+ * \return time in milliseconds or -1.0 if invalid or output is incorrect
+ */
+static double measure(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, const fpga_config_t *config, float2 *inp, float2 *out){
+  size_t total = N * how_many;
+  double t[reps];
+
+  // SVM transfers need a chunk, the last one takes the tail
+  if(config->use_svm && config->chunk == 0){
+    return -1.0;
+  }
+
+  for(unsigned r = 0; r < reps; r++){
+    memset(out, 0, sizeof(float2) * total);
+    fpga_t timing = fpga_ctx_pipeline_test(ctx, N, inp, out, how_many, config);
+    if(timing.valid == 0 || memcmp(inp, out, sizeof(float2) * total) != 0){
+      return -1.0;
+    }
+    t[r] = timing.exec_t;
+  }
+
+  qsort(t, reps, sizeof(double), cmp_double);
+  return t[reps / 2];
+}
+
+static fpga_link_t* model_link(fpga_model_t *model, unsigned l){
+  switch(l){
+    case 0: return &model->write;
+    case 1: return &model->read;
+    case 2: return &model->duplex_write;
+    default: return &model->duplex_read;
+  }
+}
+
+/**
+ * \brief  set the parameter of a direction named by key, e.g. read_latency
+ */
+static void load_link(const char *key, double value, fpga_model_t *model){
+  char name[64];
+
+  for(unsigned l = 0; l < NUM_LINKS; l++){
+    fpga_link_t *link = model_link(model, l);
+    snprintf(name, sizeof(name), "%s_latency", link_names[l]);
+    if(strcmp(key, name) == 0)
+      link->latency = value;
+    snprintf(name, sizeof(name), "%s_bandwidth", link_names[l]);
+    if(strcmp(key, name) == 0)
+      link->bandwidth = value;
+    snprintf(name, sizeof(name), "%s_r2", link_names[l]);
+    if(strcmp(key, name) == 0)
+      link->r2 = value;
+  }
+}
+
+/**
+ * \brief  replace characters that are not valid in file names by '_'
+ */
+static void sanitize(char *str){
+  for(char *p = str; *p != '\0'; p++){
+    if(!isalnum((unsigned char)*p) && *p != '.' && *p != '-' && *p != '_')
+      *p = '_';
+  }
+}
@@ -0,0 +1,20 @@
+// Author: Arjun Ramaswami
+
+#ifndef TUNE_H
+#define TUNE_H
+
+#include <stdbool.h>
+
+void board_name(char *board, size_t len);
+
+void bsp_version(char *bsp, size_t len, cl_device_id device);
+
+void profile_path(char *path, size_t len, cl_device_id device);
+
+bool load_profile(const char *path, fpga_config_t *config, fpga_model_t *model);
+
+bool save_profile(const char *path, const fpga_config_t *config, double bandwidth, const fpga_model_t *model);
+
+int autotune_search(fpga_ctx_t *ctx, size_t N, unsigned how_many, unsigned reps, bool try_svm, fpga_config_t *best, double *bandwidth);
+
+#endif // TUNE_H
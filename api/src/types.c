@@ -0,0 +1,63 @@
+// Author: Arjun Ramaswami
+
+#include <string.h>
+#include <stdbool.h>
+#include <stdalign.h>
+
+#include "bare.h"
+
+/**
+ * Size and host alignment of an element type
+ */
+typedef struct type_info {
+  const char *name;
+  size_t size;
+  size_t align;
+} type_info;
+
+// indexed by fpga_type_t
+static const type_info types[FPGA_NUM_TYPES] = {
+  {"float",   sizeof(float),   alignof(float)},
+  {"float2",  sizeof(float2),  alignof(float2)},
+  {"double",  sizeof(double),  alignof(double)},
+  {"double2", sizeof(double2), alignof(double2)},
+  {"half2",   sizeof(half2),   alignof(half2)}
+};
+
+/**
+ * \brief  bytes of an element of type, 0 if unknown
+ */
+size_t fpga_type_size(fpga_type_t type){
+  return ((unsigned)type < FPGA_NUM_TYPES) ? types[type].size : 0;
+}
+
+/**
+ * \brief  host alignment of an element of type, 0 if unknown
+ */
+size_t fpga_type_align(fpga_type_t type){
+  return ((unsigned)type < FPGA_NUM_TYPES) ? types[type].align : 0;
+}
+
+/**
+ * \brief  name of type as in C
+ */
+const char* fpga_type_name(fpga_type_t type){
+  return ((unsigned)type < FPGA_NUM_TYPES) ? types[type].name : "unknown";
+}
+
+/**
+ * \brief  type of a name as in C
+ * \return false if name is not an element type
+ */
+bool fpga_type_parse(const char *name, fpga_type_t *type){
+  if(name == NULL){
+    return false;
+  }
+  for(unsigned t = 0; t < FPGA_NUM_TYPES; t++){
+    if(strcmp(name, types[t].name) == 0){
+      *type = (fpga_type_t)t;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,201 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+// largest number of sizes and alignments swept
+#define MAX_SIZES 32
+#define MAX_ALIGNS 16
+
+static void display_matrix(const char *title, const size_t *sizes, unsigned num_sizes, const size_t *aligns, unsigned num_aligns, double gbs[][MAX_ALIGNS]){
+  printf("\n------------------------------------------\n");
+  printf("%s (GB/s) \n", title);
+  printf("--------------------------------------------\n");
+  printf("%12s", "Points");
+  for(unsigned a = 0; a < num_aligns; a++){
+    printf(" %9zu", aligns[a]);
+  }
+  printf("\n");
+  for(unsigned s = 0; s < num_sizes; s++){
+    printf("%12zu", sizes[s]);
+    for(unsigned a = 0; a < num_aligns; a++){
+      printf(" %9.4lf", gbs[s][a]);
+    }
+    printf("\n");
+  }
+}
+
+int main(int argc, const char **argv) {
+  unsigned min_N = 1024, max_N = 1 << 23, iter = 5;
+  unsigned min_align = FPGA_ALIGN_MIN, max_align = FPGA_ALIGN_MAX, offset = 0;
+  bool use_svm = false, reuse = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('m',"min", &min_N, "Smallest number of points"),
+    OPT_INTEGER('n',"max", &max_N, "Largest number of points"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations of each size and alignment"),
+    OPT_INTEGER('a',"align", &min_align, "Smallest alignment of the host buffers in bytes"),
+    OPT_INTEGER('A',"max-align", &max_align, "Largest alignment of the host buffers in bytes"),
+    OPT_INTEGER('o',"offset", &offset, "Bytes the host buffers start past the aligned address, a multiple of the float2 alignment"),
+    OPT_BOOLEAN('R', "reuse", &reuse, "Allocate the host buffers once per size and alignment instead of every iteration"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Bandwidth of blocking transfers for each size and alignment of the host buffers", "Alignments are swept in powers of two, sizes in powers of four");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(min_N == 0 || max_N < min_N || iter == 0){
+    fprintf(stderr, "Data sizes and iterations must be given\n");
+    return EXIT_FAILURE;
+  }
+  if(min_align < FPGA_ALIGN_MIN || max_align > FPGA_ALIGN_MAX || max_align < min_align || (min_align & (min_align - 1)) != 0){
+    fprintf(stderr, "Alignments must be powers of two from %d to %d bytes\n", FPGA_ALIGN_MIN, FPGA_ALIGN_MAX);
+    return EXIT_FAILURE;
+  }
+  // the tests reject float2 data that is not aligned to its type
+  if(offset >= FPGA_OFFSET_MAX || offset % fpga_type_align(FPGA_FLOAT2) != 0){
+    fprintf(stderr, "Offset must be a multiple of %zu bytes less than %d bytes\n", fpga_type_align(FPGA_FLOAT2), FPGA_OFFSET_MAX);
+    return EXIT_FAILURE;
+  }
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(max_N, iter, false, 1);
+
+  results_t *res = results_open(json_path, "align_pcietest");
+  results_config_uint(res, "min_N", min_N);
+  results_config_uint(res, "max_N", max_N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "min_align", min_align);
+  results_config_uint(res, "max_align", max_align);
+  results_config_uint(res, "offset", offset);
+  results_config_bool(res, "reuse", reuse);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  size_t sizes[MAX_SIZES], aligns[MAX_ALIGNS];
+  unsigned num_sizes = 0, num_aligns = 0;
+  for(size_t N = min_N; N <= max_N && num_sizes < MAX_SIZES; N *= 4){
+    sizes[num_sizes++] = N;
+  }
+  for(size_t a = min_align; a <= max_align && num_aligns < MAX_ALIGNS; a *= 2){
+    aligns[num_aligns++] = a;
+  }
+
+  static double rd_gbs[MAX_SIZES][MAX_ALIGNS], wr_gbs[MAX_SIZES][MAX_ALIGNS];
+  double align_t[MAX_ALIGNS] = {0.0};
+
+  for(unsigned s = 0; s < num_sizes; s++){
+    size_t N = sizes[s];
+    size_t bytes = N * sizeof(float2);
+
+    for(unsigned a = 0; a < num_aligns; a++){
+      double sum_rd = 0.0, sum_wr = 0.0;
+      float2 *inp = NULL, *out = NULL;
+      char name[64];
+
+      for(size_t i = 0; i < iter; i++){
+        // new buffers every iteration is the case of the read loss
+        if(inp == NULL){
+          inp = (float2*)fpga_host_malloc(bytes, aligns[a], offset);
+          out = (float2*)fpga_host_malloc(bytes, aligns[a], offset);
+          if(inp == NULL || out == NULL || !create_data(inp, N)){
+            fprintf(stderr, "Error in Data Creation \n");
+            fpga_host_free(inp);
+            fpga_host_free(out);
+            fpga_final();
+            return EXIT_FAILURE;
+          }
+        }
+
+        fpga_t timing = fpga_test(N, inp, out, false);
+
+        if(timing.valid == 0 || !verify_output(inp, out, N)){
+          fprintf(stderr, "Verification Failed for %zu points aligned to %zu bytes\n", N, aligns[a]);
+          fpga_host_free(inp);
+          fpga_host_free(out);
+          fpga_final();
+          return EXIT_FAILURE;
+        }
+
+        sum_rd += timing.pcie_read_t;
+        sum_wr += timing.pcie_write_t;
+        snprintf(name, sizeof(name), "pcie_read_align_%zu", aligns[a]);
+        results_add(res, name, "ms", bytes, timing.pcie_read_t);
+        snprintf(name, sizeof(name), "pcie_write_align_%zu", aligns[a]);
+        results_add(res, name, "ms", bytes, timing.pcie_write_t);
+
+        if(!reuse){
+          fpga_host_free(inp);
+          fpga_host_free(out);
+          inp = out = NULL;
+        }
+      }
+      fpga_host_free(inp);
+      fpga_host_free(out);
+
+      rd_gbs[s][a] = (sum_rd > 0.0) ? (bytes * iter) / (sum_rd * 1.0e6) : 0.0;
+      wr_gbs[s][a] = (sum_wr > 0.0) ? (bytes * iter) / (sum_wr * 1.0e6) : 0.0;
+      align_t[a] += (sum_rd + sum_wr) / iter;
+    }
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  display_matrix("Read", sizes, num_sizes, aligns, num_aligns, rd_gbs);
+  display_matrix("Write", sizes, num_sizes, aligns, num_aligns, wr_gbs);
+
+  // the alignment with the least time over all sizes
+  unsigned best = 0;
+  for(unsigned a = 1; a < num_aligns; a++){
+    if(align_t[a] < align_t[best])
+      best = a;
+  }
+  printf("\nLeast transfer time over all sizes with %zu byte alignment (%.4lf ms against %.4lf ms with %zu bytes), set with fpga_set_host_alignment\n", aligns[best], align_t[best], align_t[0], aligns[0]);
+  results_config_uint(res, "best_align", aligns[best]);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,157 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 1, iter = 1, batch = 2, reps = 3;
+  bool use_svm = false;
+  bool interleaving = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+
+  double avg_exec = 0.0;
+  double total_api_time = 0.0;
+  bool status = true, use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Data Size"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations with the tuned configuration"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_INTEGER('r',"reps", &reps, "Repetitions of each candidate configuration"),
+    OPT_BOOLEAN('s',"svm", &use_svm, "Include SVM buffers in the search"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Autotune PCIe transfers of the board", "Data size and path are mandatory, tuned configuration is stored in the board profile");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  // any number of points is tuned, tails of chunks are transferred as such
+  if(N == 0 || batch == 0 || reps == 0){
+    fprintf(stderr, "Data size, batch and repetitions must be given\n");
+    return EXIT_FAILURE;
+  }
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(N, iter, interleaving, batch);
+
+  results_t *res = results_open(json_path, "autotune");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_uint(res, "reps", reps);
+  results_config_bool(res, "svm", use_svm);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit == -5){
+    fprintf(stderr, "SVM not supported by device, tuning buffers only\n");
+    fpga_final();
+    isInit = fpga_initialize(platform, path, false);
+  }
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  fpga_config_t config;
+  int isTuned = fpga_autotune(N, batch, reps, &config);
+  if(isTuned != 0){
+    fprintf(stderr, "Autotuning error %d\n", isTuned);
+    fpga_final();
+    return EXIT_FAILURE;
+  }
+
+  printf("Tuned configuration stored in %s\n", fpga_profile_path());
+  printf("\tChunk  : %u\n", config.chunk);
+  printf("\tDepth  : %u\n", config.depth);
+  printf("\tBanks  : %u\n", config.banks);
+  printf("\tQueues : %u\n", config.queues);
+  printf("\tSVM    : %d\n\n", config.use_svm);
+
+  results_config_uint(res, "tuned_chunk", config.chunk);
+  results_config_uint(res, "tuned_depth", config.depth);
+  results_config_uint(res, "tuned_banks", config.banks);
+  results_config_uint(res, "tuned_queues", config.queues);
+  results_config_bool(res, "tuned_svm", config.use_svm);
+
+  size_t inp_sz = sizeof(float2) * N * batch;
+  float2 *inp = (float2*)fpgaf_complex_malloc(inp_sz);
+  float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
+
+  for(size_t i = 0; i < iter; i++){
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+    double temp_timer = 0.0;
+
+    status = create_data(inp, (size_t)N * batch);
+    if(!status){
+      fprintf(stderr, "Error in Data Creation \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    // NULL uses the tuned configuration
+    temp_timer = getTimeinMilliseconds();
+    timing = fpga_pipeline_test(N, inp, out, batch, NULL);
+    total_api_time += getTimeinMilliseconds() - temp_timer;
+
+    if(timing.valid == 0 || !verify_output(inp, out, (size_t)N * batch)){
+      fprintf(stderr, "Verification Failed \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    avg_exec += timing.exec_t;
+    results_add(res, "exec", "ms", sizeof(float2) * N * batch, timing.exec_t);
+
+    printf("Iter: %lu\n", i);
+    printf("\tTransfers: %lfms\n\n", timing.exec_t);
+  }  // iter
+
+  free(inp);
+  free(out);
+
+  // destroy fpga state
+  fpga_final();
+
+  // display performance measures
+  display_measures(total_api_time, 0.0, 0.0, avg_exec, (size_t)N * batch, iter);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
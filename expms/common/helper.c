@@ -17,9 +17,9 @@
  * \param  N   : number of points in the array
  * \return true if successful
  */
-bool create_data(float2 *inp, unsigned N){
+bool create_data(float2 *inp, size_t N){
 
-  if(inp == NULL || N <= 0){
+  if(inp == NULL || N == 0){
     return false;
   }
 
@@ -31,6 +31,50 @@ bool create_data(float2 *inp, unsigned N){
   return true;
 }
 
+/**
+ * \brief  create random values of the element type, in [0, 1] for the
+ *         floating point types and finite half precision values with a 
+ *         random sign, exponent and mantissa for half2
+ * \param  inp  : pointer to N elements of type
+ * \param  type : element type
+ * \param  N    : number of elements in the array
+ * \return true if successful
+ */
+bool create_typed_data(void *inp, fpga_type_t type, size_t N){
+
+  if(inp == NULL || N == 0){
+    return false;
+  }
+
+  switch(type){
+    case FPGA_FLOAT:
+      for(size_t i = 0; i < N; i++)
+        ((float *)inp)[i] = (float)rand() / (float)RAND_MAX;
+      return true;
+    case FPGA_FLOAT2:
+      return create_data((float2 *)inp, N);
+    case FPGA_DOUBLE:
+      for(size_t i = 0; i < N; i++)
+        ((double *)inp)[i] = (double)rand() / (double)RAND_MAX;
+      return true;
+    case FPGA_DOUBLE2:
+      for(size_t i = 0; i < N; i++){
+        ((double2 *)inp)[i].x = (double)rand() / (double)RAND_MAX;
+        ((double2 *)inp)[i].y = (double)rand() / (double)RAND_MAX;
+      }
+      return true;
+    case FPGA_HALF2:
+      // exponent 31 is infinity and NaN
+      for(size_t i = 0; i < N; i++){
+        ((half2 *)inp)[i].x = (uint16_t)((rand() & 0x8000) | ((rand() % 31) << 10) | (rand() & 0x3ff));
+        ((half2 *)inp)[i].y = (uint16_t)((rand() & 0x8000) | ((rand() % 31) << 10) | (rand() & 0x3ff));
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
 /**
  * \brief  print configuration chosen to execute on FPGA
  * \param  N: fft size
@@ -56,7 +100,7 @@ void print_config(unsigned N, unsigned iter, bool interleaving, unsigned batch){
  * \param  N: fft size
  * \param  iter: number of iterations of each transformation (if BATCH mode)
  */
-void display_measures(double total_api_time, double pcie_rd, double pcie_wr, double exec_t, unsigned N, unsigned iter){
+void display_measures(double total_api_time, double pcie_rd, double pcie_wr, double exec_t, size_t N, unsigned iter){
 
   double avg_api_time = 0.0;
 
@@ -67,7 +111,7 @@ void display_measures(double total_api_time, double pcie_rd, double pcie_wr, dou
   double pcie_read = pcie_rd / iter;
   double pcie_write = pcie_wr / iter;
   double exec = exec_t / iter;
-  unsigned data_sz = N * 8;
+  size_t data_sz = N * sizeof(float2);
   double pcie_rd_bandwidth = data_sz * 1e-9 / (pcie_read * 1e-3);
   double pcie_wr_bandwidth = data_sz  * 1e-9 / (pcie_write * 1e-3);
 
@@ -75,8 +119,8 @@ void display_measures(double total_api_time, double pcie_rd, double pcie_wr, dou
   printf("Measurements \n");
   printf("--------------------------------------------\n");
   printf("Iterations             = %d\n", iter);
-  printf("Points                 = %d\n", N);
-  printf("Data Size              = %u Bytes\n", data_sz);
+  printf("Points                 = %zu\n", N);
+  printf("Data Size              = %zu Bytes\n", data_sz);
   printf("PCIe Write Latency     = %.5lfms\n", pcie_write);
   printf("PCIe Read Latency      = %.5lfms\n", pcie_read);
   printf("PCIe Write Bandwidth   = %.5lf GB/s\n", pcie_wr_bandwidth);
@@ -85,13 +129,152 @@ void display_measures(double total_api_time, double pcie_rd, double pcie_wr, dou
   printf("Average API Time       = %.5lfms\n", avg_api_time);
 }
 
+/**
+ * \brief  print the submission and completion times of a pipelined test. 
+ *         Bandwidth is computed from the completion time, the time to submit
+ *         only bounds the host overhead.
+ * \param  submit_t : total time to enqueue the transfers
+ * \param  exec_t   : total wall clock time until the last transfer completed
+ * \param  device_t : total device time from profiling, 0 if not available
+ * \param  points   : number of points transferred each iteration
+ * \param  iter     : number of iterations
+ */
+void display_completion(double submit_t, double exec_t, double device_t, size_t points, unsigned iter){
+  double submit = submit_t / iter;
+  double exec = exec_t / iter;
+  double device = device_t / iter;
+  double data_sz = (double)points * sizeof(float2);
+
+  printf("\n------------------------------------------\n");
+  printf("Completion \n");
+  printf("--------------------------------------------\n");
+  printf("Average Submit Time    = %.5lfms\n", submit);
+  printf("Average Complete Time  = %.5lfms\n", exec);
+  printf("Average Device Time    = %.5lfms\n", device);
+  printf("Duplex Bandwidth       = %.5lf GB/s\n", (exec > 0.0) ? 2.0 * data_sz * 1e-9 / (exec * 1e-3) : 0.0);
+  if(device > 0.0){
+    printf("Device Bandwidth       = %.5lf GB/s\n", 2.0 * data_sz * 1e-9 / (device * 1e-3));
+  }
+}
+
+/**
+ * \brief  print the lifecycle counters of the events used by the pipelines.
+ *         Alive is 0 if every event was released, peak alive is bounded by 
+ *         the event ring of the pipeline irrespective of the batch length.
+ * \param  events: counters since the last reset
+ */
+void display_event_stats(const fpga_event_stats_t *events){
+  printf("\n------------------------------------------\n");
+  printf("Events \n");
+  printf("--------------------------------------------\n");
+  printf("Created                = %lu\n", events->created);
+  printf("Released               = %lu\n", events->released);
+  printf("Alive                  = %lu\n", events->created - events->released);
+  printf("Peak Alive             = %lu\n", events->peak_live);
+}
+
+/**
+ * \brief  print the host counters of each counted phase per iteration, and
+ *         instructions per cycle. Counts include the kernel if permitted by
+ *         perf_event_paranoid.
+ * \param  iter : iterations the counts are averaged over
+ */
+void display_perf(unsigned iter){
+  printf("\n------------------------------------------\n");
+  printf("Host Counters per Iteration \n");
+  printf("--------------------------------------------\n");
+  printf("%10s", "Phase");
+  for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+    printf(" %16s", fpga_perf_counter_name(c));
+  }
+  printf(" %6s\n", "IPC");
+
+  for(unsigned p = 0; p < FPGA_NUM_PHASES; p++){
+    fpga_perf_t perf;
+    fpga_perf_get((fpga_phase_t)p, &perf);
+    if(perf.calls == 0)
+      continue;
+
+    printf("%10s", fpga_phase_name((fpga_phase_t)p));
+    for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+      if(perf.valid[c])
+        printf(" %16.0lf", (double)perf.count[c] / iter);
+      else
+        printf(" %16s", "-");
+    }
+    // cycles and instructions are the first two counters
+    if(perf.valid[0] && perf.valid[1] && perf.count[0] > 0)
+      printf(" %6.2lf\n", (double)perf.count[1] / perf.count[0]);
+    else
+      printf(" %6s\n", "-");
+  }
+}
+
+/**
+ * \brief  print the usage of each bank of the device memory pool. Failed
+ *         requests were served by buffers of their own.
+ * \param  stats : usage of num banks
+ */
+void display_pool_stats(const fpga_pool_stats_t *stats, unsigned num){
+  printf("\n------------------------------------------\n");
+  printf("Device Memory Pool \n");
+  printf("--------------------------------------------\n");
+  printf("%6s %12s %12s %12s %12s %10s %10s %8s\n", "Bank", "Size (MiB)", "Used (MiB)", "Peak (MiB)", "Free (MiB)", "Allocs", "Frees", "Failed");
+  for(unsigned b = 0; b < num; b++){
+    printf("%6u %12.2lf %12.2lf %12.2lf %12.2lf %10zu %10zu %8zu\n", b, stats[b].size / 1048576.0, stats[b].used / 1048576.0, stats[b].peak / 1048576.0, stats[b].largest / 1048576.0, stats[b].allocs, stats[b].frees, stats[b].failed);
+  }
+}
+
+/**
+ * \brief  print the counters of the staging ring, the copy bandwidth bounds
+ *         the transfers of user memory if it is below the PCIe bandwidth
+ */
+void display_staging_stats(const fpga_staging_stats_t *stats){
+  size_t bytes = stats->bytes_in + stats->bytes_out;
+
+  printf("\n------------------------------------------\n");
+  printf("Pinned Staging \n");
+  printf("--------------------------------------------\n");
+  printf("Staged in       : %.2lf MiB\n", stats->bytes_in / 1048576.0);
+  printf("Staged out      : %.2lf MiB\n", stats->bytes_out / 1048576.0);
+  printf("Chunks          : %zu\n", stats->chunks);
+  printf("Copy            : %.4lf ms\n", stats->copy_t);
+  printf("Copy Throughput : %.4lf GB/s\n", (stats->copy_t > 0.0) ? bytes / (stats->copy_t * 1.0e6) : 0.0);
+  printf("Wait            : %.4lf ms\n", stats->wait_t);
+}
+
+/**
+ * \brief  print the counters of each stage of a flow. The stage with the
+ *         largest busy time bounds the throughput of the flow, queues in
+ *         front of it fill up and the stages after it wait for input.
+ * \param  stats : counters of num stages averaged over the iterations
+ * \param  exec_t: wall clock time of a run in milliseconds
+ */
+void display_flow(const fpga_stage_stats_t *stats, unsigned num, double exec_t){
+  unsigned limit = 0;
+
+  printf("\n------------------------------------------\n");
+  printf("Flow \n");
+  printf("--------------------------------------------\n");
+  printf("%12s %8s %12s %10s %12s %12s %10s %6s\n", "Stage", "Chunks", "Busy (ms)", "GB/s", "Wait in", "Wait out", "Queue", "Peak");
+  for(unsigned s = 0; s < num; s++){
+    printf("%12s %8zu %12.3lf %10.5lf %12.3lf %12.3lf %10.2lf %6zu\n", stats[s].name, stats[s].items, stats[s].busy_t, (stats[s].busy_t > 0.0) ? stats[s].bytes * 1.0e-6 / stats[s].busy_t : 0.0, stats[s].wait_in_t, stats[s].wait_out_t, stats[s].occupancy, stats[s].peak);
+    if(stats[s].busy_t > stats[limit].busy_t)
+      limit = s;
+  }
+  if(num > 0 && exec_t > 0.0){
+    printf("%12s %8s %12.3lf %10.5lf\n", "End to end", "", exec_t, stats[0].bytes * 1.0e-6 / exec_t);
+    printf("\nBottleneck: %s, busy %.1lf%% of the end to end time\n", stats[limit].name, 100.0 * stats[limit].busy_t / exec_t);
+  }
+}
+
 /**
  * \brief  verify if output is the same as input
  * \param  inp, out: array of complex single precision floats of size N
  * \param  N: size of the arrays
  * \return false if not the same
  */
-bool verify_output(float2 *inp, float2 *out, unsigned N){
+bool verify_output(float2 *inp, float2 *out, size_t N){
 
   for(size_t i = 0; i < N; i++){
     //printf("%lu - cpu: (%f, %f) fpga: (%f, %f)\n", i, inp[i].x, inp[i].y, out[i].x, out[i].y);
@@ -104,6 +287,68 @@ bool verify_output(float2 *inp, float2 *out, unsigned N){
 
 }
 
+/**
+ * \brief  verify that output is identical to the input of the element type.
+ *         half2 values are compared bitwise, the host does not compute on
+ *         them.
+ * \param  inp, out: arrays of N elements of type
+ * \return false if any element differs or the type is unknown
+ */
+bool verify_typed_output(const void *inp, const void *out, fpga_type_t type, size_t N){
+
+  switch(type){
+    case FPGA_FLOAT:
+      for(size_t i = 0; i < N; i++)
+        if(((const float *)inp)[i] != ((const float *)out)[i])
+          return false;
+      return true;
+    case FPGA_FLOAT2:
+      return verify_output((float2 *)inp, (float2 *)out, N);
+    case FPGA_DOUBLE:
+      for(size_t i = 0; i < N; i++)
+        if(((const double *)inp)[i] != ((const double *)out)[i])
+          return false;
+      return true;
+    case FPGA_DOUBLE2:
+      for(size_t i = 0; i < N; i++){
+        const double2 *a = &((const double2 *)inp)[i], *b = &((const double2 *)out)[i];
+        if((a->x != b->x) || (a->y != b->y))
+          return false;
+      }
+      return true;
+    case FPGA_HALF2:
+      for(size_t i = 0; i < N; i++){
+        const half2 *a = &((const half2 *)inp)[i], *b = &((const half2 *)out)[i];
+        if((a->x != b->x) || (a->y != b->y))
+          return false;
+      }
+      return true;
+    default:
+      return false;
+  }
+}
+
+/**
+ * \brief  verify if output is within a relative tolerance of the input, used
+ *         for transfers that reduce precision
+ * \param  inp, out: array of complex single precision floats of size N
+ * \param  N: size of the arrays
+ * \param  tol: maximum relative error, absolute for values smaller than 1
+ * \return false if any point exceeds the tolerance
+ */
+bool verify_output_tol(float2 *inp, float2 *out, size_t N, float tol){
+
+  for(size_t i = 0; i < N; i++){
+    float scale_x = fabsf(inp[i].x) > 1.0f ? fabsf(inp[i].x) : 1.0f;
+    float scale_y = fabsf(inp[i].y) > 1.0f ? fabsf(inp[i].y) : 1.0f;
+    if( (fabsf(inp[i].x - out[i].x) > tol * scale_x) || (fabsf(inp[i].y - out[i].y) > tol * scale_y)){
+      return false;
+    }
+  }
+
+  return true;
+}
+
 /**
  * \brief  compute walltime in milliseconds
  * \return time in milliseconds
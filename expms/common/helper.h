@@ -6,13 +6,31 @@
 #include <stdbool.h>
 #include "bare.h"
 
-bool create_data(float2 *inp, unsigned N);
+bool create_data(float2 *inp, size_t N);
+
+bool create_typed_data(void *inp, fpga_type_t type, size_t N);
 
 void print_config(unsigned N, unsigned iter, bool interleaving, unsigned batch);
 
-void display_measures(double total_api_time, double pcie_rd, double pcie_wr, double exec, unsigned N, unsigned iter);
+void display_measures(double total_api_time, double pcie_rd, double pcie_wr, double exec, size_t N, unsigned iter);
+
+void display_completion(double submit_t, double exec_t, double device_t, size_t points, unsigned iter);
+
+void display_event_stats(const fpga_event_stats_t *events);
+
+void display_flow(const fpga_stage_stats_t *stats, unsigned num, double exec_t);
+
+void display_perf(unsigned iter);
+
+void display_pool_stats(const fpga_pool_stats_t *stats, unsigned num);
+
+void display_staging_stats(const fpga_staging_stats_t *stats);
+
+bool verify_output(float2 *inp, float2 *out, size_t N);
+
+bool verify_typed_output(const void *inp, const void *out, fpga_type_t type, size_t N);
 
-bool verify_output(float2 *inp, float2 *out, unsigned N);
+bool verify_output_tol(float2 *inp, float2 *out, size_t N, float tol);
 
 double getTimeinMilliseconds();
 #endif // HELPER_H
@@ -0,0 +1,117 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <string.h>
+
+#include "histogram.h"
+
+#define SUB_COUNT (1ULL << HIST_SUB_BITS)
+
+static unsigned bucket_index(uint64_t value){
+  if(value < SUB_COUNT){
+    return (unsigned)value;
+  }
+  unsigned msb = 63 - __builtin_clzll(value);
+  unsigned shift = msb - HIST_SUB_BITS;
+  // top HIST_SUB_BITS + 1 bits of the value select the sub bucket
+  uint64_t sub = (value >> shift) - SUB_COUNT;
+  return (unsigned)(((uint64_t)(shift + 1) << HIST_SUB_BITS) + sub);
+}
+
+static uint64_t bucket_lowest(unsigned index){
+  if(index < SUB_COUNT){
+    return index;
+  }
+  unsigned shift = (index >> HIST_SUB_BITS) - 1;
+  uint64_t sub = (index & (SUB_COUNT - 1)) + SUB_COUNT;
+  return sub << shift;
+}
+
+static uint64_t bucket_width(unsigned index){
+  if(index < SUB_COUNT){
+    return 1;
+  }
+  return 1ULL << ((index >> HIST_SUB_BITS) - 1);
+}
+
+/**
+ * \brief  remove all values from the histogram
+ */
+void hist_reset(histogram_t *hist){
+  memset(hist, 0, sizeof(histogram_t));
+  hist->min = UINT64_MAX;
+}
+
+/**
+ * \brief  record a value
+ */
+void hist_record(histogram_t *hist, uint64_t value){
+  hist->counts[bucket_index(value)]++;
+  hist->total++;
+  hist->sum += (double)value;
+  if(value < hist->min)
+    hist->min = value;
+  if(value > hist->max)
+    hist->max = value;
+}
+
+/**
+ * \brief  value at the given percentile, the middle of the bucket holding it
+ *         clamped to the values recorded
+ * \param  percentile : 0 to 100
+ * \return value or 0 if the histogram is empty
+ */
+uint64_t hist_percentile(const histogram_t *hist, double percentile){
+  if(hist->total == 0){
+    return 0;
+  }
+  if(percentile > 100.0){
+    percentile = 100.0;
+  }
+
+  uint64_t rank = (uint64_t)(percentile / 100.0 * hist->total + 0.5);
+  if(rank < 1)
+    rank = 1;
+
+  uint64_t seen = 0;
+  for(unsigned i = 0; i < HIST_BUCKETS; i++){
+    seen += hist->counts[i];
+    if(seen >= rank){
+      uint64_t value = bucket_lowest(i) + bucket_width(i) / 2;
+      if(value < hist->min)
+        return hist->min;
+      if(value > hist->max)
+        return hist->max;
+      return value;
+    }
+  }
+  return hist->max;
+}
+
+/**
+ * \brief  mean of the recorded values
+ */
+double hist_mean(const histogram_t *hist){
+  return (hist->total > 0) ? hist->sum / hist->total : 0.0;
+}
+
+/**
+ * \brief  print the non empty buckets, bounds inclusive, with their count
+ *         and cumulative percentile
+ * \param  scale : factor converting the recorded values to unit
+ * \param  unit  : unit printed after the values
+ */
+void hist_print(const histogram_t *hist, double scale, const char *unit){
+  uint64_t seen = 0;
+
+  printf("%14s %14s %12s %12s\n", "From", "To", "Count", "Percentile");
+  for(unsigned i = 0; i < HIST_BUCKETS && seen < hist->total; i++){
+    if(hist->counts[i] == 0){
+      continue;
+    }
+    seen += hist->counts[i];
+    printf("%12.3lf%-2s %12.3lf%-2s %12lu %11.4lf%%\n",
+      bucket_lowest(i) * scale, unit, (bucket_lowest(i) + (bucket_width(i) - 1)) * scale, unit,
+      hist->counts[i], 100.0 * seen / hist->total);
+  }
+}
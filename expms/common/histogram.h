@@ -0,0 +1,35 @@
+//  Author: Arjun Ramaswami
+
+#ifndef HISTOGRAM_H
+#define HISTOGRAM_H
+
+#include <stdint.h>
+
+// linear sub buckets per power of two, relative error below 2^-(SUB_BITS+1)
+#define HIST_SUB_BITS 7
+#define HIST_BUCKETS ((64 - HIST_SUB_BITS + 1) << HIST_SUB_BITS)
+
+/**
+ * Log linear histogram of integer values in the manner of HdrHistogram:
+ * values below 2^HIST_SUB_BITS are exact, larger values fall into buckets
+ * whose width is a fixed fraction of the value.
+ */
+typedef struct histogram {
+  uint64_t counts[HIST_BUCKETS];
+  uint64_t total;   /**< number of values recorded */
+  uint64_t min;     /**< smallest value recorded */
+  uint64_t max;     /**< largest value recorded */
+  double sum;       /**< sum of the values recorded */
+} histogram_t;
+
+void hist_reset(histogram_t *hist);
+
+void hist_record(histogram_t *hist, uint64_t value);
+
+uint64_t hist_percentile(const histogram_t *hist, double percentile);
+
+double hist_mean(const histogram_t *hist);
+
+void hist_print(const histogram_t *hist, double scale, const char *unit);
+
+#endif // HISTOGRAM_H
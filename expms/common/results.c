@@ -0,0 +1,392 @@
+//  Author: Arjun Ramaswami
+
+#define _GNU_SOURCE // sched_getcpu
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <dirent.h>
+#include <unistd.h>
+
+#include "bare.h"
+#include "results.h"
+
+#define MAX_CONFIG 32
+
+typedef struct config_entry {
+  char key[64];
+  char value[256];    /**< JSON encoded value */
+} config_entry;
+
+typedef struct series {
+  char name[64];
+  char unit[16];
+  size_t bytes;       /**< bytes moved by each sample, 0 if not a transfer */
+  double *samples;
+  size_t len, cap;
+} series;
+
+struct results {
+  char *path;
+  char driver[64];
+  char timestamp[32];
+  config_entry config[MAX_CONFIG];
+  size_t num_config;
+  fpga_env_t env;
+  bool has_env;
+  series *series;
+  size_t num_series, cap_series;
+  fpga_perf_t perf[FPGA_NUM_PHASES];  /**< counts at the last results_perf */
+};
+
+// function prototypes
+static void json_string(FILE *fp, const char *str);
+static int cmp_double(const void *a, const void *b);
+static double percentile(const double *sorted, size_t len, double p);
+static void host_cpu(char *cpu, size_t len);
+static int numa_node(int cpu);
+static void write_series(FILE *fp, const series *s);
+
+/**
+ * \brief  start a JSON record of the results of a driver
+ * \param  path   : file to write on results_close, NULL disables the record
+ * \param  driver : name of the driver
+ * \return record or NULL if path is NULL or out of memory
+ */
+results_t* results_open(const char *path, const char *driver){
+  if(path == NULL || strlen(path) == 0){
+    return NULL;
+  }
+
+  results_t *res = (results_t *)calloc(1, sizeof(results_t));
+  if(res == NULL){
+    return NULL;
+  }
+  res->path = strdup(path);
+  snprintf(res->driver, sizeof(res->driver), "%s", driver);
+
+  time_t now = time(NULL);
+  strftime(res->timestamp, sizeof(res->timestamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+  return res;
+}
+
+static void config_set(results_t *res, const char *key, const char *value){
+  if(res == NULL || res->num_config == MAX_CONFIG){
+    return;
+  }
+  config_entry *entry = &res->config[res->num_config++];
+  snprintf(entry->key, sizeof(entry->key), "%s", key);
+  snprintf(entry->value, sizeof(entry->value), "%s", value);
+}
+
+/**
+ * \brief  record a configuration parameter of the run
+ */
+void results_config_uint(results_t *res, const char *key, unsigned long value){
+  char str[32];
+  snprintf(str, sizeof(str), "%lu", value);
+  config_set(res, key, str);
+}
+
+void results_config_bool(results_t *res, const char *key, bool value){
+  config_set(res, key, value ? "true" : "false");
+}
+
+void results_config_str(results_t *res, const char *key, const char *value){
+  char str[256];
+  size_t j = 0;
+
+  // escaped when written, quotes mark the value as a string
+  str[j++] = '"';
+  for(size_t i = 0; value[i] != '\0' && j < sizeof(str) - 3; i++){
+    if(value[i] == '"' || value[i] == '\\'){
+      str[j++] = '\\';
+    }
+    str[j++] = ((unsigned char)value[i] < 0x20) ? ' ' : value[i];
+  }
+  str[j++] = '"';
+  str[j] = '\0';
+  config_set(res, key, str);
+}
+
+/**
+ * \brief  record board, BSP and OpenCL versions, call after the FPGA has been
+ *         initialized
+ */
+void results_environment(results_t *res){
+  if(res == NULL){
+    return;
+  }
+  res->has_env = fpga_get_environment(&res->env);
+}
+
+/**
+ * \brief  add the host counters of each phase since the last call as a
+ *         sample of the series <phase>_<counter>, call once per iteration.
+ *         Counters that are not open are left out.
+ * \param  bytes : bytes moved by the iteration
+ */
+void results_perf(results_t *res, size_t bytes){
+  if(res == NULL){
+    return;
+  }
+
+  for(unsigned p = 0; p < FPGA_NUM_PHASES; p++){
+    fpga_perf_t perf;
+    fpga_perf_get((fpga_phase_t)p, &perf);
+    if(perf.calls == res->perf[p].calls){
+      continue;
+    }
+    for(unsigned c = 0; c < FPGA_PERF_COUNTERS; c++){
+      if(!perf.valid[c])
+        continue;
+      char name[64];
+      snprintf(name, sizeof(name), "%s_%s", fpga_phase_name((fpga_phase_t)p), fpga_perf_counter_name(c));
+      results_add(res, name, "count", bytes, (double)(perf.count[c] - res->perf[p].count[c]));
+    }
+    res->perf[p] = perf;
+  }
+}
+
+/**
+ * \brief  add a sample to the series of name and bytes, the series is created
+ *         on its first sample
+ * \param  name   : name of the series
+ * \param  unit   : unit of the samples, ms, us and ns are lower is better,
+ *                  GB/s higher is better
+ * \param  bytes  : bytes moved by a sample, distinguishes series of a sweep
+ * \param  sample : measured value
+ */
+void results_add(results_t *res, const char *name, const char *unit, size_t bytes, double sample){
+  if(res == NULL){
+    return;
+  }
+
+  series *s = NULL;
+  for(size_t i = 0; i < res->num_series; i++){
+    if(res->series[i].bytes == bytes && strcmp(res->series[i].name, name) == 0){
+      s = &res->series[i];
+      break;
+    }
+  }
+
+  if(s == NULL){
+    if(res->num_series == res->cap_series){
+      size_t cap = (res->cap_series == 0) ? 8 : 2 * res->cap_series;
+      series *tmp = (series *)realloc(res->series, cap * sizeof(series));
+      if(tmp == NULL){
+        return;
+      }
+      res->series = tmp;
+      res->cap_series = cap;
+    }
+    s = &res->series[res->num_series++];
+    memset(s, 0, sizeof(series));
+    snprintf(s->name, sizeof(s->name), "%s", name);
+    snprintf(s->unit, sizeof(s->unit), "%s", unit);
+    s->bytes = bytes;
+  }
+
+  if(s->len == s->cap){
+    size_t cap = (s->cap == 0) ? 16 : 2 * s->cap;
+    double *tmp = (double *)realloc(s->samples, cap * sizeof(double));
+    if(tmp == NULL){
+      return;
+    }
+    s->samples = tmp;
+    s->cap = cap;
+  }
+  s->samples[s->len++] = sample;
+}
+
+/**
+ * \brief  write the record to its path and free it
+ * \return true if written or res is NULL
+ */
+bool results_close(results_t *res){
+  if(res == NULL){
+    return true;
+  }
+
+  bool success = false;
+  FILE *fp = fopen(res->path, "w");
+  if(fp == NULL){
+    fprintf(stderr, "Unable to write results to %s\n", res->path);
+  }
+  else{
+    char cpu[128], host[128] = "unknown";
+    int cpu_id = sched_getcpu();
+    host_cpu(cpu, sizeof(cpu));
+    gethostname(host, sizeof(host));
+    host[sizeof(host) - 1] = '\0';
+
+    fprintf(fp, "{\n  \"driver\": ");
+    json_string(fp, res->driver);
+    fprintf(fp, ",\n  \"timestamp\": \"%s\",\n", res->timestamp);
+
+    fprintf(fp, "  \"config\": {");
+    for(size_t i = 0; i < res->num_config; i++){
+      fprintf(fp, "%s\n    ", (i == 0) ? "" : ",");
+      json_string(fp, res->config[i].key);
+      fprintf(fp, ": %s", res->config[i].value);
+    }
+    fprintf(fp, "\n  },\n");
+
+    fprintf(fp, "  \"environment\": {\n    \"board\": ");
+    json_string(fp, res->has_env ? res->env.board : "unknown");
+    fprintf(fp, ",\n    \"bsp\": ");
+    json_string(fp, res->has_env ? res->env.bsp : "unknown");
+    fprintf(fp, ",\n    \"device\": ");
+    json_string(fp, res->has_env ? res->env.device : "unknown");
+    fprintf(fp, ",\n    \"opencl\": ");
+    json_string(fp, res->has_env ? res->env.platform : "unknown");
+    fprintf(fp, ",\n    \"host\": ");
+    json_string(fp, host);
+    fprintf(fp, ",\n    \"host_cpu\": ");
+    json_string(fp, cpu);
+    fprintf(fp, ",\n    \"cpu\": %d,\n    \"numa_node\": %d\n  },\n", cpu_id, numa_node(cpu_id));
+
+    fprintf(fp, "  \"results\": [");
+    for(size_t i = 0; i < res->num_series; i++){
+      fprintf(fp, "%s\n", (i == 0) ? "" : ",");
+      write_series(fp, &res->series[i]);
+    }
+    fprintf(fp, "\n  ]\n}\n");
+
+    success = (fclose(fp) == 0);
+  }
+
+  for(size_t i = 0; i < res->num_series; i++){
+    free(res->series[i].samples);
+  }
+  free(res->series);
+  free(res->path);
+  free(res);
+  return success;
+}
+
+/**
+ * \brief  samples and summary statistics of a series, percentiles are
+ *         interpolated between the sorted samples
+ */
+static void write_series(FILE *fp, const series *s){
+  double *sorted = (double *)malloc((s->len + 1) * sizeof(double));
+  double sum = 0.0, var = 0.0;
+
+  for(size_t i = 0; i < s->len; i++){
+    sum += s->samples[i];
+    sorted[i] = s->samples[i];
+  }
+  qsort(sorted, s->len, sizeof(double), cmp_double);
+
+  double mean = (s->len > 0) ? sum / s->len : 0.0;
+  for(size_t i = 0; i < s->len; i++){
+    var += (s->samples[i] - mean) * (s->samples[i] - mean);
+  }
+  double stddev = (s->len > 1) ? sqrt(var / (s->len - 1)) : 0.0;
+
+  fprintf(fp, "    {\n      \"name\": ");
+  json_string(fp, s->name);
+  fprintf(fp, ",\n      \"unit\": ");
+  json_string(fp, s->unit);
+  fprintf(fp, ",\n      \"bytes\": %zu,\n      \"samples\": [", s->bytes);
+  for(size_t i = 0; i < s->len; i++){
+    fprintf(fp, "%s%.9g", (i == 0) ? "" : ", ", s->samples[i]);
+  }
+  fprintf(fp, "],\n      \"summary\": {\"n\": %zu, \"mean\": %.9g, \"stddev\": %.9g, ", s->len, mean, stddev);
+  fprintf(fp, "\"min\": %.9g, \"p50\": %.9g, \"p90\": %.9g, \"p99\": %.9g, \"max\": %.9g",
+    (s->len > 0) ? sorted[0] : 0.0, percentile(sorted, s->len, 0.50), percentile(sorted, s->len, 0.90),
+    percentile(sorted, s->len, 0.99), (s->len > 0) ? sorted[s->len - 1] : 0.0);
+  if(s->bytes > 0 && strcmp(s->unit, "ms") == 0 && mean > 0.0){
+    fprintf(fp, ", \"gbps\": %.9g", s->bytes * 1e-9 / (mean * 1e-3));
+  }
+  fprintf(fp, "}\n    }");
+
+  free(sorted);
+}
+
+static double percentile(const double *sorted, size_t len, double p){
+  if(len == 0){
+    return 0.0;
+  }
+  double pos = p * (len - 1);
+  size_t lo = (size_t)pos;
+  size_t hi = (lo + 1 < len) ? lo + 1 : lo;
+  return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+static int cmp_double(const void *a, const void *b){
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+static void json_string(FILE *fp, const char *str){
+  fputc('"', fp);
+  for(; *str != '\0'; str++){
+    unsigned char c = (unsigned char)*str;
+    if(c == '"' || c == '\\'){
+      fprintf(fp, "\\%c", c);
+    }
+    else if(c < 0x20){
+      fprintf(fp, "\\u%04x", c);
+    }
+    else{
+      fputc(c, fp);
+    }
+  }
+  fputc('"', fp);
+}
+
+/**
+ * \brief  model name of the host CPU from /proc/cpuinfo
+ */
+static void host_cpu(char *cpu, size_t len){
+  char line[256];
+  snprintf(cpu, len, "unknown");
+
+  FILE *fp = fopen("/proc/cpuinfo", "r");
+  if(fp == NULL){
+    return;
+  }
+  while(fgets(line, sizeof(line), fp) != NULL){
+    char *sep = strchr(line, ':');
+    if(strncmp(line, "model name", 10) == 0 && sep != NULL){
+      sep++;
+      while(*sep == ' ' || *sep == '\t'){
+        sep++;
+      }
+      sep[strcspn(sep, "\n")] = '\0';
+      snprintf(cpu, len, "%s", sep);
+      break;
+    }
+  }
+  fclose(fp);
+}
+
+/**
+ * \brief  NUMA node of a CPU from sysfs
+ * \return node or -1 if unknown
+ */
+static int numa_node(int cpu){
+  char dir_path[64];
+  int node = -1;
+
+  if(cpu < 0){
+    return -1;
+  }
+  snprintf(dir_path, sizeof(dir_path), "/sys/devices/system/cpu/cpu%d", cpu);
+  DIR *dir = opendir(dir_path);
+  if(dir == NULL){
+    return -1;
+  }
+  struct dirent *entry;
+  while((entry = readdir(dir)) != NULL){
+    if(sscanf(entry->d_name, "node%d", &node) == 1){
+      break;
+    }
+  }
+  closedir(dir);
+  return node;
+}
@@ -0,0 +1,32 @@
+//  Author: Arjun Ramaswami
+
+#ifndef RESULTS_H
+#define RESULTS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * JSON record of a driver run: configuration, environment, raw samples of
+ * each measured series and their summary statistics. Every function accepts
+ * NULL, so drivers call them unconditionally whether or not a path is given.
+ */
+typedef struct results results_t;
+
+results_t* results_open(const char *path, const char *driver);
+
+void results_config_uint(results_t *res, const char *key, unsigned long value);
+
+void results_config_bool(results_t *res, const char *key, bool value);
+
+void results_config_str(results_t *res, const char *key, const char *value);
+
+void results_environment(results_t *res);
+
+void results_add(results_t *res, const char *name, const char *unit, size_t bytes, double sample);
+
+void results_perf(results_t *res, size_t bytes);
+
+bool results_close(results_t *res);
+
+#endif // RESULTS_H
@@ -0,0 +1,178 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <math.h>
+#include <fftw3.h>
+
+#include "verify_fftw.h"
+#include "helper.h"
+
+// maximum relative L2 error of a single precision transform
+#define FFTW_TOLERANCE 1e-4
+
+/**
+ * \brief  fill the dimensions of a dim dimensional transform of size N
+ * \return number of points in a transform, 0 if dim is not 1, 2 or 3
+ */
+static size_t fft_dims(unsigned N, unsigned dim, int *n){
+  if(N == 0 || dim < 1 || dim > 3){
+    return 0;
+  }
+  size_t pts = 1;
+  for(unsigned d = 0; d < dim; d++){
+    n[d] = (int)N;
+    pts *= N;
+  }
+  return pts;
+}
+
+/**
+ * \brief  initialize multithreaded fftw once for both precisions
+ */
+static void fftw_threads_init(unsigned threads){
+  static bool init = false;
+  if(!init){
+    fftwf_init_threads();
+    fftw_init_threads();
+    init = true;
+  }
+  fftwf_plan_with_nthreads(threads > 0 ? threads : 1);
+  fftw_plan_with_nthreads(threads > 0 ? threads : 1);
+}
+
+/**
+ * \brief  CPU execution engine, computes a batch of single precision complex
+ *         1D, 2D or 3D FFTs using threaded FFTW
+ * \param  N       : number of points in each dimension
+ * \param  dim     : number of dimensions, 1 to 3
+ * \param  inp     : float2 pointer to input of size N^dim * how_many
+ * \param  out     : float2 pointer to output of size N^dim * how_many
+ * \param  inverse : backward transform if true
+ * \param  how_many: number of transforms in the batch
+ * \param  threads : number of threads used by FFTW
+ * \return fpga_t with exec_t the time for the batch, valid set to 1 if 
+ *         successful. pcie times are 0 as data stays in host memory.
+ */
+fpga_t cpu_fft(unsigned N, unsigned dim, float2 *inp, float2 *out, bool inverse, unsigned how_many, unsigned threads){
+  fpga_t cpu_time = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+  int n[3];
+
+  size_t pts = fft_dims(N, dim, n);
+  if(inp == NULL || out == NULL || pts == 0 || how_many < 1){
+    return cpu_time;
+  }
+
+  fftw_threads_init(threads);
+
+  // planning with FFTW_ESTIMATE does not overwrite input
+  fftwf_plan plan = fftwf_plan_many_dft(dim, n, how_many, 
+      (fftwf_complex *)inp, NULL, 1, pts, 
+      (fftwf_complex *)out, NULL, 1, pts, 
+      inverse ? FFTW_BACKWARD : FFTW_FORWARD, FFTW_ESTIMATE);
+  if(plan == NULL){
+    return cpu_time;
+  }
+
+  cpu_time.exec_t = getTimeinMilliseconds();
+  fftwf_execute(plan);
+  cpu_time.exec_t = getTimeinMilliseconds() - cpu_time.exec_t;
+
+  fftwf_destroy_plan(plan);
+
+  cpu_time.valid = 1;
+  return cpu_time;
+}
+
+/**
+ * \brief  double precision reference of a batch of complex FFTs, computed
+ *         one transform at a time to be independent of the batched engine
+ * \param  inp     : float2 pointer to input of size N^dim * how_many
+ * \param  ref     : double2 pointer to reference output of the same size
+ * \return true if successful
+ */
+bool fftw_reference(float2 *inp, double2 *ref, unsigned N, unsigned dim, bool inverse, unsigned how_many, unsigned threads){
+  int n[3];
+
+  size_t pts = fft_dims(N, dim, n);
+  if(inp == NULL || ref == NULL || pts == 0){
+    return false;
+  }
+
+  fftw_threads_init(threads);
+
+  fftw_complex *buf = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * pts);
+  if(buf == NULL){
+    return false;
+  }
+
+  fftw_plan plan = fftw_plan_dft(dim, n, buf, buf, inverse ? FFTW_BACKWARD : FFTW_FORWARD, FFTW_ESTIMATE);
+  if(plan == NULL){
+    fftw_free(buf);
+    return false;
+  }
+
+  for(size_t b = 0; b < how_many; b++){
+    for(size_t i = 0; i < pts; i++){
+      buf[i][0] = inp[b * pts + i].x;
+      buf[i][1] = inp[b * pts + i].y;
+    }
+
+    fftw_execute(plan);
+
+    for(size_t i = 0; i < pts; i++){
+      ref[b * pts + i].x = buf[i][0];
+      ref[b * pts + i].y = buf[i][1];
+    }
+  }
+
+  fftw_destroy_plan(plan);
+  fftw_free(buf);
+  return true;
+}
+
+/**
+ * \brief  verify a batch of FFTs computed on the device or the CPU engine 
+ *         against the FFTW double precision reference
+ * \param  inp     : float2 input of size N^dim * how_many
+ * \param  out     : float2 result to verify of the same size
+ * \param  max_err : optional, largest relative L2 error of a transform
+ * \return true if the error of every transform is within tolerance
+ */
+bool verify_fftw(float2 *inp, float2 *out, unsigned N, unsigned dim, bool inverse, unsigned how_many, unsigned threads, double *max_err){
+  int n[3];
+  double worst = 0.0;
+
+  size_t pts = fft_dims(N, dim, n);
+  if(inp == NULL || out == NULL || pts == 0){
+    return false;
+  }
+
+  double2 *ref = (double2 *)fpga_complex_malloc(sizeof(double2) * pts * how_many);
+  if(ref == NULL || !fftw_reference(inp, ref, N, dim, inverse, how_many, threads)){
+    free(ref);
+    return false;
+  }
+
+  for(size_t b = 0; b < how_many; b++){
+    double err = 0.0, mag = 0.0;
+    for(size_t i = 0; i < pts; i++){
+      double dx = out[b * pts + i].x - ref[b * pts + i].x;
+      double dy = out[b * pts + i].y - ref[b * pts + i].y;
+      err += dx * dx + dy * dy;
+      mag += ref[b * pts + i].x * ref[b * pts + i].x + ref[b * pts + i].y * ref[b * pts + i].y;
+    }
+    double rel = (mag > 0.0) ? sqrt(err / mag) : sqrt(err);
+    if(rel > worst){
+      worst = rel;
+    }
+  }
+
+  free(ref);
+
+  if(max_err != NULL){
+    *max_err = worst;
+  }
+  return (worst <= FFTW_TOLERANCE);
+}
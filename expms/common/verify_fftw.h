@@ -0,0 +1,15 @@
+//  Author: Arjun Ramaswami
+
+#ifndef VERIFY_FFTW_H
+#define VERIFY_FFTW_H
+
+#include <stdbool.h>
+#include "bare.h"
+
+fpga_t cpu_fft(unsigned N, unsigned dim, float2 *inp, float2 *out, bool inverse, unsigned how_many, unsigned threads);
+
+bool fftw_reference(float2 *inp, double2 *ref, unsigned N, unsigned dim, bool inverse, unsigned how_many, unsigned threads);
+
+bool verify_fftw(float2 *inp, float2 *out, unsigned N, unsigned dim, bool inverse, unsigned how_many, unsigned threads, double *max_err);
+
+#endif // VERIFY_FFTW_H
@@ -0,0 +1,160 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+#include "verify_fftw.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 64, min_N = 16, dim = 1, iter = 1, batch = 2, threads = 1;
+  bool use_svm = false, inverse = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Largest FFT size in each dimension"),
+    OPT_INTEGER('m',"min", &min_N, "Smallest FFT size in each dimension"),
+    OPT_INTEGER('d',"dim", &dim, "Number of dimensions, 1 to 3"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_INTEGER('t',"threads", &threads, "Number of FFTW threads"),
+    OPT_BOOLEAN('b',"backward", &inverse, "Backward FFT"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Compare FPGA including PCIe transfers against FFTW on the CPU", "Sweeps power of two sizes from min to n");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(dim < 1 || dim > 3 || min_N == 0 || (min_N & (min_N - 1)) != 0 || iter < 1 || batch < 1){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  results_t *res = results_open(json_path, "cpu_vs_fpga");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "min_N", min_N);
+  results_config_uint(res, "dim", dim);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_uint(res, "threads", threads);
+  results_config_bool(res, "backward", inverse);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  printf("\n%6s %12s %14s %14s %12s %8s\n", "Size", "Points", "FPGA (ms)", "CPU (ms)", "CPU Error", "Choice");
+
+  for(unsigned sz = min_N; sz <= N; sz *= 2){
+    size_t pts = 1;
+    for(unsigned d = 0; d < dim; d++)
+      pts *= sz;
+    size_t total = pts * batch;
+
+    float2 *inp = (float2*)fpgaf_complex_malloc(sizeof(float2) * total);
+    float2 *out = (float2*)fpgaf_complex_malloc(sizeof(float2) * total);
+    float2 *cpu_out = (float2*)fpgaf_complex_malloc(sizeof(float2) * total);
+    if(inp == NULL || out == NULL || cpu_out == NULL || !create_data(inp, total)){
+      fprintf(stderr, "Error in Data Creation \n");
+      free(inp);
+      free(out);
+      free(cpu_out);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    double fpga_t_avg = 0.0, cpu_t_avg = 0.0, max_err = 0.0;
+
+    for(size_t i = 0; i < iter; i++){
+      // end to end on the FPGA with the active transfer configuration
+      double temp_timer = getTimeinMilliseconds();
+      fpga_t timing = fpga_pipeline_test(pts, inp, out, batch, NULL);
+      double fpga_t_iter = getTimeinMilliseconds() - temp_timer;
+      fpga_t_avg += fpga_t_iter;
+
+      if(timing.valid == 0 || !verify_output(inp, out, total)){
+        fprintf(stderr, "FPGA: Verification Failed \n");
+        free(inp);
+        free(out);
+        free(cpu_out);
+        fpga_final();
+        return EXIT_FAILURE;
+      }
+
+      fpga_t cpu_timing = cpu_fft(sz, dim, inp, cpu_out, inverse, batch, threads);
+      if(cpu_timing.valid == 0){
+        fprintf(stderr, "CPU: Invalid execution\n");
+        free(inp);
+        free(out);
+        free(cpu_out);
+        fpga_final();
+        return EXIT_FAILURE;
+      }
+      cpu_t_avg += cpu_timing.exec_t;
+
+      results_add(res, "fpga", "ms", sizeof(float2) * total, fpga_t_iter);
+      results_add(res, "cpu", "ms", sizeof(float2) * total, cpu_timing.exec_t);
+    }
+
+    // batched threaded engine against the per transform double reference
+    if(!verify_fftw(inp, cpu_out, sz, dim, inverse, batch, threads, &max_err)){
+      fprintf(stderr, "CPU: Verification Failed, error %e\n", max_err);
+      free(inp);
+      free(out);
+      free(cpu_out);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    fpga_t_avg /= iter;
+    cpu_t_avg /= iter;
+
+    printf("%6u %12lu %14.5lf %14.5lf %12.3e %8s\n", sz, total, fpga_t_avg, cpu_t_avg, max_err, (fpga_t_avg < cpu_t_avg) ? "FPGA" : "CPU");
+
+    free(inp);
+    free(out);
+    free(cpu_out);
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+#define MAX_INTERVALS 4096
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+// write percentages of the sweep, write only and read only first as baseline
+static const unsigned sweep_pct[] = {100, 0, 90, 70, 50, 30, 10};
+#define NUM_SWEEP (sizeof(sweep_pct) / sizeof(sweep_pct[0]))
+
+int main(int argc, const char **argv) {
+  int chunk = 4194304, total_mb = 1024, write_pct = -1, iter = 1;
+  float interval = 10.0f;
+  bool use_svm = false, verbose = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('s',"chunk", &chunk, "Bytes per transfer"),
+    OPT_INTEGER('n',"total", &total_mb, "MiB transferred in both directions together"),
+    OPT_INTEGER('w',"write", &write_pct, "Percentage of bytes written, sweeps if not given"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_FLOAT('T',"interval", &interval, "Interval of the bandwidth over time in ms"),
+    OPT_BOOLEAN('v',"verbose", &verbose, "Print the bandwidth of each interval"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Full duplex PCIe bandwidth with a mix of writes and reads on separate queues and banks", "Sweeps write percentages if -w is not given");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(chunk < 1 || total_mb < 1 || write_pct > 100 || iter < 1 || interval <= 0.0){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  results_t *res = results_open(json_path, "duplex_pcietest");
+  results_config_uint(res, "chunk", chunk);
+  results_config_uint(res, "total_mb", total_mb);
+  results_config_uint(res, "iter", iter);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  unsigned num_pct = (write_pct < 0) ? NUM_SWEEP : 1;
+  size_t total = (size_t)total_mb * 1024 * 1024;
+
+  double wr_series[MAX_INTERVALS], rd_series[MAX_INTERVALS];
+  fpga_duplex_t duplex = {(double)interval, MAX_INTERVALS, wr_series, rd_series, 0, 0.0, 0.0};
+
+  // bandwidth of each direction on its own, from the first two of the sweep
+  double wr_alone = 0.0, rd_alone = 0.0;
+
+  printf("\n%8s %14s %14s %14s %12s %12s\n", "Write %", "Write GB/s", "Read GB/s", "Total GB/s", "Write Loss", "Read Loss");
+
+  for(unsigned w = 0; w < num_pct; w++){
+    unsigned pct = (write_pct < 0) ? sweep_pct[w] : (unsigned)write_pct;
+    double wr_gbps = 0.0, rd_gbps = 0.0;
+    char name[64];
+
+    for(int i = 0; i < iter; i++){
+      fpga_t timing = fpga_duplex_test(chunk, total, pct, &duplex);
+      if(timing.valid == 0){
+        fprintf(stderr, "Write %u%%: Verification Failed \n", pct);
+        fpga_final();
+        return EXIT_FAILURE;
+      }
+
+      wr_gbps += duplex.wr_total_gbps;
+      rd_gbps += duplex.rd_total_gbps;
+
+      snprintf(name, sizeof(name), "w%u_write", pct);
+      results_add(res, name, "GB/s", chunk, duplex.wr_total_gbps);
+      snprintf(name, sizeof(name), "w%u_read", pct);
+      results_add(res, name, "GB/s", chunk, duplex.rd_total_gbps);
+    }
+
+    wr_gbps /= iter;
+    rd_gbps /= iter;
+
+    if(pct == 100)
+      wr_alone = wr_gbps;
+    if(pct == 0)
+      rd_alone = rd_gbps;
+
+    // loss against the direction running alone, once measured
+    double wr_loss = (wr_alone > 0.0 && pct > 0 && pct < 100) ? 100.0 * (1.0 - wr_gbps / wr_alone) : 0.0;
+    double rd_loss = (rd_alone > 0.0 && pct > 0 && pct < 100) ? 100.0 * (1.0 - rd_gbps / rd_alone) : 0.0;
+
+    printf("%8u %14.5lf %14.5lf %14.5lf %11.2lf%% %11.2lf%%\n", pct, wr_gbps, rd_gbps, wr_gbps + rd_gbps, wr_loss, rd_loss);
+
+    // bandwidth over time of the last iteration
+    if(verbose){
+      printf("%12s %14s %14s\n", "Time (ms)", "Write GB/s", "Read GB/s");
+      for(unsigned b = 0; b < duplex.intervals; b++){
+        printf("%12.3lf %14.5lf %14.5lf\n", b * interval, wr_series[b], rd_series[b]);
+      }
+      printf("\n");
+    }
+    for(unsigned b = 0; b < duplex.intervals; b++){
+      snprintf(name, sizeof(name), "w%u_write_interval", pct);
+      results_add(res, name, "GB/s", chunk, wr_series[b]);
+      snprintf(name, sizeof(name), "w%u_read_interval", pct);
+      results_add(res, name, "GB/s", chunk, rd_series[b]);
+    }
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
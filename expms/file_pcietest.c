@@ -0,0 +1,219 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <unistd.h> // access
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+// points written per step when generating the input file
+#define GEN_POINTS (1 << 20)
+
+// names of fpga_file_io_t
+static const char *const io_names[] = {"mmap", "blocking", "uring", "threads"};
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+/**
+ * \brief  create the input file of size_mb MiB of random float2 points
+ * \return true if successful
+ */
+static bool generate_input(const char *path, unsigned size_mb){
+  size_t total = (size_t)size_mb * 1024 * 1024 / sizeof(float2);
+  float2 *buf = (float2 *)malloc(sizeof(float2) * GEN_POINTS);
+  FILE *fp = fopen(path, "wb");
+  bool success = (buf != NULL && fp != NULL);
+
+  for(size_t done = 0; success && done < total; done += GEN_POINTS){
+    size_t num = (total - done < GEN_POINTS) ? total - done : GEN_POINTS;
+    create_data(buf, num);
+    success = (fwrite(buf, sizeof(float2), num, fp) == num);
+  }
+
+  if(fp != NULL && fclose(fp) != 0){
+    success = false;
+  }
+  free(buf);
+  return success;
+}
+
+/**
+ * \brief  compare the output file with the input, the stream does not modify
+ *         the data
+ * \return true if both files are equal
+ */
+static bool verify_files(const char *inp_path, const char *out_path){
+  const size_t len = 1 << 20;
+  char *a = (char *)malloc(len), *b = (char *)malloc(len);
+  FILE *fa = fopen(inp_path, "rb"), *fb = fopen(out_path, "rb");
+  bool success = (a != NULL && b != NULL && fa != NULL && fb != NULL);
+
+  while(success){
+    size_t na = fread(a, 1, len, fa);
+    size_t nb = fread(b, 1, len, fb);
+    if(na != nb || memcmp(a, b, na) != 0){
+      success = false;
+    }
+    if(na < len){
+      break;
+    }
+  }
+
+  if(fa != NULL)
+    fclose(fa);
+  if(fb != NULL)
+    fclose(fb);
+  free(a);
+  free(b);
+  return success;
+}
+
+int main(int argc, const char **argv) {
+  int chunk = 4194304, depth = 0, size_mb = 1024, iter = 1;
+  bool use_svm = false, direct = false, keep = false;
+  char *inp_path = "stream_in.bin", *out_path = "stream_out.bin";
+  char *io_name = "mmap";
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_STRING('f', "input", &inp_path, "Input file of float2 points, generated if missing"),
+    OPT_STRING('o', "output", &out_path, "Output file"),
+    OPT_INTEGER('n',"size", &size_mb, "MiB of the generated input file"),
+    OPT_INTEGER('s',"chunk", &chunk, "Bytes per transfer, multiple of 4096"),
+    OPT_INTEGER('d',"depth", &depth, "Chunks in flight, active configuration if not given"),
+    OPT_STRING('I', "io", &io_name, "File access: mmap, blocking, uring or threads"),
+    OPT_BOOLEAN('D',"direct", &direct, "O_DIRECT through staging buffers, blocking if io is mmap"),
+    OPT_BOOLEAN('k',"keep", &keep, "Keep the output file"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Disk to FPGA to disk streaming throughput and the stage limiting it", "Without -D repeated iterations read the input from the page cache");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  unsigned io = 0;
+  while(io < 4 && strcmp(io_name, io_names[io]) != 0){
+    io++;
+  }
+  if(chunk < 4096 || chunk % 4096 != 0 || depth < 0 || size_mb < 1 || iter < 1 || io == 4){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+  if(direct && io == FPGA_FILE_MMAP){
+    io = FPGA_FILE_BLOCKING;
+  }
+
+  if(access(inp_path, R_OK) != 0){
+    printf("Generating %d MiB input file %s\n", size_mb, inp_path);
+    if(!generate_input(inp_path, size_mb)){
+      fprintf(stderr, "Error in generating %s\n", inp_path);
+      return EXIT_FAILURE;
+    }
+  }
+
+  results_t *res = results_open(json_path, "file_pcietest");
+  results_config_uint(res, "chunk", chunk);
+  results_config_str(res, "io", io_names[io]);
+  results_config_bool(res, "direct", direct);
+  results_config_uint(res, "iter", iter);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  fpga_config_t config;
+  fpga_get_config(&config);
+  if(depth > 0){
+    config.depth = depth;
+    fpga_set_config(&config);
+  }
+  results_config_uint(res, "depth", config.depth);
+
+  fpga_file_t file = {chunk, (fpga_file_io_t)io, direct, 0, 0.0, 0.0};
+  double stage_t[5] = {0.0, 0.0, 0.0, 0.0, 0.0};
+  const char *stage_name[4] = {"Disk read", "Host to device", "Device to host", "Disk write"};
+
+  for(int i = 0; i < iter; i++){
+    file.io = (fpga_file_io_t)io;
+    fpga_t timing = fpga_file_test(inp_path, out_path, &file);
+    if(timing.valid == 0 || !verify_files(inp_path, out_path)){
+      fprintf(stderr, "Iter %d: Verification Failed \n", i);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    stage_t[0] += file.read_t;
+    stage_t[1] += timing.pcie_write_t;
+    stage_t[2] += timing.pcie_read_t;
+    stage_t[3] += file.write_t;
+    stage_t[4] += timing.exec_t;
+
+    results_add(res, "disk_read", "ms", file.bytes, file.read_t);
+    results_add(res, "h2d", "ms", file.bytes, timing.pcie_write_t);
+    results_add(res, "d2h", "ms", file.bytes, timing.pcie_read_t);
+    results_add(res, "disk_write", "ms", file.bytes, file.write_t);
+    results_add(res, "end_to_end", "ms", file.bytes, timing.exec_t);
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  if(!keep){
+    remove(out_path);
+  }
+
+  // a stage alone can not be faster than its busy time, the largest bounds
+  // the stream
+  unsigned limit = 0;
+  if(file.io != io){
+    printf("\n%s not available, used %s\n", io_names[io], io_names[file.io]);
+  }
+  printf("\n%16s %14s %14s\n", "Stage", "Busy (ms)", "GB/s");
+  for(unsigned s = 0; s < 4; s++){
+    stage_t[s] /= iter;
+    printf("%16s %14.3lf %14.5lf\n", stage_name[s], stage_t[s], (stage_t[s] > 0.0) ? file.bytes * 1.0e-6 / stage_t[s] : 0.0);
+    if(stage_t[s] > stage_t[limit])
+      limit = s;
+  }
+  stage_t[4] /= iter;
+  printf("%16s %14.3lf %14.5lf\n", "End to end", stage_t[4], file.bytes * 1.0e-6 / stage_t[4]);
+  printf("\nLimiting stage: %s, %.1lf%% of the end to end time\n", stage_name[limit], 100.0 * stage_t[limit] / stage_t[4]);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
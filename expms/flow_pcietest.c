@@ -0,0 +1,132 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  int chunk = 4194304, depth = 2, size_mb = 1024, iter = 1;
+  char *spec = "generate,h2d,d2h,verify";
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_STRING('P', "flow", &spec, "Comma separated stages: generate, file_read:path, h2d, kernel:name, d2h, verify, file_write:path"),
+    OPT_INTEGER('n',"size", &size_mb, "MiB generated by the generate stage"),
+    OPT_INTEGER('s',"chunk", &chunk, "Bytes per chunk"),
+    OPT_INTEGER('d',"depth", &depth, "Chunks each queue between two stages holds"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Throughput of each stage of a host to FPGA dataflow and the stage limiting it", "A kernel stage requires a kernel(src, dst, N) in the bitstream, for example svm_copy");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(chunk < (int)sizeof(float2) || chunk % sizeof(float2) != 0 || depth < 1 || size_mb < 1 || iter < 1){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  fpga_flow_t *flow = fpga_flow_create((size_t)size_mb * 1024 * 1024, chunk, depth);
+  if(flow == NULL || !fpga_flow_parse(flow, spec)){
+    fprintf(stderr, "Invalid flow %s\n", spec);
+    fpga_flow_destroy(flow);
+    return EXIT_FAILURE;
+  }
+
+  results_t *res = results_open(json_path, "flow_pcietest");
+  results_config_str(res, "flow", spec);
+  results_config_uint(res, "chunk", chunk);
+  results_config_uint(res, "depth", depth);
+  results_config_uint(res, "iter", iter);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, false);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    fpga_flow_destroy(flow);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  fpga_stage_stats_t stats[FPGA_FLOW_MAX_STAGES], sum[FPGA_FLOW_MAX_STAGES];
+  unsigned num = 0;
+  double exec_t = 0.0;
+  memset(sum, 0, sizeof(sum));
+
+  for(int i = 0; i < iter; i++){
+    fpga_t timing = fpga_flow_run(flow);
+    if(timing.valid == 0){
+      fprintf(stderr, "Iter %d: Verification Failed \n", i);
+      fpga_final();
+      fpga_flow_destroy(flow);
+      return EXIT_FAILURE;
+    }
+
+    num = fpga_flow_stats(flow, stats);
+    for(unsigned s = 0; s < num; s++){
+      sum[s].name = stats[s].name;
+      sum[s].items += stats[s].items;
+      sum[s].bytes += stats[s].bytes;
+      sum[s].busy_t += stats[s].busy_t;
+      sum[s].wait_in_t += stats[s].wait_in_t;
+      sum[s].wait_out_t += stats[s].wait_out_t;
+      sum[s].occupancy += stats[s].occupancy;
+      if(stats[s].peak > sum[s].peak)
+        sum[s].peak = stats[s].peak;
+
+      results_add(res, stats[s].name, "ms", stats[s].bytes, stats[s].busy_t);
+    }
+    results_add(res, "end_to_end", "ms", stats[0].bytes, timing.exec_t);
+    exec_t += timing.exec_t;
+  }
+
+  // destroy fpga state
+  fpga_final();
+  fpga_flow_destroy(flow);
+
+  for(unsigned s = 0; s < num; s++){
+    sum[s].items /= iter;
+    sum[s].bytes /= iter;
+    sum[s].busy_t /= iter;
+    sum[s].wait_in_t /= iter;
+    sum[s].wait_out_t /= iter;
+    sum[s].occupancy /= iter;
+  }
+  display_flow(sum, num, exec_t / iter);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
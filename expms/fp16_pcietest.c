@@ -0,0 +1,151 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 1, iter = 1, batch = 2;
+  bool use_svm = false;
+  bool interleaving = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+
+  double avg_fp32 = 0.0, avg_fp16 = 0.0, avg_conv = 0.0;
+  bool status = true, use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Data Size"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_STRING('p', "path", &path, "Path to fp16 bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Experimenting on FPGA", "Data size and path are mandatory, default number of iterations is 1");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(N, iter, interleaving, batch);
+
+  results_t *res = results_open(json_path, "fp16_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  size_t inp_sz = sizeof(float2) * N * batch;
+  float2 *inp = (float2*)fpgaf_complex_malloc(inp_sz);
+  float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
+
+  for(size_t i = 0; i < iter; i++){
+    fpga_t fp32_timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+    fpga_t fp16_timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+
+    status = create_data(inp, (size_t)N * batch);
+    if(!status){
+      fprintf(stderr, "Error in Data Creation \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    // float2 transfers with the active configuration as baseline
+    fp32_timing = fpga_pipeline_test(N, inp, out, batch, NULL);
+    if(fp32_timing.valid == 0 || !verify_output(inp, out, (size_t)N * batch)){
+      fprintf(stderr, "float2 transfers: Verification Failed \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    // half precision has 11 significant bits
+    fp16_timing = fpga_fp16_test(N, inp, out, batch);
+    if(fp16_timing.valid == 0 || !verify_output_tol(inp, out, (size_t)N * batch, 1.0f / 2048.0f)){
+      fprintf(stderr, "half2 transfers: Verification Failed \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    avg_fp32 += fp32_timing.exec_t;
+    avg_fp16 += fp16_timing.exec_t;
+    avg_conv += fp16_timing.conv_t;
+
+    // float2 bytes for both, half2 throughput is effective
+    results_add(res, "float2_exec", "ms", sizeof(float2) * N * batch, fp32_timing.exec_t);
+    results_add(res, "half2_exec", "ms", sizeof(float2) * N * batch, fp16_timing.exec_t);
+    results_add(res, "half2_conv", "ms", sizeof(float2) * N * batch, fp16_timing.conv_t);
+
+    printf("Iter: %lu\n", i);
+    printf("\tfloat2 transfers: %lfms\n", fp32_timing.exec_t);
+    printf("\thalf2 transfers : %lfms\n", fp16_timing.exec_t);
+    printf("\thalf2 conversion: %lfms\n\n", fp16_timing.conv_t);
+  }  // iter
+
+  free(inp);
+  free(out);
+
+  // destroy fpga state
+  fpga_final();
+
+  // effective throughput is computed on float2 bytes for both
+  double data_sz = sizeof(float2) * (double)N * batch;
+  avg_fp32 /= iter;
+  avg_fp16 /= iter;
+  avg_conv /= iter;
+
+  printf("\n------------------------------------------\n");
+  printf("Measurements \n");
+  printf("--------------------------------------------\n");
+  printf("Iterations                   = %d\n", iter);
+  printf("Points                       = %zu\n", (size_t)N * batch);
+  printf("float2 Data Size             = %.0lf Bytes\n", data_sz);
+  printf("float2 Transfer Time         = %.5lfms\n", avg_fp32);
+  printf("float2 Throughput            = %.5lf GB/s\n", data_sz * 1e-9 / (avg_fp32 * 1e-3));
+  printf("half2 Transfer Time          = %.5lfms\n", avg_fp16);
+  printf("half2 Effective Throughput   = %.5lf GB/s\n", data_sz * 1e-9 / (avg_fp16 * 1e-3));
+  printf("half2 Conversion Time        = %.5lfms\n", avg_conv);
+  printf("half2 Conversion Throughput  = %.5lf GB/s\n", data_sz * 1e-9 / (avg_conv * 1e-3));
+  printf("half2 End to End Throughput  = %.5lf GB/s\n", data_sz * 1e-9 / ((avg_fp16 + avg_conv) * 1e-3));
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,280 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "histogram.h"
+#include "results.h"
+
+#define MAX_SIZES 128
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+/**
+ * \brief  sizes of the sweep, every power of two between min and max with
+ *         the size one byte below and the size half way to the next power
+ * \return number of sizes
+ */
+static unsigned sweep_sizes(size_t min_sz, size_t max_sz, size_t *sizes){
+  unsigned num = 0;
+
+  for(size_t p = 1; p <= max_sz && num + 3 <= MAX_SIZES; p *= 2){
+    size_t candidates[3] = {p - 1, p, p + p / 2};
+    for(unsigned c = 0; c < 3; c++){
+      size_t sz = candidates[c];
+      if(sz < min_sz || sz > max_sz || (num > 0 && sz <= sizes[num - 1])){
+        continue;
+      }
+      sizes[num++] = sz;
+    }
+  }
+  return num;
+}
+
+/**
+ * \brief  write count requests of bytes through the coalescer then read them
+ *         back, after an untimed batch
+ * \param  batches : timed batches
+ * \param  samples : time of each batch in microseconds
+ * \return false if the output does not match
+ */
+static bool packed_batches(fpga_coalesce_t *co, size_t bytes, unsigned count, unsigned batches, unsigned char *inp, unsigned char *out, double *samples){
+  for(unsigned b = 0; b <= batches; b++){
+    for(size_t i = 0; i < bytes * count; i++){
+      inp[i] = (unsigned char)(i + b);
+    }
+    memset(out, 0, bytes * count);
+
+    fpga_coalesce_reset(co);
+    double start = getTimeinMilliseconds();
+    for(unsigned r = 0; r < count; r++){
+      size_t offset;
+      if(!fpga_coalesce_write(co, inp + r * bytes, bytes, &offset)){
+        return false;
+      }
+    }
+    for(unsigned r = 0; r < count; r++){
+      if(!fpga_coalesce_read(co, r * bytes, bytes, out + r * bytes)){
+        return false;
+      }
+    }
+    fpga_coalesce_flush(co);
+    double end = getTimeinMilliseconds();
+
+    if(memcmp(inp, out, bytes * count) != 0){
+      return false;
+    }
+    if(b > 0){
+      samples[b - 1] = (end - start) * 1.0e3;
+    }
+  }
+  return true;
+}
+
+int main(int argc, const char **argv) {
+  int min_sz = 1, max_sz = 65536, rounds = 10000, warmup = 100;
+  int requests = 0, flush_kb = 256, flush_us = 0;
+  bool use_svm = false, print_hist = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('m',"min", &min_sz, "Smallest transfer in bytes"),
+    OPT_INTEGER('n',"max", &max_sz, "Largest transfer in bytes"),
+    OPT_INTEGER('r',"rounds", &rounds, "Round trips per size"),
+    OPT_INTEGER('w',"warmup", &warmup, "Untimed round trips per size"),
+    OPT_BOOLEAN('H',"histogram", &print_hist, "Print the histogram of each size"),
+    OPT_INTEGER('k',"requests", &requests, "Compare with batches of as many requests packed by a coalescer, 0 for none"),
+    OPT_INTEGER('F',"flush", &flush_kb, "Staging buffer of the coalescer in KiB"),
+    OPT_INTEGER('U',"flush-us", &flush_us, "Age of a pending request that flushes the coalescer, 0 for none"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Latency of small write then read round trips", "Sweeps powers of two, one byte below and half way to the next power from min to max bytes");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(min_sz < 1 || max_sz < min_sz || rounds < 1 || warmup < 0 || requests < 0 || flush_kb < 1 || flush_us < 0){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  results_t *res = results_open(json_path, "latency_pcietest");
+  results_config_uint(res, "min_bytes", min_sz);
+  results_config_uint(res, "max_bytes", max_sz);
+  results_config_uint(res, "rounds", rounds);
+  results_config_uint(res, "warmup", warmup);
+  results_config_uint(res, "requests", requests);
+  results_config_uint(res, "flush_kb", flush_kb);
+  results_config_uint(res, "flush_us", flush_us);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  size_t sizes[MAX_SIZES];
+  unsigned num_sizes = sweep_sizes(min_sz, max_sz, sizes);
+  double p50[MAX_SIZES], packed[MAX_SIZES];
+
+  double *samples = (double *)malloc(sizeof(double) * rounds);
+  histogram_t *hist = (histogram_t *)malloc(sizeof(histogram_t));
+  if(samples == NULL || hist == NULL){
+    fprintf(stderr, "Error in allocating samples\n");
+    free(samples);
+    free(hist);
+    fpga_final();
+    return EXIT_FAILURE;
+  }
+
+  // the same number of round trips as the individual transfers, packed into
+  // batches of requests
+  fpga_coalesce_t *co = NULL;
+  unsigned char *packed_inp = NULL, *packed_out = NULL;
+  unsigned batches = (rounds > requests) ? rounds / requests : 1;
+  fpga_coalesce_stats_t co_stats = {0, 0, 0, 0, 0, 0.0};
+  if(requests > 0){
+    size_t capacity = (size_t)requests * max_sz;
+    size_t flush_bytes = (size_t)flush_kb * 1024;
+    co = fpga_coalesce_open(capacity, (flush_bytes < capacity) ? flush_bytes : capacity, flush_us);
+    packed_inp = (unsigned char *)fpga_complex_malloc(capacity);
+    packed_out = (unsigned char *)fpga_complex_malloc(capacity);
+    if(co == NULL || packed_inp == NULL || packed_out == NULL){
+      fprintf(stderr, "Error in opening the coalescer of %d requests\n", requests);
+      fpga_coalesce_close(co);
+      free(packed_inp);
+      free(packed_out);
+      free(samples);
+      free(hist);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+  }
+
+  printf("\n%10s %12s %12s %12s %12s %12s %12s\n", "Bytes", "Mean (us)", "p50 (us)", "p99 (us)", "p99.9 (us)", "Max (us)", "p50 MB/s");
+
+  for(unsigned s = 0; s < num_sizes; s++){
+    fpga_t timing = fpga_latency_test(sizes[s], rounds, warmup, samples);
+    if(timing.valid == 0){
+      fprintf(stderr, "%lu bytes: Verification Failed \n", sizes[s]);
+      fpga_coalesce_close(co);
+      free(packed_inp);
+      free(packed_out);
+      free(samples);
+      free(hist);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    // recorded in nanoseconds
+    hist_reset(hist);
+    for(int r = 0; r < rounds; r++){
+      hist_record(hist, (uint64_t)(samples[r] * 1.0e3 + 0.5));
+      results_add(res, "round_trip", "us", 2 * sizes[s], samples[r]);
+    }
+
+    p50[s] = hist_percentile(hist, 50.0) * 1.0e-3;
+    printf("%10lu %12.3lf %12.3lf %12.3lf %12.3lf %12.3lf %12.3lf\n", sizes[s],
+      hist_mean(hist) * 1.0e-3, p50[s], hist_percentile(hist, 99.0) * 1.0e-3,
+      hist_percentile(hist, 99.9) * 1.0e-3, hist->max * 1.0e-3,
+      2.0 * sizes[s] / p50[s]);
+
+    if(print_hist){
+      hist_print(hist, 1.0e-3, "us");
+      printf("\n");
+    }
+
+    packed[s] = 0.0;
+    if(co == NULL){
+      continue;
+    }
+    if(!packed_batches(co, sizes[s], requests, batches, packed_inp, packed_out, samples)){
+      fprintf(stderr, "%lu bytes: Verification of packed requests Failed \n", sizes[s]);
+      fpga_coalesce_close(co);
+      free(packed_inp);
+      free(packed_out);
+      free(samples);
+      free(hist);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+    double mean = 0.0;
+    for(unsigned b = 0; b < batches; b++){
+      mean += samples[b];
+      results_add(res, "packed_batch", "us", 2 * sizes[s] * requests, samples[b]);
+    }
+    mean /= batches;
+    packed[s] = 2.0 * sizes[s] * requests / mean;
+  }
+
+  fpga_coalesce_stats(co, &co_stats);
+  fpga_coalesce_close(co);
+  free(packed_inp);
+  free(packed_out);
+  free(samples);
+  free(hist);
+
+  // destroy fpga state
+  fpga_final();
+
+  // a size is worth avoiding if a larger transfer has a lower median
+  printf("\nSizes slower than a larger size:");
+  unsigned num_slow = 0;
+  for(unsigned s = 0; s < num_sizes; s++){
+    for(unsigned l = s + 1; l < num_sizes; l++){
+      if(p50[l] < 0.95 * p50[s]){
+        printf(" %lu", sizes[s]);
+        num_slow++;
+        break;
+      }
+    }
+  }
+  printf("%s\n", (num_slow == 0) ? " none" : "");
+
+  if(requests > 0){
+    printf("\n------------------------------------------\n");
+    printf("Packed Requests, %d per batch, %d KiB staging \n", requests, flush_kb);
+    printf("--------------------------------------------\n");
+    printf("%10s %16s %14s %10s\n", "Bytes", "Individual MB/s", "Packed MB/s", "Speedup");
+    for(unsigned s = 0; s < num_sizes; s++){
+      double individual = 2.0 * sizes[s] / p50[s];
+      printf("%10lu %16.3lf %14.3lf %9.1lfx\n", sizes[s], individual, packed[s], packed[s] / individual);
+    }
+    printf("%zu requests in %zu DMA transfers over %zu flushes, %.3lf ms flushing\n", co_stats.writes + co_stats.reads, co_stats.transfers, co_stats.flushes, co_stats.flush_t);
+  }
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,200 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <stdbool.h>
+#include <math.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+// largest number of sizes swept
+#define MAX_SIZES 32
+
+static void display_link(const char *name, const fpga_link_t *link){
+  printf("%14s %12.3lf %12.5lf %8.4lf\n", name, link->latency, link->bandwidth, link->r2);
+}
+
+int main(int argc, const char **argv) {
+  unsigned min_N = 1024, max_N = 1 << 24, iter = 1, batch = 1, reps = 5, tolerance = 15;
+  bool use_svm = false, calibrate = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('m',"min", &min_N, "Smallest number of points per batch"),
+    OPT_INTEGER('n',"max", &max_N, "Largest number of points per batch"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations of each size"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_BOOLEAN('C', "calibrate", &calibrate, "Fit the model before the sweep and store it in the profile"),
+    OPT_INTEGER('r',"reps", &reps, "Repetitions of each calibration size"),
+    OPT_INTEGER('t',"tolerance", &tolerance, "Largest error of a prediction in percent"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Predicted against measured time of pipelined transfers planned by the PCIe model", "Without -C the model of the board profile is used");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(min_N == 0 || max_N < min_N || batch == 0 || iter == 0){
+    fprintf(stderr, "Data sizes, batch and iterations must be given\n");
+    return EXIT_FAILURE;
+  }
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(max_N, iter, false, batch);
+
+  results_t *res = results_open(json_path, "model_pcietest");
+  results_config_uint(res, "min_N", min_N);
+  results_config_uint(res, "max_N", max_N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "calibrate", calibrate);
+  results_config_uint(res, "tolerance", tolerance);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  fpga_model_t model;
+  if(calibrate){
+    int status = fpga_calibrate(reps, &model);
+    if(status != 0){
+      fprintf(stderr, "Calibration error %d\n", status);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+    printf("Stored model in %s\n", fpga_profile_path());
+  }
+  else if(!fpga_get_model(&model)){
+    fprintf(stderr, "No model in %s, calibrate with -C\n", fpga_profile_path());
+    fpga_final();
+    return EXIT_FAILURE;
+  }
+
+  printf("\n------------------------------------------\n");
+  printf("PCIe Model \n");
+  printf("--------------------------------------------\n");
+  printf("%14s %12s %12s %8s\n", "Direction", "Latency (us)", "GB/s", "R2");
+  display_link("write", &model.write);
+  display_link("read", &model.read);
+  display_link("duplex write", &model.duplex_write);
+  display_link("duplex read", &model.duplex_read);
+
+  char value[64];
+  snprintf(value, sizeof(value), "%.4lf us %.5lf GB/s", model.write.latency, model.write.bandwidth);
+  results_config_str(res, "model_write", value);
+  snprintf(value, sizeof(value), "%.4lf us %.5lf GB/s", model.read.latency, model.read.bandwidth);
+  results_config_str(res, "model_read", value);
+
+  // the active configuration with the chunk and depth planned per payload
+  fpga_config_t config;
+  fpga_get_config(&config);
+  config.use_svm = false;
+  config.use_model = true;
+
+  size_t sizes[MAX_SIZES];
+  fpga_config_t plans[MAX_SIZES];
+  double predicted[MAX_SIZES], measured[MAX_SIZES];
+  unsigned num_sizes = 0;
+  bool drift = false;
+
+  for(size_t N = min_N; N <= max_N && num_sizes < MAX_SIZES; N *= 4){
+    size_t total = N * batch;
+    size_t bytes = total * sizeof(float2);
+
+    // the plan of fpga_pipeline_test, which may further split chunks
+    // beyond a device buffer
+    fpga_config_t plan = config;
+    fpga_model_plan(&model, total, sizeof(float2), 0, &plan);
+
+    float2 *inp = (float2*)fpga_complex_malloc(bytes);
+    float2 *out = (float2*)fpga_complex_malloc(bytes);
+    if(inp == NULL || out == NULL || !create_data(inp, total)){
+      fprintf(stderr, "Error in Data Creation \n");
+      free(inp);
+      free(out);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    double sum = 0.0;
+    for(size_t i = 0; i < iter; i++){
+      fpga_t timing = fpga_pipeline_test(N, inp, out, batch, &config);
+
+      if(timing.valid == 0 || !verify_output(inp, out, total)){
+        fprintf(stderr, "Verification Failed for %zu points\n", N);
+        free(inp);
+        free(out);
+        fpga_final();
+        return EXIT_FAILURE;
+      }
+
+      sum += timing.exec_t;
+      results_add(res, "measured", "ms", bytes, timing.exec_t);
+    }
+
+    free(inp);
+    free(out);
+
+    sizes[num_sizes] = N;
+    plans[num_sizes] = plan;
+    predicted[num_sizes] = fpga_model_predict(&model, bytes, (size_t)plan.chunk * sizeof(float2), plan.depth, plan.queues);
+    measured[num_sizes] = sum / iter;
+    results_add(res, "predicted", "ms", bytes, predicted[num_sizes]);
+    num_sizes++;
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  printf("\n------------------------------------------\n");
+  printf("Predicted and Measured \n");
+  printf("--------------------------------------------\n");
+  printf("%12s %12s %6s %14s %14s %10s\n", "Points", "Chunk", "Depth", "Predicted (ms)", "Measured (ms)", "Error (%)");
+  for(unsigned s = 0; s < num_sizes; s++){
+    double err = (predicted[s] > 0.0) ? (measured[s] - predicted[s]) * 100.0 / predicted[s] : 0.0;
+    bool off = (fabs(err) > tolerance);
+    printf("%12zu %12u %6u %14.4lf %14.4lf %10.2lf%s\n", sizes[s], plans[s].chunk, plans[s].depth, predicted[s], measured[s], err, off ? "  drift" : "");
+    drift = drift || off;
+  }
+  if(drift){
+    printf("Predictions are off by more than %u%%, recalibrate with -C\n", tolerance);
+  }
+
+  if(!results_close(res) || drift){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -10,6 +10,7 @@
 
 #include "argparse.h"
 #include "helper.h"
+#include "results.h"
 
 static const char *const usage[] = {
     "bin/host [options]",
@@ -21,9 +22,12 @@ int main(int argc, const char **argv) {
   bool use_svm = false;
   bool interleaving = false;
   char *path = "test.aocx";
+  char *json_path = NULL;
+  char *trace_path = NULL;
   const char *platform;
   
   double avg_rd = 0.0, avg_wr = 0.0, avg_exec = 0.0;
+  double avg_submit = 0.0, avg_device = 0.0;
   double total_api_time = 0.0;
   bool status = true, use_emulator = false;
 
@@ -36,6 +40,8 @@ int main(int argc, const char **argv) {
     OPT_INTEGER('c',"batch", &batch, "Batch"),
     OPT_STRING('p', "path", &path, "Path to bitstream"),
     OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_STRING('T', "trace", &trace_path, "Write the host call trace to path, needs a library built with USE_TRACE"),
     OPT_END(),
   };
 
@@ -47,6 +53,13 @@ int main(int argc, const char **argv) {
   // Print to console the configuration chosen to execute during runtime
   print_config(N, iter, interleaving, batch);
 
+  results_t *res = results_open(json_path, "nb_event_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "interleaving", interleaving);
+  results_config_bool(res, "emulator", use_emulator);
+
   if(use_emulator){
     platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
     //platform = "Intel(R) FPGA";
@@ -61,6 +74,7 @@ int main(int argc, const char **argv) {
     fprintf(stderr, "FPGA initialization error %d\n", isInit);
     return EXIT_FAILURE;
   }
+  results_environment(res);
 
   // create and use same data every iteration
   size_t inp_sz = sizeof(float2) * N * batch;
@@ -68,10 +82,10 @@ int main(int argc, const char **argv) {
   float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
 
   for(size_t i = 0; i < iter; i++){
-    fpga_t timing = {0.0, 0.0, 0.0, 0};
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
     double temp_timer = 0.0;
 
-    status = create_data(inp, N * batch);
+    status = create_data(inp, (size_t)N * batch);
     if(!status){
       fprintf(stderr, "Error in Data Creation \n");
       free(inp);
@@ -83,15 +97,16 @@ int main(int argc, const char **argv) {
     timing = nb_event_pcie_test(N, inp, out, interleaving, batch);
     total_api_time += getTimeinMilliseconds() - temp_timer;
 
-    if(!verify_output(inp, out, N * batch)){
-      fprintf(stderr, "Verification Failed \n");
+    // output is only complete for a valid execution
+    if(timing.valid == 0){
+      fprintf(stderr, "Invalid execution, timing found to be 0\n");
       free(inp);
       free(out);
       return EXIT_FAILURE;
     }
 
-    if(timing.valid == 0){
-      fprintf(stderr, "Invalid execution, timing found to be 0\n");
+    if(!verify_output(inp, out, (size_t)N * batch)){
+      fprintf(stderr, "Verification Failed \n");
       free(inp);
       free(out);
       return EXIT_FAILURE;
@@ -100,11 +115,18 @@ int main(int argc, const char **argv) {
     avg_rd += timing.pcie_read_t;
     avg_wr += timing.pcie_write_t;
     avg_exec += timing.exec_t;
+    avg_submit += timing.submit_t;
+    avg_device += timing.device_t;
+
+    // bytes moved in each direction
+    results_add(res, "exec", "ms", sizeof(float2) * N * batch, timing.exec_t);
+    results_add(res, "submit", "ms", sizeof(float2) * N * batch, timing.submit_t);
+    results_add(res, "device", "ms", sizeof(float2) * N * batch, timing.device_t);
 
     printf("Iter: %lu\n", i);
-    printf("\tPCIe Rd: %lfms\n", timing.pcie_read_t);
-    printf("\tKernel: %lfms\n", timing.exec_t);
-    printf("\tPCIe Wr: %lfms\n\n", timing.pcie_write_t);
+    printf("\tSubmit: %lfms\n", timing.submit_t);
+    printf("\tComplete: %lfms\n", timing.exec_t);
+    printf("\tDevice: %lfms\n\n", timing.device_t);
             
   }  // iter
 
@@ -112,11 +134,28 @@ int main(int argc, const char **argv) {
   free(inp);
   free(out);
 
+  fpga_event_stats_t events;
+  fpga_get_event_stats(&events);
+
+  // summary of the host calls of the runs
+  if(trace_path != NULL){
+    if(!fpga_trace_enabled())
+      fprintf(stderr, "Host calls not traced, build with -DUSE_TRACE=ON\n");
+    else
+      fpga_trace_dump(trace_path);
+  }
+
   // destroy fpga state
   fpga_final();
 
   // display performance measures
   display_measures(total_api_time, avg_rd, avg_wr, avg_exec, N, iter);
+  display_completion(avg_submit, avg_exec, avg_device, (size_t)N * batch, iter);
+  display_event_stats(&events);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
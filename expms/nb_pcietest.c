@@ -10,6 +10,7 @@
 
 #include "argparse.h"
 #include "helper.h"
+#include "results.h"
 
 static const char *const usage[] = {
     "bin/host [options]",
@@ -21,6 +22,7 @@ int main(int argc, const char **argv) {
   bool use_svm = false;
   bool interleaving = false;
   char *path = "test.aocx";
+  char *json_path = NULL;
   const char *platform;
   
   double avg_rd = 0.0, avg_wr = 0.0, avg_exec = 0.0;
@@ -36,6 +38,7 @@ int main(int argc, const char **argv) {
     OPT_INTEGER('c',"batch", &batch, "Batch"),
     OPT_STRING('p', "path", &path, "Path to bitstream"),
     OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
     OPT_END(),
   };
 
@@ -47,6 +50,13 @@ int main(int argc, const char **argv) {
   // Print to console the configuration chosen to execute during runtime
   print_config(N, iter, interleaving, batch);
 
+  results_t *res = results_open(json_path, "nb_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "interleaving", interleaving);
+  results_config_bool(res, "emulator", use_emulator);
+
   if(use_emulator){
     platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
     //platform = "Intel(R) FPGA";
@@ -61,6 +71,7 @@ int main(int argc, const char **argv) {
     fprintf(stderr, "FPGA initialization error %d\n", isInit);
     return EXIT_FAILURE;
   }
+  results_environment(res);
 
   // create and use same data every iteration
   size_t inp_sz = sizeof(float2) * N * batch;
@@ -68,10 +79,10 @@ int main(int argc, const char **argv) {
   float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
 
   for(size_t i = 0; i < iter; i++){
-    fpga_t timing = {0.0, 0.0, 0.0, 0};
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
     double temp_timer = 0.0;
 
-    status = create_data(inp, N * batch);
+    status = create_data(inp, (size_t)N * batch);
     if(!status){
       fprintf(stderr, "Error in Data Creation \n");
       free(inp);
@@ -83,7 +94,7 @@ int main(int argc, const char **argv) {
     timing = nb_pcie_test(N, inp, out, interleaving, batch);
     total_api_time += getTimeinMilliseconds() - temp_timer;
 
-    if(!verify_output(inp, out, N * batch)){
+    if(!verify_output(inp, out, (size_t)N * batch)){
       fprintf(stderr, "Verification Failed \n");
       free(inp);
       free(out);
@@ -101,6 +112,9 @@ int main(int argc, const char **argv) {
     avg_wr += timing.pcie_write_t;
     avg_exec += timing.exec_t;
 
+    // bytes moved in each direction
+    results_add(res, "exec", "ms", sizeof(float2) * N * batch, timing.exec_t);
+
     printf("Iter: %lu\n", i);
     printf("\tPCIe Rd: %lfms\n", timing.pcie_read_t);
     printf("\tKernel: %lfms\n", timing.exec_t);
@@ -112,11 +126,19 @@ int main(int argc, const char **argv) {
   free(inp);
   free(out);
 
+  fpga_event_stats_t events;
+  fpga_get_event_stats(&events);
+
   // destroy fpga state
   fpga_final();
 
   // display performance measures
   display_measures(total_api_time, avg_rd, avg_wr, avg_exec, N, iter);
+  display_event_stats(&events);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -10,6 +10,7 @@
 
 #include "argparse.h"
 #include "helper.h"
+#include "results.h"
 
 static const char *const usage[] = {
     "bin/host [options]",
@@ -18,14 +19,18 @@ static const char *const usage[] = {
 
 int main(int argc, const char **argv) {
   unsigned N = 1, iter = 1, batch = 1; 
+  unsigned reserve = 0, banks = 2;
+  unsigned staging = 0, depth = 2, threads = 0;
+  unsigned align = FPGA_ALIGN_MIN;
   bool use_svm = false;
   bool interleaving = false;
   char *path = "test.aocx";
+  char *json_path = NULL;
   const char *platform;
   
   double avg_rd = 0.0, avg_wr = 0.0, avg_exec = 0.0;
   double total_api_time = 0.0;
-  bool status = true, use_emulator = false;
+  bool status = true, use_emulator = false, use_perf = false;
 
   struct argparse_option options[] = {
     OPT_HELP(),
@@ -33,8 +38,16 @@ int main(int argc, const char **argv) {
     OPT_INTEGER('n',"n", &N, "Data Size"),
     OPT_INTEGER('i',"iter", &iter, "Iterations"),
     OPT_BOOLEAN('t',"interleaving", &interleaving, "Use burst interleaving in case of BRAM designs"),
+    OPT_INTEGER('r',"reserve", &reserve, "MiB of device memory pooled per bank, 0 allocates every buffer"),
+    OPT_INTEGER('b',"banks", &banks, "DDR banks of the pool"),
+    OPT_INTEGER('S',"staging", &staging, "KiB of each pinned staging buffer, 0 transfers user memory directly"),
+    OPT_INTEGER('d',"depth", &depth, "Pinned staging buffers"),
+    OPT_INTEGER('T',"threads", &threads, "Staging copy threads, 0 for the OpenMP default"),
+    OPT_INTEGER('a',"align", &align, "Alignment of the host buffers in bytes"),
     OPT_STRING('p', "path", &path, "Path to bitstream"),
     OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_BOOLEAN('P', "perf", &use_perf, "Count host cycles, cache and TLB misses, page faults and context switches per phase"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
     OPT_END(),
   };
 
@@ -46,6 +59,20 @@ int main(int argc, const char **argv) {
   // Print to console the configuration chosen to execute during runtime
   print_config(N, iter, interleaving, batch);
 
+  results_t *res = results_open(json_path, "newdata_newmem");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "interleaving", interleaving);
+  results_config_uint(res, "reserve_mib", reserve);
+  results_config_uint(res, "banks", banks);
+  results_config_uint(res, "staging_kib", staging);
+  results_config_uint(res, "depth", depth);
+  results_config_uint(res, "threads", threads);
+  results_config_uint(res, "align", align);
+  results_config_bool(res, "emulator", use_emulator);
+  results_config_bool(res, "perf", use_perf);
+
   if(use_emulator){
     platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
     //platform = "Intel(R) FPGA";
@@ -55,21 +82,48 @@ int main(int argc, const char **argv) {
     //platform = "Intel(R) FPGA";
   }
   
+  if(!fpga_set_host_alignment(align)){
+    fprintf(stderr, "Alignment must be a power of two from %d to %d bytes\n", FPGA_ALIGN_MIN, FPGA_ALIGN_MAX);
+    return EXIT_FAILURE;
+  }
+
   int isInit = fpga_initialize(platform, path, use_svm);
   if(isInit != 0){
     fprintf(stderr, "FPGA initialization error %d\n", isInit);
     return EXIT_FAILURE;
   }
+  results_environment(res);
+
+  // counters of this thread, the blocking test counts write and read
+  if(use_perf && fpga_perf_open() == 0){
+    fprintf(stderr, "perf events not permitted, see /proc/sys/kernel/perf_event_paranoid\n");
+    use_perf = false;
+  }
+
+  if(reserve > 0 && !fpga_pool_reserve((size_t)reserve * 1024 * 1024, banks)){
+    fprintf(stderr, "Unable to reserve %u MiB in %u banks\n", reserve, banks);
+    fpga_final();
+    return EXIT_FAILURE;
+  }
+
+  if(staging > 0 && !fpga_staging_reserve((size_t)staging * 1024, depth, threads)){
+    fprintf(stderr, "Unable to reserve %u staging buffers of %u KiB\n", depth, staging);
+    fpga_final();
+    return EXIT_FAILURE;
+  }
 
   for(size_t i = 0; i < iter; i++){
-    fpga_t timing = {0.0, 0.0, 0.0, 0};
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
     double temp_timer = 0.0;
-    // create and destroy data every iteration
+    // create and destroy data every iteration, first touch faults the
+    // pages of the new allocation in while generating
+    fpga_perf_begin(FPGA_PHASE_GENERATE);
     size_t inp_sz = sizeof(float2) * N;
     float2 *inp = (float2*)fpgaf_complex_malloc(inp_sz);
     float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
 
     status = create_data(inp, N);
+    fpga_perf_end(FPGA_PHASE_GENERATE);
     if(!status){
       fprintf(stderr, "Error in Data Creation \n");
       free(inp);
@@ -81,7 +135,10 @@ int main(int argc, const char **argv) {
     timing = fpga_test(N, inp, out, interleaving);
     total_api_time += getTimeinMilliseconds() - temp_timer;
 
-    if(!verify_output(inp, out, N)){
+    fpga_perf_begin(FPGA_PHASE_VERIFY);
+    bool verified = verify_output(inp, out, N);
+    fpga_perf_end(FPGA_PHASE_VERIFY);
+    if(!verified){
       fprintf(stderr, "Verification Failed \n");
       free(inp);
       free(out);
@@ -99,6 +156,11 @@ int main(int argc, const char **argv) {
     avg_wr += timing.pcie_write_t;
     avg_exec += timing.exec_t;
 
+    results_add(res, "pcie_read", "ms", sizeof(float2) * N, timing.pcie_read_t);
+    results_add(res, "pcie_write", "ms", sizeof(float2) * N, timing.pcie_write_t);
+    results_add(res, "exec", "ms", sizeof(float2) * N, timing.exec_t);
+    results_perf(res, sizeof(float2) * N);
+
     printf("Iter: %lu\n", i);
     printf("\tPCIe Rd: %lfms\n", timing.pcie_read_t);
     printf("\tKernel: %lfms\n", timing.exec_t);
@@ -109,11 +171,31 @@ int main(int argc, const char **argv) {
     free(out);
   }  // iter
 
+  // buffers came from the pool if the counters moved
+  fpga_pool_stats_t pool_stats[FPGA_POOL_MAX_BANKS];
+  unsigned pool_banks = fpga_pool_stats(pool_stats);
+  fpga_staging_stats_t staging_stats;
+  bool staged = fpga_staging_stats(&staging_stats);
+
   // destroy fpga state
   fpga_final();
 
   // display performance measures
   display_measures(total_api_time, avg_rd, avg_wr, avg_exec, N, iter);
+  if(use_perf){
+    display_perf(iter);
+    fpga_perf_close();
+  }
+  if(pool_banks > 0){
+    display_pool_stats(pool_stats, pool_banks);
+  }
+  if(staged){
+    display_staging_stats(&staging_stats);
+  }
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
 
   return EXIT_SUCCESS;
 }
@@ -10,6 +10,7 @@
 
 #include "argparse.h"
 #include "helper.h"
+#include "results.h"
 
 static const char *const usage[] = {
     "bin/host [options]",
@@ -21,6 +22,7 @@ int main(int argc, const char **argv) {
   bool use_svm = false;
   bool interleaving = false;
   char *path = "test.aocx";
+  char *json_path = NULL;
   const char *platform;
   
   double avg_rd = 0.0, avg_wr = 0.0, avg_exec = 0.0;
@@ -35,6 +37,7 @@ int main(int argc, const char **argv) {
     OPT_BOOLEAN('t',"interleaving", &interleaving, "Use burst interleaving in case of BRAM designs"),
     OPT_STRING('p', "path", &path, "Path to bitstream"),
     OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
     OPT_END(),
   };
 
@@ -46,6 +49,13 @@ int main(int argc, const char **argv) {
   // Print to console the configuration chosen to execute during runtime
   print_config(N, iter, interleaving, batch);
 
+  results_t *res = results_open(json_path, "newdata_samemem_samedevbuf");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "interleaving", interleaving);
+  results_config_bool(res, "emulator", use_emulator);
+
   if(use_emulator){
     platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
     //platform = "Intel(R) FPGA";
@@ -60,6 +70,7 @@ int main(int argc, const char **argv) {
     fprintf(stderr, "FPGA initialization error %d\n", isInit);
     return EXIT_FAILURE;
   }
+  results_environment(res);
 
   // create and use same data every iteration
   size_t inp_sz = sizeof(float2) * N;
@@ -67,7 +78,7 @@ int main(int argc, const char **argv) {
   float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
 
   for(size_t i = 0; i < iter; i++){
-    fpga_t timing = {0.0, 0.0, 0.0, 0};
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
     double temp_timer = 0.0;
 
     status = create_data(inp, N);
@@ -100,6 +111,10 @@ int main(int argc, const char **argv) {
     avg_wr += timing.pcie_write_t;
     avg_exec += timing.exec_t;
 
+    results_add(res, "pcie_read", "ms", sizeof(float2) * N, timing.pcie_read_t);
+    results_add(res, "pcie_write", "ms", sizeof(float2) * N, timing.pcie_write_t);
+    results_add(res, "exec", "ms", sizeof(float2) * N, timing.exec_t);
+
     printf("Iter: %lu\n", i);
     printf("\tPCIe Rd: %lfms\n", timing.pcie_read_t);
     printf("\tKernel: %lfms\n", timing.exec_t);
@@ -117,5 +132,9 @@ int main(int argc, const char **argv) {
   // display performance measures
   display_measures(total_api_time, avg_rd, avg_wr, avg_exec, N, iter);
 
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
@@ -3,6 +3,7 @@
 #include <stdio.h>
 #include <stdlib.h> // EXIT_FAILURE
 #include <math.h>
+#include <string.h>
 #include <stdbool.h>
 
 #include "CL/opencl.h"
@@ -10,6 +11,7 @@
 
 #include "argparse.h"
 #include "helper.h"
+#include "results.h"
 
 static const char *const usage[] = {
     "bin/host [options]",
@@ -17,10 +19,12 @@ static const char *const usage[] = {
 };
 
 int main(int argc, const char **argv) {
-  unsigned N = 1, iter = 1, batch = 1; 
+  unsigned N = 1, iter = 1, batch = 1, update = 0, update_pct = 0; 
   bool use_svm = false;
   bool interleaving = false;
   char *path = "test.aocx";
+  char *json_path = NULL;
+  char *cache = "off";
   const char *platform;
   
   double avg_rd = 0.0, avg_wr = 0.0, avg_exec = 0.0;
@@ -33,8 +37,12 @@ int main(int argc, const char **argv) {
     OPT_INTEGER('n',"n", &N, "Data Size"),
     OPT_INTEGER('i',"iter", &iter, "Iterations"),
     OPT_BOOLEAN('t',"interleaving", &interleaving, "Use burst interleaving in case of BRAM designs"),
+    OPT_STRING('C', "cache", &cache, "Skip uploads of resident data of a persistent buffer: off, hash, version or dirty"),
+    OPT_INTEGER('u',"update", &update, "Modify the data every given iterations, 0 for never"),
+    OPT_INTEGER('D',"dirty", &update_pct, "Percentage of 4 KiB pages modified by an update, 0 for one point"),
     OPT_STRING('p', "path", &path, "Path to bitstream"),
     OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
     OPT_END(),
   };
 
@@ -43,9 +51,31 @@ int main(int argc, const char **argv) {
   argparse_describe(&argparse, "Experimenting on FPGA", "Data size and path are mandatory, default number of iterations is 1");
   argc = argparse_parse(&argparse, argc, argv);
 
+  fpga_cache_mode_t cache_mode = FPGA_CACHE_OFF;
+  if(strcmp(cache, "hash") == 0)
+    cache_mode = FPGA_CACHE_HASH;
+  else if(strcmp(cache, "version") == 0)
+    cache_mode = FPGA_CACHE_VERSION;
+  else if(strcmp(cache, "dirty") == 0)
+    cache_mode = FPGA_CACHE_DIRTY;
+  else if(strcmp(cache, "off") != 0){
+    fprintf(stderr, "Unknown cache mode %s\n", cache);
+    return EXIT_FAILURE;
+  }
+
   // Print to console the configuration chosen to execute during runtime
   print_config(N, iter, interleaving, batch);
 
+  results_t *res = results_open(json_path, "reusedata_samemem");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "interleaving", interleaving);
+  results_config_str(res, "cache", cache);
+  results_config_uint(res, "update", update);
+  results_config_uint(res, "update_pct", update_pct);
+  results_config_bool(res, "emulator", use_emulator);
+
   if(use_emulator){
     platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
     //platform = "Intel(R) FPGA";
@@ -55,11 +85,16 @@ int main(int argc, const char **argv) {
     //platform = "Intel(R) FPGA";
   }
   
-  int isInit = fpga_initialize(platform, path, use_svm);
+  // the cache keeps the data of a persistent buffer
+  int isInit = (cache_mode == FPGA_CACHE_OFF) ? fpga_initialize(platform, path, use_svm) : fpga_initialize_withBuf(platform, path, use_svm, N);
+  if(isInit == 0 && cache_mode != FPGA_CACHE_OFF && !fpga_cache_set_mode(cache_mode)){
+    isInit = -7;
+  }
   if(isInit != 0){
     fprintf(stderr, "FPGA initialization error %d\n", isInit);
     return EXIT_FAILURE;
   }
+  results_environment(res);
 
   // create and use same data every iteration
   size_t inp_sz = sizeof(float2) * N;
@@ -67,9 +102,16 @@ int main(int argc, const char **argv) {
   float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
 
   status = create_data(inp, N);
+  uint64_t version = 0;
+  fpga_cache_tag(inp, version);
+  if(update_pct > 100){
+    update_pct = 100;
+  }
+  size_t stride = (update_pct > 0) ? 100 / update_pct * (4096 / sizeof(float2)) : N;
+  double full_upload = 0.0;
 
   for(size_t i = 0; i < iter; i++){
-    fpga_t timing = {0.0, 0.0, 0.0, 0};
+    fpga_t timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
     double temp_timer = 0.0;
 
     if(!status){
@@ -79,10 +121,26 @@ int main(int argc, const char **argv) {
       return EXIT_FAILURE;
     }
 
+    // changed data has to be uploaded again
+    if(update > 0 && i > 0 && i % update == 0){
+      for(size_t k = i % N; k < N; k += stride){
+        inp[k].x += 1.0f;
+      }
+      fpga_cache_tag(inp, ++version);
+    }
+
     temp_timer = getTimeinMilliseconds();
-    timing = fpga_test(N, inp, out, interleaving);
+    if(cache_mode == FPGA_CACHE_OFF)
+      timing = fpga_test(N, inp, out, interleaving);
+    else
+      timing = fpga_test_bufPersist(N, inp, out, interleaving);
     total_api_time += getTimeinMilliseconds() - temp_timer;
 
+    // the first upload is complete in every mode
+    if(i == 0){
+      full_upload = timing.pcie_write_t;
+    }
+
     if(!verify_output(inp, out, N)){
       fprintf(stderr, "Verification Failed \n");
       free(inp);
@@ -101,6 +159,10 @@ int main(int argc, const char **argv) {
     avg_wr += timing.pcie_write_t;
     avg_exec += timing.exec_t;
 
+    results_add(res, "pcie_read", "ms", sizeof(float2) * N, timing.pcie_read_t);
+    results_add(res, "pcie_write", "ms", sizeof(float2) * N, timing.pcie_write_t);
+    results_add(res, "exec", "ms", sizeof(float2) * N, timing.exec_t);
+
     printf("Iter: %lu\n", i);
     printf("\tPCIe Rd: %lfms\n", timing.pcie_read_t);
     printf("\tKernel: %lfms\n", timing.exec_t);
@@ -108,6 +170,11 @@ int main(int argc, const char **argv) {
             
   }  // iter
 
+  // stop tracking inp before it is freed
+  fpga_cache_stats_t cache_stats;
+  fpga_cache_stats(&cache_stats);
+  fpga_cache_invalidate();
+
   // destroy FFT input and output
   free(inp);
   free(out);
@@ -118,5 +185,17 @@ int main(int argc, const char **argv) {
   // display performance measures
   display_measures(total_api_time, avg_rd, avg_wr, avg_exec, N, iter);
 
+  if(cache_mode != FPGA_CACHE_OFF){
+    printf("Cache (%s): %zu hits, %zu misses, %.3lf MB saved, %.3lf MB uploaded, %.3lf ms hashing\n", cache, cache_stats.hits, cache_stats.misses, cache_stats.bytes_saved * 1.0e-6, cache_stats.bytes_uploaded * 1.0e-6, cache_stats.hash_t);
+  }
+  if(cache_mode == FPGA_CACHE_DIRTY){
+    double per_upload = cache_stats.track_t / iter;
+    printf("Dirty tracking: %zu faults, %zu ranges, %.3lf ms per upload, %.2lf%% of a full upload of %.3lf ms\n", cache_stats.faults, cache_stats.ranges, per_upload, (full_upload > 0.0) ? per_upload * 100.0 / full_upload : 0.0, full_upload);
+  }
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
   return EXIT_SUCCESS;
 }
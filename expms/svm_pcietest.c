@@ -0,0 +1,149 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 1, iter = 1, batch = 1;
+  bool use_svm = false, use_kernel = false;
+  bool interleaving = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  const char *platform;
+
+  double avg_buf = 0.0, avg_svm = 0.0;
+  double total_api_time = 0.0;
+  bool status = true, use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Data Size"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_BOOLEAN('s',"svm", &use_svm, "Use SVM, falls back to buffers if unsupported"),
+    OPT_BOOLEAN('k',"kernel", &use_kernel, "Copy on device using svm_copy kernel"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Experimenting on FPGA", "Data size and path are mandatory, default number of iterations is 1");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(N, iter, interleaving, batch);
+
+  results_t *res = results_open(json_path, "svm_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "svm", use_svm);
+  results_config_bool(res, "kernel", use_kernel);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit == -5){
+    fprintf(stderr, "SVM not supported by device, falling back to buffers\n");
+    fpga_final();
+    isInit = fpga_initialize(platform, path, false);
+  }
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  size_t inp_sz = sizeof(float2) * N * batch;
+  float2 *inp = (float2*)fpgaf_complex_malloc(inp_sz);
+  float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
+
+  for(size_t i = 0; i < iter; i++){
+    fpga_t buf_timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+    fpga_t svm_timing = {0.0, 0.0, 0.0, 0.0, 0.0, 0.0, 0};
+    double temp_timer = 0.0;
+
+    status = create_data(inp, (size_t)N * batch);
+    if(!status){
+      fprintf(stderr, "Error in Data Creation \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    // Buffer based transfers as baseline
+    buf_timing = nb_pcie_test(N, inp, out, interleaving, batch);
+    if(buf_timing.valid == 0 || !verify_output(inp, out, (size_t)N * batch)){
+      fprintf(stderr, "Buffer transfers: Verification Failed \n");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    // SVM transfers, same as buffer transfers if SVM is not enabled
+    temp_timer = getTimeinMilliseconds();
+    svm_timing = svm_pcie_test(N, inp, out, batch, use_kernel);
+    total_api_time += getTimeinMilliseconds() - temp_timer;
+
+    if(svm_timing.valid == 0 || !verify_output(inp, out, (size_t)N * batch)){
+      fprintf(stderr, "%s transfers: Verification Failed \n", fpga_svm_enabled() ? "SVM" : "Buffer");
+      free(inp);
+      free(out);
+      return EXIT_FAILURE;
+    }
+
+    avg_buf += buf_timing.exec_t;
+    avg_svm += svm_timing.exec_t;
+
+    results_add(res, "buffer_exec", "ms", sizeof(float2) * N * batch, buf_timing.exec_t);
+    results_add(res, fpga_svm_enabled() ? "svm_exec" : "fallback_exec", "ms", sizeof(float2) * N * batch, svm_timing.exec_t);
+
+    printf("Iter: %lu\n", i);
+    printf("\tBuffer: %lfms\n", buf_timing.exec_t);
+    printf("\t%s: %lfms\n\n", fpga_svm_enabled() ? "SVM" : "Buffer (fallback)", svm_timing.exec_t);
+  }  // iter
+
+  free(inp);
+  free(out);
+
+  bool svm_used = fpga_svm_enabled();
+
+  // destroy fpga state
+  fpga_final();
+
+  // display performance measures
+  printf("\nBuffer transfers");
+  display_measures(0.0, 0.0, 0.0, avg_buf, (size_t)N * batch, iter);
+  printf("\n%s transfers", svm_used ? "SVM" : "Buffer (fallback)");
+  display_measures(total_api_time, 0.0, 0.0, avg_svm, (size_t)N * batch, iter);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <math.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 65536, min_N = 16, iter = 1, batch = 64;
+  bool use_svm = false;
+  bool interleaving = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  char *trace_path = NULL;
+  const char *platform;
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Largest data size"),
+    OPT_INTEGER('m',"min", &min_N, "Smallest data size"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_STRING('T', "trace", &trace_path, "Write the host call trace to path, needs a library built with USE_TRACE"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Enqueue overhead of single threaded and per queue thread submission", "Sweeps power of two sizes from min to n");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  if(min_N == 0 || (min_N & (min_N - 1)) != 0 || iter < 1 || batch < 2){
+    fprintf(stderr, "Invalid arguments\n");
+    return EXIT_FAILURE;
+  }
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(N, iter, interleaving, batch);
+
+  results_t *res = results_open(json_path, "thread_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "min_N", min_N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  size_t inp_sz = sizeof(float2) * N * batch;
+  float2 *inp = (float2*)fpgaf_complex_malloc(inp_sz);
+  float2 *out = (float2*)fpgaf_complex_malloc(inp_sz);
+
+  printf("%10s %18s %18s %14s %16s %16s\n", "Points", "1 Thread Submit", "Thread Submit", "Saved (ms)", "1 Thread Total", "Thread Total");
+
+  for(unsigned sz = min_N; sz <= N; sz *= 2){
+    double single_submit = 0.0, thread_submit = 0.0;
+    double single_exec = 0.0, thread_exec = 0.0;
+
+    for(size_t i = 0; i < iter; i++){
+      if(!create_data(inp, (size_t)sz * batch)){
+        fprintf(stderr, "Error in Data Creation \n");
+        free(inp);
+        free(out);
+        return EXIT_FAILURE;
+      }
+
+      // enqueue and flush of both queues from the calling thread
+      fpga_t single_timing = nb_event_pcie_test(sz, inp, out, interleaving, batch);
+
+      fpga_t thread_timing = nb_thread_pcie_test(sz, inp, out, interleaving, batch);
+      if(single_timing.valid == 0 || thread_timing.valid == 0 || !verify_output(inp, out, (size_t)sz * batch)){
+        fprintf(stderr, "Verification Failed \n");
+        free(inp);
+        free(out);
+        return EXIT_FAILURE;
+      }
+
+      single_submit += single_timing.submit_t;
+      thread_submit += thread_timing.submit_t;
+      single_exec += single_timing.exec_t;
+      thread_exec += thread_timing.exec_t;
+
+      size_t bytes = sizeof(float2) * sz * batch;
+      results_add(res, "single_submit", "ms", bytes, single_timing.submit_t);
+      results_add(res, "thread_submit", "ms", bytes, thread_timing.submit_t);
+      results_add(res, "single_exec", "ms", bytes, single_timing.exec_t);
+      results_add(res, "thread_exec", "ms", bytes, thread_timing.exec_t);
+    }
+
+    single_submit /= iter;
+    thread_submit /= iter;
+    single_exec /= iter;
+    thread_exec /= iter;
+
+    printf("%10u %16.5lfms %16.5lfms %14.5lf %14.5lfms %14.5lfms\n", sz, single_submit, thread_submit, single_submit - thread_submit, single_exec, thread_exec);
+  }
+
+  free(inp);
+  free(out);
+
+  fpga_event_stats_t events;
+  fpga_get_event_stats(&events);
+
+  // summary of the host calls of the runs
+  if(trace_path != NULL){
+    if(!fpga_trace_enabled())
+      fprintf(stderr, "Host calls not traced, build with -DUSE_TRACE=ON\n");
+    else
+      fpga_trace_dump(trace_path);
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  display_event_stats(&events);
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
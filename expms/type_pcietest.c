@@ -0,0 +1,155 @@
+//  Author: Arjun Ramaswami
+
+#include <stdio.h>
+#include <stdlib.h> // EXIT_FAILURE
+#include <string.h>
+#include <stdbool.h>
+
+#include "CL/opencl.h"
+#include "bare.h"
+
+#include "argparse.h"
+#include "helper.h"
+#include "results.h"
+
+static const char *const usage[] = {
+    "bin/host [options]",
+    NULL,
+};
+
+int main(int argc, const char **argv) {
+  unsigned N = 1, iter = 1, batch = 1;
+  bool use_svm = false, same_bytes = false;
+  char *path = "test.aocx";
+  char *json_path = NULL;
+  char *type_list = "float,float2,double,double2,half2";
+  const char *platform;
+
+  bool use_emulator = false;
+
+  struct argparse_option options[] = {
+    OPT_HELP(),
+    OPT_GROUP("Basic Options"),
+    OPT_INTEGER('n',"n", &N, "Elements per batch"),
+    OPT_INTEGER('i',"iter", &iter, "Iterations of each type"),
+    OPT_INTEGER('c',"batch", &batch, "Batch"),
+    OPT_STRING('T', "types", &type_list, "Comma separated element types"),
+    OPT_BOOLEAN('B', "bytes", &same_bytes, "Move the bytes of N float2 for every type instead of N elements"),
+    OPT_STRING('p', "path", &path, "Path to bitstream"),
+    OPT_BOOLEAN('e', "emu", &use_emulator, "Use emulator"),
+    OPT_STRING('j', "json", &json_path, "Write results as JSON to path"),
+    OPT_END(),
+  };
+
+  struct argparse argparse;
+  argparse_init(&argparse, options, usage, 0);
+  argparse_describe(&argparse, "Pipelined PCIe transfers of each element type", "Data size and path are mandatory, the active transfer configuration is used");
+  argc = argparse_parse(&argparse, argc, argv);
+
+  // parse the types before touching the device
+  fpga_type_t types[FPGA_NUM_TYPES];
+  unsigned num_types = 0;
+  char *list = strdup(type_list), *save = NULL;
+  for(char *name = strtok_r(list, ",", &save); name != NULL; name = strtok_r(NULL, ",", &save)){
+    if(num_types == FPGA_NUM_TYPES || !fpga_type_parse(name, &types[num_types])){
+      fprintf(stderr, "Unknown element type %s or more than %d types\n", name, FPGA_NUM_TYPES);
+      free(list);
+      return EXIT_FAILURE;
+    }
+    num_types++;
+  }
+  free(list);
+  if(num_types == 0 || N == 0 || batch == 0 || iter == 0){
+    fprintf(stderr, "Types, data size, batch and iterations must be given\n");
+    return EXIT_FAILURE;
+  }
+
+  // Print to console the configuration chosen to execute during runtime
+  print_config(N, iter, false, batch);
+
+  results_t *res = results_open(json_path, "type_pcietest");
+  results_config_uint(res, "N", N);
+  results_config_uint(res, "iter", iter);
+  results_config_uint(res, "batch", batch);
+  results_config_str(res, "types", type_list);
+  results_config_bool(res, "same_bytes", same_bytes);
+  results_config_bool(res, "emulator", use_emulator);
+
+  if(use_emulator){
+    platform = "Intel(R) FPGA Emulation Platform for OpenCL(TM)";
+  }
+  else{
+    platform = "Intel(R) FPGA SDK for OpenCL(TM)";
+  }
+
+  int isInit = fpga_initialize(platform, path, use_svm);
+  if(isInit != 0){
+    fprintf(stderr, "FPGA initialization error %d\n", isInit);
+    return EXIT_FAILURE;
+  }
+  results_environment(res);
+
+  double avg_exec[FPGA_NUM_TYPES] = {0.0};
+  size_t bytes[FPGA_NUM_TYPES] = {0};
+
+  for(unsigned t = 0; t < num_types; t++){
+    fpga_type_t type = types[t];
+    size_t elem = fpga_type_size(type);
+    size_t points = same_bytes ? (sizeof(float2) * N + elem - 1) / elem : N;
+    size_t total = points * batch;
+    bytes[t] = elem * total;
+
+    void *inp = fpga_complex_malloc(bytes[t]);
+    void *out = fpga_complex_malloc(bytes[t]);
+    if(inp == NULL || out == NULL || !create_typed_data(inp, type, total)){
+      fprintf(stderr, "Error in Data Creation of %s\n", fpga_type_name(type));
+      free(inp);
+      free(out);
+      fpga_final();
+      return EXIT_FAILURE;
+    }
+
+    char series[64];
+    snprintf(series, sizeof(series), "exec_%s", fpga_type_name(type));
+
+    for(size_t i = 0; i < iter; i++){
+      memset(out, 0, bytes[t]);
+
+      // NULL uses the active configuration, chunks are in elements
+      fpga_t timing = fpga_typed_pipeline_test(points, type, inp, out, batch, NULL);
+
+      if(timing.valid == 0 || !verify_typed_output(inp, out, type, total)){
+        fprintf(stderr, "Verification Failed for %s\n", fpga_type_name(type));
+        free(inp);
+        free(out);
+        fpga_final();
+        return EXIT_FAILURE;
+      }
+
+      avg_exec[t] += timing.exec_t;
+      results_add(res, series, "ms", bytes[t], timing.exec_t);
+    }
+
+    free(inp);
+    free(out);
+  }
+
+  // destroy fpga state
+  fpga_final();
+
+  printf("\n------------------------------------------\n");
+  printf("Element Types \n");
+  printf("--------------------------------------------\n");
+  printf("%10s %6s %14s %12s %10s\n", "Type", "Bytes", "Elements", "Avg (ms)", "GB/s");
+  for(unsigned t = 0; t < num_types; t++){
+    size_t elem = fpga_type_size(types[t]);
+    double avg = avg_exec[t] / iter;
+    printf("%10s %6zu %14zu %12.4lf %10.5lf\n", fpga_type_name(types[t]), elem, bytes[t] / elem, avg, (avg > 0.0) ? bytes[t] * 1.0e-6 / avg : 0.0);
+  }
+
+  if(!results_close(res)){
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
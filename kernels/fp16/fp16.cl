@@ -0,0 +1,23 @@
+// Author: Arjun Ramaswami
+
+/**
+ * Expands N half precision complex points packed as consecutive halfs to 
+ * single precision complex points
+ */
+kernel void unpack_half2(global const half * restrict src, global float2 * restrict dst, unsigned N){
+
+  for(unsigned i = 0; i < N; i++){
+    dst[i] = vload_half2(i, src);
+  }
+}
+
+/**
+ * Packs N single precision complex points to consecutive half precision 
+ * values, rounding to nearest even
+ */
+kernel void pack_half2(global const float2 * restrict src, global half * restrict dst, unsigned N){
+
+  for(unsigned i = 0; i < N; i++){
+    vstore_half2_rte(src[i], i, dst);
+  }
+}
@@ -0,0 +1,12 @@
+// Author: Arjun Ramaswami
+
+/**
+ * Copies N complex points from src to dst. Both are coarse grained SVM
+ * pointers set using clSetKernelArgSVMPointer.
+ */
+kernel void svm_copy(global const float2 * restrict src, global float2 * restrict dst, unsigned N){
+
+  for(unsigned i = 0; i < N; i++){
+    dst[i] = src[i];
+  }
+}
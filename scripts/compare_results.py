@@ -0,0 +1,159 @@
+#!/usr/bin/env python3
+# Author: Arjun Ramaswami
+"""Compare JSON results of a driver against a stored baseline.
+
+Series are matched by name and bytes. Each pair of sample sets is compared
+with Welch's t-test. A series regresses if the difference is significant at
+alpha and the mean is worse than the baseline by more than the threshold.
+Times (ms, us, ns) are lower is better, GB/s is higher is better.
+
+    ./nb_event_pcietest -n 1048576 -c 8 -i 30 -p empty.aocx -j new.json
+    python3 scripts/compare_results.py baseline.json new.json
+
+Exit status is 1 if any series regressed, 2 on invalid input.
+"""
+
+import argparse
+import json
+import math
+import sys
+
+LOWER_IS_BETTER = {"ms", "us", "ns"}
+HIGHER_IS_BETTER = {"GB/s"}
+
+
+def betacf(a, b, x):
+    """Continued fraction of the incomplete beta function."""
+    tiny = 1e-300
+    qab, qap, qam = a + b, a + 1.0, a - 1.0
+    c, d = 1.0, 1.0 - qab * x / qap
+    d = 1.0 / (d if abs(d) > tiny else tiny)
+    h = d
+    for m in range(1, 300):
+        m2 = 2 * m
+        aa = m * (b - m) * x / ((qam + m2) * (a + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        h *= d * c
+        aa = -(a + m) * (qab + m) * x / ((a + m2) * (qap + m2))
+        d = 1.0 + aa * d
+        d = 1.0 / (d if abs(d) > tiny else tiny)
+        c = 1.0 + aa / c
+        c = c if abs(c) > tiny else tiny
+        delta = d * c
+        h *= delta
+        if abs(delta - 1.0) < 1e-12:
+            break
+    return h
+
+
+def betainc(a, b, x):
+    """Regularized incomplete beta function I_x(a, b)."""
+    if x <= 0.0:
+        return 0.0
+    if x >= 1.0:
+        return 1.0
+    lbeta = math.lgamma(a + b) - math.lgamma(a) - math.lgamma(b)
+    front = math.exp(lbeta + a * math.log(x) + b * math.log(1.0 - x))
+    if x < (a + 1.0) / (a + b + 2.0):
+        return front * betacf(a, b, x) / a
+    return 1.0 - front * betacf(b, a, 1.0 - x) / b
+
+
+def welch(base, cand):
+    """Two sided p-value of Welch's t-test, None if not computable."""
+    n1, n2 = len(base), len(cand)
+    if n1 < 2 or n2 < 2:
+        return None
+    m1, m2 = sum(base) / n1, sum(cand) / n2
+    v1 = sum((x - m1) ** 2 for x in base) / (n1 - 1)
+    v2 = sum((x - m2) ** 2 for x in cand) / (n2 - 1)
+    se2 = v1 / n1 + v2 / n2
+    if se2 == 0.0:
+        return 0.0 if m1 != m2 else 1.0
+    t = (m2 - m1) / math.sqrt(se2)
+    df = se2 ** 2 / ((v1 / n1) ** 2 / (n1 - 1) + (v2 / n2) ** 2 / (n2 - 1))
+    return betainc(df / 2.0, 0.5, df / (df + t * t))
+
+
+def load(path):
+    with open(path) as fp:
+        record = json.load(fp)
+    series = {}
+    for res in record.get("results", []):
+        series[(res["name"], res.get("bytes", 0))] = res
+    return record, series
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("baseline", help="JSON results of the baseline")
+    parser.add_argument("candidate", help="JSON results to qualify")
+    parser.add_argument("-a", "--alpha", type=float, default=0.01,
+                        help="significance level, default 0.01")
+    parser.add_argument("-t", "--threshold", type=float, default=0.02,
+                        help="relative change ignored, default 0.02")
+    args = parser.parse_args()
+
+    try:
+        base_rec, base = load(args.baseline)
+        cand_rec, cand = load(args.candidate)
+    except (OSError, ValueError, KeyError) as err:
+        print("Invalid results: %s" % err, file=sys.stderr)
+        return 2
+
+    if base_rec.get("driver") != cand_rec.get("driver"):
+        print("Warning: drivers differ, %s and %s" % (base_rec.get("driver"), cand_rec.get("driver")))
+    for key in ("config", "environment"):
+        a, b = base_rec.get(key, {}), cand_rec.get(key, {})
+        for k in sorted(set(a) | set(b)):
+            if a.get(k) != b.get(k):
+                print("%-12s %-14s %s -> %s" % (key, k, a.get(k), b.get(k)))
+
+    print("\n%-18s %12s %14s %14s %9s %10s  %s" % ("Series", "Bytes", "Baseline", "Candidate", "Change", "p", "Status"))
+
+    regressions = 0
+    for key in sorted(set(base) | set(cand)):
+        name, nbytes = key
+        if key not in base or key not in cand:
+            print("%-18s %12d %14s %14s %9s %10s  %s" % (name, nbytes, "-" if key not in base else "", "-" if key not in cand else "", "", "", "missing"))
+            continue
+
+        unit = base[key].get("unit", "")
+        b, c = base[key]["samples"], cand[key]["samples"]
+        if not b or not c:
+            continue
+        mb, mc = sum(b) / len(b), sum(c) / len(c)
+        change = (mc - mb) / mb if mb != 0.0 else 0.0
+        p = welch(b, c)
+
+        if unit in LOWER_IS_BETTER:
+            worse, better = change > args.threshold, change < -args.threshold
+        elif unit in HIGHER_IS_BETTER:
+            worse, better = change < -args.threshold, change > args.threshold
+        else:
+            worse = better = False
+
+        significant = p is not None and p < args.alpha
+        if p is None:
+            status = "too few samples"
+        elif worse and significant:
+            status = "REGRESSION"
+            regressions += 1
+        elif better and significant:
+            status = "improved"
+        else:
+            status = "ok"
+
+        print("%-18s %12d %11.5f %-2s %11.5f %-2s %+8.2f%% %10s  %s" % (
+            name, nbytes, mb, unit, mc, unit, 100.0 * change,
+            "-" if p is None else "%.2e" % p, status))
+
+    print("\n%d regression(s)" % regressions)
+    return 1 if regressions > 0 else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())